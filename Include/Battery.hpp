@@ -16,16 +16,26 @@
 #pragma once
 
 #include <string>
+#include <stddef.h>
 #include <stdint.h>
 
 // Corresponds to Rev9 board. "IN_DOCK" is for the hall effect sensor.
+// Only used when GPIO_TABLE_PATH does not describe the board.
 #define IN_DOCK_PORT			(1)
 #define IN_DOCK_PIN 			(5)
 #define CHARGING_PORT			(5)
 #define CHARGING_PIN 			(15)
 
+// The hall sensor chatters as the meter settles in the base.
+#define IN_DOCK_DEBOUNCE_MS		(50)
+#define CHARGING_DEBOUNCE_MS	(0)
+
 #define CONSUMER				"In_Base"
 
+// GPIO table names of the lines the battery code reads.
+#define GPIO_LINE_IN_BASE		"in_base"
+#define GPIO_LINE_CHARGING		"charging"
+
 #ifndef BATTERY_DRIVER_SYMLINK
 	#define BATTERY_PATH "/sys/class/power_supply/max1726x_battery/"
 #else
@@ -40,13 +50,6 @@
 #define BATTERY_VOLTAGE_FILE "/sys/class/power_supply/max1726x_battery/voltage_now"
 #define BATTERY_CURRENT_FILE "/sys/class/power_supply/max1726x_battery/current_now"
 
-typedef enum
-{
-	BATTERY_GPIO_NONE = 0,
-	BATTERY_GPIO_IN_BASE = 0x01,
-	BATTERY_GPIO_CHARGING = 0x02,
-} BatteryGPIO;
-
 typedef enum
 {
 	IN_BASE,
@@ -56,16 +59,47 @@ typedef enum
 
 typedef enum
 {
-	LINE_IN_BASE,
-	LINE_CHARGING,
-	LINE_MAX
-} line_id;
+	BATTERY_FIELD_NONE     = 0x00,
+	BATTERY_FIELD_CURRENT  = 0x01,
+	BATTERY_FIELD_VOLTAGE  = 0x02,
+	BATTERY_FIELD_TEMP     = 0x04,
+	BATTERY_FIELD_LEVEL    = 0x08,
+	BATTERY_FIELD_HEALTH   = 0x10,
+	BATTERY_FIELD_IN_DOCK  = 0x20,
+	BATTERY_FIELD_CHARGING = 0x40,
+	BATTERY_FIELD_GPIO     = 0x80,
+	BATTERY_FIELD_ALL      = 0xFF,
+} BatteryField;
+
+#define BATTERY_FIELD_COUNT		(8)		// bits in BATTERY_FIELD_ALL
+#define BATTERY_FIELD_LINES		(BATTERY_FIELD_IN_DOCK | BATTERY_FIELD_CHARGING | BATTERY_FIELD_GPIO)
+
+#define BATTERY_HEALTH_LEN		(16)
+
+// One read of the raw battery inputs. Only members flagged in fields are valid.
+typedef struct
+{
+	int64_t  t_ns;							// CLOCK_MONOTONIC when read
+	uint32_t fields;						// BatteryField mask
+	int32_t  current;						// mA
+	int32_t  voltage;						// V * 100
+	int32_t  temp;							// ºC * 10
+	int32_t  level;							// %
+	int32_t  in_dock;						// raw IN_DOCK line value
+	int32_t  charging;						// raw CHARGING line value
+	uint32_t gpio;							// active lines, bit n for GPIO table line n
+	uint32_t gpio_table;					// GpioTable_Hash of the table gpio indexes
+	char     health[BATTERY_HEALTH_LEN];	// sysfs health string
+} BatterySample;
 
+// Where battery samples come from. sysfs/GPIO on the meter, or a replay/model.
 typedef struct
 {
-	struct gpiod_line * line;
-	const unsigned int pin;
-} power_line;
+	const char * name;
+	int (*read)(void * ctx, BatterySample * sample, uint32_t fields);
+	void * ctx;
+	bool recorded;							// the source records its own samples, reads are not recorded
+} BatterySource;
 
 #ifdef __cplusplus
 extern "C" {
@@ -75,22 +109,22 @@ int GetIsBatteryCharging(void);
 void *RunBatteryMonitor(void *args);
 void RunBatteryMonitorCleanup(void);
 int Battery_Init(void);
+int Battery_LoadGpioTable(void);
 int InitializeBatteryGPIOs();
-int OpenGPIO(line_id line_id);
-int ReadGPIO(uint32_t GPIO);
 void CloseGPIOs();
-void CloseGPIOInDock();
-void CloseGPIO(line_id line_id);
-int GetGPIOLineValue(line_id line_id);
-void MonitorForGPIOEvent(uint32_t GPIOs);
-void *BatteryTaskLoop(void *arg);
 int IsMeterInDock(void);
 int IsBatteryCharging(void);
 int GetBatteryPercentage(void);
-std::string GetBatteryHealth(void);
+int GetBatteryHealth(char * health, size_t len);
 int GetBatteryTemp(void);
 int GetBatteryCurrent(void);
 int GetBatteryVoltage(void);
+int64_t Battery_NowNs(void);
+void Battery_SetSource(const BatterySource * source);
+const BatterySource * Battery_GetSource(void);
+int Battery_ReadSample(BatterySample * sample, uint32_t fields);
+// The BATTERY_FIELD_LINES in fields from the GPIO engine, whatever the source.
+int Battery_ReadLines(BatterySample * sample, uint32_t fields);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,210 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Battery Record
+ *  Source Filename  - BatteryRecord.hpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Fixed layout little endian wire record for a battery
+ *  				   snapshot. Readers use the view accessors on the buffer
+ *  				   in place, nothing is parsed or allocated.
+ *
+ *******************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+#include "Battery.hpp"
+
+/*
+ * Layout, all fields little endian:
+ *
+ *   0  uint8   schema         BATTERY_RECORD_SCHEMA
+ *   1  uint8   fixed_size     offset of the first extension
+ *   2  uint16  total_size     fixed part plus extensions
+ *   4  uint32  presence       BatteryField mask
+ *   8  int64   t_ns
+ *  16  int32   current        mA
+ *  20  int32   voltage        V * 100
+ *  24  int32   temp           ºC * 10
+ *  28  int16   level          %
+ *  30  int8    in_dock        raw line value, -1 if the read failed
+ *  31  int8    charging       raw line value, -1 if the read failed
+ *  32  char    health[16]     not NUL terminated when full
+ *  48  ext...  uint16 type, uint16 length, data, padded to 4 bytes
+ *
+ * Newer schemas may only append to the fixed part. Readers use fixed_size to
+ * find the extensions and skip extension types they do not know.
+ */
+#define BATTERY_RECORD_SCHEMA		(1)
+#define BATTERY_RECORD_FIXED_SIZE	(48)
+#define BATTERY_RECORD_MAX_SIZE		(0xFFFF)
+#define BATTERY_RECORD_EXT_HDR		(4)
+#define BATTERY_RECORD_EXT_ALIGN	(4)
+
+#define BATTERY_RECORD_OFF_SCHEMA		(0)
+#define BATTERY_RECORD_OFF_FIXED_SIZE	(1)
+#define BATTERY_RECORD_OFF_TOTAL_SIZE	(2)
+#define BATTERY_RECORD_OFF_PRESENCE		(4)
+#define BATTERY_RECORD_OFF_T_NS			(8)
+#define BATTERY_RECORD_OFF_CURRENT		(16)
+#define BATTERY_RECORD_OFF_VOLTAGE		(20)
+#define BATTERY_RECORD_OFF_TEMP			(24)
+#define BATTERY_RECORD_OFF_LEVEL		(28)
+#define BATTERY_RECORD_OFF_IN_DOCK		(30)
+#define BATTERY_RECORD_OFF_CHARGING		(31)
+#define BATTERY_RECORD_OFF_HEALTH		(32)
+
+typedef enum
+{
+	BATTERY_EXT_NONE      = 0,
+	BATTERY_EXT_DEVICE_ID = 1,		// char[], not NUL terminated
+	BATTERY_EXT_HISTORY   = 2,		// { int64 t_ms, int32 value } pairs, LE
+	BATTERY_EXT_GPIO      = 3,		// uint32 active GPIO table lines, uint32 GpioTable_Hash, LE
+	BATTERY_EXT_VENDOR    = 0x8000,	// first of the plugin defined types
+} BatteryRecordExt;
+
+typedef struct
+{
+	const uint8_t * data;
+	size_t size;
+} BatteryRecordView;
+
+typedef struct
+{
+	uint16_t type;
+	uint16_t length;
+	const uint8_t * data;
+} BatteryRecordExtView;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * BatteryRecord_Encode
+ * writes the fixed part of sample into buf, followed by a BATTERY_EXT_GPIO
+ * extension if the sample has BATTERY_FIELD_GPIO.
+ * returns the record size, or -1 if len is too small.
+ */
+int BatteryRecord_Encode(const BatterySample * sample, uint8_t * buf, size_t len);
+
+/**
+ * BatteryRecord_AddExt
+ * appends an extension to a record already encoded in buf.
+ * returns the new record size, or -1 if it does not fit.
+ */
+int BatteryRecord_AddExt(uint8_t * buf, size_t len, uint16_t type, const void * data, uint16_t length);
+
+/**
+ * BatteryRecord_View
+ * checks the record in buf and points view at it.
+ * returns 0, or -1 if the record is truncated or from an unknown schema.
+ */
+int BatteryRecord_View(const uint8_t * buf, size_t len, BatteryRecordView * view);
+
+/**
+ * BatteryRecord_NextExt
+ * walks the extensions. Start with *offset = 0.
+ * returns 1 with ext filled, 0 at the end, -1 if an extension is malformed.
+ */
+int BatteryRecord_NextExt(const BatteryRecordView * view, size_t * offset, BatteryRecordExtView * ext);
+
+/**
+ * BatteryRecord_ToSample
+ * copies a viewed record out into a BatterySample.
+ */
+void BatteryRecord_ToSample(const BatteryRecordView * view, BatterySample * sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+static inline uint16_t BatteryRecord_Load16(const uint8_t * p)
+{
+	uint16_t v;
+	memcpy(&v, p, sizeof(v));
+	return le16toh(v);
+}
+
+static inline uint32_t BatteryRecord_Load32(const uint8_t * p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return le32toh(v);
+}
+
+static inline uint64_t BatteryRecord_Load64(const uint8_t * p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return le64toh(v);
+}
+
+// In place accessors, only valid on a view filled by BatteryRecord_View.
+static inline uint8_t BatteryRecord_Schema(const BatteryRecordView * v)
+{
+	return v->data[BATTERY_RECORD_OFF_SCHEMA];
+}
+
+static inline uint32_t BatteryRecord_Presence(const BatteryRecordView * v)
+{
+	return BatteryRecord_Load32(v->data + BATTERY_RECORD_OFF_PRESENCE);
+}
+
+static inline bool BatteryRecord_Has(const BatteryRecordView * v, uint32_t field)
+{
+	return (BatteryRecord_Presence(v) & field) == field;
+}
+
+static inline int64_t BatteryRecord_TimeNs(const BatteryRecordView * v)
+{
+	return (int64_t)BatteryRecord_Load64(v->data + BATTERY_RECORD_OFF_T_NS);
+}
+
+static inline int32_t BatteryRecord_Current(const BatteryRecordView * v)
+{
+	return (int32_t)BatteryRecord_Load32(v->data + BATTERY_RECORD_OFF_CURRENT);
+}
+
+static inline int32_t BatteryRecord_Voltage(const BatteryRecordView * v)
+{
+	return (int32_t)BatteryRecord_Load32(v->data + BATTERY_RECORD_OFF_VOLTAGE);
+}
+
+static inline int32_t BatteryRecord_Temp(const BatteryRecordView * v)
+{
+	return (int32_t)BatteryRecord_Load32(v->data + BATTERY_RECORD_OFF_TEMP);
+}
+
+static inline int32_t BatteryRecord_Level(const BatteryRecordView * v)
+{
+	return (int16_t)BatteryRecord_Load16(v->data + BATTERY_RECORD_OFF_LEVEL);
+}
+
+static inline int32_t BatteryRecord_InDock(const BatteryRecordView * v)
+{
+	return (int8_t)v->data[BATTERY_RECORD_OFF_IN_DOCK];
+}
+
+static inline int32_t BatteryRecord_Charging(const BatteryRecordView * v)
+{
+	return (int8_t)v->data[BATTERY_RECORD_OFF_CHARGING];
+}
+
+// Points at the health bytes in the record, *len excludes any NUL padding.
+static inline const char * BatteryRecord_Health(const BatteryRecordView * v, size_t * len)
+{
+	const char * health = (const char *)(v->data + BATTERY_RECORD_OFF_HEALTH);
+
+	*len = strnlen(health, BATTERY_HEALTH_LEN);
+
+	return health;
+}
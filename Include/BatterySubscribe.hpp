@@ -0,0 +1,57 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Battery Subscribe
+ *  Source Filename  - BatterySubscribe.hpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Local socket other processes on the meter subscribe to
+ *  				   for battery snapshots instead of reading sysfs.
+ *
+ *******************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+#include "BatteryRecord.hpp"
+
+/*
+ * A SOCK_SEQPACKET socket at BATTERY_SUBSCRIBE_PATH. The client sends one
+ * request, little endian:
+ *
+ *   0  uint32  magic            BATTERY_SUBSCRIBE_MAGIC
+ *   4  uint32  fields           BatteryField mask of the fields to follow
+ *   8  uint32  min_interval_ms  at most one snapshot per interval, 0 for every change
+ *
+ * and from then on receives one BatteryRecord per packet. It gets one soon
+ * after subscribing, then one whenever a field in its mask changes. Changes
+ * inside the interval are sent together once it has passed. Each record
+ * carries every field, not just the subscribed ones. Sending another request
+ * replaces the subscription. A bad request closes the connection.
+ */
+#define BATTERY_SUBSCRIBE_PATH			"/var/run/battery_info.sock"
+#define BATTERY_SUBSCRIBE_MAGIC			(0x42555342)	// "BSUB"
+#define BATTERY_SUBSCRIBE_SIZE			(12)
+
+#define BATTERY_SUBSCRIBE_OFF_MAGIC		(0)
+#define BATTERY_SUBSCRIBE_OFF_FIELDS	(4)
+#define BATTERY_SUBSCRIBE_OFF_INTERVAL	(8)
+
+static inline void BatterySubscribe_Encode(uint8_t * buf, uint32_t fields, uint32_t min_interval_ms)
+{
+	uint32_t v;
+
+	v = htole32(BATTERY_SUBSCRIBE_MAGIC);
+	memcpy(buf + BATTERY_SUBSCRIBE_OFF_MAGIC, &v, sizeof(v));
+	v = htole32(fields);
+	memcpy(buf + BATTERY_SUBSCRIBE_OFF_FIELDS, &v, sizeof(v));
+	v = htole32(min_interval_ms);
+	memcpy(buf + BATTERY_SUBSCRIBE_OFF_INTERVAL, &v, sizeof(v));
+}
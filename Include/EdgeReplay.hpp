@@ -0,0 +1,102 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Edge Replay
+ *  Source Filename  - EdgeReplay.hpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Records the raw edges the GPIO engine reads to a binary
+ *  				   log and plays a log back through the mock backend, so
+ *  				   the debounce and the sinks run on them again.
+ *
+ *******************************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EDGE_LOG_MAGIC			(0x47444542)	// "BEDG"
+#define EDGE_LOG_VERSION		(1)
+#define EDGE_LOG_SUFFIX			".edges"		// added to the path of the sample log it goes with
+
+// Followed by EdgeLogRecord records in the order the engine read them.
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	int64_t  start_ns;							// CLOCK_MONOTONIC at start, as the edge timestamps
+	uint32_t gpio_table;						// GpioTable_Hash of the table the bits index
+	uint32_t state;								// line levels at start
+	uint32_t valid;								// lines whose level was known
+	uint32_t reserved;
+} EdgeLogHeader;
+
+typedef struct
+{
+	int64_t  t_ns;								// kernel timestamp of the edge
+	uint32_t bit;								// bit n for GPIO table line n
+	int32_t  value;								// line level after the edge
+} EdgeLogRecord;
+
+typedef struct
+{
+	bool     done;
+	uint64_t edges;					// loaded from the log
+	uint64_t played;
+	uint64_t late;					// played 1 ms or more after their time
+	uint64_t dropped;				// lost to a full mock line queue
+} EdgeReplayStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * EdgeRecorder_Start
+ * starts appending every edge the GPIO engine reads to path, after the line
+ * levels it holds now.
+ */
+int EdgeRecorder_Start(const char * path);
+
+/**
+ * EdgeRecorder_Stop
+ * flushes and closes the log.
+ */
+void EdgeRecorder_Stop(void);
+
+/**
+ * EdgeReplay_Load
+ * reads the log at path and sets each recorded line to its starting level on
+ * the mock backend. Call it with the GPIO table loaded, before GpioEngine_Open
+ * requests the lines from GpioBackend_Mock.
+ */
+int EdgeReplay_Load(const char * path);
+
+/**
+ * EdgeReplay_Start
+ * plays the loaded edges from the mock's script thread, spaced as they were
+ * recorded. Always real time, the debounce windows are. Call it once the
+ * engine is started.
+ */
+int EdgeReplay_Start(void);
+
+/**
+ * EdgeReplay_Stop
+ * stops the playback and frees the loaded edges.
+ */
+void EdgeReplay_Stop(void);
+
+/**
+ * EdgeReplay_GetStats
+ * copies the counters of the current or last playback.
+ */
+void EdgeReplay_GetStats(EdgeReplayStats * stats);
+
+#ifdef __cplusplus
+}
+#endif
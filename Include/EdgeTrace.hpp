@@ -0,0 +1,79 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Edge Trace
+ *  Source Filename  - EdgeTrace.hpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Timestamps one GPIO edge at a time on its way from the
+ *  				   kernel to the display, for the edge to pixel latency
+ *  				   benchmark. Every mark is a single atomic load while no
+ *  				   trace is running.
+ *
+ *******************************************************************************/
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+	EDGE_STAGE_KERNEL,				// event timestamp from the GPIO backend
+	EDGE_STAGE_DISPATCH,			// GPIO engine read the event on the reactor
+	EDGE_STAGE_PUBLISH,				// confirmed state published
+	EDGE_STAGE_ENQUEUE,				// monitor handed the new text to the GUI
+	EDGE_STAGE_LABEL,				// label text set under the LVGL lock
+	EDGE_STAGE_FLUSH,				// display driver finished the next frame
+	EDGE_STAGE_COUNT
+} EdgeStage;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * EdgeTrace_Start
+ * starts tracing edges of the line at bit, keeping up to max_edges of them.
+ */
+int EdgeTrace_Start(uint32_t bit, size_t max_edges);
+
+/**
+ * EdgeTrace_Stop
+ * stops tracing, the collected edges stay until the next start.
+ */
+void EdgeTrace_Stop(void);
+
+/**
+ * EdgeTrace_Dispatch
+ * opens a trace for an edge of bit read by the engine, if none is open.
+ */
+void EdgeTrace_Dispatch(uint32_t bit, int64_t kernel_ns);
+
+/**
+ * EdgeTrace_Mark
+ * stamps stage of the open trace, once the stage before it is stamped.
+ * EDGE_STAGE_FLUSH completes the trace.
+ */
+void EdgeTrace_Mark(EdgeStage stage);
+
+/**
+ * EdgeTrace_Wait
+ * waits for the open or next trace to complete.
+ * returns 0 if it did, -1 if it timed out and was dropped.
+ */
+int EdgeTrace_Wait(int timeout_ms);
+
+/**
+ * EdgeTrace_WriteJson
+ * writes p50/p99/max of every stage and of the whole path as one JSON object.
+ */
+void EdgeTrace_WriteJson(FILE * file);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,110 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Generator
+ *  Source Filename  - Generator.hpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Synthetic battery pack model used as a battery source
+ *  				   for load testing above real hardware rates.
+ *
+ *******************************************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#include "Battery.hpp"
+
+#define GENERATOR_MAX_RATE_HZ		(100000.0)
+#define GENERATOR_MAX_SUPPLIES		(64)
+
+typedef struct
+{
+	unsigned int supplies;			// number of virtual packs
+	double   rate_hz;				// samples per second per pack
+	double   time_scale;			// model seconds per wall second
+	uint32_t seed;
+	double   capacity_mah;
+	double   start_soc;				// 0.0 - 1.0
+	double   r_internal_ohm;
+	double   load_ma;				// discharge current when undocked
+	double   charge_ma;				// constant current phase when docked
+	double   ambient_c;
+	double   ambient_drift_c;		// amplitude of the slow ambient swing
+	double   thermal_r_c_per_w;
+	double   thermal_tau_s;
+	double   noise_ma;				// 1 sigma
+	double   noise_mv;
+	double   noise_c;
+	double   dock_mean_s;			// mean time undocked before docking
+	double   undock_mean_s;			// mean time docked before undocking
+} GeneratorConfig;
+
+typedef struct
+{
+	bool     running;
+	uint64_t samples;				// across all packs
+	uint64_t batches;
+	uint64_t late_batches;			// batches that started a full period late
+	uint64_t max_lag_ns;
+	double   achieved_hz;			// per pack
+} GeneratorStats;
+
+// Called from the generator thread for every sample of every pack.
+typedef void (*GeneratorSink)(void * arg, unsigned int supply, const BatterySample * sample);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Generator_DefaultConfig
+ * one pack at 1 kHz, modelled on the meter's max1726x pack.
+ */
+void Generator_DefaultConfig(GeneratorConfig * config);
+
+/**
+ * Generator_Init
+ * allocates the pack models. rate_hz is capped at GENERATOR_MAX_RATE_HZ.
+ */
+int Generator_Init(const GeneratorConfig * config);
+
+/**
+ * Generator_Cleanup
+ * stops the generator and frees the pack models.
+ */
+void Generator_Cleanup(void);
+
+/**
+ * Generator_GetSource
+ * battery source serving the latest sample of one pack,
+ * pass it to Battery_SetSource to feed the app.
+ */
+const BatterySource * Generator_GetSource(unsigned int supply);
+
+/**
+ * Generator_Start
+ * starts stepping every pack at rate_hz. sink may be NULL. Every sample
+ * of pack 0 goes to a running recording, its source's reads do not.
+ */
+int Generator_Start(GeneratorSink sink, void * arg);
+
+/**
+ * Generator_Stop
+ * stops the generator thread, the last samples keep being served.
+ */
+void Generator_Stop(void);
+
+/**
+ * Generator_GetStats
+ * copies the generator throughput stats.
+ */
+void Generator_GetStats(GeneratorStats * stats);
+
+#ifdef __cplusplus
+}
+#endif
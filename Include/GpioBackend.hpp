@@ -0,0 +1,121 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - GPIO Backend
+ *  Source Filename  - GpioBackend.hpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - What the GPIO engine needs from a GPIO driver, with the
+ *  				   libgpiod implementation and an in-process mock that
+ *  				   injects edges through eventfds.
+ *
+ *******************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GPIO_BACKEND_MAX_REQUEST	(64)	// lines in one request, as GPIOD_LINE_BULK_MAX_LINES
+#define GPIO_MOCK_MAX_LINES			(64)
+#define GPIO_MOCK_QUEUE				(16)	// queued edges per line, as the kernel's kfifo
+
+typedef struct
+{
+	int64_t  t_ns;						// event timestamp
+	uint32_t rising;
+} GpioEvent;
+
+// One request covers some lines of one chip, requested for both edges.
+typedef struct
+{
+	const char * name;
+	void * (*request)(const char * chip, const unsigned int * offsets, unsigned int count, const char * consumer);
+	void (*release)(void * request);
+	int (*get_values)(void * request, int * values);
+	int (*event_fd)(void * request, unsigned int index);
+	int (*read_events)(void * request, unsigned int index, GpioEvent * events, unsigned int max);
+} GpioBackend;
+
+typedef struct
+{
+	int64_t  at_ns;						// from the start of the script
+	int      line;						// from GpioMock_Line
+	int      value;
+} GpioMockStep;
+
+typedef struct
+{
+	bool     running;
+	uint64_t edges;						// injected
+	uint64_t dropped;					// lost to a full queue
+	uint64_t steps;						// script steps played
+	uint64_t late_steps;				// script steps played 1 ms or more late
+} GpioMockStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * GpioBackend_Gpiod
+ * the libgpiod backend used on the meter.
+ */
+const GpioBackend * GpioBackend_Gpiod(void);
+
+/**
+ * GpioBackend_Mock
+ * the in-process mock backend. Lines exist once a chip/offset is used.
+ */
+const GpioBackend * GpioBackend_Mock(void);
+
+/**
+ * GpioMock_Line
+ * id of the mock line at chip offset, creating it at value 0 if needed.
+ */
+int GpioMock_Line(const char * chip, unsigned int offset);
+
+/**
+ * GpioMock_SetValue
+ * sets a line's level without an edge, as it would read at startup.
+ */
+int GpioMock_SetValue(int line, int value);
+
+/**
+ * GpioMock_Edge
+ * moves a line to value now, queueing an edge if it changed.
+ * t_ns of 0 stamps it with CLOCK_MONOTONIC.
+ */
+int GpioMock_Edge(int line, int value, int64_t t_ns);
+
+/**
+ * GpioMock_Play
+ * plays steps (sorted by at_ns) from a mock thread, starting now.
+ * steps must stay valid until GpioMock_Stop or the script ends.
+ */
+int GpioMock_Play(const GpioMockStep * steps, size_t count);
+
+/**
+ * GpioMock_Stop
+ * stops a playing script.
+ */
+void GpioMock_Stop(void);
+
+/**
+ * GpioMock_Reset
+ * stops any script and forgets every mock line.
+ */
+void GpioMock_Reset(void);
+
+/**
+ * GpioMock_GetStats
+ * copies the mock counters.
+ */
+void GpioMock_GetStats(GpioMockStats * stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,199 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - GPIO Engine
+ *  Source Filename  - GpioEngine.hpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Requests the board GPIO lines in bulk per chip, waits
+ *  				   on their events with epoll, debounces them and keeps a
+ *  				   cached copy of the confirmed line states, so readers
+ *  				   never touch the GPIO chip.
+ *
+ *******************************************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#include "GpioBackend.hpp"
+
+#define GPIO_ENGINE_MAX_LINES		(32)
+#define GPIO_ENGINE_MAX_CHIPS		(8)
+#define GPIO_ENGINE_CHIP_LEN		(32)
+#define GPIO_ENGINE_EVENT_BATCH		(16)
+#define GPIO_LINE_NAME_LEN			(32)
+#define GPIO_ENGINE_MAX_SINKS		(4)
+
+typedef enum
+{
+	GPIO_EDGE_NONE    = 0x00,
+	GPIO_EDGE_RISING  = 0x01,			// line became active
+	GPIO_EDGE_FALLING = 0x02,			// line became inactive
+	GPIO_EDGE_BOTH    = 0x03,
+} GpioEdge;
+
+typedef struct
+{
+	char name[GPIO_LINE_NAME_LEN];
+	char chip[GPIO_ENGINE_CHIP_LEN];
+	unsigned int offset;
+	uint32_t edges;						// GpioEdge mask of transitions to report
+	bool active_low;
+	unsigned int debounce_ms;			// 0 reports every edge
+} GpioLineConfig;
+
+typedef struct
+{
+	bool     running;				// the lines are reactor sources
+	uint32_t lines;
+	uint32_t chips;
+	uint64_t wakeups;				// reactor callbacks for a line or its debounce timer
+	uint64_t events;				// edge events read
+	uint64_t changes;				// cached state changes published
+	uint64_t reads;					// bulk value reads, one per chip
+} GpioEngineStats;
+
+typedef struct
+{
+	unsigned int debounce_ms;
+	uint64_t edges;					// raw edges from the kernel
+	uint64_t bounces;				// edges swallowed by the debounce window
+	uint64_t transitions;			// confirmed value changes
+	uint64_t max_burst;				// most edges in one debounce window
+} GpioLineStats;
+
+// Called from the reactor thread for every confirmed transition in the line's
+// edges. value is the line level, t_ns the kernel timestamp of the edge the
+// line settled on.
+typedef void (*GpioTransitionSink)(void * arg, uint32_t bit, int value, int64_t t_ns);
+
+// Called from the reactor thread for every edge read from a line, before the
+// debounce. value is the line level after the edge, t_ns its kernel timestamp.
+typedef void (*GpioEdgeSink)(void * arg, uint32_t bit, int value, int64_t t_ns);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * GpioEngine_AddLine
+ * registers a line under a state bit. A change is only published once the
+ * line has held it for debounce_ms. Only allowed before GpioEngine_Open.
+ */
+int GpioEngine_AddLine(const GpioLineConfig * config, uint32_t bit);
+
+/**
+ * GpioEngine_Open
+ * requests the registered lines with one bulk request per chip
+ * and seeds the cache with one bulk read per chip.
+ */
+int GpioEngine_Open(void);
+
+/**
+ * GpioEngine_Close
+ * stops the engine, releases the lines and forgets them.
+ */
+void GpioEngine_Close(void);
+
+/**
+ * GpioEngine_SetBackend
+ * sets the GPIO driver the lines are requested from, NULL for libgpiod.
+ * Only allowed while the lines are not requested.
+ */
+int GpioEngine_SetBackend(const GpioBackend * backend);
+
+/**
+ * GpioEngine_AddSink
+ * adds a receiver of confirmed transitions, also while the engine runs.
+ * A sink must not add or remove sinks itself.
+ */
+int GpioEngine_AddSink(GpioTransitionSink sink, void * arg);
+
+/**
+ * GpioEngine_RemoveSink
+ * removes a sink. Once this returns the sink is not running and will not be
+ * called again, so its code may be unloaded.
+ */
+void GpioEngine_RemoveSink(GpioTransitionSink sink, void * arg);
+
+/**
+ * GpioEngine_SetEdgeSink
+ * sets the one receiver of raw edges, NULL for none. Once this returns the
+ * sink it replaced is not running and will not be called again.
+ */
+void GpioEngine_SetEdgeSink(GpioEdgeSink sink, void * arg);
+
+/**
+ * GpioEngine_Start
+ * adds the event fds and debounce timers of the opened lines to the reactor,
+ * which then confirms and publishes their edges. Call it after Reactor_Init,
+ * before Reactor_Run or from the reactor thread.
+ */
+int GpioEngine_Start(void);
+
+/**
+ * GpioEngine_Stop
+ * takes the lines off the reactor, they stay requested. Call it from the
+ * reactor thread or while Reactor_Run is not running.
+ */
+void GpioEngine_Stop(void);
+
+/**
+ * GpioEngine_Read
+ * reads every line now, one ioctl per chip, and returns the line levels.
+ * valid, if not NULL, gets the bits that were read.
+ */
+uint32_t GpioEngine_Read(uint32_t * valid);
+
+/**
+ * GpioEngine_GetState
+ * cached line levels. valid, if not NULL, gets the bits that are known.
+ */
+uint32_t GpioEngine_GetState(uint32_t * valid);
+
+/**
+ * GpioEngine_GetActive
+ * cached state with every known line set while active, whatever its polarity.
+ */
+uint32_t GpioEngine_GetActive(uint32_t * valid);
+
+/**
+ * GpioEngine_GetLine
+ * cached value of one line, or -1 if the engine does not know it.
+ */
+int GpioEngine_GetLine(uint32_t bit);
+
+/**
+ * GpioEngine_Wait
+ * blocks until the cached state moves past seq or timeout_ms passes.
+ * returns the current sequence number.
+ */
+uint64_t GpioEngine_Wait(uint64_t seq, int timeout_ms);
+
+/**
+ * GpioEngine_EventFd
+ * non-blocking eventfd that turns readable whenever the cached state moves,
+ * for callers with their own poll loop. Read it to rearm.
+ * returns the fd, or -1 if it could not be created.
+ */
+int GpioEngine_EventFd(void);
+
+/**
+ * GpioEngine_GetLineStats
+ * copies the debounce counters of the line registered under bit.
+ */
+int GpioEngine_GetLineStats(uint32_t bit, GpioLineStats * stats);
+
+/**
+ * GpioEngine_GetStats
+ * copies the engine counters.
+ */
+void GpioEngine_GetStats(GpioEngineStats * stats);
+
+#ifdef __cplusplus
+}
+#endif
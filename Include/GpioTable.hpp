@@ -0,0 +1,78 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - GPIO Table
+ *  Source Filename  - GpioTable.hpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The GPIO lines of the board, loaded once at startup from
+ *  				   a text file so a new board revision only needs a new
+ *  				   file. Line n of the table is bit (1 << n) of every state
+ *  				   word the GPIO engine publishes.
+ *
+ *******************************************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#include "GpioEngine.hpp"
+
+#define GPIO_TABLE_PATH			"/usr/nova/gpio_lines.conf"
+#define GPIO_TABLE_MAX_LINES	GPIO_ENGINE_MAX_LINES
+
+/*
+ * One line per GPIO, '#' starts a comment:
+ *
+ *   # name    chip       offset  edge     active  debounce_ms
+ *   in_base   gpiochip1  5       both     low     50
+ *   charging  gpiochip5  15      both     high    0
+ *
+ * edge    - rising, falling or both. Which confirmed transitions are reported,
+ *           rising being the line becoming active. The state follows both.
+ * active  - high or low, the level at which the line counts as active.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * GpioTable_Load
+ * replaces the table with the lines in path. If path is missing or has an
+ * error the count defaults are used instead.
+ * returns 0 if path was loaded, 1 if the defaults were, -1 if neither.
+ */
+int GpioTable_Load(const char * path, const GpioLineConfig * defaults, unsigned int count);
+
+/**
+ * GpioTable_Count
+ * number of lines in the table.
+ */
+unsigned int GpioTable_Count(void);
+
+/**
+ * GpioTable_Line
+ * line index of the table, or NULL past the end.
+ */
+const GpioLineConfig * GpioTable_Line(unsigned int index);
+
+/**
+ * GpioTable_Bit
+ * state bit of the line called name, or 0 if there is none.
+ */
+uint32_t GpioTable_Bit(const char * name);
+
+/**
+ * GpioTable_Hash
+ * FNV-1a of every line of the table in order, 0 while it is empty. Kept with
+ * each GPIO bitset so a reader can tell which table the bits index.
+ */
+uint32_t GpioTable_Hash(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -39,9 +39,22 @@
 #define RIGHT_BTN_X				(246)
 #define NOVA_COLOR_BKGND        LV_COLOR_MAKE(0xE8, 0xE8, 0xE8)
 #define TOUCHSCREEN				"/dev/input/event0"
+#define GUI_LABEL_TEXT_LEN		(32)
+#define GUI_MAX_LABEL_TEXTS		(24)
+#define GUI_TASK_MAX_SLEEP_MS	(30)		// longest LVGL task thread sleep, one refresh period
+#define GUI_TREND_MAX_POINTS	(480)		// one per pixel column at most
 
 typedef void (*callback)(lv_obj_t *obj, lv_event_t event);
 
+typedef enum
+{
+	GUI_EVENT_LABEL_SET,			// obj is the label ChangeLabel set
+	GUI_EVENT_FLUSHED,				// the display driver wrote the last area of a frame
+} GuiEvent;
+
+// Called with the LVGL lock held, must not call back into the GUI.
+typedef void (*GuiHook)(GuiEvent event, lv_obj_t *obj);
+
 struct GuiImage
 {
 	const void * image;
@@ -86,6 +99,19 @@ struct GuiTable
 	lv_coord_t h;
 };
 
+// A label for AddLabels. Only plain data, so screens can be constexpr tables.
+struct GuiLabelDesc
+{
+	const char * text;				// must outlive the label
+	const lv_font_t * font;
+	lv_label_align_t text_align;
+	lv_coord_t x;
+	lv_coord_t y;
+	lv_coord_t w;
+	bool set_color;
+	lv_color_t color;
+};
+
 enum {
     LV_STATE_PASSED  =  0x30,
     LV_STATE_FAILED =  0x40,
@@ -185,12 +211,41 @@ extern "C"
      */
 	lv_obj_t * AddLabel(GuiObj obj, char *text);
 
+    /**
+     * AddLabels
+     * creates a batch of labels under one LVGL lock.
+     * labels - labels to create
+     * count  - number of labels
+     * objs   - gets the count label objects
+     */
+    int AddLabels(const GuiLabelDesc *labels, size_t count, lv_obj_t **objs);
+
     /**
 	 * AddDirectionsLabel
 	 * creates a label on the screen
 	 */
 	void AddDirectionLabel();
 
+    /**
+     * GuiSetHook
+     * sets a function told about label changes and display flushes, NULL for none.
+     */
+    void GuiSetHook(GuiHook hook);
+
+    /**
+     * GuiPause
+     * stops the LVGL task and tick threads while paused is true, so the GUI
+     * neither redraws nor wakes up. Resuming ignores the touch until it is
+     * released, so the touch that woke the screen does not press a button.
+     */
+    void GuiPause(bool paused);
+
+    /**
+     * GuiGetWakeups
+     * number of LVGL task and tick thread iterations so far.
+     */
+    uint64_t GuiGetWakeups(void);
+
     /**
      * ChangeLabel
      * changes text of active label
@@ -199,6 +254,51 @@ extern "C"
      */
     void ChangeLabel(GuiObj label, char *text);
 
+    /**
+     * GetLabelBuffer
+     * back buffer of a label's double buffered text, owned by the GUI so it
+     * outlives the caller. Fill it, then show it with SwapLabel. Each label
+     * must only be written from one thread.
+     * obj   - label object
+     * size  - gets the size of the buffer
+     */
+    char * GetLabelBuffer(lv_obj_t *obj, size_t *size);
+
+    /**
+     * SwapLabel
+     * shows the back buffer of the label, the old text becomes the next back
+     * buffer once LVGL stops using it.
+     * obj        - label object
+     * set_color  - true to also change the text color
+     * color      - text color
+     */
+    void SwapLabel(lv_obj_t *obj, bool set_color, lv_color_t color);
+
+    /**
+     * AddTrend
+     * creates an empty line plot on the screen, there is room for one.
+     * x, y  - top left corner
+     * w, h  - size, points are relative to the top left corner
+     */
+    lv_obj_t * AddTrend(lv_coord_t x, lv_coord_t y, lv_coord_t w, lv_coord_t h);
+
+    /**
+     * GetTrendBuffer
+     * back buffer of the trend's double buffered points, same rules as
+     * GetLabelBuffer. Fill it, then show it with SwapTrend.
+     * obj   - trend object
+     * count - gets the number of points the buffer holds
+     */
+    lv_point_t * GetTrendBuffer(lv_obj_t *obj, size_t *count);
+
+    /**
+     * SwapTrend
+     * shows the first count points of the back buffer.
+     * obj   - trend object
+     * count - number of points filled in
+     */
+    void SwapTrend(lv_obj_t *obj, size_t count);
+
     /**
      * AddCountdownLabel
      * creates a label on the screen
@@ -0,0 +1,101 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - History
+ *  Source Filename  - History.hpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Fixed size sample history for each battery metric and
+ *  				   the downsamplers used to draw it on the display.
+ *
+ *******************************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// One day of samples at 1 Hz.
+#define HISTORY_DEFAULT_CAPACITY	(86400)
+#define HISTORY_DEFAULT_PERIOD_MS	(1000)
+
+// The display is 480 px wide, a trend never needs more points than this.
+#define HISTORY_MAX_PLOT_POINTS		(480)
+
+typedef enum
+{
+	HISTORY_CURRENT,
+	HISTORY_VOLTAGE,
+	HISTORY_TEMP,
+	HISTORY_LEVEL,
+	HISTORY_MAX
+} HistoryMetric;
+
+typedef enum
+{
+	HISTORY_DOWNSAMPLE_LTTB,
+	HISTORY_DOWNSAMPLE_MINMAX
+} HistoryDownsampleMode;
+
+typedef struct
+{
+	int64_t t_ms;
+	int32_t value;
+} HistoryPoint;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * History_Init
+ * allocates the ring for every metric once, nothing is allocated afterwards.
+ * capacity  - number of samples kept per metric
+ * period_ms - samples pushed sooner than this after the last kept one are dropped
+ */
+int History_Init(size_t capacity, int64_t period_ms);
+
+/**
+ * History_Cleanup
+ * frees the rings allocated by History_Init.
+ */
+void History_Cleanup(void);
+
+/**
+ * History_Push
+ * appends a sample, overwriting the oldest one when the ring is full.
+ * t_ms must not go backwards for a given metric.
+ * returns 1 if the sample was kept, 0 if it fell inside the sample period.
+ */
+int History_Push(HistoryMetric metric, int64_t t_ms, int32_t value);
+
+/**
+ * History_Count
+ * returns the number of samples currently held for a metric.
+ */
+size_t History_Count(HistoryMetric metric);
+
+/**
+ * History_Downsample
+ * reduces the samples in [from_ms, to_ms] to at most max_points points,
+ * written into the caller's preallocated out array. Runs in O(samples)
+ * without allocating, so it can be called on every chart refresh.
+ * For HISTORY_DOWNSAMPLE_MINMAX every bucket emits its min and max, so
+ * max_points should be twice the plot width in pixels.
+ * returns the number of points written.
+ */
+size_t History_Downsample(HistoryMetric metric, int64_t from_ms, int64_t to_ms,
+		HistoryPoint * out, size_t max_points, HistoryDownsampleMode mode);
+
+/**
+ * History_NowMs
+ * monotonic clock in milliseconds, the time base used for all samples.
+ */
+int64_t History_NowMs(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,106 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Reactor
+ *  Source Filename  - Reactor.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - One epoll loop that runs every periodic task and fd
+ *  				   handler of the app on a single thread. Periodic tasks
+ *  				   are timerfds, so the thread only wakes when a task is
+ *  				   due or an fd has something to read.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#define REACTOR_MAX_SOURCES		(96)	// the app's own and each GPIO line's event and debounce fds
+#define REACTOR_MAX_POSTS		(32)
+
+// Runs on the reactor thread. An fd callback must drain its fd.
+typedef void (*ReactorCallback)(void * arg);
+
+typedef struct
+{
+	uint32_t sources;
+	uint64_t wakeups;				// epoll_wait returns
+	uint64_t timer_runs;			// periodic task calls
+	uint64_t timer_missed;			// periods that passed while the thread was busy
+	uint64_t fd_runs;				// fd callback calls
+	uint64_t posts;					// posted calls run
+	uint64_t posts_dropped;			// posts refused with the queue full
+} ReactorStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Reactor_Init
+ * creates the epoll set and the post eventfd.
+ */
+int Reactor_Init(void);
+
+/**
+ * Reactor_AddTimer
+ * runs callback every period_ms, the first time on the next loop.
+ * returns a source id, or -1 on error.
+ */
+int Reactor_AddTimer(unsigned int period_ms, ReactorCallback callback, void * arg);
+
+/**
+ * Reactor_SetTimer
+ * changes the period of timer id, the next run is period_ms from now. A
+ * period_ms of 0 stops it until it is set again. Call it from the reactor
+ * thread, or before Reactor_Run.
+ */
+int Reactor_SetTimer(int id, unsigned int period_ms);
+
+/**
+ * Reactor_AddFd
+ * runs callback whenever fd is readable. The fd stays owned by the caller.
+ * returns a source id, or -1 on error.
+ */
+int Reactor_AddFd(int fd, ReactorCallback callback, void * arg);
+
+/**
+ * Reactor_RemoveFd
+ * stops watching the fd of source id, its callback is not run again. Call
+ * it from the reactor thread, or while Reactor_Run is not running.
+ */
+void Reactor_RemoveFd(int id);
+
+/**
+ * Reactor_Post
+ * runs callback once on the reactor thread. Safe from any thread.
+ * returns 0, or -1 if the queue is full.
+ */
+int Reactor_Post(ReactorCallback callback, void * arg);
+
+/**
+ * Reactor_Run
+ * runs the loop on the calling thread until Reactor_Stop.
+ */
+void Reactor_Run(void);
+
+/**
+ * Reactor_Stop
+ * makes Reactor_Run return after the callbacks of the current wakeup.
+ */
+void Reactor_Stop(void);
+
+/**
+ * Reactor_GetStats
+ * copies the loop counters, call it from the reactor thread.
+ */
+void Reactor_GetStats(ReactorStats * stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,104 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Replay
+ *  Source Filename  - Replay.hpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Records the raw battery inputs to a binary log and plays
+ *  				   a log back in place of the sysfs/GPIO source.
+ *
+ *******************************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "Battery.hpp"
+
+#define BATTERY_LOG_MAGIC		(0x43455242)	// "BREC"
+#define BATTERY_LOG_VERSION		(3)
+#define BATTERY_LOG_DEVICE_LEN	(32)
+
+// Play back as fast as the pipeline consumes the samples.
+#define REPLAY_SPEED_MAX		(0.0)
+
+// Followed by record_size byte BatterySample records in the order they were read.
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	int64_t  start_ns;							// CLOCK_MONOTONIC at start
+	int64_t  start_wall_ns;						// CLOCK_REALTIME at the same instant
+	char     device_id[BATTERY_LOG_DEVICE_LEN];	// hostname of the meter
+} BatteryLogHeader;
+
+typedef struct
+{
+	bool     done;
+	uint64_t records;
+	uint64_t unconsumed;			// records overwritten before the pipeline read them
+	uint64_t wall_ns;
+	double   records_per_sec;
+	uint32_t late_p50_us;			// replay thread lateness against the log timeline
+	uint32_t late_p99_us;
+	uint32_t late_max_us;
+	uint32_t consume_p50_us;		// publish to first read by the pipeline
+	uint32_t consume_p99_us;
+	uint32_t consume_max_us;
+} ReplayStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Recorder_Start
+ * starts appending every sample read through Battery_ReadSample to path.
+ */
+int Recorder_Start(const char * path);
+
+/**
+ * Recorder_Stop
+ * flushes and closes the log.
+ */
+void Recorder_Stop(void);
+
+/**
+ * Recorder_Write
+ * appends one sample if a recording is running, otherwise does nothing.
+ */
+void Recorder_Write(const BatterySample * sample);
+
+/**
+ * Replay_Start
+ * installs the replay source and starts playing path back.
+ * speed - 1.0 for real time, N for N times faster, REPLAY_SPEED_MAX to
+ *         release each record as soon as the previous one was consumed.
+ * fields - the BatteryFields taken from the log, BATTERY_FIELD_ALL unless an
+ *         edge replay drives the lines. Lines left out are read from the
+ *         GPIO engine.
+ */
+int Replay_Start(const char * path, double speed, uint32_t fields);
+
+/**
+ * Replay_Stop
+ * stops the replay thread, the last replayed values keep being served.
+ * must be called before another Replay_Start, even if the log has ended.
+ */
+void Replay_Stop(void);
+
+/**
+ * Replay_GetStats
+ * copies the throughput and latency stats of the current or last replay.
+ */
+void Replay_GetStats(ReplayStats * stats);
+
+#ifdef __cplusplus
+}
+#endif
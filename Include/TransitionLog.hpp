@@ -0,0 +1,128 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Transition Log
+ *  Source Filename  - TransitionLog.hpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Kernel timestamped record of every confirmed GPIO line
+ *  				   transition, kept in a ring and on disk, with an index
+ *  				   for per day and per session timing queries.
+ *
+ *******************************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "GpioEngine.hpp"
+
+#define TRANSITION_LOG_PATH			"/usr/nova/battery_info/transitions.log"
+#define TRANSITION_LOG_MAGIC		(0x4E525447)	// "GTRN"
+#define TRANSITION_LOG_VERSION		(2)
+#define TRANSITION_RING_SIZE		(256)
+#define TRANSITION_WRITE_QUEUE		(64)	// records waiting for the writer thread
+#define TRANSITION_MAX_LINES		(32)
+#define TRANSITION_MAX_DAYS			(400)
+#define TRANSITION_MAX_SESSIONS		(1024)
+
+typedef enum
+{
+	TRANSITION_FLAG_NONE = 0x00,
+	TRANSITION_FLAG_BOOT = 0x01,		// line state when the engine started
+} TransitionFlag;
+
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+} TransitionLogHeader;
+
+typedef struct
+{
+	int64_t  t_ns;						// CLOCK_MONOTONIC of the confirming edge
+	int64_t  wall_ns;					// CLOCK_REALTIME of the same edge
+	char     line[GPIO_LINE_NAME_LEN];	// GPIO table line name, bits move when the table changes
+	uint8_t  value;
+	uint8_t  flags;						// TransitionFlag
+	uint16_t reserved[3];
+} TransitionRecord;
+
+typedef struct
+{
+	int64_t day_wall_ns;				// local midnight
+	int64_t active_ns;
+} TransitionDay;
+
+typedef struct
+{
+	int64_t start_wall_ns;
+	int64_t duration_ns;				// up to now while open
+	bool    open;
+} TransitionSession;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * TransitionLog_Init
+ * loads the existing log at path into the index and opens it for appending
+ * from a writer thread. path may be NULL to keep the ring and index in
+ * memory only.
+ */
+int TransitionLog_Init(const char * path);
+
+/**
+ * TransitionLog_Load
+ * loads the log at path into the ring and index without writing to it, for
+ * reading the log of a running app.
+ */
+int TransitionLog_Load(const char * path);
+
+/**
+ * TransitionLog_Cleanup
+ * closes the log and drops the ring and index.
+ */
+void TransitionLog_Cleanup(void);
+
+/**
+ * TransitionLog_AddLine
+ * indexes the line called name, which this table has under bit, counting
+ * time while it reads active_value. Records are matched to lines by name.
+ */
+int TransitionLog_AddLine(uint32_t bit, const char * name, int active_value);
+
+/**
+ * TransitionLog_Record
+ * logs one confirmed transition. t_ns is the kernel event timestamp.
+ * Never waits for the file, the writer thread appends it.
+ */
+void TransitionLog_Record(uint32_t bit, int value, int64_t t_ns, uint32_t flags);
+
+/**
+ * TransitionLog_Recent
+ * copies up to max of the newest records from the ring, oldest first.
+ */
+size_t TransitionLog_Recent(TransitionRecord * out, size_t max);
+
+/**
+ * TransitionLog_DailyActive
+ * time bit was active per local day, oldest first, today included.
+ */
+size_t TransitionLog_DailyActive(uint32_t bit, TransitionDay * out, size_t max);
+
+/**
+ * TransitionLog_Sessions
+ * up to max of the newest active sessions of bit, oldest first.
+ */
+size_t TransitionLog_Sessions(uint32_t bit, TransitionSession * out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
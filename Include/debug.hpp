@@ -57,10 +57,17 @@ enum
 };
 
 
+/* global debug level set at run time by the app, DBG_ALL where it is not linked in */
+#ifdef __cplusplus
+extern "C" int dbg_level __attribute__((weak));
+#else
+extern int dbg_level __attribute__((weak));
+#endif
+
 /* sets local and global debug level to print. defaults to DBG_WARN and DBG_ALL respectively */
 /* can be overridden on a file-by-file based */
 #define DBGLVL  DBG_ALL
-#define GLBL_DBGLVL DBG_ALL
+#define GLBL_DBGLVL ((&dbg_level != NULL) ? dbg_level : DBG_ALL)
 
 /* print debug messages to stdout */
 #define DBGPRT(lvl, fmt,  ...)                                                                                                                  \
@@ -0,0 +1,364 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Backlight
+ *  Source Filename  - Backlight.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Any thread moves the target, only the reactor thread
+ *  				   writes the backlight. The ramp timer runs while the
+ *  				   level is moving and once more to save it, then stops.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <atomic>
+
+#include "Backlight.h"
+#include "Reactor.h"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+static int backlight_fd = -1;
+static int backlight_max = BACKLIGHT_DEFAULT_MAX;
+static std::string backlight_setting_path;
+static std::atomic<int> backlight_target(BACKLIGHT_DEFAULT);
+static std::atomic<bool> backlight_kick_pending(false);
+static std::atomic<bool> backlight_started(false);		// the ramp timer is on the reactor
+
+// Reactor thread only, after Backlight_Init.
+static int backlight_level = -1;				// last level written
+static int backlight_timer = -1;
+static unsigned int backlight_period_ms = 0;	// of backlight_timer, 0 stopped
+static int64_t backlight_last_ns = 0;
+static int backlight_saved = -1;				// target in the setting file
+static int backlight_limit = -1;				// cap from Backlight_Limit, -1 none
+
+static int64_t BacklightNowNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((int64_t)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+static int BacklightClamp(int level)
+{
+	return (level < 0) ? 0 : ((level > backlight_max) ? backlight_max : level);
+}
+
+// The level the ramp heads for.
+static int BacklightGoal(void)
+{
+	int target = backlight_target.load();
+
+	return ((backlight_limit >= 0) && (backlight_limit < target)) ? backlight_limit : target;
+}
+
+static int ReadInt(const char * path, int * value)
+{
+	char text[16];
+	ssize_t length;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+	{
+		return -1;
+	}
+
+	length = read(fd, text, sizeof(text) - 1);
+	close(fd);
+
+	if (length <= 0)
+	{
+		return -1;
+	}
+
+	text[length] = '\0';
+	*value = atoi(text);
+
+	return 0;
+}
+
+static void BacklightWrite(int level)
+{
+	char text[16];
+	int length = snprintf(text, sizeof(text), "%d\n", level);
+
+	backlight_level = level;
+
+	if ((backlight_fd >= 0) && (pwrite(backlight_fd, text, length, 0) != length))
+	{
+		DBGPRT(DBG_ERR, "BacklightWrite: Failed to set %d, %s\n", level, strerror(errno));
+	}
+}
+
+static void BacklightSave(int level)
+{
+	char text[16];
+	int length = snprintf(text, sizeof(text), "%d\n", level);
+	std::string temp = backlight_setting_path + ".tmp";
+	int fd;
+
+	backlight_saved = level;
+
+	if ((fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+	{
+		DBGPRT(DBG_ERR, "BacklightSave: Failed to open %s, %s\n", temp.c_str(), strerror(errno));
+		return;
+	}
+
+	bool written = (write(fd, text, length) == length);
+
+	close(fd);
+
+	if (!written || (rename(temp.c_str(), backlight_setting_path.c_str()) != 0))
+	{
+		DBGPRT(DBG_ERR, "BacklightSave: Failed to save %s, %s\n", backlight_setting_path.c_str(), strerror(errno));
+		unlink(temp.c_str());
+	}
+}
+
+static void BacklightSetPeriod(unsigned int period_ms)
+{
+	if (backlight_period_ms != period_ms)
+	{
+		backlight_period_ms = period_ms;
+		Reactor_SetTimer(backlight_timer, period_ms);
+	}
+}
+
+// Reactor timer, moves the level toward the target by the time since the last
+// step so the ramp takes as long however late the steps run.
+static void BacklightRamp(void * arg)
+{
+	(void)arg;
+
+	int goal = BacklightGoal();
+	int target = backlight_target.load();
+	int64_t now = BacklightNowNs();
+
+	if (backlight_level != goal)
+	{
+		int64_t elapsed_ms = (now - backlight_last_ns) / 1000000LL;
+		int step = (int)((backlight_max * elapsed_ms) / BACKLIGHT_RAMP_FULL_MS);
+
+		step = (step < 1) ? 1 : step;
+		backlight_last_ns = now;
+
+		if (backlight_level < goal)
+		{
+			BacklightWrite(((backlight_level + step) > goal) ? goal : (backlight_level + step));
+		}
+		else
+		{
+			BacklightWrite(((backlight_level - step) < goal) ? goal : (backlight_level - step));
+		}
+	}
+
+	if (backlight_level != goal)
+	{
+		return;
+	}
+
+	// Save the target, not a limited level, once it has been left alone for a while.
+	if ((target != backlight_saved) && (backlight_period_ms != BACKLIGHT_SAVE_DELAY_MS))
+	{
+		BacklightSetPeriod(BACKLIGHT_SAVE_DELAY_MS);
+		return;
+	}
+
+	if (target != backlight_saved)
+	{
+		BacklightSave(target);
+	}
+
+	BacklightSetPeriod(0);
+}
+
+static void BacklightStartRamp(void)
+{
+	if (backlight_timer < 0)
+	{
+		BacklightWrite(BacklightGoal());
+		return;
+	}
+
+	if (backlight_period_ms != BACKLIGHT_RAMP_STEP_MS)
+	{
+		backlight_last_ns = BacklightNowNs();
+		BacklightSetPeriod(BACKLIGHT_RAMP_STEP_MS);
+	}
+}
+
+// Reactor post, a new target was set.
+static void BacklightKick(void * arg)
+{
+	(void)arg;
+
+	backlight_kick_pending.store(false);
+	BacklightStartRamp();
+}
+
+int Backlight_Init(const char * dir, const char * setting_path, int level)
+{
+	std::string path = std::string(dir) + "/max_brightness";
+	int saved;
+	int max;
+
+	if ((ReadInt(path.c_str(), &max) == 0) && (max > 0))
+	{
+		backlight_max = max;
+	}
+	else
+	{
+		DBGPRT(DBG_ERR, "Backlight_Init: Failed to read %s, using %d\n", path.c_str(), BACKLIGHT_DEFAULT_MAX);
+	}
+
+	backlight_setting_path = setting_path;
+
+	if (ReadInt(setting_path, &saved) == 0)
+	{
+		level = saved;
+	}
+
+	level = BacklightClamp(level);
+	backlight_saved = level;
+	backlight_target.store(level);
+
+	path = std::string(dir) + "/brightness";
+
+	if ((backlight_fd = open(path.c_str(), O_WRONLY | O_CLOEXEC)) < 0)
+	{
+		DBGPRT(DBG_ERR, "Backlight_Init: Failed to open %s, %s\n", path.c_str(), strerror(errno));
+		backlight_level = level;
+		return -1;
+	}
+
+	BacklightWrite(level);
+
+	DBGPRT(DBG_INFO1, "Backlight_Init: brightness %d of %d\n", level, backlight_max);
+
+	return 0;
+}
+
+int Backlight_Start(void)
+{
+	if ((backlight_timer = Reactor_AddTimer(BACKLIGHT_RAMP_STEP_MS, BacklightRamp, NULL)) < 0)
+	{
+		return -1;
+	}
+
+	// Idle until the first new target.
+	backlight_period_ms = BACKLIGHT_RAMP_STEP_MS;
+	BacklightSetPeriod(0);
+	backlight_started.store(true);
+
+	return 0;
+}
+
+void Backlight_Stop(void)
+{
+	int target = backlight_target.load();
+
+	if (backlight_started.exchange(false))
+	{
+		Reactor_RemoveFd(backlight_timer);
+		backlight_timer     = -1;
+		backlight_period_ms = 0;
+	}
+
+	if (backlight_fd < 0)
+	{
+		return;
+	}
+
+	// A ramp cut short ends at its goal, a target not yet saved is saved now.
+	BacklightWrite(BacklightGoal());
+
+	if (target != backlight_saved)
+	{
+		BacklightSave(target);
+	}
+
+	close(backlight_fd);
+	backlight_fd = -1;
+}
+
+// One kick in the queue is enough, it reads the latest target. Before
+// Backlight_Start there is no ramp, and maybe no reactor to post to yet, so
+// the startup thread writes the level itself.
+static void BacklightPostKick(void)
+{
+	if (!backlight_started.load())
+	{
+		BacklightWrite(BacklightGoal());
+		return;
+	}
+
+	if (!backlight_kick_pending.exchange(true) && (Reactor_Post(BacklightKick, NULL) != 0))
+	{
+		backlight_kick_pending.store(false);
+	}
+}
+
+int Backlight_Set(int level)
+{
+	level = BacklightClamp(level);
+	backlight_target.store(level);
+	BacklightPostKick();
+
+	return level;
+}
+
+int Backlight_Step(int delta)
+{
+	int target = backlight_target.load();
+
+	while (!backlight_target.compare_exchange_weak(target, BacklightClamp(target + delta)))
+	{
+	}
+
+	BacklightPostKick();
+
+	return BacklightClamp(target + delta);
+}
+
+void Backlight_Limit(int level, bool ramp)
+{
+	backlight_limit = (level < 0) ? -1 : BacklightClamp(level);
+
+	if (ramp)
+	{
+		BacklightStartRamp();
+		return;
+	}
+
+	// The ramp, if running, finds itself at the goal and winds down.
+	BacklightWrite(BacklightGoal());
+}
+
+int Backlight_Get(void)
+{
+	return backlight_target.load();
+}
+
+int Backlight_Max(void)
+{
+	return backlight_max;
+}
@@ -0,0 +1,93 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Backlight
+ *  Source Filename  - Backlight.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Drives the LCD backlight through its sysfs brightness
+ *  				   file, kept open, ramping to each new level on the
+ *  				   reactor and remembering the last level across restarts.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#define BACKLIGHT_SYSFS_DIR			"/sys/class/backlight/lcd-backlight"
+#define BACKLIGHT_SETTING_PATH		"/usr/nova/battery_info/brightness"
+#define BACKLIGHT_DEFAULT			(60)
+#define BACKLIGHT_DEFAULT_MAX		(255)	// if max_brightness cannot be read
+#define BACKLIGHT_RAMP_STEP_MS		(20)	// one write per step at most
+#define BACKLIGHT_RAMP_FULL_MS		(400)	// time to ramp from 0 to max
+#define BACKLIGHT_SAVE_DELAY_MS		(2000)	// quiet time before the level is saved
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Backlight_Init
+ * opens the brightness file in dir, reads max_brightness and sets the level
+ * saved at setting_path, or level if none was saved, without a ramp.
+ */
+int Backlight_Init(const char * dir, const char * setting_path, int level);
+
+/**
+ * Backlight_Start
+ * adds the ramp timer to the reactor, call it before Reactor_Run. Until then
+ * new levels are written at once, by the thread that sets them.
+ */
+int Backlight_Start(void);
+
+/**
+ * Backlight_Stop
+ * removes the ramp timer, writes the level the ramp was heading for, saves a
+ * target not yet saved and closes the brightness file. Call it once
+ * Reactor_Run has returned.
+ */
+void Backlight_Stop(void);
+
+/**
+ * Backlight_Set
+ * ramps to level, clamped to 0..max. Safe from any thread once
+ * Backlight_Start was called, levels set faster than the ramp steps only
+ * write the last one. Before that, call it from the startup thread.
+ * returns the clamped level.
+ */
+int Backlight_Set(int level);
+
+/**
+ * Backlight_Step
+ * ramps to the current target plus delta, as Backlight_Set.
+ * returns the new target.
+ */
+int Backlight_Step(int delta);
+
+/**
+ * Backlight_Limit
+ * caps the backlight at level, -1 for no cap, without changing the target
+ * or the saved setting. With ramp false the new level is written at once.
+ * Call it from the reactor thread.
+ */
+void Backlight_Limit(int level, bool ramp);
+
+/**
+ * Backlight_Get
+ * the level set by the user, which the backlight is at or ramping to unless
+ * Backlight_Limit caps it.
+ */
+int Backlight_Get(void);
+
+/**
+ * Backlight_Max
+ * max_brightness of the backlight.
+ */
+int Backlight_Max(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,455 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Config
+ *  Source Filename  - Config.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Every load parses into a fresh AppConfig from the
+ *  				   defaults, so a reload either replaces all settings or,
+ *  				   with any bad line, none of them.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <string>
+
+#include "Config.h"
+#include "Reactor.h"
+#include "Snapshot.h"
+#include "Idle.h"
+#include "Backlight.h"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+// Read by DBGPRT everywhere, see debug.hpp.
+int dbg_level = DBG_ALL;
+
+typedef enum
+{
+	CONFIG_UINT,
+	CONFIG_INT,
+	CONFIG_LEVEL,						// a DBG_STR name or number
+	CONFIG_STRING,						// char[CONFIG_PATH_LEN]
+} ConfigType;
+
+typedef struct
+{
+	const char * key;
+	ConfigType type;
+	size_t offset;
+	long min;
+	long max;
+} ConfigKey;
+
+#define CONFIG_KEY(name, type, min, max)	{ #name, type, offsetof(AppConfig, name), min, max }
+
+static const ConfigKey config_keys[] =
+{
+	CONFIG_KEY(battery_period_ms,  CONFIG_UINT,   50,  3600000),
+	CONFIG_KEY(gpio_poll_ms,       CONFIG_UINT,   10,  60000),
+	CONFIG_KEY(snapshot_period_ms, CONFIG_UINT,   1000, 86400000),
+	CONFIG_KEY(idle_dim_s,         CONFIG_UINT,   1,   86400),
+	CONFIG_KEY(idle_blank_s,       CONFIG_UINT,   1,   86400),
+	CONFIG_KEY(idle_dim_percent,   CONFIG_UINT,   0,   100),
+	CONFIG_KEY(idle_sampler_ms,    CONFIG_UINT,   50,  3600000),
+	CONFIG_KEY(current_good_min,   CONFIG_INT,    INT_MIN, INT_MAX),
+	CONFIG_KEY(current_good_max,   CONFIG_INT,    INT_MIN, INT_MAX),
+	CONFIG_KEY(current_warn_min,   CONFIG_INT,    INT_MIN, INT_MAX),
+	CONFIG_KEY(current_warn_max,   CONFIG_INT,    INT_MIN, INT_MAX),
+	CONFIG_KEY(voltage_good_min,   CONFIG_INT,    INT_MIN, INT_MAX),
+	CONFIG_KEY(voltage_good_max,   CONFIG_INT,    INT_MIN, INT_MAX),
+	CONFIG_KEY(voltage_warn_min,   CONFIG_INT,    INT_MIN, INT_MAX),
+	CONFIG_KEY(temp_good_min,      CONFIG_INT,    INT_MIN, INT_MAX),
+	CONFIG_KEY(temp_good_max,      CONFIG_INT,    INT_MIN, INT_MAX),
+	CONFIG_KEY(temp_warn_min,      CONFIG_INT,    INT_MIN, INT_MAX),
+	CONFIG_KEY(level_good_min,     CONFIG_INT,    INT_MIN, INT_MAX),
+	CONFIG_KEY(level_warn_min,     CONFIG_INT,    INT_MIN, INT_MAX),
+	CONFIG_KEY(log_level,          CONFIG_LEVEL,  DBG_ALL, DBG_NONE),
+	CONFIG_KEY(brightness,         CONFIG_INT,    0,   INT_MAX),
+	CONFIG_KEY(snapshot_path,      CONFIG_STRING, 0,   0),
+};
+
+static const char * const config_level_names[] =
+{
+	"all", "info4", "info3", "info2", "info1", "warn", "err", "none"
+};
+
+static AppConfig config_current;
+static std::string config_path;
+static std::string config_name;				// config_path without its directory
+static const char * config_overrides[CONFIG_MAX_OVERRIDES];
+static unsigned int config_override_count = 0;
+static ConfigCallback config_callback = NULL;
+
+static void ConfigDefaults(AppConfig * config)
+{
+	memset(config, 0, sizeof(*config));
+
+	config->battery_period_ms  = BATTERY_MONITOR_PERIOD_MS;
+	config->gpio_poll_ms       = GPIO_MONITOR_POLL_MS;
+	config->snapshot_period_ms = SNAPSHOT_PERIOD_MS;
+	config->idle_dim_s         = IDLE_DIM_S;
+	config->idle_blank_s       = IDLE_BLANK_S;
+	config->idle_dim_percent   = IDLE_DIM_PERCENT;
+	config->idle_sampler_ms    = IDLE_SAMPLER_PERIOD_MS;
+
+	config->current_good_min   = 50;
+	config->current_good_max   = 700;
+	config->current_warn_min   = 1;
+	config->current_warn_max   = 850;
+	config->voltage_good_min   = 350;
+	config->voltage_good_max   = 550;
+	config->voltage_warn_min   = 560;
+	config->temp_good_min      = 400;
+	config->temp_good_max      = 500;
+	config->temp_warn_min      = 480;
+	config->level_good_min     = 75;
+	config->level_warn_min     = 25;
+
+	config->log_level          = DBG_ALL;
+	config->brightness         = BACKLIGHT_DEFAULT;
+
+	snprintf(config->snapshot_path, sizeof(config->snapshot_path), "%s", SNAPSHOT_PATH);
+}
+
+static char * Trim(char * text)
+{
+	char * end;
+
+	while ((*text == ' ') || (*text == '\t'))
+	{
+		text++;
+	}
+
+	end = text + strlen(text);
+
+	while ((end > text) && ((end[-1] == ' ') || (end[-1] == '\t') || (end[-1] == '\r') || (end[-1] == '\n')))
+	{
+		*--end = '\0';
+	}
+
+	return text;
+}
+
+static int ConfigSet(AppConfig * config, const char * key, const char * value)
+{
+	const ConfigKey * entry = NULL;
+	char * field = (char *)config;
+	char * end;
+	long number;
+
+	for (size_t i = 0; i < (sizeof(config_keys) / sizeof(config_keys[0])); i++)
+	{
+		if (strcmp(config_keys[i].key, key) == 0)
+		{
+			entry = &config_keys[i];
+			break;
+		}
+	}
+
+	if (entry == NULL)
+	{
+		DBGPRT(DBG_ERR, "ConfigSet: unknown key %s\n", key);
+		return -1;
+	}
+
+	field += entry->offset;
+
+	if (entry->type == CONFIG_STRING)
+	{
+		if ((*value == '\0') || (strlen(value) >= CONFIG_PATH_LEN))
+		{
+			DBGPRT(DBG_ERR, "ConfigSet: %s must be 1 to %d characters\n", key, CONFIG_PATH_LEN - 1);
+			return -1;
+		}
+
+		snprintf(field, CONFIG_PATH_LEN, "%s", value);
+		return 0;
+	}
+
+	if (entry->type == CONFIG_LEVEL)
+	{
+		for (int level = DBG_ALL; level <= DBG_NONE; level++)
+		{
+			if (strcmp(config_level_names[level], value) == 0)
+			{
+				*(int *)field = level;
+				return 0;
+			}
+		}
+	}
+
+	errno  = 0;
+	number = strtol(value, &end, 0);
+
+	if ((errno != 0) || (end == value) || (*end != '\0') || (number < entry->min) || (number > entry->max))
+	{
+		DBGPRT(DBG_ERR, "ConfigSet: %s = %s is not a number from %ld to %ld\n", key, value, entry->min, entry->max);
+		return -1;
+	}
+
+	if (entry->type == CONFIG_UINT)
+	{
+		*(unsigned int *)field = (unsigned int)number;
+	}
+	else
+	{
+		*(int *)field = (int)number;
+	}
+
+	return 0;
+}
+
+// Splits "key = value" in place and sets it.
+static int ConfigAssign(AppConfig * config, char * line)
+{
+	char * equals = strchr(line, '=');
+
+	if (equals == NULL)
+	{
+		DBGPRT(DBG_ERR, "ConfigAssign: %s is not key = value\n", line);
+		return -1;
+	}
+
+	*equals = '\0';
+
+	return ConfigSet(config, Trim(line), Trim(equals + 1));
+}
+
+static int ConfigCheck(const AppConfig * config)
+{
+	if (config->idle_blank_s < config->idle_dim_s)
+	{
+		DBGPRT(DBG_ERR, "ConfigCheck: idle_blank_s %u is before idle_dim_s %u\n", config->idle_blank_s, config->idle_dim_s);
+		return -1;
+	}
+
+	return 0;
+}
+
+// Parses the defaults, the file if with_file, then the overrides.
+static int ConfigLoad(AppConfig * config, bool with_file)
+{
+	char line[CONFIG_LINE_LEN];
+	unsigned int number = 0;
+	int errors = 0;
+	FILE * file = NULL;
+
+	ConfigDefaults(config);
+
+	if (with_file && ((file = fopen(config_path.c_str(), "r")) != NULL))
+	{
+		while (fgets(line, sizeof(line), file) != NULL)
+		{
+			char * comment = strchr(line, '#');
+			char * text;
+
+			number++;
+
+			if (comment != NULL)
+			{
+				*comment = '\0';
+			}
+
+			if ((*(text = Trim(line)) != '\0') && (ConfigAssign(config, text) != 0))
+			{
+				DBGPRT(DBG_ERR, "ConfigLoad: %s line %u is not valid\n", config_path.c_str(), number);
+				errors++;
+			}
+		}
+
+		fclose(file);
+	}
+	else if (with_file && (errno != ENOENT))
+	{
+		DBGPRT(DBG_ERR, "ConfigLoad: Failed to open %s, %s\n", config_path.c_str(), strerror(errno));
+		errors++;
+	}
+
+	for (unsigned int i = 0; i < config_override_count; i++)
+	{
+		snprintf(line, sizeof(line), "%s", config_overrides[i]);
+		errors += (ConfigAssign(config, line) == 0) ? 0 : 1;
+	}
+
+	errors += (ConfigCheck(config) == 0) ? 0 : 1;
+
+	return (errors == 0) ? 0 : -1;
+}
+
+int Config_Override(const char * assignment)
+{
+	AppConfig scratch;
+	char line[CONFIG_LINE_LEN];
+
+	if (config_override_count >= CONFIG_MAX_OVERRIDES)
+	{
+		DBGPRT(DBG_ERR, "Config_Override: at most %d overrides\n", CONFIG_MAX_OVERRIDES);
+		return -1;
+	}
+
+	ConfigDefaults(&scratch);
+	snprintf(line, sizeof(line), "%s", assignment);
+
+	if (ConfigAssign(&scratch, line) != 0)
+	{
+		return -1;
+	}
+
+	config_overrides[config_override_count++] = assignment;
+
+	return 0;
+}
+
+int Config_Init(const char * path)
+{
+	AppConfig config;
+	int result;
+
+	config_path = path;
+	config_name = config_path.substr(config_path.find_last_of('/') + 1);
+
+	if ((result = ConfigLoad(&config, true)) != 0)
+	{
+		DBGPRT(DBG_ERR, "Config_Init: %s is not valid, using the defaults\n", path);
+
+		if (ConfigLoad(&config, false) != 0)
+		{
+			ConfigDefaults(&config);
+		}
+	}
+
+	config_current = config;
+	dbg_level      = config.log_level;
+
+	return result;
+}
+
+const AppConfig * Config_Get(void)
+{
+	return &config_current;
+}
+
+// Reactor fd handler, something in the directory of the file changed.
+static void ConfigEvent(void * arg)
+{
+	char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool changed = false;
+	ssize_t length;
+
+	while ((length = read((int)(intptr_t)arg, events, sizeof(events))) > 0)
+	{
+		for (ssize_t i = 0; i < length; )
+		{
+			const struct inotify_event * event = (const struct inotify_event *)&events[i];
+
+			if ((event->len > 0) && (config_name == event->name))
+			{
+				changed = true;
+			}
+
+			i += sizeof(struct inotify_event) + event->len;
+		}
+	}
+
+	if (!changed)
+	{
+		return;
+	}
+
+	AppConfig config;
+
+	if (ConfigLoad(&config, true) != 0)
+	{
+		DBGPRT(DBG_ERR, "ConfigEvent: %s is not valid, keeping the current settings\n", config_path.c_str());
+		return;
+	}
+
+	if (memcmp(&config, &config_current, sizeof(config)) == 0)
+	{
+		return;
+	}
+
+	AppConfig old_config = config_current;
+
+	config_current = config;
+	dbg_level      = config.log_level;
+
+	DBGPRT(DBG_INFO1, "ConfigEvent: reloaded %s\n", config_path.c_str());
+
+	if (config_callback != NULL)
+	{
+		config_callback(&old_config, &config_current);
+	}
+}
+
+int Config_Watch(ConfigCallback callback)
+{
+	std::string dir = config_path.substr(0, config_path.find_last_of('/') + 1);
+	int fd;
+
+	config_callback = callback;
+
+	if (dir.empty())
+	{
+		dir = ".";
+	}
+
+	if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+	{
+		DBGPRT(DBG_ERR, "Config_Watch: inotify_init1 failed, %s\n", strerror(errno));
+		return -1;
+	}
+
+	// The directory, so files replaced by a rename are seen as well.
+	if ((inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) ||
+		(Reactor_AddFd(fd, ConfigEvent, (void *)(intptr_t)fd) < 0))
+	{
+		DBGPRT(DBG_ERR, "Config_Watch: Failed to watch %s, %s\n", dir.c_str(), strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+void Config_Print(void)
+{
+	const char * config = (const char *)&config_current;
+
+	for (size_t i = 0; i < (sizeof(config_keys) / sizeof(config_keys[0])); i++)
+	{
+		const ConfigKey * entry = &config_keys[i];
+		const char * field = config + entry->offset;
+
+		switch (entry->type)
+		{
+		case CONFIG_UINT:
+			DBGPRT(DBG_INFO1, "Config: %-20s = %u\n", entry->key, *(const unsigned int *)field);
+			break;
+		case CONFIG_INT:
+			DBGPRT(DBG_INFO1, "Config: %-20s = %d\n", entry->key, *(const int *)field);
+			break;
+		case CONFIG_LEVEL:
+			DBGPRT(DBG_INFO1, "Config: %-20s = %s\n", entry->key, config_level_names[*(const int *)field]);
+			break;
+		case CONFIG_STRING:
+			DBGPRT(DBG_INFO1, "Config: %-20s = %s\n", entry->key, field);
+			break;
+		}
+	}
+}
@@ -0,0 +1,106 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Config
+ *  Source Filename  - Config.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The tunable settings of the app, read from a key = value
+ *  				   file with command line overrides on top, and read again
+ *  				   whenever the file changes.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#define CONFIG_PATH				"/usr/nova/battery_info/battery_info.conf"
+#define CONFIG_PATH_LEN			(128)
+#define CONFIG_LINE_LEN			(256)
+#define CONFIG_MAX_OVERRIDES	(16)
+
+// Defaults of the periods. Sources other than the GPIO engine do not signal
+// changes, they are polled at gpio_poll_ms.
+#define GPIO_MONITOR_POLL_MS		(500)
+#define BATTERY_MONITOR_PERIOD_MS	(500)
+
+typedef struct
+{
+	// Periods, applied at once on reload.
+	unsigned int battery_period_ms;
+	unsigned int gpio_poll_ms;
+	unsigned int snapshot_period_ms;
+	unsigned int idle_dim_s;
+	unsigned int idle_blank_s;
+	unsigned int idle_dim_percent;
+	unsigned int idle_sampler_ms;
+
+	// Classification of the samples, in the units of their metrics.
+	int current_good_min;
+	int current_good_max;
+	int current_warn_min;
+	int current_warn_max;
+	int voltage_good_min;
+	int voltage_good_max;
+	int voltage_warn_min;
+	int temp_good_min;
+	int temp_good_max;
+	int temp_warn_min;
+	int level_good_min;
+	int level_warn_min;
+
+	int log_level;						// DBG_ALL .. DBG_NONE
+
+	// Read at start only.
+	int brightness;						// when no level was saved
+	char snapshot_path[CONFIG_PATH_LEN];
+} AppConfig;
+
+// Runs on the reactor thread after a reload changed the settings.
+typedef void (*ConfigCallback)(const AppConfig * old_config, const AppConfig * new_config);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Config_Override
+ * adds a "key=value" from the command line, applied over the file on every
+ * load. Call it before Config_Init.
+ * returns 0, or -1 if the key or value is not valid.
+ */
+int Config_Override(const char * assignment);
+
+/**
+ * Config_Init
+ * loads path, or only the defaults and overrides if it does not exist.
+ * returns 0, or -1 if the file is not valid, the defaults are used then.
+ */
+int Config_Init(const char * path);
+
+/**
+ * Config_Get
+ * the current settings. Read them from the reactor thread, or before
+ * Reactor_Run; a reload replaces them whole between reactor callbacks.
+ */
+const AppConfig * Config_Get(void);
+
+/**
+ * Config_Watch
+ * reloads the file from the reactor whenever it is written or replaced and
+ * calls callback if anything changed. A file with any bad line is ignored.
+ */
+int Config_Watch(ConfigCallback callback);
+
+/**
+ * Config_Print
+ * logs every setting.
+ */
+void Config_Print(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,384 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Coroutine
+ *  Source Filename  - Coroutine.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The runtime is one reactor source, an epoll set of its
+ *  				   own holding a timerfd for the sleepers, an eventfd for
+ *  				   GPIO transitions and the fds being waited on.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "Coroutine.h"
+#include "Reactor.h"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+typedef struct
+{
+	uint32_t bit;
+	int value;
+	int64_t t_ns;
+} CoGpioTransition;
+
+// epoll data of the runtime's own fds, waiters are tagged by their address.
+static CoWaiter co_timer_tag;
+static CoWaiter co_gpio_tag;
+
+static int co_epoll_fd = -1;
+static int co_timer_fd = -1;
+static int co_gpio_fd = -1;
+static CoWaiter * co_sleepers = NULL;			// by due_ns
+static CoWaiter * co_gpio_waiters = NULL;
+static bool co_gpio_sink = false;
+static CoStats co_stats;
+
+// Filled by the GPIO engine's sink call and emptied on a later wakeup, so a
+// resumed coroutine never runs under the engine's sink lock.
+static pthread_mutex_t co_gpio_lock = PTHREAD_MUTEX_INITIALIZER;
+static CoGpioTransition co_gpio_queue[CO_GPIO_QUEUE_LEN];
+static unsigned int co_gpio_head = 0;
+static unsigned int co_gpio_count = 0;
+static uint64_t co_gpio_dropped = 0;
+
+static int64_t CoNowNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((int64_t)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+static void CoResume(CoWaiter * waiter)
+{
+	co_stats.resumes++;
+	waiter->handle.resume();
+}
+
+// Sets the timerfd for the first sleeper, or stops it.
+static void CoArmTimer(void)
+{
+	struct itimerspec spec;
+
+	memset(&spec, 0, sizeof(spec));
+
+	if (co_sleepers != NULL)
+	{
+		// 0 would stop the timer, a sleeper already due fires at once.
+		int64_t due_ns = (co_sleepers->due_ns > 0) ? co_sleepers->due_ns : 1;
+
+		spec.it_value.tv_sec  = due_ns / 1000000000LL;
+		spec.it_value.tv_nsec = due_ns % 1000000000LL;
+	}
+
+	if (timerfd_settime(co_timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) != 0)
+	{
+		DBGPRT(DBG_ERR, "CoArmTimer: Failed to set the timer, %s\n", strerror(errno));
+	}
+}
+
+static void CoRunSleepers(void)
+{
+	uint64_t expirations;
+	int64_t now = CoNowNs();
+
+	// EAGAIN when a new first sleeper moved the timer before it was read.
+	if ((read(co_timer_fd, &expirations, sizeof(expirations)) < 0) && (errno != EAGAIN))
+	{
+		DBGPRT(DBG_ERR, "CoRunSleepers: read failed, %s\n", strerror(errno));
+	}
+
+	// A resumed coroutine may sleep again, only take what was due on entry.
+	while ((co_sleepers != NULL) && (co_sleepers->due_ns <= now))
+	{
+		CoWaiter * waiter = co_sleepers;
+
+		co_sleepers = waiter->next;
+		CoResume(waiter);
+	}
+
+	CoArmTimer();
+}
+
+// GPIO engine sink, on the reactor thread. Queues the transition for CoRunGpio.
+static void CoGpioSink(void * arg, uint32_t bit, int value, int64_t t_ns)
+{
+	UNUSED(arg);
+
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&co_gpio_lock);
+
+	if (co_gpio_count < CO_GPIO_QUEUE_LEN)
+	{
+		CoGpioTransition * transition = &co_gpio_queue[(co_gpio_head + co_gpio_count) % CO_GPIO_QUEUE_LEN];
+
+		transition->bit   = bit;
+		transition->value = value;
+		transition->t_ns  = t_ns;
+		co_gpio_count++;
+	}
+	else
+	{
+		co_gpio_dropped++;
+	}
+
+	pthread_mutex_unlock(&co_gpio_lock);
+
+	if (write(co_gpio_fd, &one, sizeof(one)) != sizeof(one))
+	{
+		DBGPRT(DBG_ERR, "CoGpioSink: Failed to signal eventfd, %s\n", strerror(errno));
+	}
+}
+
+static void CoRunGpio(void)
+{
+	uint64_t count;
+	uint32_t active_valid;
+	uint32_t active = GpioEngine_GetActive(&active_valid);
+	uint32_t active_low = (GpioEngine_GetState(NULL) ^ active) & active_valid;
+
+	if (read(co_gpio_fd, &count, sizeof(count)) < 0)
+	{
+		return;
+	}
+
+	for (;;)
+	{
+		CoGpioTransition transition;
+
+		pthread_mutex_lock(&co_gpio_lock);
+
+		if (co_gpio_count == 0)
+		{
+			co_stats.gpio_dropped = co_gpio_dropped;
+			pthread_mutex_unlock(&co_gpio_lock);
+			break;
+		}
+
+		transition = co_gpio_queue[co_gpio_head];
+		co_gpio_head = (co_gpio_head + 1) % CO_GPIO_QUEUE_LEN;
+		co_gpio_count--;
+
+		pthread_mutex_unlock(&co_gpio_lock);
+
+		uint32_t edge = ((transition.value != 0) != ((active_low & transition.bit) != 0)) ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING;
+		CoWaiter ** link = &co_gpio_waiters;
+		CoWaiter * resume = NULL;
+
+		// Take every matching waiter off first, a resumed one may wait again.
+		while (*link != NULL)
+		{
+			CoWaiter * waiter = *link;
+
+			if ((waiter->bit & transition.bit) && (waiter->edges & edge))
+			{
+				*link         = waiter->next;
+				waiter->bit   = transition.bit;
+				waiter->value = transition.value;
+				waiter->t_ns  = transition.t_ns;
+				waiter->next  = resume;
+				resume        = waiter;
+			}
+			else
+			{
+				link = &waiter->next;
+			}
+		}
+
+		while (resume != NULL)
+		{
+			CoWaiter * waiter = resume;
+
+			resume = waiter->next;
+			CoResume(waiter);
+		}
+	}
+}
+
+// Reactor fd handler for the runtime's epoll set.
+static void CoRun(void * arg)
+{
+	UNUSED(arg);
+
+	struct epoll_event ready[CO_MAX_EVENTS];
+	int count = epoll_wait(co_epoll_fd, ready, CO_MAX_EVENTS, 0);
+
+	for (int i = 0; i < count; i++)
+	{
+		CoWaiter * waiter = (CoWaiter *)ready[i].data.ptr;
+
+		if (waiter == &co_timer_tag)
+		{
+			CoRunSleepers();
+		}
+		else if (waiter == &co_gpio_tag)
+		{
+			CoRunGpio();
+		}
+		else
+		{
+			epoll_ctl(co_epoll_fd, EPOLL_CTL_DEL, waiter->fd, NULL);
+			CoResume(waiter);
+		}
+	}
+}
+
+static int CoWatch(int fd, CoWaiter * waiter)
+{
+	struct epoll_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.events   = EPOLLIN;
+	event.data.ptr = waiter;
+
+	if (epoll_ctl(co_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+	{
+		DBGPRT(DBG_ERR, "CoWatch: Failed to watch fd %d, %s\n", fd, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+int Co_Init(void)
+{
+	if (co_epoll_fd >= 0)
+	{
+		return 0;
+	}
+
+	if (((co_epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) ||
+		((co_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) < 0) ||
+		((co_gpio_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0))
+	{
+		DBGPRT(DBG_ERR, "Co_Init: Failed to create fds, %s\n", strerror(errno));
+		return -1;
+	}
+
+	if ((CoWatch(co_timer_fd, &co_timer_tag) != 0) || (CoWatch(co_gpio_fd, &co_gpio_tag) != 0) ||
+		(Reactor_AddFd(co_epoll_fd, CoRun, NULL) < 0))
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+void Co_Spawn(CoTask task)
+{
+	co_stats.resumes++;
+	task.handle.resume();
+}
+
+void CoFrameAlloc(size_t size)
+{
+	co_stats.tasks++;
+	co_stats.frame_bytes += (uint32_t)size;
+
+	if (size > co_stats.frame_max)
+	{
+		co_stats.frame_max = (uint32_t)size;
+	}
+}
+
+void CoFrameFree(size_t size)
+{
+	co_stats.frame_bytes -= (uint32_t)size;
+	co_stats.tasks--;
+}
+
+void CoSleep(CoWaiter * waiter)
+{
+	CoWaiter ** link = &co_sleepers;
+
+	// Few monitors sleep at once, a sorted list is enough.
+	while ((*link != NULL) && ((*link)->due_ns <= waiter->due_ns))
+	{
+		link = &(*link)->next;
+	}
+
+	waiter->next = *link;
+	*link        = waiter;
+
+	if (co_sleepers == waiter)
+	{
+		CoArmTimer();
+	}
+}
+
+int CoWatchFd(CoWaiter * waiter)
+{
+	return CoWatch(waiter->fd, waiter);
+}
+
+int CoWatchGpio(CoWaiter * waiter)
+{
+	if (!co_gpio_sink)
+	{
+		if (GpioEngine_AddSink(CoGpioSink, NULL) != 0)
+		{
+			return -1;
+		}
+
+		co_gpio_sink = true;
+	}
+
+	waiter->next    = co_gpio_waiters;
+	co_gpio_waiters = waiter;
+
+	return 0;
+}
+
+CoSleepAwaiter Co_SleepFor(unsigned int ms)
+{
+	CoSleepAwaiter awaiter = {};
+
+	awaiter.waiter.due_ns = CoNowNs() + ((int64_t)ms * 1000000LL);
+
+	return awaiter;
+}
+
+CoReadableAwaiter Co_Readable(int fd)
+{
+	CoReadableAwaiter awaiter = {};
+
+	awaiter.waiter.fd = fd;
+
+	return awaiter;
+}
+
+CoGpioEdgeAwaiter Co_GpioEdge(uint32_t bits, uint32_t edges)
+{
+	CoGpioEdgeAwaiter awaiter = {};
+
+	awaiter.waiter.bit   = bits;
+	awaiter.waiter.edges = edges;
+
+	return awaiter;
+}
+
+void Co_GetStats(CoStats * stats)
+{
+	*stats = co_stats;
+}
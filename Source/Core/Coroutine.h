@@ -0,0 +1,183 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Coroutine
+ *  Source Filename  - Coroutine.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - C++20 coroutines run on the reactor thread, so a monitor
+ *  				   can be a straight loop that waits on a timer, an fd or a
+ *  				   GPIO edge without a thread of its own.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <coroutine>
+#include <exception>
+
+#include "GpioEngine.hpp"
+
+#define CO_MAX_EVENTS			(16)		// fds resumed per reactor callback
+#define CO_GPIO_QUEUE_LEN		(32)		// transitions between two reactor wakeups
+
+/*
+ * A monitor is a function returning CoTask, started once with Co_Spawn:
+ *
+ *   CoTask SnapshotMonitor(void)
+ *   {
+ *       for (;;)
+ *       {
+ *           co_await Co_SleepFor(Config_Get()->snapshot_period_ms);
+ *           Snapshot_Save(Config_Get()->snapshot_path);
+ *       }
+ *   }
+ *
+ * Its frame is allocated once when it is called and freed when it returns.
+ * Every wait holds its node in that frame, nothing is allocated per wait.
+ */
+
+typedef struct
+{
+	uint32_t tasks;					// started and not returned
+	uint32_t frame_bytes;			// held by those tasks
+	uint32_t frame_max;				// largest single frame
+	uint64_t resumes;
+	uint64_t gpio_dropped;			// transitions lost with the queue full
+} CoStats;
+
+// One suspended wait, lives in the waiting coroutine's frame.
+typedef struct CoWaiter
+{
+	std::coroutine_handle<> handle;
+	int64_t due_ns;					// Co_SleepFor
+	int fd;							// Co_Readable
+	uint32_t bit;					// Co_GpioEdge, the lines waited on then the one that changed
+	uint32_t edges;
+	int value;						// level the line settled on
+	int64_t t_ns;					// kernel time of that edge
+	struct CoWaiter * next;
+} CoWaiter;
+
+// A transition Co_GpioEdge resumed with.
+typedef struct
+{
+	int value;
+	int64_t t_ns;
+	uint32_t bit;					// the line that changed
+} CoGpioEvent;
+
+/**
+ * Co_Init
+ * adds the coroutine runtime to the reactor, call it after Reactor_Init.
+ */
+int Co_Init(void);
+
+/**
+ * Co_GetStats
+ * copies the runtime counters, call it from the reactor thread.
+ */
+void Co_GetStats(CoStats * stats);
+
+// Called by the awaiters below, from the reactor thread.
+void CoSleep(CoWaiter * waiter);
+int CoWatchFd(CoWaiter * waiter);
+int CoWatchGpio(CoWaiter * waiter);
+void CoFrameAlloc(size_t size);
+void CoFrameFree(size_t size);
+
+// Started suspended, Co_Spawn runs it up to its first wait. The frame frees
+// itself when the coroutine returns.
+class CoTask
+{
+public:
+	struct promise_type
+	{
+		CoTask get_return_object(void) { return CoTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend(void) noexcept { return {}; }
+		std::suspend_never final_suspend(void) noexcept { return {}; }
+		void return_void(void) {}
+		void unhandled_exception(void) { std::terminate(); }
+
+		void * operator new(size_t size)
+		{
+			void * frame = ::operator new(size);
+			CoFrameAlloc(size);
+			return frame;
+		}
+
+		void operator delete(void * frame, size_t size)
+		{
+			CoFrameFree(size);
+			::operator delete(frame);
+		}
+	};
+
+	explicit CoTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * Co_Spawn
+ * runs task until its first co_await, the reactor resumes it from there.
+ * Call it from the reactor thread, or before Reactor_Run.
+ */
+void Co_Spawn(CoTask task);
+
+struct CoSleepAwaiter
+{
+	CoWaiter waiter;
+
+	bool await_ready(void) const noexcept { return false; }
+	void await_suspend(std::coroutine_handle<> handle) { waiter.handle = handle; CoSleep(&waiter); }
+	void await_resume(void) const noexcept {}
+};
+
+struct CoReadableAwaiter
+{
+	CoWaiter waiter;
+	int result;
+
+	bool await_ready(void) const noexcept { return false; }
+	bool await_suspend(std::coroutine_handle<> handle) { waiter.handle = handle; result = CoWatchFd(&waiter); return (result == 0); }
+	int await_resume(void) const noexcept { return result; }
+};
+
+struct CoGpioEdgeAwaiter
+{
+	CoWaiter waiter;
+	int result;
+
+	bool await_ready(void) const noexcept { return false; }
+	bool await_suspend(std::coroutine_handle<> handle) { waiter.handle = handle; result = CoWatchGpio(&waiter); return (result == 0); }
+	CoGpioEvent await_resume(void) const noexcept { return { (result == 0) ? waiter.value : -1, waiter.t_ns, waiter.bit }; }
+};
+
+/**
+ * Co_SleepFor
+ * co_await resumes after ms on the monotonic clock.
+ */
+CoSleepAwaiter Co_SleepFor(unsigned int ms);
+
+/**
+ * Co_Readable
+ * co_await resumes once fd is readable, the coroutine reads it.
+ * returns 0, or -1 at once if fd cannot be watched.
+ */
+CoReadableAwaiter Co_Readable(int fd);
+
+/**
+ * Co_GpioEdge
+ * co_await resumes on the next confirmed transition of a line under bits
+ * that is in edges and in the line's configured edges.
+ * returns the level, time and bit of the edge, a level of -1 at once if the
+ * GPIO engine could not take the sink.
+ */
+CoGpioEdgeAwaiter Co_GpioEdge(uint32_t bits, uint32_t edges = GPIO_EDGE_BOTH);
@@ -0,0 +1,360 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Idle
+ *  Source Filename  - Idle.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Runs on the reactor thread. Touches only record their
+ *  				   evdev timestamp, the idle timer is set for the next
+ *  				   deadline and looks at the last touch when it fires.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include "Idle.h"
+#include "Backlight.h"
+#include "Gui.hpp"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+static const char * const idle_state_names[IDLE_STATE_COUNT] = { "active", "dim", "blank" };
+
+static IdleConfig idle_config;
+static int idle_fd = -1;
+static int idle_source = -1;
+static int idle_timer = -1;
+static IdleState idle_state = IDLE_ACTIVE;
+static int64_t idle_last_input_ns = 0;
+static int64_t idle_since_ns = 0;				// entered idle_state
+static uint64_t idle_since_wakeups = 0;
+static int idle_backlight = 0;					// level applied in idle_state
+static int64_t idle_time_ns[IDLE_STATE_COUNT];
+static uint64_t idle_wakeups[IDLE_STATE_COUNT];
+static double idle_saved_j = 0;
+
+static int64_t IdleNowNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((int64_t)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+static uint64_t IdleWakeups(void)
+{
+	ReactorStats stats;
+
+	Reactor_GetStats(&stats);
+
+	return stats.wakeups + GuiGetWakeups();
+}
+
+static double IdleRate(IdleState state)
+{
+	return (idle_time_ns[state] > 0) ? ((double)idle_wakeups[state] * 1e9 / idle_time_ns[state]) : 0;
+}
+
+// Adds the time spent in idle_state to the totals and what it saved against
+// the active rate, logging it if report.
+static void IdleAccount(int64_t now, bool report)
+{
+	int64_t time_ns = now - idle_since_ns;
+	uint64_t wakeups = IdleWakeups() - idle_since_wakeups;
+
+	idle_time_ns[idle_state] += time_ns;
+	idle_wakeups[idle_state] += wakeups;
+
+	if ((idle_state == IDLE_ACTIVE) || (time_ns <= 0))
+	{
+		return;
+	}
+
+	double seconds = time_ns / 1e9;
+	double rate = wakeups / seconds;
+	double backlight_j = ((double)(Backlight_Get() - idle_backlight) / Backlight_Max()) * IDLE_BACKLIGHT_MW * seconds / 1000;
+	double wakeup_j = (IdleRate(IDLE_ACTIVE) - rate) * seconds * IDLE_WAKEUP_UJ / 1e6;
+	double saved_j = ((backlight_j > 0) ? backlight_j : 0) + ((wakeup_j > 0) ? wakeup_j : 0);
+
+	idle_saved_j += saved_j;
+
+	if (!report)
+	{
+		return;
+	}
+
+	DBGPRT(DBG_INFO1, "Idle: %s for %.1f s, %.1f wakeups/s against %.1f active, saved about %.1f J (%.1f J total)\n",
+			idle_state_names[idle_state], seconds, rate, IdleRate(IDLE_ACTIVE), saved_j, idle_saved_j);
+}
+
+static void IdleEnter(IdleState state, int64_t now)
+{
+	IdleAccount(now, true);
+
+	idle_state         = state;
+	idle_since_ns      = now;
+	idle_since_wakeups = IdleWakeups();
+
+	switch (state)
+	{
+	case IDLE_ACTIVE:
+		// Everything at once, the user is looking.
+		Backlight_Limit(-1, false);
+		GuiPause(false);
+		idle_backlight = Backlight_Get();
+
+		if (idle_config.sampler_timer >= 0)
+		{
+			Reactor_SetTimer(idle_config.sampler_timer, idle_config.sampler_period_ms);
+		}
+
+		if (idle_config.sampler != NULL)
+		{
+			idle_config.sampler(NULL);
+		}
+		break;
+	case IDLE_DIM:
+		idle_backlight = (Backlight_Get() * (int)idle_config.dim_percent) / 100;
+		Backlight_Limit(idle_backlight, true);
+		break;
+	case IDLE_BLANK:
+		idle_backlight = 0;
+		Backlight_Limit(0, true);
+		GuiPause(true);
+
+		if (idle_config.sampler_timer >= 0)
+		{
+			Reactor_SetTimer(idle_config.sampler_timer, idle_config.sampler_idle_ms);
+		}
+		break;
+	default:
+		break;
+	}
+
+	DBGPRT(DBG_INFO2, "IdleEnter: %s\n", idle_state_names[state]);
+}
+
+// Sets the idle timer to fire when the next state is due, or stops it.
+static void IdleArm(int64_t now)
+{
+	int64_t idle_ns = now - idle_last_input_ns;
+	int64_t due_ns;
+
+	switch (idle_state)
+	{
+	case IDLE_ACTIVE:
+		due_ns = ((int64_t)idle_config.dim_s * 1000000000LL) - idle_ns;
+		break;
+	case IDLE_DIM:
+		due_ns = ((int64_t)idle_config.blank_s * 1000000000LL) - idle_ns;
+		break;
+	default:
+		Reactor_SetTimer(idle_timer, 0);
+		return;
+	}
+
+	Reactor_SetTimer(idle_timer, (due_ns > 1000000LL) ? (unsigned int)(due_ns / 1000000LL) : 1);
+}
+
+// Reactor timer, a deadline from IdleArm passed.
+static void IdleTimer(void * arg)
+{
+	(void)arg;
+
+	int64_t now = IdleNowNs();
+	int64_t idle_ns = now - idle_last_input_ns;
+
+	if ((idle_state == IDLE_ACTIVE) && (idle_ns >= ((int64_t)idle_config.dim_s * 1000000000LL)))
+	{
+		IdleEnter(IDLE_DIM, now);
+	}
+
+	if ((idle_state == IDLE_DIM) && (idle_ns >= ((int64_t)idle_config.blank_s * 1000000000LL)))
+	{
+		IdleEnter(IDLE_BLANK, now);
+	}
+
+	IdleArm(now);
+}
+
+// Reactor fd handler, the touchscreen reported events.
+static void IdleInput(void * arg)
+{
+	(void)arg;
+
+	struct input_event events[IDLE_EVENTS_PER_READ];
+	int64_t last_ns = -1;
+	ssize_t length;
+
+	while ((length = read(idle_fd, events, sizeof(events))) > 0)
+	{
+		size_t count = (size_t)length / sizeof(events[0]);
+
+		if (count > 0)
+		{
+			last_ns = ((int64_t)events[count - 1].input_event_sec * 1000000000LL) +
+					  ((int64_t)events[count - 1].input_event_usec * 1000LL);
+		}
+	}
+
+	if (last_ns < 0)
+	{
+		return;
+	}
+
+	int64_t now = IdleNowNs();
+
+	// Timestamps from a clock other than CLOCK_MONOTONIC are not comparable.
+	idle_last_input_ns = ((last_ns <= now) && (last_ns > idle_last_input_ns)) ? last_ns : now;
+
+	if (idle_state != IDLE_ACTIVE)
+	{
+		IdleEnter(IDLE_ACTIVE, now);
+		IdleArm(now);
+	}
+}
+
+static int IdleCheck(const IdleConfig * config)
+{
+	if ((config->dim_s == 0) || (config->blank_s < config->dim_s) || (config->dim_percent > 100) ||
+		(config->sampler_period_ms == 0) || (config->sampler_idle_ms == 0))
+	{
+		DBGPRT(DBG_ERR, "IdleCheck: dim after %u s, blank after %u s, dim to %u%%, sample every %u or %u ms is not valid\n",
+				config->dim_s, config->blank_s, config->dim_percent, config->sampler_period_ms, config->sampler_idle_ms);
+		return -1;
+	}
+
+	return 0;
+}
+
+int Idle_Start(const IdleConfig * config)
+{
+	int clock = CLOCK_MONOTONIC;
+
+	if (IdleCheck(config) != 0)
+	{
+		return -1;
+	}
+
+	idle_config = *config;
+
+	if ((idle_fd = open(config->device, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) < 0)
+	{
+		DBGPRT(DBG_ERR, "Idle_Start: Failed to open %s, %s\n", config->device, strerror(errno));
+		return -1;
+	}
+
+	// LVGL reads the same device, evdev gives every reader its own copy.
+	if (ioctl(idle_fd, EVIOCSCLOCKID, &clock) != 0)
+	{
+		DBGPRT(DBG_ERR, "Idle_Start: %s keeps its own clock, %s\n", config->device, strerror(errno));
+	}
+
+	if (((idle_source = Reactor_AddFd(idle_fd, IdleInput, NULL)) < 0) ||
+		((idle_timer = Reactor_AddTimer(config->dim_s * 1000, IdleTimer, NULL)) < 0))
+	{
+		Idle_Stop();
+		return -1;
+	}
+
+	idle_last_input_ns = IdleNowNs();
+	idle_since_ns      = idle_last_input_ns;
+	idle_since_wakeups = IdleWakeups();
+	idle_backlight     = Backlight_Get();
+
+	IdleArm(idle_last_input_ns);
+
+	return 0;
+}
+
+int Idle_Update(const IdleConfig * config)
+{
+	if ((idle_timer < 0) || (IdleCheck(config) != 0))
+	{
+		return -1;
+	}
+
+	idle_config.dim_s             = config->dim_s;
+	idle_config.blank_s           = config->blank_s;
+	idle_config.dim_percent       = config->dim_percent;
+	idle_config.sampler_period_ms = config->sampler_period_ms;
+	idle_config.sampler_idle_ms   = config->sampler_idle_ms;
+
+	if (idle_state == IDLE_DIM)
+	{
+		idle_backlight = (Backlight_Get() * (int)idle_config.dim_percent) / 100;
+		Backlight_Limit(idle_backlight, true);
+	}
+
+	if (idle_config.sampler_timer >= 0)
+	{
+		Reactor_SetTimer(idle_config.sampler_timer,
+				(idle_state == IDLE_BLANK) ? idle_config.sampler_idle_ms : idle_config.sampler_period_ms);
+	}
+
+	IdleArm(IdleNowNs());
+
+	return 0;
+}
+
+void Idle_Stop(void)
+{
+	if (idle_fd < 0)
+	{
+		return;
+	}
+
+	if (idle_timer >= 0)
+	{
+		IdleAccount(IdleNowNs(), true);
+		Reactor_RemoveFd(idle_timer);
+	}
+
+	if (idle_source >= 0)
+	{
+		Reactor_RemoveFd(idle_source);
+	}
+
+	close(idle_fd);
+	idle_fd     = -1;
+	idle_source = -1;
+	idle_timer  = -1;
+
+	// Whatever runs next starts with the screen lit.
+	idle_state = IDLE_ACTIVE;
+	Backlight_Limit(-1, false);
+}
+
+void Idle_GetStats(IdleStats * stats)
+{
+	int64_t now = IdleNowNs();
+
+	IdleAccount(now, false);
+	idle_since_ns      = now;
+	idle_since_wakeups = IdleWakeups();
+
+	stats->state   = idle_state;
+	stats->saved_j = idle_saved_j;
+
+	for (int i = 0; i < IDLE_STATE_COUNT; i++)
+	{
+		stats->time_ms[i]       = (uint64_t)(idle_time_ns[i] / 1000000LL);
+		stats->wakeups_per_s[i] = IdleRate((IdleState)i);
+	}
+}
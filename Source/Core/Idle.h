@@ -0,0 +1,95 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Idle
+ *  Source Filename  - Idle.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Watches the touchscreen and, when it is left alone,
+ *  				   dims the backlight, then blanks it, pauses the GUI and
+ *  				   slows the sampler. The next touch undoes all of it.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "Reactor.h"
+
+#define IDLE_DIM_S					(30)
+#define IDLE_BLANK_S				(120)
+#define IDLE_DIM_PERCENT			(20)
+#define IDLE_SAMPLER_PERIOD_MS		(10000)
+#define IDLE_EVENTS_PER_READ		(16)
+
+// Rough figures for the saving estimate only, not measured on the board.
+#define IDLE_BACKLIGHT_MW			(1200)		// backlight at max_brightness
+#define IDLE_WAKEUP_UJ				(40)		// one thread wakeup
+
+typedef enum
+{
+	IDLE_ACTIVE,
+	IDLE_DIM,
+	IDLE_BLANK,
+	IDLE_STATE_COUNT
+} IdleState;
+
+typedef struct
+{
+	const char * device;				// evdev node of the touchscreen
+	unsigned int dim_s;
+	unsigned int blank_s;
+	unsigned int dim_percent;			// of the user's brightness
+	int sampler_timer;					// reactor timer slowed while blank, -1 for none
+	unsigned int sampler_period_ms;		// its usual period
+	unsigned int sampler_idle_ms;		// its period while blank
+	ReactorCallback sampler;			// run once on waking so values are fresh, may be NULL
+} IdleConfig;
+
+typedef struct
+{
+	IdleState state;
+	uint64_t time_ms[IDLE_STATE_COUNT];
+	double wakeups_per_s[IDLE_STATE_COUNT];	// reactor and GUI threads
+	double saved_j;						// estimated energy saved so far
+} IdleStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Idle_Start
+ * opens config->device and watches it from the reactor. Call it before
+ * Reactor_Run, after GuiInit and Backlight_Start.
+ */
+int Idle_Start(const IdleConfig * config);
+
+/**
+ * Idle_Update
+ * takes new timings, the current state keeps going under them. Call it from
+ * the reactor thread.
+ */
+int Idle_Update(const IdleConfig * config);
+
+/**
+ * Idle_Stop
+ * closes the device, removes the reactor sources and lifts the backlight
+ * limit. Call it once Reactor_Run has returned, before Backlight_Stop.
+ */
+void Idle_Stop(void);
+
+/**
+ * Idle_GetStats
+ * copies the time and wakeups per state, call it from the reactor thread.
+ */
+void Idle_GetStats(IdleStats * stats);
+
+#ifdef __cplusplus
+}
+#endif
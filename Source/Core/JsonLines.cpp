@@ -0,0 +1,282 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - JsonLines
+ *  Source Filename  - JsonLines.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The numbers are formatted by hand, printf would cost
+ *  				   more than the write at the generator's rates.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "JsonLines.h"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+typedef struct
+{
+	char * pos;
+	char * end;
+	bool full;
+} JsonCursor;
+
+static pthread_mutex_t jsonl_lock = PTHREAD_MUTEX_INITIALIZER;
+static int jsonl_fd = -1;
+static char jsonl_line[JSONL_LINE_LEN];
+static JsonLinesStats jsonl_stats;
+
+static int64_t JsonNowNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((int64_t)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+static void JsonPut(JsonCursor * cursor, const char * text, size_t length)
+{
+	if ((size_t)(cursor->end - cursor->pos) < length)
+	{
+		cursor->full = true;
+		return;
+	}
+
+	memcpy(cursor->pos, text, length);
+	cursor->pos += length;
+}
+
+static void JsonPutInt(JsonCursor * cursor, int64_t value)
+{
+	char digits[24];
+	char * p = &digits[sizeof(digits)];
+	uint64_t magnitude = (value < 0) ? (0 - (uint64_t)value) : (uint64_t)value;
+
+	do
+	{
+		*--p = (char)('0' + (magnitude % 10));
+		magnitude /= 10;
+	} while (magnitude != 0);
+
+	if (value < 0)
+	{
+		*--p = '-';
+	}
+
+	JsonPut(cursor, p, (size_t)(&digits[sizeof(digits)] - p));
+}
+
+// Appends ,"key":value, key is a literal without the separator.
+static void JsonPutField(JsonCursor * cursor, const char * key, size_t key_length, int64_t value)
+{
+	JsonPut(cursor, key, key_length);
+	JsonPutInt(cursor, value);
+}
+
+#define JSON_FIELD(cursor, key, value)	JsonPutField((cursor), ",\"" key "\":", sizeof(",\"" key "\":") - 1, (value))
+
+// Appends text as a JSON string, sysfs strings are short and rarely need escaping.
+static void JsonPutString(JsonCursor * cursor, const char * text, size_t length)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	JsonPut(cursor, "\"", 1);
+
+	for (size_t i = 0; i < length; i++)
+	{
+		unsigned char c = (unsigned char)text[i];
+
+		if ((c == '"') || (c == '\\'))
+		{
+			char escaped[2] = { '\\', (char)c };
+			JsonPut(cursor, escaped, sizeof(escaped));
+		}
+		else if (c < 0x20)
+		{
+			char escaped[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+			JsonPut(cursor, escaped, sizeof(escaped));
+		}
+		else
+		{
+			JsonPut(cursor, (const char *)&c, 1);
+		}
+	}
+
+	JsonPut(cursor, "\"", 1);
+}
+
+static size_t JsonFormat(char * line, size_t size, unsigned int supply, const BatterySample * sample)
+{
+	JsonCursor cursor = { line, line + size, false };
+
+	JsonPut(&cursor, "{\"t_ns\":", 8);
+	JsonPutInt(&cursor, sample->t_ns);
+	JSON_FIELD(&cursor, "supply", supply);
+
+	if (sample->fields & BATTERY_FIELD_CURRENT)
+	{
+		JSON_FIELD(&cursor, "current", sample->current);
+	}
+
+	if (sample->fields & BATTERY_FIELD_VOLTAGE)
+	{
+		JSON_FIELD(&cursor, "voltage", sample->voltage);
+	}
+
+	if (sample->fields & BATTERY_FIELD_TEMP)
+	{
+		JSON_FIELD(&cursor, "temp", sample->temp);
+	}
+
+	if (sample->fields & BATTERY_FIELD_LEVEL)
+	{
+		JSON_FIELD(&cursor, "level", sample->level);
+	}
+
+	if (sample->fields & BATTERY_FIELD_HEALTH)
+	{
+		JsonPut(&cursor, ",\"health\":", 10);
+		JsonPutString(&cursor, sample->health, strnlen(sample->health, BATTERY_HEALTH_LEN));
+	}
+
+	if (sample->fields & BATTERY_FIELD_IN_DOCK)
+	{
+		JSON_FIELD(&cursor, "in_dock", sample->in_dock);
+	}
+
+	if (sample->fields & BATTERY_FIELD_CHARGING)
+	{
+		JSON_FIELD(&cursor, "charging", sample->charging);
+	}
+
+	if (sample->fields & BATTERY_FIELD_GPIO)
+	{
+		JSON_FIELD(&cursor, "gpio", sample->gpio);
+		JSON_FIELD(&cursor, "gpio_table", sample->gpio_table);
+	}
+
+	JsonPut(&cursor, "}\n", 2);
+
+	return cursor.full ? 0 : (size_t)(cursor.pos - line);
+}
+
+int JsonLines_Open(const char * path)
+{
+	int fd;
+
+	if (strcmp(path, JSONL_STDOUT) == 0)
+	{
+		// Everything else printed goes to stderr, the stream keeps the real stdout.
+		fflush(stdout);
+
+		if (((fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, STDERR_FILENO + 1)) < 0) ||
+			(dup2(STDERR_FILENO, STDOUT_FILENO) < 0))
+		{
+			DBGPRT(DBG_ERR, "JsonLines_Open: Failed to take stdout, %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	else if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+	{
+		DBGPRT(DBG_ERR, "JsonLines_Open: Failed to create %s, %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	pthread_mutex_lock(&jsonl_lock);
+	jsonl_fd = fd;
+	memset(&jsonl_stats, 0, sizeof(jsonl_stats));
+	pthread_mutex_unlock(&jsonl_lock);
+
+	DBGPRT(DBG_INFO1, "JsonLines_Open: streaming samples to %s\n", path);
+
+	return 0;
+}
+
+int JsonLines_Write(unsigned int supply, const BatterySample * sample)
+{
+	int result = 0;
+
+	pthread_mutex_lock(&jsonl_lock);
+
+	size_t length = JsonFormat(jsonl_line, sizeof(jsonl_line), supply, sample);
+	size_t done = 0;
+	int64_t start = JsonNowNs();
+
+	// A pipe or file takes the whole line at once, the loop is for signals.
+	while ((jsonl_fd >= 0) && (done < length))
+	{
+		ssize_t written = write(jsonl_fd, jsonl_line + done, length - done);
+
+		if (written > 0)
+		{
+			done += (size_t)written;
+		}
+		else if ((written < 0) && (errno != EINTR))
+		{
+			if (jsonl_stats.dropped == 0)
+			{
+				DBGPRT(DBG_ERR, "JsonLines_Write: Failed to write, %s\n", strerror(errno));
+			}
+			break;
+		}
+	}
+
+	uint32_t write_us = (uint32_t)((JsonNowNs() - start) / 1000);
+
+	if (write_us > jsonl_stats.write_max_us)
+	{
+		jsonl_stats.write_max_us = write_us;
+	}
+
+	jsonl_stats.bytes += done;
+
+	if ((length > 0) && (done == length))
+	{
+		jsonl_stats.records++;
+	}
+	else
+	{
+		jsonl_stats.dropped++;
+		result = -1;
+	}
+
+	pthread_mutex_unlock(&jsonl_lock);
+
+	return result;
+}
+
+void JsonLines_Close(void)
+{
+	pthread_mutex_lock(&jsonl_lock);
+
+	if (jsonl_fd >= 0)
+	{
+		close(jsonl_fd);
+		jsonl_fd = -1;
+	}
+
+	pthread_mutex_unlock(&jsonl_lock);
+}
+
+void JsonLines_GetStats(JsonLinesStats * stats)
+{
+	pthread_mutex_lock(&jsonl_lock);
+	*stats = jsonl_stats;
+	pthread_mutex_unlock(&jsonl_lock);
+}
@@ -0,0 +1,81 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - JsonLines
+ *  Source Filename  - JsonLines.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Streams battery samples as JSON Lines, one object per
+ *  				   sample, for the headless mode. Each line is formatted
+ *  				   into a preallocated buffer and written with one write().
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "Battery.hpp"
+
+// Path that selects stdout, the log is moved to stderr so the stream stays clean.
+#define JSONL_STDOUT			"-"
+
+// Longest line, a health string of control characters escaped included.
+#define JSONL_LINE_LEN			(384)
+
+/*
+ * One line per sample, only the fields the sample has, in the units of
+ * BatterySample:
+ *
+ *   {"t_ns":123,"supply":0,"current":-512,"voltage":385,"temp":251,
+ *    "level":80,"health":"Good","in_dock":1,"charging":0,"gpio":3,
+ *    "gpio_table":2923764441}
+ *
+ * gpio_table is the GpioTable_Hash of the table the gpio bits index.
+ */
+
+typedef struct
+{
+	uint64_t records;				// lines written whole
+	uint64_t bytes;
+	uint64_t dropped;				// lines lost to a write error
+	uint32_t write_max_us;			// slowest write()
+} JsonLinesStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * JsonLines_Open
+ * creates path, or takes stdout for JSONL_STDOUT. Call it before anything
+ * logs, the log goes to stderr from then on when stdout is taken.
+ */
+int JsonLines_Open(const char * path);
+
+/**
+ * JsonLines_Write
+ * writes one line for sample. Safe from any thread.
+ * returns 0, or -1 if the line was dropped.
+ */
+int JsonLines_Write(unsigned int supply, const BatterySample * sample);
+
+/**
+ * JsonLines_Close
+ * closes the stream, later writes are dropped.
+ */
+void JsonLines_Close(void);
+
+/**
+ * JsonLines_GetStats
+ * copies the stream counters.
+ */
+void JsonLines_GetStats(JsonLinesStats * stats);
+
+#ifdef __cplusplus
+}
+#endif
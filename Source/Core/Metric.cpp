@@ -0,0 +1,271 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Metric
+ *  Source Filename  - Metric.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Metrics are set from the reactor thread, but observers
+ *  				   and readers may come from others, so the table is
+ *  				   locked. Observers run outside the lock so they can take
+ *  				   the LVGL lock or read other metrics.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <charconv>
+
+#include "Metric.h"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+typedef struct
+{
+	const char * unit;
+	unsigned int decimals;			// value is in 10^-decimals of the unit
+} MetricUnit;
+
+typedef struct
+{
+	Metric metric;
+	unsigned int observer_count;
+	MetricObserver observers[METRIC_MAX_OBSERVERS];
+	void * observer_args[METRIC_MAX_OBSERVERS];
+} MetricEntry;
+
+static pthread_mutex_t metric_lock = PTHREAD_MUTEX_INITIALIZER;
+static MetricEntry metric_entries[METRIC_COUNT];
+static uint64_t metric_sets = 0;
+static uint64_t metric_changes = 0;
+
+static const MetricUnit metric_units[METRIC_COUNT] =
+{
+	{ " mA", 0 },					// METRIC_CURRENT
+	{ " V",  2 },					// METRIC_VOLTAGE
+	{ "",    0 },					// METRIC_HEALTH
+	{ " ºC", 1 },					// METRIC_TEMP
+	{ "%",   0 },					// METRIC_LEVEL
+	{ "",    0 },					// METRIC_IN_DOCK
+	{ "",    0 },					// METRIC_CHARGING
+	{ "",    0 },					// METRIC_BRIGHTNESS
+};
+
+// Appends text at *next, stopping at last. Returns false once it is full.
+static bool FormatText(char ** next, char * last, const char * text)
+{
+	while ((*text != '\0') && (*next < last))
+	{
+		*(*next)++ = *text++;
+	}
+
+	return (*text == '\0');
+}
+
+// Appends value / 10^decimals with the fraction zero padded, 1234 with two
+// decimals is "12.34" and -5 with one is "-0.5".
+static bool FormatFixed(char ** next, char * last, int32_t value, unsigned int decimals)
+{
+	int64_t magnitude = (value < 0) ? -(int64_t)value : value;
+	int64_t scale = 1;
+	char fraction[12];
+
+	for (unsigned int i = 0; i < decimals; i++)
+	{
+		scale *= 10;
+	}
+
+	if ((value < 0) && !FormatText(next, last, "-"))
+	{
+		return false;
+	}
+
+	std::to_chars_result result = std::to_chars(*next, last, magnitude / scale);
+
+	if (result.ec != std::errc())
+	{
+		return false;
+	}
+
+	*next = result.ptr;
+
+	if (decimals == 0)
+	{
+		return true;
+	}
+
+	// Leading 1 keeps the zeros, it is skipped when copying.
+	result = std::to_chars(fraction, fraction + sizeof(fraction) - 1, scale + (magnitude % scale));
+	*result.ptr = '\0';
+
+	return FormatText(next, last, ".") && FormatText(next, last, &fraction[1]);
+}
+
+// Called with metric_lock held, returns it unlocked.
+static void MetricUpdate(MetricId id, const Metric * metric)
+{
+	MetricEntry * entry = &metric_entries[id];
+	MetricObserver observers[METRIC_MAX_OBSERVERS];
+	void * args[METRIC_MAX_OBSERVERS];
+	unsigned int count = 0;
+
+	metric_sets++;
+
+	if (!entry->metric.known ||
+		(entry->metric.value != metric->value) ||
+		(entry->metric.level != metric->level) ||
+		(strcmp(entry->metric.text, metric->text) != 0))
+	{
+		entry->metric = *metric;
+		metric_changes++;
+
+		count = entry->observer_count;
+		memcpy(observers, entry->observers, count * sizeof(MetricObserver));
+		memcpy(args, entry->observer_args, count * sizeof(void *));
+	}
+
+	pthread_mutex_unlock(&metric_lock);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		observers[i](args[i], id, metric);
+	}
+}
+
+int Metric_Subscribe(MetricId id, MetricObserver observer, void * arg)
+{
+	Metric metric;
+
+	if ((id >= METRIC_COUNT) || (observer == NULL))
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&metric_lock);
+
+	MetricEntry * entry = &metric_entries[id];
+
+	if (entry->observer_count >= METRIC_MAX_OBSERVERS)
+	{
+		pthread_mutex_unlock(&metric_lock);
+		DBGPRT(DBG_ERR, "Metric_Subscribe: metric %d has %d observers\n", id, METRIC_MAX_OBSERVERS);
+		return -1;
+	}
+
+	entry->observers[entry->observer_count]     = observer;
+	entry->observer_args[entry->observer_count] = arg;
+	entry->observer_count++;
+	metric = entry->metric;
+
+	pthread_mutex_unlock(&metric_lock);
+
+	if (metric.known)
+	{
+		observer(arg, id, &metric);
+	}
+
+	return 0;
+}
+
+void Metric_Set(MetricId id, int32_t value, MetricLevel level)
+{
+	Metric metric;
+
+	if (id >= METRIC_COUNT)
+	{
+		return;
+	}
+
+	memset(&metric, 0, sizeof(metric));
+	metric.known = true;
+	metric.value = value;
+	metric.level = level;
+
+	pthread_mutex_lock(&metric_lock);
+	MetricUpdate(id, &metric);
+}
+
+void Metric_SetText(MetricId id, const char * text, MetricLevel level)
+{
+	Metric metric;
+
+	if (id >= METRIC_COUNT)
+	{
+		return;
+	}
+
+	memset(&metric, 0, sizeof(metric));
+	metric.known = true;
+	metric.level = level;
+	snprintf(metric.text, sizeof(metric.text), "%s", text);
+
+	pthread_mutex_lock(&metric_lock);
+	MetricUpdate(id, &metric);
+}
+
+void Metric_Get(MetricId id, Metric * metric)
+{
+	if (id >= METRIC_COUNT)
+	{
+		memset(metric, 0, sizeof(*metric));
+		return;
+	}
+
+	pthread_mutex_lock(&metric_lock);
+	*metric = metric_entries[id].metric;
+	pthread_mutex_unlock(&metric_lock);
+}
+
+size_t Metric_Format(MetricId id, const Metric * metric, char * text, size_t size)
+{
+	if ((text == NULL) || (size == 0))
+	{
+		return 0;
+	}
+
+	char * next = text;
+	char * last = text + size - 1;
+
+	if (id >= METRIC_COUNT)
+	{
+		*text = '\0';
+		return 0;
+	}
+
+	switch (id)
+	{
+	case METRIC_HEALTH:
+		FormatText(&next, last, metric->text);
+		break;
+	case METRIC_IN_DOCK:
+	case METRIC_CHARGING:
+		FormatText(&next, last, (metric->value == 1) ? "TRUE" : "FALSE");
+		break;
+	default:
+		if (FormatFixed(&next, last, metric->value, metric_units[id].decimals))
+		{
+			FormatText(&next, last, metric_units[id].unit);
+		}
+		break;
+	}
+
+	*next = '\0';
+
+	return (size_t)(next - text);
+}
+
+void Metric_GetStats(MetricStats * stats)
+{
+	pthread_mutex_lock(&metric_lock);
+	stats->sets    = metric_sets;
+	stats->changes = metric_changes;
+	pthread_mutex_unlock(&metric_lock);
+}
@@ -0,0 +1,108 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Metric
+ *  Source Filename  - Metric.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The values the app shows, each with its classification.
+ *  				   Producers set every sample, observers only hear about
+ *  				   samples that changed the value, text or level.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define METRIC_TEXT_LEN			(16)
+#define METRIC_MAX_OBSERVERS	(4)
+
+typedef enum
+{
+	METRIC_CURRENT,					// mA
+	METRIC_VOLTAGE,					// 10 mV
+	METRIC_HEALTH,					// text only
+	METRIC_TEMP,					// 0.1 C
+	METRIC_LEVEL,					// %
+	METRIC_IN_DOCK,					// 1 in the dock
+	METRIC_CHARGING,				// 1 charging
+	METRIC_BRIGHTNESS,				// backlight level
+	METRIC_COUNT
+} MetricId;
+
+typedef enum
+{
+	METRIC_LEVEL_NONE,				// not classified
+	METRIC_LEVEL_GOOD,
+	METRIC_LEVEL_WARN,
+	METRIC_LEVEL_BAD,
+} MetricLevel;
+
+typedef struct
+{
+	bool known;						// set at least once
+	int32_t value;
+	char text[METRIC_TEXT_LEN];		// for metrics that are not numbers
+	MetricLevel level;
+} Metric;
+
+// Runs on the thread that set the metric, after it changed.
+typedef void (*MetricObserver)(void * arg, MetricId id, const Metric * metric);
+
+typedef struct
+{
+	uint64_t sets;					// samples given to Metric_Set*
+	uint64_t changes;				// samples that notified observers
+} MetricStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Metric_Subscribe
+ * adds an observer of id. It is called at once if id is already known.
+ */
+int Metric_Subscribe(MetricId id, MetricObserver observer, void * arg);
+
+/**
+ * Metric_Set
+ * sets a numeric metric and tells the observers if it changed.
+ */
+void Metric_Set(MetricId id, int32_t value, MetricLevel level);
+
+/**
+ * Metric_SetText
+ * sets a text metric and tells the observers if it changed.
+ */
+void Metric_SetText(MetricId id, const char * text, MetricLevel level);
+
+/**
+ * Metric_Get
+ * copies the current state of id.
+ */
+void Metric_Get(MetricId id, Metric * metric);
+
+/**
+ * Metric_Format
+ * writes metric as the screen shows it, in the units of id, without
+ * allocating. The text is cut short if size is too small.
+ * returns the length written, not counting the terminator.
+ */
+size_t Metric_Format(MetricId id, const Metric * metric, char * text, size_t size);
+
+/**
+ * Metric_GetStats
+ * copies the set and change counters.
+ */
+void Metric_GetStats(MetricStats * stats);
+
+#ifdef __cplusplus
+}
+#endif
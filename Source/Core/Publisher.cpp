@@ -0,0 +1,395 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Publisher
+ *  Source Filename  - Publisher.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The listener and every client are coroutines waiting on
+ *  				   their socket. A changed sample is encoded into one shared
+ *  				   record that each due client is sent with a non-blocking
+ *  				   send.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "Publisher.h"
+#include "Coroutine.h"
+#include "BatteryRecord.hpp"
+#include "BatterySubscribe.hpp"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+typedef struct
+{
+	int fd;							// -1 for a free slot
+	pid_t pid;
+	uint32_t fields;				// subscribed BatteryField mask, 0 until subscribed
+	int64_t min_interval_ns;
+	int64_t last_sent_ns;
+	uint32_t pending;				// subscribed fields changed since the last record sent
+	uint64_t sent;
+	uint64_t dropped;
+	void * task;					// its PublisherClientLoop frame, suspended while fd is open
+} PublisherClient;
+
+static PublisherClient publisher_clients[PUBLISHER_MAX_CLIENTS];
+static int publisher_listen_fd = -1;
+static void * publisher_accept_task = NULL;
+static struct sockaddr_un publisher_addr;
+static BatterySample publisher_last;
+static uint8_t publisher_record[PUBLISHER_RECORD_LEN];
+static size_t publisher_record_len = 0;
+static PublisherStats publisher_stats;
+
+static int64_t PublisherNowNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((int64_t)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+// BatteryField mask of what differs between two samples, t_ns aside.
+static uint32_t PublisherChanges(const BatterySample * old_sample, const BatterySample * new_sample)
+{
+	uint32_t fields = new_sample->fields;
+	uint32_t changed = old_sample->fields ^ fields;
+
+	if ((fields & BATTERY_FIELD_CURRENT) && (old_sample->current != new_sample->current))
+	{
+		changed |= BATTERY_FIELD_CURRENT;
+	}
+
+	if ((fields & BATTERY_FIELD_VOLTAGE) && (old_sample->voltage != new_sample->voltage))
+	{
+		changed |= BATTERY_FIELD_VOLTAGE;
+	}
+
+	if ((fields & BATTERY_FIELD_TEMP) && (old_sample->temp != new_sample->temp))
+	{
+		changed |= BATTERY_FIELD_TEMP;
+	}
+
+	if ((fields & BATTERY_FIELD_LEVEL) && (old_sample->level != new_sample->level))
+	{
+		changed |= BATTERY_FIELD_LEVEL;
+	}
+
+	if ((fields & BATTERY_FIELD_HEALTH) && (strncmp(old_sample->health, new_sample->health, BATTERY_HEALTH_LEN) != 0))
+	{
+		changed |= BATTERY_FIELD_HEALTH;
+	}
+
+	if ((fields & BATTERY_FIELD_IN_DOCK) && (old_sample->in_dock != new_sample->in_dock))
+	{
+		changed |= BATTERY_FIELD_IN_DOCK;
+	}
+
+	if ((fields & BATTERY_FIELD_CHARGING) && (old_sample->charging != new_sample->charging))
+	{
+		changed |= BATTERY_FIELD_CHARGING;
+	}
+
+	if ((fields & BATTERY_FIELD_GPIO) &&
+		((old_sample->gpio != new_sample->gpio) || (old_sample->gpio_table != new_sample->gpio_table)))
+	{
+		changed |= BATTERY_FIELD_GPIO;
+	}
+
+	return changed;
+}
+
+static void PublisherSend(PublisherClient * client, int64_t now)
+{
+	ssize_t length = send(client->fd, publisher_record, publisher_record_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+	if (length == (ssize_t)publisher_record_len)
+	{
+		client->pending      = 0;
+		client->last_sent_ns = now;
+		client->sent++;
+		publisher_stats.sent++;
+	}
+	else if ((length < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS)))
+	{
+		// Still pending, the next snapshot replaces this one.
+		client->dropped++;
+		publisher_stats.dropped++;
+	}
+	else
+	{
+		// The client's loop sees the end of the stream and closes it.
+		DBGPRT(DBG_ERR, "PublisherSend: pid %d, %s\n", (int)client->pid, strerror(errno));
+		client->fields  = 0;
+		client->pending = 0;
+		shutdown(client->fd, SHUT_RDWR);
+	}
+}
+
+static int PublisherSubscribe(PublisherClient * client, const uint8_t * request, ssize_t length)
+{
+	if (length != BATTERY_SUBSCRIBE_SIZE)
+	{
+		DBGPRT(DBG_ERR, "PublisherSubscribe: pid %d sent %zd bytes\n", (int)client->pid, length);
+		return -1;
+	}
+
+	uint32_t magic    = BatteryRecord_Load32(request + BATTERY_SUBSCRIBE_OFF_MAGIC);
+	uint32_t fields   = BatteryRecord_Load32(request + BATTERY_SUBSCRIBE_OFF_FIELDS);
+	uint32_t interval = BatteryRecord_Load32(request + BATTERY_SUBSCRIBE_OFF_INTERVAL);
+
+	if ((magic != BATTERY_SUBSCRIBE_MAGIC) || (fields == 0) || ((fields & ~(uint32_t)BATTERY_FIELD_ALL) != 0))
+	{
+		DBGPRT(DBG_ERR, "PublisherSubscribe: pid %d sent magic 0x%08x fields 0x%x\n", (int)client->pid, magic, fields);
+		return -1;
+	}
+
+	client->fields          = fields;
+	client->min_interval_ns = (int64_t)interval * 1000000LL;
+	client->last_sent_ns    = 0;
+	client->pending         = fields;
+
+	DBGPRT(DBG_INFO2, "PublisherSubscribe: pid %d fields 0x%x every %u ms at most\n", (int)client->pid, fields, interval);
+
+	return 0;
+}
+
+// Reads the client's requests until it hangs up or sends a bad one.
+static CoTask PublisherClientLoop(PublisherClient * client)
+{
+	uint8_t request[BATTERY_SUBSCRIBE_SIZE + 1];
+
+	while (co_await Co_Readable(client->fd) == 0)
+	{
+		ssize_t length = recv(client->fd, request, sizeof(request), MSG_DONTWAIT);
+
+		if ((length < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+		{
+			continue;
+		}
+
+		if ((length <= 0) || (PublisherSubscribe(client, request, length) != 0))
+		{
+			break;
+		}
+	}
+
+	DBGPRT(DBG_INFO1, "PublisherClientLoop: pid %d left, %llu sent, %llu dropped\n",
+			(int)client->pid, (unsigned long long)client->sent, (unsigned long long)client->dropped);
+
+	close(client->fd);
+	client->fd = -1;
+	publisher_stats.clients--;
+}
+
+static PublisherClient * PublisherAccept(int fd)
+{
+	PublisherClient * client = NULL;
+	struct ucred cred;
+	socklen_t cred_len = sizeof(cred);
+
+	for (int i = 0; (i < PUBLISHER_MAX_CLIENTS) && (client == NULL); i++)
+	{
+		if (publisher_clients[i].fd < 0)
+		{
+			client = &publisher_clients[i];
+		}
+	}
+
+	if (client == NULL)
+	{
+		DBGPRT(DBG_ERR, "PublisherAccept: %d clients already, refused\n", PUBLISHER_MAX_CLIENTS);
+		close(fd);
+		return NULL;
+	}
+
+	memset(client, 0, sizeof(*client));
+	client->fd  = fd;
+	client->pid = (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0) ? cred.pid : -1;
+	publisher_stats.clients++;
+
+	DBGPRT(DBG_INFO1, "PublisherAccept: pid %d connected\n", (int)client->pid);
+
+	return client;
+}
+
+static CoTask PublisherAcceptLoop(int listen_fd)
+{
+	while (co_await Co_Readable(listen_fd) == 0)
+	{
+		int fd;
+
+		while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+		{
+			PublisherClient * client = PublisherAccept(fd);
+
+			if (client != NULL)
+			{
+				CoTask task = PublisherClientLoop(client);
+
+				client->task = task.handle.address();
+				Co_Spawn(task);
+			}
+		}
+	}
+
+	close(listen_fd);
+	publisher_listen_fd = -1;
+}
+
+int Publisher_Start(const char * path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		DBGPRT(DBG_ERR, "Publisher_Start: %s is too long for a socket path\n", path);
+		return -1;
+	}
+
+	for (int i = 0; i < PUBLISHER_MAX_CLIENTS; i++)
+	{
+		publisher_clients[i].fd = -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+	{
+		DBGPRT(DBG_ERR, "Publisher_Start: socket failed, %s\n", strerror(errno));
+		return -1;
+	}
+
+	unlink(path);
+
+	// The analyzer and the updater run as other users.
+	if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (chmod(path, 0666) != 0) ||
+		(listen(fd, PUBLISHER_MAX_CLIENTS) != 0))
+	{
+		DBGPRT(DBG_ERR, "Publisher_Start: Failed to listen on %s, %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	CoTask task = PublisherAcceptLoop(fd);
+
+	publisher_addr        = addr;
+	publisher_listen_fd   = fd;
+	publisher_accept_task = task.handle.address();
+	Co_Spawn(task);
+
+	DBGPRT(DBG_INFO1, "Publisher_Start: serving snapshots on %s\n", path);
+
+	return 0;
+}
+
+uint32_t Publisher_Clients(void)
+{
+	return publisher_stats.clients;
+}
+
+void Publisher_Publish(const BatterySample * sample)
+{
+	if (publisher_stats.clients == 0)
+	{
+		return;
+	}
+
+	int64_t now = PublisherNowNs();
+	uint32_t changed = PublisherChanges(&publisher_last, sample);
+
+	if ((changed != 0) || (publisher_record_len == 0))
+	{
+		int length = BatteryRecord_Encode(sample, publisher_record, sizeof(publisher_record));
+
+		if (length < 0)
+		{
+			DBGPRT(DBG_ERR, "Publisher_Publish: Failed to encode the snapshot\n");
+			return;
+		}
+
+		publisher_record_len = (size_t)length;
+		publisher_last       = *sample;
+		publisher_stats.snapshots++;
+	}
+
+	for (int i = 0; i < PUBLISHER_MAX_CLIENTS; i++)
+	{
+		PublisherClient * client = &publisher_clients[i];
+
+		if (client->fd < 0)
+		{
+			continue;
+		}
+
+		client->pending |= changed & client->fields;
+
+		// Changes inside the interval wait for a later snapshot.
+		if ((client->pending != 0) && ((now - client->last_sent_ns) >= client->min_interval_ns))
+		{
+			PublisherSend(client, now);
+		}
+	}
+}
+
+void Publisher_Stop(void)
+{
+	if (publisher_addr.sun_path[0] == '\0')
+	{
+		return;
+	}
+
+	// Each task is suspended on its socket, closing it drops the wait.
+	for (int i = 0; i < PUBLISHER_MAX_CLIENTS; i++)
+	{
+		PublisherClient * client = &publisher_clients[i];
+
+		if (client->fd >= 0)
+		{
+			close(client->fd);
+			client->fd = -1;
+			std::coroutine_handle<>::from_address(client->task).destroy();
+		}
+	}
+
+	if (publisher_listen_fd >= 0)
+	{
+		close(publisher_listen_fd);
+		publisher_listen_fd = -1;
+		std::coroutine_handle<>::from_address(publisher_accept_task).destroy();
+	}
+
+	publisher_stats.clients = 0;
+
+	unlink(publisher_addr.sun_path);
+	publisher_addr.sun_path[0] = '\0';
+
+	DBGPRT(DBG_INFO1, "Publisher_Stop: %llu snapshots, %llu records sent, %llu dropped\n",
+			(unsigned long long)publisher_stats.snapshots, (unsigned long long)publisher_stats.sent,
+			(unsigned long long)publisher_stats.dropped);
+}
+
+void Publisher_GetStats(PublisherStats * stats)
+{
+	*stats = publisher_stats;
+}
@@ -0,0 +1,74 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Publisher
+ *  Source Filename  - Publisher.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Serves battery snapshots to the subscribers of the
+ *  				   BatterySubscribe.hpp socket. Runs on the reactor thread.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "Battery.hpp"
+
+#define PUBLISHER_MAX_CLIENTS		(8)
+#define PUBLISHER_RECORD_LEN		(64)	// fixed part and the GPIO extension
+
+typedef struct
+{
+	uint32_t clients;
+	uint64_t snapshots;				// changed samples, each encoded once
+	uint64_t sent;					// records across all clients
+	uint64_t dropped;				// records a full client socket refused
+} PublisherStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Publisher_Start
+ * listens on path, replacing a socket left by an earlier run. Call it after
+ * Co_Init, from the reactor thread or before Reactor_Run.
+ */
+int Publisher_Start(const char * path);
+
+/**
+ * Publisher_Clients
+ * number of connected clients, samples need not be read for none.
+ */
+uint32_t Publisher_Clients(void);
+
+/**
+ * Publisher_Publish
+ * encodes sample once if it changed and sends it to every client due one.
+ * A client whose socket is full misses it and is counted as a drop, it gets
+ * a later one instead. Never blocks.
+ */
+void Publisher_Publish(const BatterySample * sample);
+
+/**
+ * Publisher_Stop
+ * closes the clients and the listening socket and removes its path. Call it
+ * once Reactor_Run has returned.
+ */
+void Publisher_Stop(void);
+
+/**
+ * Publisher_GetStats
+ * copies the counters, call it from the reactor thread.
+ */
+void Publisher_GetStats(PublisherStats * stats);
+
+#ifdef __cplusplus
+}
+#endif
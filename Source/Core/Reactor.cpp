@@ -0,0 +1,384 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Reactor
+ *  Source Filename  - Reactor.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Sources are added and removed before Reactor_Run or from
+ *  				   its own callbacks, so the source table needs no lock.
+ *  				   Only the post queue is shared with other threads.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <atomic>
+
+#include "Reactor.h"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+#define REACTOR_ID_POST		(0xFFFFFFFFu)
+
+typedef struct
+{
+	int fd;
+	bool timer;								// fd is a timerfd owned by the reactor
+	ReactorCallback callback;
+	void * arg;
+} ReactorSource;
+
+typedef struct
+{
+	ReactorCallback callback;
+	void * arg;
+} ReactorPost;
+
+static int reactor_epoll_fd = -1;
+static int reactor_post_fd = -1;
+static ReactorSource reactor_sources[REACTOR_MAX_SOURCES];
+static unsigned int reactor_source_count = 0;		// slots ever used, removed ones have no callback
+static unsigned int reactor_source_used = 0;
+static std::atomic<bool> reactor_stop(false);
+
+static pthread_mutex_t reactor_post_lock = PTHREAD_MUTEX_INITIALIZER;
+static ReactorPost reactor_posts[REACTOR_MAX_POSTS];
+static unsigned int reactor_post_head = 0;
+static unsigned int reactor_post_count = 0;
+
+static uint64_t reactor_wakeups = 0;
+static uint64_t reactor_timer_runs = 0;
+static uint64_t reactor_timer_missed = 0;
+static uint64_t reactor_fd_runs = 0;
+static uint64_t reactor_post_runs = 0;
+static std::atomic<uint64_t> reactor_posts_dropped(0);
+
+static void ReactorWake(void)
+{
+	uint64_t one = 1;
+
+	if ((write(reactor_post_fd, &one, sizeof(one)) != sizeof(one)) && (errno != EAGAIN))
+	{
+		DBGPRT(DBG_ERR, "ReactorWake: write failed, %s\n", strerror(errno));
+	}
+}
+
+static int ReactorAdd(int fd, bool timer, ReactorCallback callback, void * arg)
+{
+	struct epoll_event event;
+
+	unsigned int id = 0;
+
+	// A removed source's slot is taken first.
+	while ((id < reactor_source_count) && (reactor_sources[id].callback != NULL))
+	{
+		id++;
+	}
+
+	if ((reactor_epoll_fd < 0) || (fd < 0) || (callback == NULL) || (id >= REACTOR_MAX_SOURCES))
+	{
+		DBGPRT(DBG_ERR, "ReactorAdd: no room for fd %d\n", fd);
+		return -1;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events   = EPOLLIN;
+	event.data.u32 = (uint32_t)id;
+
+	if (epoll_ctl(reactor_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+	{
+		DBGPRT(DBG_ERR, "ReactorAdd: Failed to watch fd %d, %s\n", fd, strerror(errno));
+		return -1;
+	}
+
+	reactor_sources[id].fd       = fd;
+	reactor_sources[id].timer    = timer;
+	reactor_sources[id].callback = callback;
+	reactor_sources[id].arg      = arg;
+
+	if (id == reactor_source_count)
+	{
+		reactor_source_count++;
+	}
+
+	reactor_source_used++;
+
+	return (int)id;
+}
+
+// Runs what was queued when the eventfd fired, later posts wake the loop again.
+static void ReactorRunPosts(void)
+{
+	uint64_t count;
+
+	if (read(reactor_post_fd, &count, sizeof(count)) < 0)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&reactor_post_lock);
+	unsigned int pending = reactor_post_count;
+	pthread_mutex_unlock(&reactor_post_lock);
+
+	while (pending-- > 0)
+	{
+		pthread_mutex_lock(&reactor_post_lock);
+		ReactorPost post = reactor_posts[reactor_post_head];
+		reactor_post_head = (reactor_post_head + 1) % REACTOR_MAX_POSTS;
+		reactor_post_count--;
+		pthread_mutex_unlock(&reactor_post_lock);
+
+		post.callback(post.arg);
+		reactor_post_runs++;
+	}
+}
+
+static void ReactorRunSource(ReactorSource * source)
+{
+	// Removed by an earlier callback of the same wakeup.
+	if (source->callback == NULL)
+	{
+		return;
+	}
+
+	if (source->timer)
+	{
+		uint64_t expirations;
+
+		if (read(source->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+		{
+			return;
+		}
+
+		// A late task runs once, not once per missed period.
+		reactor_timer_missed += expirations - 1;
+		reactor_timer_runs++;
+	}
+	else
+	{
+		reactor_fd_runs++;
+	}
+
+	source->callback(source->arg);
+}
+
+int Reactor_Init(void)
+{
+	if (reactor_epoll_fd >= 0)
+	{
+		return 0;
+	}
+
+	if (((reactor_epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) ||
+		((reactor_post_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0))
+	{
+		DBGPRT(DBG_ERR, "Reactor_Init: Failed to create fds, %s\n", strerror(errno));
+		return -1;
+	}
+
+	struct epoll_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.events   = EPOLLIN;
+	event.data.u32 = REACTOR_ID_POST;
+
+	if (epoll_ctl(reactor_epoll_fd, EPOLL_CTL_ADD, reactor_post_fd, &event) != 0)
+	{
+		DBGPRT(DBG_ERR, "Reactor_Init: Failed to watch the post fd, %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+int Reactor_AddTimer(unsigned int period_ms, ReactorCallback callback, void * arg)
+{
+	struct itimerspec spec;
+	int fd;
+
+	if ((period_ms == 0) || ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) < 0))
+	{
+		DBGPRT(DBG_ERR, "Reactor_AddTimer: Unable to create a %u ms timer\n", period_ms);
+		return -1;
+	}
+
+	memset(&spec, 0, sizeof(spec));
+	spec.it_interval.tv_sec  = period_ms / 1000;
+	spec.it_interval.tv_nsec = (long)(period_ms % 1000) * 1000000L;
+	spec.it_value.tv_nsec    = 1;
+
+	int id = -1;
+
+	if ((timerfd_settime(fd, 0, &spec, NULL) != 0) || ((id = ReactorAdd(fd, true, callback, arg)) < 0))
+	{
+		DBGPRT(DBG_ERR, "Reactor_AddTimer: Failed to arm the %u ms timer\n", period_ms);
+		close(fd);
+	}
+
+	return id;
+}
+
+int Reactor_SetTimer(int id, unsigned int period_ms)
+{
+	struct itimerspec spec;
+
+	if ((id < 0) || ((unsigned int)id >= reactor_source_count) || !reactor_sources[id].timer ||
+		(reactor_sources[id].callback == NULL))
+	{
+		DBGPRT(DBG_ERR, "Reactor_SetTimer: %d is not a timer\n", id);
+		return -1;
+	}
+
+	memset(&spec, 0, sizeof(spec));
+	spec.it_interval.tv_sec  = period_ms / 1000;
+	spec.it_interval.tv_nsec = (long)(period_ms % 1000) * 1000000L;
+	spec.it_value            = spec.it_interval;
+
+	// Setting the timer also drops any expiry not read yet.
+	if (timerfd_settime(reactor_sources[id].fd, 0, &spec, NULL) != 0)
+	{
+		DBGPRT(DBG_ERR, "Reactor_SetTimer: Failed to set timer %d, %s\n", id, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+int Reactor_AddFd(int fd, ReactorCallback callback, void * arg)
+{
+	return ReactorAdd(fd, false, callback, arg);
+}
+
+void Reactor_RemoveFd(int id)
+{
+	if ((id < 0) || ((unsigned int)id >= reactor_source_count) || (reactor_sources[id].callback == NULL))
+	{
+		DBGPRT(DBG_ERR, "Reactor_RemoveFd: %d is not a source\n", id);
+		return;
+	}
+
+	ReactorSource * source = &reactor_sources[id];
+
+	if (epoll_ctl(reactor_epoll_fd, EPOLL_CTL_DEL, source->fd, NULL) != 0)
+	{
+		DBGPRT(DBG_ERR, "Reactor_RemoveFd: Failed to stop watching fd %d, %s\n", source->fd, strerror(errno));
+	}
+
+	if (source->timer)
+	{
+		close(source->fd);
+	}
+
+	source->fd       = -1;
+	source->callback = NULL;
+	source->arg      = NULL;
+	reactor_source_used--;
+}
+
+int Reactor_Post(ReactorCallback callback, void * arg)
+{
+	int result = -1;
+
+	pthread_mutex_lock(&reactor_post_lock);
+
+	if ((callback != NULL) && (reactor_post_fd >= 0) && (reactor_post_count < REACTOR_MAX_POSTS))
+	{
+		unsigned int tail = (reactor_post_head + reactor_post_count) % REACTOR_MAX_POSTS;
+
+		reactor_posts[tail].callback = callback;
+		reactor_posts[tail].arg      = arg;
+		reactor_post_count++;
+		result = 0;
+	}
+
+	pthread_mutex_unlock(&reactor_post_lock);
+
+	if (result == 0)
+	{
+		ReactorWake();
+	}
+	else
+	{
+		reactor_posts_dropped++;
+	}
+
+	return result;
+}
+
+void Reactor_Run(void)
+{
+	struct epoll_event ready[REACTOR_MAX_SOURCES + 1];
+
+	DBGPRT(DBG_INFO1, "Reactor_Run: %u sources\n", reactor_source_used);
+
+	while (!reactor_stop.load())
+	{
+		int count = epoll_wait(reactor_epoll_fd, ready, REACTOR_MAX_SOURCES + 1, -1);
+
+		if (count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			DBGPRT(DBG_ERR, "Reactor_Run: epoll_wait failed, %s\n", strerror(errno));
+			break;
+		}
+
+		reactor_wakeups++;
+
+		for (int i = 0; i < count; i++)
+		{
+			uint32_t id = ready[i].data.u32;
+
+			if (id == REACTOR_ID_POST)
+			{
+				ReactorRunPosts();
+			}
+			else if (id < reactor_source_count)
+			{
+				ReactorRunSource(&reactor_sources[id]);
+			}
+		}
+	}
+
+	reactor_stop.store(false);
+
+	DBGPRT(DBG_INFO1, "Reactor_Run: stopped\n");
+}
+
+void Reactor_Stop(void)
+{
+	reactor_stop.store(true);
+
+	if (reactor_post_fd >= 0)
+	{
+		ReactorWake();
+	}
+}
+
+void Reactor_GetStats(ReactorStats * stats)
+{
+	stats->sources       = reactor_source_used;
+	stats->wakeups       = reactor_wakeups;
+	stats->timer_runs    = reactor_timer_runs;
+	stats->timer_missed  = reactor_timer_missed;
+	stats->fd_runs       = reactor_fd_runs;
+	stats->posts         = reactor_post_runs;
+	stats->posts_dropped = reactor_posts_dropped.load();
+}
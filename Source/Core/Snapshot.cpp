@@ -0,0 +1,159 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Snapshot
+ *  Source Filename  - Snapshot.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Saved from the reactor thread, loaded once at startup
+ *  				   with a single pread of the fixed size file.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+
+#include "Snapshot.h"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+static SnapshotFile snapshot_saved;
+static bool snapshot_saved_valid = false;
+
+// The brightness is a setting, not a battery reading, and is not persisted.
+static bool SnapshotKeeps(unsigned int id)
+{
+	return (id != METRIC_BRIGHTNESS);
+}
+
+int Snapshot_Load(const char * path, Metric * metrics)
+{
+	SnapshotFile file;
+	ssize_t length;
+	int fd;
+
+	memset(metrics, 0, METRIC_COUNT * sizeof(Metric));
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+	{
+		if (errno != ENOENT)
+		{
+			DBGPRT(DBG_ERR, "Snapshot_Load: Failed to open %s, %s\n", path, strerror(errno));
+		}
+
+		return -1;
+	}
+
+	length = pread(fd, &file, sizeof(file), 0);
+	close(fd);
+
+	if ((length != (ssize_t)sizeof(file)) ||
+		(file.header.magic != SNAPSHOT_MAGIC) ||
+		(file.header.version != SNAPSHOT_VERSION) ||
+		(file.header.metric_count != METRIC_COUNT))
+	{
+		DBGPRT(DBG_ERR, "Snapshot_Load: unknown snapshot format in %s\n", path);
+		return -1;
+	}
+
+	for (unsigned int id = 0; id < METRIC_COUNT; id++)
+	{
+		if (SnapshotKeeps(id) && file.values[id].known && (file.values[id].level <= METRIC_LEVEL_BAD))
+		{
+			metrics[id].known = true;
+			metrics[id].value = file.values[id].value;
+			metrics[id].level = (MetricLevel)file.values[id].level;
+		}
+	}
+
+	if (metrics[METRIC_HEALTH].known)
+	{
+		memcpy(metrics[METRIC_HEALTH].text, file.health, METRIC_TEXT_LEN);
+		metrics[METRIC_HEALTH].text[METRIC_TEXT_LEN - 1] = '\0';
+	}
+
+	return 0;
+}
+
+int Snapshot_Save(const char * path)
+{
+	SnapshotFile file;
+	Metric metric;
+	int fd;
+
+	memset(&file, 0, sizeof(file));
+	file.header.magic        = SNAPSHOT_MAGIC;
+	file.header.version      = SNAPSHOT_VERSION;
+	file.header.metric_count = METRIC_COUNT;
+
+	for (unsigned int id = 0; id < METRIC_COUNT; id++)
+	{
+		if (!SnapshotKeeps(id))
+		{
+			continue;
+		}
+
+		Metric_Get((MetricId)id, &metric);
+
+		// Do not replace a full snapshot with one from before the first sample.
+		if (!metric.known)
+		{
+			return 0;
+		}
+
+		file.values[id].value = metric.value;
+		file.values[id].known = 1;
+		file.values[id].level = (uint8_t)metric.level;
+
+		if (id == METRIC_HEALTH)
+		{
+			memcpy(file.health, metric.text, METRIC_TEXT_LEN);
+		}
+	}
+
+	// Flash is only written when a value moved.
+	if (snapshot_saved_valid && (memcmp(&file, &snapshot_saved, sizeof(file)) == 0))
+	{
+		return 0;
+	}
+
+	std::string temp = std::string(path) + ".tmp";
+
+	if ((fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+	{
+		DBGPRT(DBG_ERR, "Snapshot_Save: Failed to open %s, %s\n", temp.c_str(), strerror(errno));
+		return -1;
+	}
+
+	if ((write(fd, &file, sizeof(file)) != (ssize_t)sizeof(file)) || (fsync(fd) != 0))
+	{
+		DBGPRT(DBG_ERR, "Snapshot_Save: Failed to write %s, %s\n", temp.c_str(), strerror(errno));
+		close(fd);
+		unlink(temp.c_str());
+		return -1;
+	}
+
+	close(fd);
+
+	if (rename(temp.c_str(), path) != 0)
+	{
+		DBGPRT(DBG_ERR, "Snapshot_Save: Failed to replace %s, %s\n", path, strerror(errno));
+		unlink(temp.c_str());
+		return -1;
+	}
+
+	snapshot_saved       = file;
+	snapshot_saved_valid = true;
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Snapshot
+ *  Source Filename  - Snapshot.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The last known battery metrics, kept in a small file so
+ *  				   the next start can paint them before the first sample.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "Metric.h"
+
+#define SNAPSHOT_PATH			"/usr/nova/battery_info/snapshot.bin"
+#define SNAPSHOT_MAGIC			(0x50414E53)	// "SNAP"
+#define SNAPSHOT_VERSION		(1)
+#define SNAPSHOT_PERIOD_MS		(30000)
+
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t metric_count;				// METRIC_COUNT of the writer
+} SnapshotHeader;
+
+typedef struct
+{
+	int32_t value;
+	uint8_t known;
+	uint8_t level;						// MetricLevel
+	uint16_t reserved;
+} SnapshotValue;
+
+typedef struct
+{
+	SnapshotHeader header;
+	SnapshotValue values[METRIC_COUNT];
+	char health[METRIC_TEXT_LEN];		// METRIC_HEALTH is the only text metric
+} SnapshotFile;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Snapshot_Load
+ * reads the snapshot at path into metrics, indexed by MetricId. Metrics that
+ * were not known when it was saved are left unknown.
+ * returns 0, or -1 if there is no valid snapshot.
+ */
+int Snapshot_Load(const char * path, Metric * metrics);
+
+/**
+ * Snapshot_Save
+ * writes the current metrics to path once every battery metric is known,
+ * and only when they changed since the last save. The file is replaced
+ * whole so a power cut leaves the old or the new one.
+ * returns 0 if written or unchanged, -1 on error.
+ */
+int Snapshot_Save(const char * path);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,248 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Startup
+ *  Source Filename  - Startup.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The caller of Startup_Run schedules: it starts every
+ *  				   stage whose dependencies are done, then sleeps until a
+ *  				   stage finishes. Stage threads only report back.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "Startup.h"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+typedef enum
+{
+	STAGE_WAITING,
+	STAGE_RUNNING,
+	STAGE_DONE,
+} StageState;
+
+typedef struct
+{
+	const StartupStage * stage;
+	StageState state;
+	int result;
+	int64_t start_us;
+	int64_t end_us;
+	pthread_t tid;
+	unsigned int deps[STARTUP_MAX_DEPS];
+	unsigned int dep_count;
+} StageRun;
+
+static pthread_mutex_t startup_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t startup_cond = PTHREAD_COND_INITIALIZER;
+static int64_t startup_t0_ns = 0;
+static const char * startup_marks[STARTUP_MAX_MARKS];
+static unsigned int startup_mark_count = 0;
+
+static int64_t StartupNowNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((int64_t)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+static void *StageThread(void *arg)
+{
+	StageRun * run = (StageRun *)arg;
+	int result = run->stage->func();
+
+	pthread_mutex_lock(&startup_lock);
+	run->result = result;
+	run->end_us = Startup_Us();
+	run->state  = STAGE_DONE;
+	pthread_cond_signal(&startup_cond);
+	pthread_mutex_unlock(&startup_lock);
+
+	return NULL;
+}
+
+static int FindStage(const StartupStage * stages, unsigned int count, const char * name)
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (strcmp(stages[i].name, name) == 0)
+		{
+			return (int)i;
+		}
+	}
+
+	return -1;
+}
+
+static bool StageReady(const StageRun * runs, const StageRun * run)
+{
+	for (unsigned int d = 0; d < run->dep_count; d++)
+	{
+		if (runs[run->deps[d]].state != STAGE_DONE)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Startup_Init(void)
+{
+	startup_t0_ns = StartupNowNs();
+}
+
+int64_t Startup_Us(void)
+{
+	return (StartupNowNs() - startup_t0_ns) / 1000;
+}
+
+int Startup_Run(const StartupStage * stages, unsigned int count)
+{
+	StageRun runs[STARTUP_MAX_STAGES];
+	unsigned int done = 0;
+	unsigned int running = 0;
+	int failed = 0;
+
+	if (count > STARTUP_MAX_STAGES)
+	{
+		DBGPRT(DBG_ERR, "Startup_Run: %u stages, at most %d\n", count, STARTUP_MAX_STAGES);
+		return -1;
+	}
+
+	memset(runs, 0, sizeof(runs));
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		runs[i].stage = &stages[i];
+
+		for (unsigned int d = 0; (d < STARTUP_MAX_DEPS) && (stages[i].deps[d] != NULL); d++)
+		{
+			int dep = FindStage(stages, count, stages[i].deps[d]);
+
+			if ((dep < 0) || ((unsigned int)dep == i))
+			{
+				DBGPRT(DBG_ERR, "Startup_Run: %s depends on unknown stage %s\n", stages[i].name, stages[i].deps[d]);
+				return -1;
+			}
+
+			runs[i].deps[runs[i].dep_count++] = (unsigned int)dep;
+		}
+	}
+
+	pthread_mutex_lock(&startup_lock);
+
+	while (done < count)
+	{
+		bool progressed;
+
+		// A stage run inline finishes during the scan and may make an earlier
+		// one ready, so scan again until nothing new starts.
+		do
+		{
+			progressed = false;
+
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if ((runs[i].state == STAGE_WAITING) && StageReady(runs, &runs[i]))
+				{
+					runs[i].state    = STAGE_RUNNING;
+					runs[i].start_us = Startup_Us();
+
+					if (pthread_create(&runs[i].tid, NULL, StageThread, &runs[i]) != 0)
+					{
+						DBGPRT(DBG_ERR, "Startup_Run: Failed to start %s, running it inline\n", stages[i].name);
+						pthread_mutex_unlock(&startup_lock);
+						runs[i].result = stages[i].func();
+						pthread_mutex_lock(&startup_lock);
+						runs[i].end_us = Startup_Us();
+						runs[i].state  = STAGE_DONE;
+						runs[i].tid    = 0;
+						done++;
+						progressed = true;
+						continue;
+					}
+
+					running++;
+				}
+			}
+		} while (progressed);
+
+		if (running == 0)
+		{
+			if (done < count)
+			{
+				DBGPRT(DBG_ERR, "Startup_Run: stages depend on each other in a cycle\n");
+				pthread_mutex_unlock(&startup_lock);
+				return -1;
+			}
+
+			break;
+		}
+
+		pthread_cond_wait(&startup_cond, &startup_lock);
+
+		// Collect every stage that finished while this thread slept.
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if ((runs[i].state == STAGE_DONE) && (runs[i].tid != 0))
+			{
+				pthread_join(runs[i].tid, NULL);
+				runs[i].tid = 0;
+				running--;
+				done++;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&startup_lock);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		DBGPRT(DBG_INFO1, "Startup: %-10s %8lld us -> %8lld us (%lld us)%s\n", stages[i].name,
+				(long long)runs[i].start_us, (long long)runs[i].end_us,
+				(long long)(runs[i].end_us - runs[i].start_us), (runs[i].result == 0) ? "" : " FAILED");
+
+		failed += (runs[i].result == 0) ? 0 : 1;
+	}
+
+	return failed;
+}
+
+void Startup_Mark(const char * name)
+{
+	pthread_mutex_lock(&startup_lock);
+
+	for (unsigned int i = 0; i < startup_mark_count; i++)
+	{
+		if (startup_marks[i] == name)
+		{
+			pthread_mutex_unlock(&startup_lock);
+			return;
+		}
+	}
+
+	if (startup_mark_count < STARTUP_MAX_MARKS)
+	{
+		startup_marks[startup_mark_count++] = name;
+	}
+
+	pthread_mutex_unlock(&startup_lock);
+
+	DBGPRT(DBG_INFO1, "Startup: %-10s %8lld us\n", name, (long long)Startup_Us());
+}
@@ -0,0 +1,70 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Startup
+ *  Source Filename  - Startup.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Runs the startup stages of the app as a dependency
+ *  				   graph, every stage on its own thread as soon as the
+ *  				   stages it needs are done, and logs when each one ran.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#define STARTUP_MAX_STAGES		(8)
+#define STARTUP_MAX_DEPS		(4)
+#define STARTUP_MAX_MARKS		(8)
+
+// Returns 0 on success. A failed stage is logged, the stages after it still
+// run as startup always carried on without a subsystem.
+typedef int (*StartupFunc)(void);
+
+typedef struct
+{
+	const char * name;
+	StartupFunc func;
+	const char * deps[STARTUP_MAX_DEPS];	// names of the stages it needs, NULL past the last
+} StartupStage;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Startup_Init
+ * starts the clock every timeline entry is relative to.
+ */
+void Startup_Init(void);
+
+/**
+ * Startup_Run
+ * runs the stages and returns once all have finished.
+ * returns the number of failed stages, or -1 if the graph has a cycle or an
+ * unknown dependency.
+ */
+int Startup_Run(const StartupStage * stages, unsigned int count);
+
+/**
+ * Startup_Mark
+ * logs a milestone such as the first frame, only the first time for name.
+ * name must be a string literal.
+ */
+void Startup_Mark(const char * name);
+
+/**
+ * Startup_Us
+ * microseconds since Startup_Init.
+ */
+int64_t Startup_Us(void);
+
+#ifdef __cplusplus
+}
+#endif
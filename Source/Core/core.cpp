@@ -26,47 +26,47 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <dlfcn.h>
+#include <signal.h>
 #include <gpiod.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <linux/netlink.h>
 
 #include "Audio.h"
 #include "core.h"
+#include "Reactor.h"
+#include "Startup.h"
+#include "Snapshot.h"
+#include "Backlight.h"
+#include "Idle.h"
+#include "Config.h"
+#include "JsonLines.h"
+#include "Coroutine.h"
+#include "Publisher.h"
+#include "Metric.h"
 #include "Gui.hpp"
 #include "Battery.hpp"
+#include "GpioEngine.hpp"
+#include "GpioTable.hpp"
+#include "EdgeTrace.hpp"
+#include "History.hpp"
+#include "TransitionLog.hpp"
+#include "Replay.hpp"
+#include "EdgeReplay.hpp"
+#include "Generator.hpp"
+#include "BatterySubscribe.hpp"
 
 #undef DBGLVL
 #define DBGLVL DBG_ALL
 
 GuiObj title;
 GuiObj header;
-GuiObj battery_temp_label;
-GuiObj battery_temp;
-GuiObj battery_health_label;
-GuiObj battery_health;
-GuiObj battery_level_label;
-GuiObj battery_level;
-GuiObj in_dock_label;
-GuiObj in_dock;
-GuiObj charging_label;
-GuiObj charging;
-GuiObj brightness_label;
-GuiObj brightness_value;
-GuiObj current_label;
-GuiObj current;
-GuiObj voltage_label;
-GuiObj voltage;
 GuiObj increase_btn;
 GuiObj decrease_btn;
 GuiObj reset_btn;
-pthread_t battery_current_tid;
-pthread_t battery_voltage_tid;
-pthread_t battery_health_tid;
-pthread_t battery_temp_tid;
-pthread_t battery_level_tid;
-pthread_t in_dock_monitor_tid;
-pthread_t battery_charging_tid;
-pthread_t brightness_monitor_tid;
-pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t start_cond1 = PTHREAD_COND_INITIALIZER;
+pthread_t latency_bench_tid;
+bool latency_bench_started = false;
+Plugin test_plugin;
 
 const char PLUGIN_PATH[]    = "/usr/nova/battery_info/plugins/";
 const char LIB_PREFIX[]     = "libdiag.";
@@ -74,19 +74,177 @@ const char PLUGIN_SUFFIX[]  = ".pi.so";
 const char INIT_SUFFIX[]    = "_init";
 const char START_SUFFIX[]   = "_start";
 const char END_SUFFIX[]     = "_end";
-int brightness = 60;
-std::string brightness_string;
+const char * record_path = NULL;
+const char * replay_path = NULL;
+double replay_speed = 1.0;
+double generator_rate = 0;
+unsigned int generator_supplies = 1;
+const char * latency_path = NULL;
+const char * test_name = NULL;
+const char * config_path = CONFIG_PATH;
+const char * json_path = NULL;
+int test_result = 0;
+bool replay_finished = false;
+bool edge_replay = false;					// the replay drives the engine from its edge log
+bool transitions_report = false;
+int battery_timer = -1;
+bool idle_started = false;
+bool first_value_marked = false;			// Startup_Mark("first_value") done
+BatterySample published;					// last value of each field the Update functions read
+
+// Value labels, indexed by the metric they show.
+MetricLabel metric_labels[METRIC_COUNT];
+
+// Static, the points are too big for a coroutine frame.
+Trend level_trend;
+
+// Last known values painted at startup, the labels point at stale_text until
+// their first sample.
+Metric stale_metrics[METRIC_COUNT];
+char stale_text[METRIC_COUNT][GUI_LABEL_TEXT_LEN];
+
+static constexpr lv_coord_t NAME_W = HALF_SCREEN - 35;
+
+static constexpr ScreenWidget main_screen[] =
+{
+	// row  x    w            text           font              align                  color               metric
+	{ 0,    0,   NAME_W,      "Current:",    &statstrip_reg_40, LV_LABEL_ALIGN_RIGHT,  SCREEN_COLOR_NONE,  METRIC_COUNT      },
+	{ 0,    240, HALF_SCREEN, "Checking...", &statstrip_reg_40, LV_LABEL_ALIGN_CENTER, SCREEN_COLOR_LEVEL, METRIC_CURRENT    },
+	{ 1,    0,   NAME_W,      "Voltage:",    &statstrip_reg_40, LV_LABEL_ALIGN_RIGHT,  SCREEN_COLOR_NONE,  METRIC_COUNT      },
+	{ 1,    240, HALF_SCREEN, "Checking...", &statstrip_reg_40, LV_LABEL_ALIGN_CENTER, SCREEN_COLOR_LEVEL, METRIC_VOLTAGE    },
+	{ 2,    0,   NAME_W,      "Health:",     &statstrip_reg_40, LV_LABEL_ALIGN_RIGHT,  SCREEN_COLOR_NONE,  METRIC_COUNT      },
+	{ 2,    240, HALF_SCREEN, "Checking...", &statstrip_reg_40, LV_LABEL_ALIGN_CENTER, SCREEN_COLOR_LEVEL, METRIC_HEALTH     },
+	{ 3,    0,   NAME_W,      "Temp:",       &statstrip_reg_40, LV_LABEL_ALIGN_RIGHT,  SCREEN_COLOR_NONE,  METRIC_COUNT      },
+	{ 3,    240, HALF_SCREEN, "Checking...", &statstrip_reg_40, LV_LABEL_ALIGN_CENTER, SCREEN_COLOR_LEVEL, METRIC_TEMP       },
+	{ 4,    0,   NAME_W,      "Level:",      &statstrip_reg_40, LV_LABEL_ALIGN_RIGHT,  SCREEN_COLOR_NONE,  METRIC_COUNT      },
+	{ 4,    240, HALF_SCREEN, "Checking...", &statstrip_reg_40, LV_LABEL_ALIGN_CENTER, SCREEN_COLOR_LEVEL, METRIC_LEVEL      },
+	{ 5,    0,   NAME_W,      "In Dock:",    &statstrip_reg_40, LV_LABEL_ALIGN_RIGHT,  SCREEN_COLOR_NONE,  METRIC_COUNT      },
+	{ 5,    240, HALF_SCREEN, "Checking...", &statstrip_reg_40, LV_LABEL_ALIGN_CENTER, SCREEN_COLOR_LEVEL, METRIC_IN_DOCK    },
+	{ 6,    0,   NAME_W,      "Charging:",   &statstrip_reg_40, LV_LABEL_ALIGN_RIGHT,  SCREEN_COLOR_NONE,  METRIC_COUNT      },
+	{ 6,    240, HALF_SCREEN, "Checking...", &statstrip_reg_40, LV_LABEL_ALIGN_CENTER, SCREEN_COLOR_LEVEL, METRIC_CHARGING   },
+	{ 9,    50,  NAME_W,      "Brightness:", &statstrip_reg_40, LV_LABEL_ALIGN_RIGHT,  SCREEN_COLOR_NONE,  METRIC_COUNT      },
+	{ 9,    240, NAME_W,      "60",          &statstrip_reg_40, LV_LABEL_ALIGN_CENTER, SCREEN_COLOR_NONE,  METRIC_BRIGHTNESS },
+};
+
+static const struct option long_options[] =
+{
+	{ "record", required_argument, NULL, 'r' },
+	{ "replay", required_argument, NULL, 'p' },
+	{ "speed",  required_argument, NULL, 's' },
+	{ "generate", required_argument, NULL, 'g' },
+	{ "supplies", required_argument, NULL, 'n' },
+	{ "latency", required_argument, NULL, 'l' },
+	{ "test",   required_argument, NULL, 't' },
+	{ "config", required_argument, NULL, 'c' },
+	{ "set",    required_argument, NULL, 'o' },
+	{ "json",   required_argument, NULL, 'j' },
+	{ "transitions", no_argument,  NULL, 'x' },
+	{ "help",   no_argument,       NULL, 'h' },
+	{ NULL,     0,                 NULL,  0  }
+};
+
+void PrintUsage(const char * app)
+{
+	printf("usage: %s [options]\n", app);
+	printf("  -r, --record <file>   record the raw battery inputs to a binary log, GPIO edges to <file>.edges\n");
+	printf("  -p, --replay <file>   replay a binary log instead of reading sysfs/GPIO, with <file>.edges if there\n");
+	printf("  -s, --speed <N>       replay at N times real time, 0 for as fast as possible\n");
+	printf("  -g, --generate <Hz>   read from the synthetic pack model at Hz samples/s\n");
+	printf("  -n, --supplies <N>    number of virtual packs for --generate, pack 0 is shown\n");
+	printf("  -l, --latency <file>  measure dock edge to display latency on mock GPIO, JSON to file\n");
+	printf("  -t, --test <name>     run the diagnostic plugin %s<name>%s from %s\n", LIB_PREFIX, PLUGIN_SUFFIX, PLUGIN_PATH);
+	printf("  -c, --config <file>   read the settings from file instead of %s\n", CONFIG_PATH);
+	printf("  -o, --set <key=value> override a setting of the config file, may be repeated\n");
+	printf("  -j, --json <file>     run without the display, one JSON line per sample to file, - for stdout\n");
+	printf("  -x, --transitions     print the logged GPIO line transitions and active time, then exit\n");
+	printf("  -h, --help            show this help\n");
+}
+
+// Every sample of every pack, the battery period would drop most of them.
+void GeneratorSampleSink(void * arg, unsigned int supply, const BatterySample * sample)
+{
+	UNUSED(arg);
+
+	JsonLines_Write(supply, sample);
+}
+
+int StartGenerator(void)
+{
+	GeneratorConfig config;
+
+	Generator_DefaultConfig(&config);
+	config.rate_hz  = generator_rate;
+	config.supplies = generator_supplies;
+
+	if (Generator_Init(&config) != 0)
+	{
+		return -1;
+	}
+
+	Battery_SetSource(Generator_GetSource(0));
 
-void SetScreenBrightness(int brightness)
+	return Generator_Start((json_path != NULL) ? GeneratorSampleSink : NULL, NULL);
+}
+
+int ParseArgs(int argc, char **argv)
 {
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "r:p:s:g:n:l:t:c:o:j:xh", long_options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'r':
+			record_path = optarg;
+			break;
+		case 'p':
+			replay_path = optarg;
+			break;
+		case 's':
+			replay_speed = atof(optarg);
+			break;
+		case 'g':
+			generator_rate = atof(optarg);
+			break;
+		case 'n':
+			generator_supplies = (unsigned int)atoi(optarg);
+			break;
+		case 'l':
+			latency_path = optarg;
+			break;
+		case 't':
+			test_name = optarg;
+			break;
+		case 'c':
+			config_path = optarg;
+			break;
+		case 'o':
+			if (Config_Override(optarg) != 0)
+			{
+				PrintUsage(argv[0]);
+				return -1;
+			}
+			break;
+		case 'j':
+			json_path = optarg;
+			break;
+		case 'x':
+			transitions_report = true;
+			break;
+		case 'h':
+		default:
+			PrintUsage(argv[0]);
+			return -1;
+		}
+	}
 
-	brightness_string = std::to_string(brightness);
-	std::string command = "echo " + brightness_string + " >> /sys/class/backlight/lcd-backlight/brightness";
-	system((char*)command.c_str());
-	//brightness_value.text = brightness_string;
-	DBGPRT(DBG_INFO1, "SetScreenBrightness: brightness set to %s\n", brightness_value.text.c_str());
-	//ChangeLabel(brightness_value, (char*)brightness_string.c_str());
+	return 0;
+}
 
+// Reactor post from the brightness buttons.
+void UpdateBrightness(void *arg)
+{
+	Metric_Set(METRIC_BRIGHTNESS, (int32_t)(intptr_t)arg, METRIC_LEVEL_NONE);
 }
 
 void decrease_brightness_btn_callback(lv_obj_t *obj, lv_event_t event)
@@ -95,8 +253,7 @@ void decrease_brightness_btn_callback(lv_obj_t *obj, lv_event_t event)
 	{
 		std::string id = (char*)lv_obj_get_user_data(obj);
 		Audio_PlayTrack(KeyPress);
-		brightness--;
-		SetScreenBrightness(brightness);
+		Reactor_Post(UpdateBrightness, (void*)(intptr_t)Backlight_Step(-1));
 	}
 }
 
@@ -106,8 +263,7 @@ void increase_brightness_btn_callback(lv_obj_t *obj, lv_event_t event)
 	{
 		std::string id = (char*)lv_obj_get_user_data(obj);
 		Audio_PlayTrack(KeyPress);
-		brightness++;
-		SetScreenBrightness(brightness);
+		Reactor_Post(UpdateBrightness, (void*)(intptr_t)Backlight_Step(+1));
 	}
 }
 
@@ -140,453 +296,1275 @@ void AddAdjustBrightness()
 	increase_btn.obj	   = AddButton(&increase_btn);
 }
 
-void *brightness_monitor(void *arg)
+lv_color_t LevelColor(MetricLevel level)
 {
-	UNUSED(arg);
+	switch (level)
+	{
+	case METRIC_LEVEL_GOOD:
+		return LV_COLOR_GREEN;
+	case METRIC_LEVEL_BAD:
+		return LV_COLOR_RED;
+	default:
+		return LV_COLOR_ORANGE;
+	}
+}
 
-	DBGPRT(DBG_INFO1, "brightness_monitor: started\n");
+// Binds a value label to a metric, arg is its MetricLabel.
+void MetricLabelObserver(void *arg, MetricId id, const Metric *metric)
+{
+	MetricLabel * label = (MetricLabel *)arg;
+	size_t size;
+	char * text = GetLabelBuffer(label->obj, &size);
 
-	while (1)
+	if (text == NULL)
 	{
-		std::string b = std::to_string(brightness);
-		if(brightness_value.text != b)
-		{
-			brightness_value.text = b;
-			ChangeLabel(brightness_value, (char*)b.c_str());
-		}
-		usleep(1000);
+		return;
 	}
-	return NULL;
+
+	Metric_Format(id, metric, text, size);
+
+	// Only the first one is a milestone, skip the lookup for every later update.
+	if (!first_value_marked && (id != METRIC_BRIGHTNESS))
+	{
+		Startup_Mark("first_value");
+		first_value_marked = true;
+	}
+
+	if (id == METRIC_IN_DOCK)
+	{
+		EdgeTrace_Mark(EDGE_STAGE_ENQUEUE);
+	}
+
+	SwapLabel(label->obj, label->set_color, LevelColor(metric->level));
 }
 
-void *battery_current_monitor(void *arg)
+// Reads fields for an Update function and keeps what came back for
+// PublishSnapshot. Returns the fields that were read.
+uint32_t ReadFields(BatterySample * sample, uint32_t fields)
 {
-	UNUSED(arg);
-	DBGPRT(DBG_INFO1, "battery_current_monitor: started\n");
+	if (Battery_ReadSample(sample, fields) != 0)
+	{
+		sample->fields = BATTERY_FIELD_NONE;
+	}
+
+	uint32_t read = sample->fields & fields;
 
-	while (1)
+	if (read & BATTERY_FIELD_CURRENT)  published.current  = sample->current;
+	if (read & BATTERY_FIELD_VOLTAGE)  published.voltage  = sample->voltage;
+	if (read & BATTERY_FIELD_TEMP)     published.temp     = sample->temp;
+	if (read & BATTERY_FIELD_LEVEL)    published.level    = sample->level;
+	if (read & BATTERY_FIELD_IN_DOCK)  published.in_dock  = sample->in_dock;
+	if (read & BATTERY_FIELD_CHARGING) published.charging = sample->charging;
+
+	if (read & BATTERY_FIELD_HEALTH)
 	{
-		int batteryCurrent = GetBatteryCurrent();
-		std::string batteryCurrentFormatted = std::to_string(batteryCurrent);
-		batteryCurrentFormatted = batteryCurrentFormatted.append(" mA");
-		if ((batteryCurrent >= 50) && (batteryCurrent <= 700))
-		{
-			current.color = LV_COLOR_GREEN;
-		}
-		else if ((batteryCurrent >= 1) && (batteryCurrent < 50))
-		{
-			current.color = LV_COLOR_ORANGE;
-		}
-		else if ((batteryCurrent > 700) && (batteryCurrent < 850))
-		{
-			current.color = LV_COLOR_ORANGE;
-		}
-		else
-		{
-			current.color = LV_COLOR_RED;
-		}
-		ChangeLabel(current, (char*)batteryCurrentFormatted.c_str());
-		sleep(0.5);
+		memcpy(published.health, sample->health, sizeof(published.health));
 	}
+
+	if (read & BATTERY_FIELD_GPIO)
+	{
+		published.gpio       = sample->gpio;
+		published.gpio_table = sample->gpio_table;
+	}
+
+	published.fields |= read;
+	published.t_ns    = sample->t_ns;
+
+	return read;
 }
 
-void *battery_voltage_monitor(void *arg)
+void UpdateCurrent(void)
 {
-	UNUSED(arg);
-	DBGPRT(DBG_INFO1, "battery_voltage_monitor: started\n");
+	const AppConfig * config = Config_Get();
+	BatterySample sample;
+	int batteryCurrent = ReadFields(&sample, BATTERY_FIELD_CURRENT) ? sample.current : -1;
+	MetricLevel level;
 
-	while (1)
+	History_Push(HISTORY_CURRENT, History_NowMs(), batteryCurrent);
+
+	if ((batteryCurrent >= config->current_good_min) && (batteryCurrent <= config->current_good_max))
 	{
-		int batteryVoltage = GetBatteryVoltage();
-		std::string batteryVoltageFormatted = std::to_string(batteryVoltage);
-		batteryVoltageFormatted = batteryVoltageFormatted.insert(batteryVoltageFormatted.length() - 2, ".").append(" V");
-		if ((batteryVoltage >= 350) && (batteryVoltage <= 550))
-		{
-			voltage.color = LV_COLOR_GREEN;
-		}
-		else if (batteryVoltage > 560)
-		{
-			voltage.color = LV_COLOR_ORANGE;
-		}
-		else
-		{
-			voltage.color = LV_COLOR_RED;
-		}
-		ChangeLabel(voltage, (char*)batteryVoltageFormatted.c_str());
-		sleep(0.5);
+		level = METRIC_LEVEL_GOOD;
+	}
+	else if ((batteryCurrent >= config->current_warn_min) && (batteryCurrent < config->current_good_min))
+	{
+		level = METRIC_LEVEL_WARN;
+	}
+	else if ((batteryCurrent > config->current_good_max) && (batteryCurrent < config->current_warn_max))
+	{
+		level = METRIC_LEVEL_WARN;
+	}
+	else
+	{
+		level = METRIC_LEVEL_BAD;
+	}
+
+	Metric_Set(METRIC_CURRENT, batteryCurrent, level);
+}
+
+void UpdateVoltage(void)
+{
+	const AppConfig * config = Config_Get();
+	BatterySample sample;
+	int batteryVoltage = ReadFields(&sample, BATTERY_FIELD_VOLTAGE) ? sample.voltage : -1;
+	MetricLevel level;
+
+	History_Push(HISTORY_VOLTAGE, History_NowMs(), batteryVoltage);
+
+	if ((batteryVoltage >= config->voltage_good_min) && (batteryVoltage <= config->voltage_good_max))
+	{
+		level = METRIC_LEVEL_GOOD;
+	}
+	else if (batteryVoltage > config->voltage_warn_min)
+	{
+		level = METRIC_LEVEL_WARN;
+	}
+	else
+	{
+		level = METRIC_LEVEL_BAD;
+	}
+
+	Metric_Set(METRIC_VOLTAGE, batteryVoltage, level);
+}
+
+void UpdateHealth(void)
+{
+	char batteryHealth[BATTERY_HEALTH_LEN];
+	BatterySample sample;
+	MetricLevel level;
+
+	if (!ReadFields(&sample, BATTERY_FIELD_HEALTH))
+	{
+		snprintf(batteryHealth, sizeof(batteryHealth), "Error");
+	}
+	else
+	{
+		snprintf(batteryHealth, sizeof(batteryHealth), "%.*s", BATTERY_HEALTH_LEN, sample.health);
+	}
+
+	if (batteryHealth[0] == '\0')
+	{
+		snprintf(batteryHealth, sizeof(batteryHealth), "ERROR");
+	}
+
+	if (strcmp(batteryHealth, "Good") == 0)
+	{
+		level = METRIC_LEVEL_GOOD;
+	}
+	else if (strcmp(batteryHealth, "Ok") == 0)
+	{
+		level = METRIC_LEVEL_WARN;
+	}
+	else
+	{
+		level = METRIC_LEVEL_BAD;
+	}
+
+	Metric_SetText(METRIC_HEALTH, batteryHealth, level);
+}
+
+void UpdateTemp(void)
+{
+	const AppConfig * config = Config_Get();
+	BatterySample sample;
+	int batteryTemp = ReadFields(&sample, BATTERY_FIELD_TEMP) ? sample.temp : -1;
+	MetricLevel level;
+
+	History_Push(HISTORY_TEMP, History_NowMs(), batteryTemp);
+
+	if ((batteryTemp >= config->temp_good_min) && (batteryTemp <= config->temp_good_max))
+	{
+		level = METRIC_LEVEL_GOOD;
+	}
+	else if (batteryTemp > config->temp_warn_min)
+	{
+		level = METRIC_LEVEL_WARN;
+	}
+	else
+	{
+		level = METRIC_LEVEL_BAD;
+	}
+
+	Metric_Set(METRIC_TEMP, batteryTemp, level);
+}
+
+void UpdateLevel(void)
+{
+	const AppConfig * config = Config_Get();
+	BatterySample sample;
+	int batteryLevel = (ReadFields(&sample, BATTERY_FIELD_LEVEL) ? sample.level : -1) + 1;
+	MetricLevel level;
+
+	History_Push(HISTORY_LEVEL, History_NowMs(), batteryLevel);
+
+	if (batteryLevel >= config->level_good_min)
+	{
+		level = METRIC_LEVEL_GOOD;
+	}
+	else if ((batteryLevel >= config->level_warn_min) && (batteryLevel < config->level_good_min))
+	{
+		level = METRIC_LEVEL_WARN;
+	}
+	else
+	{
+		level = METRIC_LEVEL_BAD;
+	}
+
+	Metric_Set(METRIC_LEVEL, batteryLevel, level);
+}
+
+void UpdateInDock(void)
+{
+	// Served from the GPIO engine's cache, the line itself is not read here.
+	BatterySample sample;
+	uint32_t read = ReadFields(&sample, BATTERY_FIELD_IN_DOCK | BATTERY_FIELD_GPIO);
+	int isMeterInDock = ((read & BATTERY_FIELD_IN_DOCK) && (sample.in_dock == 0)) ? 1 : 0;
+	Metric_Set(METRIC_IN_DOCK, isMeterInDock, (isMeterInDock == 1) ? METRIC_LEVEL_GOOD : METRIC_LEVEL_BAD);
+}
+
+void UpdateCharging(void)
+{
+	BatterySample sample;
+	int isBatteryCharging = (ReadFields(&sample, BATTERY_FIELD_CHARGING) && (sample.charging == 1)) ? 1 : 0;
+	Metric_Set(METRIC_CHARGING, isBatteryCharging, (isBatteryCharging == 1) ? METRIC_LEVEL_GOOD : METRIC_LEVEL_BAD);
+}
+
+// Sends the battery state to the socket's subscribers, the values the Update
+// functions just read, so nothing is read or recorded twice.
+void PublishSnapshot(void)
+{
+	if (Publisher_Clients() > 0)
+	{
+		Publisher_Publish(&published);
 	}
 }
 
-void *battery_health_monitor(void *arg)
+// Reactor task, every BATTERY_MONITOR_PERIOD_MS.
+void battery_task(void *arg)
+{
+	UNUSED(arg);
+
+	UpdateCurrent();
+	UpdateVoltage();
+	UpdateHealth();
+	UpdateTemp();
+	UpdateLevel();
+	PublishSnapshot();
+}
+
+// Reactor task, every GPIO_MONITOR_POLL_MS for sources that do not signal.
+void lines_task(void *arg)
 {
 	UNUSED(arg);
-	DBGPRT(DBG_INFO1, "battery_health_monitor: started\n");
 
-	while (1)
+	UpdateInDock();
+	UpdateCharging();
+	PublishSnapshot();
+}
+
+// Saves the values for the next start, every snapshot period.
+CoTask SnapshotMonitor(void)
+{
+	for (;;)
 	{
-		std::string batteryHealth = GetBatteryHealth();
+		co_await Co_SleepFor(Config_Get()->snapshot_period_ms);
 
-		if (batteryHealth.length() <= 0)
-		{
-			batteryHealth = "ERROR";
-		}
+		Snapshot_Save(Config_Get()->snapshot_path);
+	}
+}
+
+// Redraws the level trend every trend period. The history is downsampled to
+// the plot width first, so the draw cost does not grow with the window.
+CoTask TrendMonitor(void)
+{
+	for (;;)
+	{
+		size_t count;
+		lv_point_t * points = GetTrendBuffer(level_trend.obj, &count);
 
-		if (batteryHealth.compare("Good") == 0)
+		if (points != NULL)
 		{
-			battery_health.color = LV_COLOR_GREEN;
+			int64_t to_ms   = History_NowMs();
+			int64_t from_ms = to_ms - TREND_WINDOW_MS;
+			size_t written  = History_Downsample(HISTORY_LEVEL, from_ms, to_ms, level_trend.points,
+					(count < HISTORY_MAX_PLOT_POINTS) ? count : HISTORY_MAX_PLOT_POINTS, HISTORY_DOWNSAMPLE_LTTB);
+
+			for (size_t i = 0; i < written; i++)
+			{
+				int32_t level = std::min(std::max(level_trend.points[i].value, 0), 100);
+
+				points[i].x = (lv_coord_t)(((level_trend.points[i].t_ms - from_ms) * (TREND_W - 1)) / TREND_WINDOW_MS);
+				points[i].y = (lv_coord_t)((TREND_H - 1) - ((level * (TREND_H - 1)) / 100));
+			}
+
+			SwapTrend(level_trend.obj, written);
 		}
-		else if (batteryHealth.compare("Ok") == 0)
+
+		co_await Co_SleepFor(TREND_PERIOD_MS);
+	}
+}
+
+// Every line in the GPIO table, as the engine registered them.
+uint32_t TableBits(void)
+{
+	uint32_t bits = 0;
+
+	for (unsigned int i = 0; i < GpioTable_Count(); i++)
+	{
+		bits |= (uint32_t)1 << i;
+	}
+
+	return bits;
+}
+
+// Follows the GPIO engine's state changes, or polls sources that do not
+// signal them every gpio poll period.
+CoTask LinesMonitor(uint32_t bits)
+{
+	lines_task(NULL);
+
+	for (;;)
+	{
+		if (bits == 0)
 		{
-			battery_health.color = LV_COLOR_ORANGE;
+			co_await Co_SleepFor(Config_Get()->gpio_poll_ms);
 		}
-		else
+		else if ((co_await Co_GpioEdge(bits)).value < 0)
 		{
-			battery_health.color = LV_COLOR_RED;
+			bits = 0;
+			continue;
 		}
 
-		ChangeLabel(battery_health, (char*)batteryHealth.c_str());
-		sleep(0.5);
+		lines_task(NULL);
 	}
 }
 
-void *battery_temp_monitor(void *arg)
+int OpenUevent(void)
 {
-	UNUSED(arg);
-	DBGPRT(DBG_INFO1, "battery_temp_monitor: started\n");
+	struct sockaddr_nl addr;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_pid    = 0;
+	addr.nl_groups = 1;
 
-	while (1)
+	if ((fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT)) < 0)
 	{
-		int batteryTemp = GetBatteryTemp();
-		std::string batteryTempFormatted = std::to_string(batteryTemp);
-		batteryTempFormatted = batteryTempFormatted.insert(batteryTempFormatted.length() - 1, ".").append(" ºC");
+		DBGPRT(DBG_ERR, "OpenUevent: socket failed, %s\n", strerror(errno));
+		return -1;
+	}
 
-		if ((batteryTemp >= 400) && (batteryTemp <= 500))
-		{
-			battery_temp.color = LV_COLOR_GREEN;
-		}
-		else if (batteryTemp > 480)
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+	{
+		DBGPRT(DBG_ERR, "OpenUevent: bind failed, %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+// Drains the uevent socket, true if a power supply reported a change. The
+// buffer is on this stack rather than in UeventMonitor's frame.
+bool ReadUevents(int fd)
+{
+	char message[UEVENT_BUFFER_LEN];
+	bool power_supply = false;
+	ssize_t length;
+
+	while ((length = recv(fd, message, sizeof(message) - 1, 0)) > 0)
+	{
+		message[length] = '\0';
+
+		// "action@devpath" then NUL separated KEY=value pairs.
+		for (ssize_t i = 0; i < length; i += strlen(&message[i]) + 1)
 		{
-			battery_temp.color = LV_COLOR_ORANGE;
+			if (strcmp(&message[i], UEVENT_POWER_SUPPLY) == 0)
+			{
+				power_supply = true;
+			}
 		}
-		else
+	}
+
+	return power_supply;
+}
+
+// Refreshes everything early when a power supply reports a change instead
+// of waiting for the next battery_task.
+CoTask UeventMonitor(int fd)
+{
+	while (co_await Co_Readable(fd) == 0)
+	{
+		if (ReadUevents(fd))
 		{
-			battery_temp.color = LV_COLOR_RED;
+			battery_task(NULL);
+			lines_task(NULL);
 		}
+	}
+
+	close(fd);
+}
 
-		ChangeLabel(battery_temp, (char*)batteryTempFormatted.c_str());
-		sleep(0.5);
+void LatencyGuiHook(GuiEvent event, lv_obj_t *obj)
+{
+	if ((event == GUI_EVENT_LABEL_SET) && (obj == metric_labels[METRIC_IN_DOCK].obj))
+	{
+		EdgeTrace_Mark(EDGE_STAGE_LABEL);
+	}
+	else if (event == GUI_EVENT_FLUSHED)
+	{
+		EdgeTrace_Mark(EDGE_STAGE_FLUSH);
 	}
 }
 
-void *battery_level_monitor(void *arg)
+// Toggles the mocked in_base line and follows each edge to the display, then
+// writes the stage latencies to latency_path and lets main exit.
+void *latency_bench(void *arg)
 {
 	UNUSED(arg);
-	DBGPRT(DBG_INFO1, "battery_level_monitor: started\n");
 
-	while (1)
+	uint32_t bit = GpioTable_Bit(GPIO_LINE_IN_BASE);
+	const GpioLineConfig * line = (bit != 0) ? GpioTable_Line(__builtin_ctz(bit)) : NULL;
+	FILE * file;
+
+	DBGPRT(DBG_INFO1, "latency_bench: started\n");
+
+	if ((line == NULL) || (EdgeTrace_Start(bit, LATENCY_BENCH_EDGES) != 0))
+	{
+		DBGPRT(DBG_ERR, "latency_bench: no %s line to drive\n", GPIO_LINE_IN_BASE);
+	}
+	else
 	{
-		int batteryLevel = GetBatteryPercentage() + 1;
-		std::string batteryLevelFormatted = std::to_string(batteryLevel) + "%";
+		int id = GpioMock_Line(line->chip, line->offset);
+		int value = GpioEngine_GetLine(bit);
 
-		if (batteryLevel >= 75)
+		GuiSetHook(LatencyGuiHook);
+
+		for (int i = 0; i < LATENCY_BENCH_EDGES; i++)
 		{
-			battery_level.color = LV_COLOR_GREEN;
+			value = (value == 1) ? 0 : 1;
+			GpioMock_Edge(id, value, 0);
+			EdgeTrace_Wait(LATENCY_EDGE_TIMEOUT_MS);
+
+			// Jitter the gap so edges do not phase lock with the LVGL refresh.
+			usleep((LATENCY_EDGE_GAP_MS + (rand() % LATENCY_EDGE_GAP_MS)) * 1000);
 		}
-		else if ((batteryLevel >= 25) && (batteryLevel < 75))
+
+		GuiSetHook(NULL);
+		EdgeTrace_Stop();
+
+		if ((file = fopen(latency_path, "w")) == NULL)
 		{
-			battery_level.color = LV_COLOR_ORANGE;
+			DBGPRT(DBG_ERR, "latency_bench: Failed to open %s, %s\n", latency_path, strerror(errno));
 		}
 		else
 		{
-			battery_level.color = LV_COLOR_RED;
+			EdgeTrace_WriteJson(file);
+			fclose(file);
 		}
-		ChangeLabel(battery_level, (char*)batteryLevelFormatted.c_str());
-		sleep(0.5);
 	}
+
+	Reactor_Stop();
+
+	return NULL;
 }
 
-void *in_dock_monitor(void *arg)
+func_ptr LoadPluginFunc(Plugin * plugin, const char * suffix)
 {
-	UNUSED(arg);
-	DBGPRT(DBG_INFO1, "in_dock_charging_monitor: started\n");
-	//sleep(3);
+	std::string symbol = plugin->name + suffix;
+	func_ptr func = (func_ptr)dlsym(plugin->handle, symbol.c_str());
 
-	while (1)
+	if (func == NULL)
 	{
-		int isMeterInDock = IsMeterInDock();
-		std::string isMeterInDockValue = (isMeterInDock == 0) ? "TRUE" : "FALSE";
-		in_dock.color = (isMeterInDock == 0) ? LV_COLOR_GREEN : LV_COLOR_RED;
-		ChangeLabel(in_dock, (char*)isMeterInDockValue.c_str());
-		sleep(0.5);
+		DBGPRT(DBG_ERR, "LoadPluginFunc: %s missing, %s\n", symbol.c_str(), dlerror());
 	}
+
+	return func;
 }
 
-void *battery_charging_monitor(void *arg)
+int LoadPlugin(const char * name, Plugin * plugin)
 {
-	UNUSED(arg);
-	DBGPRT(DBG_INFO1, "battery_charging_monitor: started\n");
+	std::string path = std::string(PLUGIN_PATH) + LIB_PREFIX + name + PLUGIN_SUFFIX;
 
-	while (1)
+	plugin->name   = name;
+	plugin->handle = dlopen(path.c_str(), RTLD_NOW);
+
+	if (plugin->handle == NULL)
 	{
-		int isBatteryCharging = IsBatteryCharging();
-		std::string isBatteryChargingValue = (isBatteryCharging == 1) ? "TRUE" : "FALSE";
-		charging.color = (isBatteryCharging == 1) ? LV_COLOR_GREEN : LV_COLOR_RED;
-		ChangeLabel(charging, (char*)isBatteryChargingValue.c_str());
-		sleep(0.5);
+		DBGPRT(DBG_ERR, "LoadPlugin: Failed to open %s, %s\n", path.c_str(), dlerror());
+		return -1;
 	}
-}
-
-void *main_menu(void *arg)
-{
-	UNUSED(arg);
-	title.text   = "Battery Monitor";
-	title.y      = 35;
-	DBGPRT(DBG_INFO1, "main_menu: started\n");
 
-	AddTitle(title, (char*)title.text.c_str());
+	plugin->init  = LoadPluginFunc(plugin, INIT_SUFFIX);
+	plugin->start = LoadPluginFunc(plugin, START_SUFFIX);
+	plugin->end   = LoadPluginFunc(plugin, END_SUFFIX);
 
-	char *version = (char*)arg;
-	std::string ver = version;
-	lv_coord_t right_column = HALF_SCREEN - 35;
-
-	usleep(10000);
-
-	current_label.font        = &statstrip_reg_40;
-	current_label.text    	 = "Current:";
-	current_label.text_align  = LV_LABEL_ALIGN_RIGHT;
-	current_label.x           = 0;
-	current_label.y           = 175;
-	current_label.w           = right_column;
-	current_label.h           = 50;
-	AddLabel(current_label, (char*)current_label.text.c_str());
-
-	usleep(10000);
-
-	current.font        = &statstrip_reg_40;
-	current.text        = "Checking...";
-	current.text_align  = LV_LABEL_ALIGN_CENTER;
-	current.set_color   = true;
-	current.color       = LV_COLOR_ORANGE;
-	current.x           = 240;
-	current.y           = 175;
-	current.w           = HALF_SCREEN;
-	current.h           = 50;
-	current.obj         = AddLabel(current, (char*)current.text.c_str());
-
-	usleep(10000);
-
-	voltage_label.font        = &statstrip_reg_40;
-	voltage_label.text    	 = "Voltage:";
-	voltage_label.text_align  = LV_LABEL_ALIGN_RIGHT;
-	voltage_label.x           = 0;
-	voltage_label.y           = 225;
-	voltage_label.w           = right_column;
-	voltage_label.h           = 50;
-	AddLabel(voltage_label, (char*)voltage_label.text.c_str());
-
-	usleep(10000);
-
-	voltage.font        = &statstrip_reg_40;
-	voltage.text        = "Checking...";
-	voltage.text_align  = LV_LABEL_ALIGN_CENTER;
-	voltage.set_color   = true;
-	voltage.color       = LV_COLOR_ORANGE;
-	voltage.x           = 240;
-	voltage.y           = 225;
-	voltage.w           = HALF_SCREEN;
-	voltage.h           = 50;
-	voltage.obj         = AddLabel(voltage, (char*)voltage.text.c_str());
-
-	usleep(10000);
-
-	battery_health_label.font        = &statstrip_reg_40;
-	battery_health_label.text        = "Health:";
-	battery_health_label.text_align  = LV_LABEL_ALIGN_RIGHT;
-	battery_health_label.x           = 0;
-	battery_health_label.y           = 275;
-	battery_health_label.w           = right_column;
-	battery_health_label.h           = 50;
-	AddLabel(battery_health_label, (char*)battery_health_label.text.c_str());
-
-	usleep(10000);
-
-	battery_health.font        = &statstrip_reg_40;
-	battery_health.text        = "Checking...";
-	battery_health.text_align  = LV_LABEL_ALIGN_CENTER;
-	battery_health.set_color   = true;
-	battery_health.color       = LV_COLOR_ORANGE;
-	battery_health.x           = 240;
-	battery_health.y           = 275;
-	battery_health.w           = HALF_SCREEN;
-	battery_health.h           = 50;
-	battery_health.obj         = AddLabel(battery_health, (char*)battery_health.text.c_str());
-
-	usleep(10000);
-
-	battery_temp_label.font        = &statstrip_reg_40;
-	battery_temp_label.text        = "Temp:";
-	battery_temp_label.text_align  = LV_LABEL_ALIGN_RIGHT;
-	battery_temp_label.x           = 0;
-	battery_temp_label.y           = 325;
-	battery_temp_label.w           = right_column;
-	battery_temp_label.h           = 50;
-	AddLabel(battery_temp_label, (char*)battery_temp_label.text.c_str());
-
-	usleep(10000);
-
-	battery_temp.font        = &statstrip_reg_40;
-	battery_temp.text        = "Checking...";
-	battery_temp.text_align  = LV_LABEL_ALIGN_CENTER;
-	battery_temp.set_color   = true;
-	battery_temp.color       = LV_COLOR_ORANGE;
-	battery_temp.x           = 240;
-	battery_temp.y           = 325;
-	battery_temp.w           = HALF_SCREEN;
-	battery_temp.h           = 50;
-	battery_temp.obj 		 = AddLabel(battery_temp, (char*)battery_temp.text.c_str());
-
-	usleep(10000);
-
-	battery_level_label.font        = &statstrip_reg_40;
-	battery_level_label.text        = "Level:";
-	battery_level_label.text_align  = LV_LABEL_ALIGN_RIGHT;
-	battery_level_label.x           = 0;
-	battery_level_label.y           = 375;
-	battery_level_label.w           = right_column;
-	battery_level_label.h           = 50;
-	AddLabel(battery_level_label, (char*)battery_level_label.text.c_str());
-
-	usleep(10000);
-
-	battery_level.font        = &statstrip_reg_40;
-	battery_level.text        = "Checking...";
-	battery_level.text_align  = LV_LABEL_ALIGN_CENTER;
-	battery_level.set_color   = true;
-	battery_level.color       = LV_COLOR_ORANGE;
-	battery_level.x           = 240;
-	battery_level.y           = 375;
-	battery_level.w           = HALF_SCREEN;
-	battery_level.h           = 50;
-	battery_level.obj		  = AddLabel(battery_level, (char*)battery_level.text.c_str());
-
-	usleep(10000);
-
-	in_dock_label.font        = &statstrip_reg_40;
-	in_dock_label.text        = "In Dock:";
-	in_dock_label.text_align  = LV_LABEL_ALIGN_RIGHT;
-	in_dock_label.x           = 0;
-	in_dock_label.y           = 425;
-	in_dock_label.w           = right_column;
-	in_dock_label.h           = 50;
-	AddLabel(in_dock_label, (char*)in_dock_label.text.c_str());
-
-	usleep(10000);
-
-	in_dock.font        = &statstrip_reg_40;
-	in_dock.text        = "Checking...";
-	in_dock.text_align  = LV_LABEL_ALIGN_CENTER;
-	in_dock.set_color   = true;
-	in_dock.color       = LV_COLOR_ORANGE;
-	in_dock.x           = 240;
-	in_dock.y           = 425;
-	in_dock.w           = HALF_SCREEN;
-	in_dock.h           = 50;
-	in_dock.obj			= AddLabel(in_dock, (char*)in_dock.text.c_str());
-
-	usleep(10000);
-
-	charging_label.font        = &statstrip_reg_40;
-	charging_label.text        = "Charging:";
-	charging_label.text_align  = LV_LABEL_ALIGN_RIGHT;
-	charging_label.x           = 0;
-	charging_label.y           = 475;
-	charging_label.w           = right_column;
-	charging_label.h           = 50;
-	AddLabel(charging_label, (char*)charging_label.text.c_str());
-
-	usleep(10000);
-
-	charging.font        = &statstrip_reg_40;
-	charging.text        = "Checking...";
-	charging.text_align  = LV_LABEL_ALIGN_CENTER;
-	charging.set_color   = true;
-	charging.color       = LV_COLOR_ORANGE;
-	charging.x           = 240;
-	charging.y           = 475;
-	charging.w           = HALF_SCREEN;
-	charging.h           = 50;
-	charging.obj		 = AddLabel(charging, (char*)charging.text.c_str());
-
-	usleep(10000);
-
-	brightness_label.font        = &statstrip_reg_40;
-	brightness_label.text    	 = "Brightness:";
-	brightness_label.text_align  = LV_LABEL_ALIGN_RIGHT;
-	brightness_label.x           = 50;
-	brightness_label.y           = 625;
-	brightness_label.w           = right_column;
-	brightness_label.h           = 50;
-	AddLabel(brightness_label, (char*)brightness_label.text.c_str());
-
-	usleep(10000);
-
-	brightness_value.font        = &statstrip_reg_40;
-	brightness_value.text        = "60";
-	brightness_value.text_align  = LV_LABEL_ALIGN_CENTER;
-	brightness_value.x           = 240;
-	brightness_value.y           = 625;
-	brightness_value.w           = right_column;
-	brightness_value.h           = 50;
-	AddLabel(brightness_value, (char*)brightness_value.text.c_str());
-
-	usleep(250000);
-	
-	Battery_Init();
+	if ((plugin->init == NULL) || (plugin->start == NULL) || (plugin->end == NULL))
+	{
+		dlclose(plugin->handle);
+		plugin->handle = NULL;
+		return -1;
+	}
 
-	sleep(1);
-	
-	//pthread_t batteryMonitor;
-	//pthread_create(&batteryMonitor, NULL, RunBatteryMonitor, NULL);
-	pthread_create(&brightness_monitor_tid, NULL, brightness_monitor, (void*)brightness);
-	pthread_create(&battery_current_tid, NULL, battery_current_monitor, NULL);
-	pthread_create(&battery_voltage_tid, NULL, battery_voltage_monitor, NULL);
-	pthread_create(&battery_health_tid, NULL, battery_health_monitor, NULL);
-	pthread_create(&battery_temp_tid, NULL, battery_temp_monitor, NULL);
-	pthread_create(&battery_level_tid, NULL, battery_level_monitor, NULL);
-	pthread_create(&in_dock_monitor_tid, NULL, in_dock_monitor, NULL);
-	pthread_create(&battery_charging_tid, NULL, battery_charging_monitor, NULL);
-	return NULL;
+	return 0;
 }
 
-int main(int argc, char **argv)
+// Creates every label of a screen with one AddLabels call and binds the value
+// labels to their metrics. Value labels with a known stale metric start with
+// it in SCREEN_STALE_COLOR, stale may be NULL.
+int BuildScreen(const ScreenWidget *widgets, size_t count, const Metric *stale)
 {
+	GuiLabelDesc labels[SCREEN_MAX_WIDGETS];
+	lv_obj_t * objs[SCREEN_MAX_WIDGETS];
 
-	UNUSED(argc);
-	UNUSED(argv);
+	if (count > SCREEN_MAX_WIDGETS)
+	{
+		DBGPRT(DBG_ERR, "BuildScreen: %zu widgets, at most %d\n", count, SCREEN_MAX_WIDGETS);
+		return -1;
+	}
 
-	pthread_t tid;
+	for (size_t i = 0; i < count; i++)
+	{
+		labels[i].text       = widgets[i].text;
+		labels[i].font       = widgets[i].font;
+		labels[i].text_align = widgets[i].align;
+		labels[i].x          = widgets[i].x;
+		labels[i].y          = SCREEN_FIRST_ROW_Y + (widgets[i].row * SCREEN_ROW_HEIGHT);
+		labels[i].w          = widgets[i].w;
+		labels[i].set_color  = (widgets[i].color == SCREEN_COLOR_LEVEL);
+		labels[i].color      = LevelColor(METRIC_LEVEL_NONE);
+
+		MetricId id = widgets[i].metric;
+
+		if ((stale != NULL) && (id < METRIC_COUNT) && stale[id].known)
+		{
+			Metric_Format(id, &stale[id], stale_text[id], sizeof(stale_text[id]));
+			labels[i].text      = stale_text[id];
+			labels[i].set_color = true;
+			labels[i].color     = SCREEN_STALE_COLOR;
+		}
+	}
 
-	std::string version =
-			MAJOR_VER + std::string(".") +
-			MINOR_VER + std::string(".") +
-			BUILD_VER + std::string(".") +
-			PATCH_VER;
+	AddLabels(labels, count, objs);
 
-	DBGPRT(DBG_INFO1, "Hospital Meter Battery Info version - %s\n", version.c_str());
+	for (size_t i = 0; i < count; i++)
+	{
+		MetricId id = widgets[i].metric;
 
-	SetScreenBrightness(brightness);
+		if (id < METRIC_COUNT)
+		{
+			metric_labels[id].obj       = objs[i];
+			metric_labels[id].set_color = (widgets[i].color == SCREEN_COLOR_LEVEL);
+			Metric_Subscribe(id, MetricLabelObserver, &metric_labels[id]);
+		}
+	}
 
-	GuiInit();
+	return 0;
+}
 
-	AddAdjustBrightness();
+// Marks the first frame on the timeline, until latency_bench takes the hook.
+void StartupGuiHook(GuiEvent event, lv_obj_t *obj)
+{
+	UNUSED(obj);
 
-	pthread_create(&tid, NULL, main_menu, (void*)version.c_str());
-	pthread_mutex_lock(&start_lock);
-	pthread_cond_wait(&start_cond1, &start_lock);
-	pthread_mutex_unlock(&start_lock);
-	pthread_join(tid, NULL);
-	
-	DBGPRT(DBG_INFO1, "Hospital Meter Battery Info Completed\n");
+	if (event == GUI_EVENT_FLUSHED)
+	{
+		Startup_Mark("first_frame");
+	}
+}
+
+// True when the battery values come from sysfs and the GPIO engine.
+bool HardwareSource(void)
+{
+	return (replay_path == NULL) && (generator_rate <= 0);
+}
+
+// True when the GPIO engine runs on lines, real ones or a replayed edge log.
+bool EngineSource(void)
+{
+	return HardwareSource() || edge_replay;
+}
+
+int StageBacklight(void)
+{
+	int result = Backlight_Init(BACKLIGHT_SYSFS_DIR, BACKLIGHT_SETTING_PATH, Config_Get()->brightness);
+
+	Metric_Set(METRIC_BRIGHTNESS, Backlight_Get(), METRIC_LEVEL_NONE);
+
+	return result;
+}
+
+int StageGui(void)
+{
+	GuiSetHook(StartupGuiHook);
+
+	if (GuiInit() != 0)
+	{
+		DBGPRT(DBG_ERR, "StageGui: GuiInit failed\n");
+		return -1;
+	}
+
+	if (test_name != NULL)
+	{
+		return 0;
+	}
+
+	AddAdjustBrightness();
+
+	title.text   = "Battery Monitor";
+	title.y      = 35;
+	AddTitle(title, (char*)title.text.c_str());
+
+	// Replayed and generated runs start from their own data.
+	bool stale = HardwareSource() && (Snapshot_Load(Config_Get()->snapshot_path, stale_metrics) == 0);
+
+	if (BuildScreen(main_screen, sizeof(main_screen) / sizeof(main_screen[0]), stale ? stale_metrics : NULL) != 0)
+	{
+		return -1;
+	}
+
+	level_trend.obj = AddTrend(TREND_X, TREND_Y, TREND_W, TREND_H);
 
 	return 0;
 }
+
+int StageAudio(void)
+{
+	RunAudioPlayer();
+
+	return 0;
+}
+
+int StageGpio(void)
+{
+	// A replay with an edge log next to it feeds the engine through the mock
+	// lines, so the debounce and the sinks run on the recorded edges.
+	if ((test_name == NULL) && (replay_path != NULL))
+	{
+		std::string edges_path = std::string(replay_path) + EDGE_LOG_SUFFIX;
+
+		if ((access(edges_path.c_str(), R_OK) == 0) &&
+			(Battery_LoadGpioTable() == 0) &&
+			(EdgeReplay_Load(edges_path.c_str()) == 0))
+		{
+			edge_replay = true;
+		}
+	}
+
+	// Replayed and generated samples still name their lines by the table.
+	if ((test_name == NULL) && !EngineSource())
+	{
+		return Battery_LoadGpioTable();
+	}
+
+	if ((test_name == NULL) && ((latency_path != NULL) || edge_replay))
+	{
+		GpioEngine_SetBackend(GpioBackend_Mock());
+	}
+
+	Battery_Init();
+
+	return 0;
+}
+
+// Stops the replay and logs how it kept up, once, at the end of the log or on exit.
+void ReplayFinish(void)
+{
+	ReplayStats stats;
+
+	if ((replay_path == NULL) || replay_finished)
+	{
+		return;
+	}
+
+	replay_finished = true;
+
+	Replay_Stop();
+	Replay_GetStats(&stats);
+
+	if (edge_replay)
+	{
+		EdgeReplayStats edges;
+
+		EdgeReplay_Stop();
+		EdgeReplay_GetStats(&edges);
+
+		DBGPRT(DBG_INFO1, "ReplayFinish: %llu of %llu edges, %llu late, %llu dropped\n",
+				(unsigned long long)edges.played, (unsigned long long)edges.edges,
+				(unsigned long long)edges.late, (unsigned long long)edges.dropped);
+	}
+
+	DBGPRT(DBG_INFO1, "ReplayFinish: %llu records in %.3f s, %.0f records/s, %llu unconsumed\n",
+			(unsigned long long)stats.records, (double)stats.wall_ns / 1e9, stats.records_per_sec,
+			(unsigned long long)stats.unconsumed);
+	DBGPRT(DBG_INFO1, "ReplayFinish: lateness p50 %u us, p99 %u us, max %u us\n",
+			stats.late_p50_us, stats.late_p99_us, stats.late_max_us);
+	DBGPRT(DBG_INFO1, "ReplayFinish: consume latency p50 %u us, p99 %u us, max %u us\n",
+			stats.consume_p50_us, stats.consume_p99_us, stats.consume_max_us);
+}
+
+// Waits for the replay to reach the end of its logs, the last values stay shown.
+CoTask ReplayMonitor(void)
+{
+	ReplayStats stats;
+	EdgeReplayStats edges;
+
+	edges.done = !edge_replay;
+
+	do
+	{
+		co_await Co_SleepFor(REPLAY_POLL_MS);
+
+		Replay_GetStats(&stats);
+
+		if (edge_replay)
+		{
+			EdgeReplay_GetStats(&edges);
+		}
+	}
+	while (!stats.done || !edges.done);
+
+	ReplayFinish();
+}
+
+int StageBattery(void)
+{
+	int result = 0;
+
+	if (replay_path != NULL)
+	{
+		// The lines come from the engine when their edges are replayed.
+		uint32_t fields = edge_replay ? (BATTERY_FIELD_ALL & ~BATTERY_FIELD_LINES) : BATTERY_FIELD_ALL;
+
+		if (edge_replay && (replay_speed != 1.0))
+		{
+			DBGPRT(DBG_WARN, "StageBattery: edges replay in real time, samples at %.2fx\n", replay_speed);
+		}
+
+		if (Replay_Start(replay_path, replay_speed, fields) != 0)
+		{
+			DBGPRT(DBG_ERR, "StageBattery: Replay_Start failed for %s\n", replay_path);
+			replay_finished = true;
+			result = -1;
+		}
+		else
+		{
+			if (edge_replay && (EdgeReplay_Start() != 0))
+			{
+				DBGPRT(DBG_ERR, "StageBattery: EdgeReplay_Start failed for %s\n", replay_path);
+				result = -1;
+			}
+
+			Co_Spawn(ReplayMonitor());
+		}
+	}
+	else if (generator_rate > 0)
+	{
+		if (StartGenerator() != 0)
+		{
+			DBGPRT(DBG_ERR, "StageBattery: StartGenerator failed\n");
+			result = -1;
+		}
+	}
+
+	if (record_path != NULL)
+	{
+		if (Recorder_Start(record_path) != 0)
+		{
+			DBGPRT(DBG_ERR, "StageBattery: Recorder_Start failed for %s\n", record_path);
+			result = -1;
+		}
+
+		std::string edges_path = std::string(record_path) + EDGE_LOG_SUFFIX;
+
+		if (EngineSource() && (EdgeRecorder_Start(edges_path.c_str()) != 0))
+		{
+			DBGPRT(DBG_ERR, "StageBattery: EdgeRecorder_Start failed for %s\n", edges_path.c_str());
+			result = -1;
+		}
+	}
+
+	if (History_Init(HISTORY_DEFAULT_CAPACITY, HISTORY_DEFAULT_PERIOD_MS) != 0)
+	{
+		DBGPRT(DBG_ERR, "StageBattery: History_Init failed, trends disabled\n");
+	}
+
+	return result;
+}
+
+int StagePlugins(void)
+{
+	return LoadPlugin(test_name, &test_plugin);
+}
+
+void IdleSettings(const AppConfig *config, IdleConfig *idle)
+{
+	idle->device            = TOUCHSCREEN;
+	idle->dim_s             = config->idle_dim_s;
+	idle->blank_s           = config->idle_blank_s;
+	idle->dim_percent       = config->idle_dim_percent;
+	idle->sampler_timer     = battery_timer;
+	idle->sampler_period_ms = config->battery_period_ms;
+	idle->sampler_idle_ms   = config->idle_sampler_ms;
+	idle->sampler           = battery_task;
+}
+
+// Config reload on the reactor thread, moves the battery timer to the new
+// period and samples at once so new thresholds show. The monitors read their
+// periods each time round.
+void ConfigChanged(const AppConfig *old_config, const AppConfig *new_config)
+{
+	IdleConfig idle;
+
+	if (idle_started)
+	{
+		IdleSettings(new_config, &idle);
+		Idle_Update(&idle);
+	}
+	else if (old_config->battery_period_ms != new_config->battery_period_ms)
+	{
+		Reactor_SetTimer(battery_timer, new_config->battery_period_ms);
+	}
+
+	battery_task(NULL);
+	lines_task(NULL);
+}
+
+// Registers the reactor sources, the screen is built and every source is
+// open, so the first values go straight to the labels.
+int StageTasks(void)
+{
+	const AppConfig * config = Config_Get();
+
+	Backlight_Start();
+
+	battery_timer = Reactor_AddTimer(config->battery_period_ms, battery_task, NULL);
+
+	// Only the GPIO engine signals line changes, other sources are polled.
+	Co_Spawn(LinesMonitor(EngineSource() ? TableBits() : 0));
+
+	if (HardwareSource())
+	{
+		Co_Spawn(SnapshotMonitor());
+	}
+
+	Co_Spawn(TrendMonitor());
+
+	// The latency bench needs the display running throughout.
+	if (latency_path == NULL)
+	{
+		IdleConfig idle;
+
+		IdleSettings(config, &idle);
+		idle_started = (Idle_Start(&idle) == 0);
+	}
+
+	Config_Watch(ConfigChanged);
+
+	Publisher_Start(BATTERY_SUBSCRIBE_PATH);
+
+	int uevent_fd = OpenUevent();
+
+	if (uevent_fd >= 0)
+	{
+		Co_Spawn(UeventMonitor(uevent_fd));
+	}
+
+	if ((latency_path != NULL) && HardwareSource())
+	{
+		latency_bench_started = (pthread_create(&latency_bench_tid, NULL, latency_bench, NULL) == 0);
+	}
+
+	return 0;
+}
+
+static const StartupStage app_stages[] =
+{
+	// name         func              deps
+	{ "backlight",  StageBacklight,   { NULL } },
+	{ "gui",        StageGui,         { NULL } },
+	{ "audio",      StageAudio,       { NULL } },
+	{ "gpio",       StageGpio,        { NULL } },
+	{ "battery",    StageBattery,     { "gpio", NULL } },
+	{ "tasks",      StageTasks,       { "gui", "gpio", "battery", "backlight" } },
+};
+
+// Runs the test_name plugin on the GPIO lines instead of the battery screen.
+static const StartupStage test_stages[] =
+{
+	// name         func              deps
+	{ "backlight",  StageBacklight,   { NULL } },
+	{ "gui",        StageGui,         { NULL } },
+	{ "audio",      StageAudio,       { NULL } },
+	{ "gpio",       StageGpio,        { NULL } },
+	{ "plugins",    StagePlugins,     { NULL } },
+};
+
+// Runs the loaded test plugin into test_result, then stops the reactor that
+// was dispatching its GPIO edges meanwhile.
+void *RunPluginTest(void *arg)
+{
+	UNUSED(arg);
+
+	test_result = 1;
+
+	if ((test_plugin.handle != NULL) && (test_plugin.init(NULL) == NULL))
+	{
+		test_result = (test_plugin.start(NULL) == NULL) ? 0 : 1;
+		DBGPRT(DBG_INFO1, "RunPluginTest: %s %s\n", test_name, (test_result == 0) ? "PASSED" : "FAILED");
+		sleep(PLUGIN_RESULT_S);
+	}
+
+	Reactor_Stop();
+
+	return NULL;
+}
+
+// Once the reactor is stopped, so the lines are released off its thread.
+void EndPluginTest(void)
+{
+	if (test_plugin.handle != NULL)
+	{
+		test_plugin.end(NULL);
+		RunBatteryMonitorCleanup();
+		dlclose(test_plugin.handle);
+	}
+}
+
+// Reactor task in headless mode, every battery period for sources other than
+// the generator, which streams from its own sink.
+void headless_task(void *arg)
+{
+	UNUSED(arg);
+
+	BatterySample sample;
+
+	if (Battery_ReadSample(&sample, BATTERY_FIELD_ALL) == 0)
+	{
+		JsonLines_Write(0, &sample);
+
+		if (Publisher_Clients() > 0)
+		{
+			Publisher_Publish(&sample);
+		}
+	}
+}
+
+// Reactor fd handler in headless mode, a line changed so it gets its own line.
+void headless_gpio_event(void *arg)
+{
+	uint64_t count;
+
+	if (read((int)(intptr_t)arg, &count, sizeof(count)) == sizeof(count))
+	{
+		headless_task(NULL);
+	}
+}
+
+// Reactor fd handler, SIGINT or SIGTERM ends a headless run cleanly.
+void signal_event(void *arg)
+{
+	struct signalfd_siginfo info;
+
+	if (read((int)(intptr_t)arg, &info, sizeof(info)) == sizeof(info))
+	{
+		DBGPRT(DBG_INFO1, "signal_event: %s, stopping\n", strsignal((int)info.ssi_signo));
+		Reactor_Stop();
+	}
+}
+
+void HeadlessConfigChanged(const AppConfig *old_config, const AppConfig *new_config)
+{
+	if ((battery_timer >= 0) && (old_config->battery_period_ms != new_config->battery_period_ms))
+	{
+		Reactor_SetTimer(battery_timer, new_config->battery_period_ms);
+	}
+}
+
+// StageTasks without the display, backlight or idle manager.
+int StageHeadless(void)
+{
+	sigset_t signals;
+	int signal_fd;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+
+	if (((signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) ||
+		(Reactor_AddFd(signal_fd, signal_event, (void*)(intptr_t)signal_fd) < 0))
+	{
+		DBGPRT(DBG_ERR, "StageHeadless: signals will not stop the reactor\n");
+	}
+
+	if (generator_rate > 0)
+	{
+		return 0;
+	}
+
+	battery_timer = Reactor_AddTimer(Config_Get()->battery_period_ms, headless_task, NULL);
+
+	int gpio_fd = EngineSource() ? GpioEngine_EventFd() : -1;
+
+	if (gpio_fd >= 0)
+	{
+		Reactor_AddFd(gpio_fd, headless_gpio_event, (void*)(intptr_t)gpio_fd);
+	}
+
+	Config_Watch(HeadlessConfigChanged);
+
+	Publisher_Start(BATTERY_SUBSCRIBE_PATH);
+
+	return (battery_timer >= 0) ? 0 : -1;
+}
+
+// The acquisition stack only, for bench rigs and fleet logging.
+static const StartupStage headless_stages[] =
+{
+	// name         func              deps
+	{ "gpio",       StageGpio,        { NULL } },
+	{ "battery",    StageBattery,     { "gpio", NULL } },
+	{ "tasks",      StageHeadless,    { "gpio", "battery", NULL } },
+};
+
+// Stops the generator so no line is cut short and reports what was streamed.
+void HeadlessFinish(void)
+{
+	JsonLinesStats stats;
+
+	if (generator_rate > 0)
+	{
+		GeneratorStats generator;
+
+		Generator_Stop();
+		Generator_GetStats(&generator);
+
+		DBGPRT(DBG_INFO1, "HeadlessFinish: generator made %llu samples at %.0f Hz per pack, %llu batches late\n",
+				(unsigned long long)generator.samples, generator.achieved_hz, (unsigned long long)generator.late_batches);
+	}
+
+	JsonLines_GetStats(&stats);
+	JsonLines_Close();
+
+	DBGPRT(DBG_INFO1, "HeadlessFinish: %llu lines, %llu bytes, %llu dropped, slowest write %u us\n",
+			(unsigned long long)stats.records, (unsigned long long)stats.bytes,
+			(unsigned long long)stats.dropped, stats.write_max_us);
+}
+
+void FormatWall(int64_t wall_ns, const char * format, char * text, size_t size)
+{
+	time_t t = (time_t)(wall_ns / 1000000000LL);
+	struct tm local;
+
+	if ((localtime_r(&t, &local) == NULL) || (strftime(text, size, format, &local) == 0))
+	{
+		snprintf(text, size, "?");
+	}
+}
+
+void FormatDuration(int64_t ns, char * text, size_t size)
+{
+	long long s = (long long)(ns / 1000000000LL);
+
+	snprintf(text, size, "%lldh %02lldm %02llds", s / 3600, (s / 60) % 60, s % 60);
+}
+
+// --transitions, reads the log of the running app and prints what the GPIO
+// table's lines did.
+int PrintTransitions(void)
+{
+	TransitionRecord records[TRANSITIONS_REPORT_RECENT];
+	TransitionDay days[TRANSITIONS_REPORT_DAYS];
+	TransitionSession sessions[TRANSITIONS_REPORT_SESSIONS];
+	char when[32];
+	char duration[32];
+
+	if (Battery_LoadGpioTable() != 0)
+	{
+		return 1;
+	}
+
+	for (unsigned int i = 0; i < GpioTable_Count(); i++)
+	{
+		TransitionLog_AddLine((uint32_t)1 << i, GpioTable_Line(i)->name, GpioTable_Line(i)->active_low ? 0 : 1);
+	}
+
+	if (TransitionLog_Load(TRANSITION_LOG_PATH) != 0)
+	{
+		TransitionLog_Cleanup();
+		return 1;
+	}
+
+	size_t count = TransitionLog_Recent(records, TRANSITIONS_REPORT_RECENT);
+
+	printf("Last %zu transitions:\n", count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		FormatWall(records[i].wall_ns, "%Y-%m-%d %H:%M:%S", when, sizeof(when));
+		printf("  %s  %-16.*s %u%s\n", when, GPIO_LINE_NAME_LEN, records[i].line, records[i].value,
+				(records[i].flags & TRANSITION_FLAG_BOOT) ? "  boot" : "");
+	}
+
+	for (unsigned int i = 0; i < GpioTable_Count(); i++)
+	{
+		uint32_t bit = (uint32_t)1 << i;
+
+		printf("\n%s, active per day:\n", GpioTable_Line(i)->name);
+
+		count = TransitionLog_DailyActive(bit, days, TRANSITIONS_REPORT_DAYS);
+
+		for (size_t d = 0; d < count; d++)
+		{
+			FormatWall(days[d].day_wall_ns, "%Y-%m-%d", when, sizeof(when));
+			FormatDuration(days[d].active_ns, duration, sizeof(duration));
+			printf("  %s  %s\n", when, duration);
+		}
+
+		printf("%s, last sessions:\n", GpioTable_Line(i)->name);
+
+		count = TransitionLog_Sessions(bit, sessions, TRANSITIONS_REPORT_SESSIONS);
+
+		for (size_t n = 0; n < count; n++)
+		{
+			FormatWall(sessions[n].start_wall_ns, "%Y-%m-%d %H:%M:%S", when, sizeof(when));
+			FormatDuration(sessions[n].duration_ns, duration, sizeof(duration));
+			printf("  %s  %s%s\n", when, duration, sessions[n].open ? "  open" : "");
+		}
+	}
+
+	TransitionLog_Cleanup();
+
+	return 0;
+}
+
+// The startup stages undone in reverse once the reactor has returned: the
+// tasks stage's socket and sources, the recorders and history, then the GPIO
+// lines.
+void Shutdown(void)
+{
+	Publisher_Stop();
+
+	if (idle_started)
+	{
+		Idle_Stop();
+		idle_started = false;
+	}
+
+	Backlight_Stop();
+	EdgeRecorder_Stop();
+	Recorder_Stop();
+	History_Cleanup();
+	RunBatteryMonitorCleanup();
+}
+
+int main(int argc, char **argv)
+{
+
+	if (ParseArgs(argc, argv) != 0)
+	{
+		return 1;
+	}
+
+	if (transitions_report)
+	{
+		return PrintTransitions();
+	}
+
+	// Before anything logs, stdout may become the stream.
+	if ((test_name == NULL) && (json_path != NULL))
+	{
+		sigset_t signals;
+
+		if (JsonLines_Open(json_path) != 0)
+		{
+			return 1;
+		}
+
+		// Every thread started from here leaves these to the reactor's signalfd.
+		sigemptyset(&signals);
+		sigaddset(&signals, SIGINT);
+		sigaddset(&signals, SIGTERM);
+		pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+		// A reader going away shows up as dropped lines, not a silent exit.
+		signal(SIGPIPE, SIG_IGN);
+	}
+
+	Startup_Init();
+
+	Config_Init(config_path);
+
+	std::string version =
+			MAJOR_VER + std::string(".") +
+			MINOR_VER + std::string(".") +
+			BUILD_VER + std::string(".") +
+			PATCH_VER;
+
+	DBGPRT(DBG_INFO1, "Hospital Meter Battery Info version - %s\n", version.c_str());
+
+	Config_Print();
+
+	if ((Reactor_Init() != 0) || (Co_Init() != 0))
+	{
+		return 1;
+	}
+
+	if (test_name != NULL)
+	{
+		pthread_t plugin_tid;
+
+		Startup_Run(test_stages, sizeof(test_stages) / sizeof(test_stages[0]));
+
+		// The plugin blocks on its GPIO edges, this thread dispatches them.
+		if (pthread_create(&plugin_tid, NULL, RunPluginTest, NULL) != 0)
+		{
+			DBGPRT(DBG_ERR, "main: Failed to start the %s test\n", test_name);
+			test_result = 1;
+		}
+		else
+		{
+			Reactor_Run();
+			pthread_join(plugin_tid, NULL);
+		}
+
+		EndPluginTest();
+	}
+	else if (json_path != NULL)
+	{
+		Startup_Run(headless_stages, sizeof(headless_stages) / sizeof(headless_stages[0]));
+
+		Reactor_Run();
+
+		ReplayFinish();
+		HeadlessFinish();
+		Shutdown();
+	}
+	else
+	{
+		CoStats co_stats;
+
+		Startup_Run(app_stages, sizeof(app_stages) / sizeof(app_stages[0]));
+
+		Co_GetStats(&co_stats);
+		DBGPRT(DBG_INFO1, "main: %u monitors in %u bytes of coroutine frames, largest %u\n",
+				co_stats.tasks, co_stats.frame_bytes, co_stats.frame_max);
+
+		// This thread is the reactor from here on.
+		Reactor_Run();
+
+		ReplayFinish();
+
+		if (latency_bench_started)
+		{
+			pthread_join(latency_bench_tid, NULL);
+		}
+
+		Shutdown();
+	}
+
+	DBGPRT(DBG_INFO1, "Hospital Meter Battery Info Completed\n");
+
+	return test_result;
+}
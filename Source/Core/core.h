@@ -21,6 +21,9 @@
 #include <pthread.h>
 
 #include "debug.hpp"
+#include "Gui.hpp"
+#include "Metric.h"
+#include "History.hpp"
 
 #define MAJOR_VER       "1"
 #define MINOR_VER       "0"
@@ -33,10 +36,89 @@
 #define BTN_HEIGHT      (100)
 #define STRT_X          ((CANVAS_WIDTH / 2) - (BTN_WIDTH / 2))
 #define STRT_Y          (CANVAS_HEIGHT - BTN_HEIGHT - BRDR_WIDTH)
+
+// power_supply uevents refresh the battery labels without waiting for a period.
+#define UEVENT_BUFFER_LEN		(4096)
+#define UEVENT_POWER_SUPPLY		"SUBSYSTEM=power_supply"
+
+// --latency injects this many dock edges through the mock GPIO backend, one at
+// a time, waiting long enough between them for the in_base debounce to settle.
+#define LATENCY_BENCH_EDGES		(200)
+#define LATENCY_EDGE_GAP_MS		(100)
+#define LATENCY_EDGE_TIMEOUT_MS	(2000)
+
+// A replay is checked for the end of its log this often.
+#define REPLAY_POLL_MS			(1000)
+
+// --transitions prints this much of the transition log.
+#define TRANSITIONS_REPORT_RECENT	(20)
+#define TRANSITIONS_REPORT_DAYS		(7)
+#define TRANSITIONS_REPORT_SESSIONS	(10)
+
+// --test leaves the plugin's results on screen this long before ending it.
+#define PLUGIN_RESULT_S			(5)
+
+// Main screen rows, row n of a ScreenWidget sits at FIRST_ROW_Y + n * ROW_HEIGHT.
+#define SCREEN_FIRST_ROW_Y		(175)
+#define SCREEN_ROW_HEIGHT		(50)
+#define SCREEN_MAX_WIDGETS		(24)
+#define SCREEN_STALE_COLOR		LV_COLOR_GRAY	// values from the snapshot, until the first sample
+
+// Battery level trend over the free rows 7 and 8, redrawn from the history.
+#define TREND_X					(35)
+#define TREND_Y					(SCREEN_FIRST_ROW_Y + (7 * SCREEN_ROW_HEIGHT) + 5)
+#define TREND_W					(CANVAS_WIDTH - (2 * TREND_X))
+#define TREND_H					((2 * SCREEN_ROW_HEIGHT) - 10)
+#define TREND_WINDOW_MS			(24LL * 60 * 60 * 1000)
+#define TREND_PERIOD_MS			(10000)
+
 #define GPIOD_API		__attribute__((visibility("default")))
 
 typedef void *(*func_ptr)(void*);
 
+typedef enum
+{
+	SCREEN_COLOR_NONE,				// default label color
+	SCREEN_COLOR_LEVEL,				// follows the level of the bound metric
+} ScreenColor;
+
+// One label of a screen layout. metric is METRIC_COUNT for fixed text.
+typedef struct
+{
+	int row;
+	lv_coord_t x;
+	lv_coord_t w;
+	const char * text;
+	const lv_font_t * font;
+	lv_label_align_t align;
+	ScreenColor color;
+	MetricId metric;
+} ScreenWidget;
+
+// A value label bound to a metric.
+typedef struct
+{
+	lv_obj_t * obj;
+	bool set_color;
+} MetricLabel;
+
+// Level trend plot and its downsampled points.
+typedef struct
+{
+	lv_obj_t * obj;
+	HistoryPoint points[HISTORY_MAX_PLOT_POINTS];
+} Trend;
+
+// A diagnostic plugin. init, start and end return NULL on success.
+typedef struct
+{
+	std::string name;
+	void * handle;
+	func_ptr init;
+	func_ptr start;
+	func_ptr end;
+} Plugin;
+
 
 
 
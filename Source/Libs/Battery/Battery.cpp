@@ -16,43 +16,38 @@
 
 #include <iostream>
 #include <iomanip>
-#include <fstream>
 #include <string>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <unistd.h>
 #include <pthread.h>
-#include <gpiod.h>
+#include <atomic>
 #include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 
 #include "Battery.hpp"
+#include "GpioEngine.hpp"
+#include "GpioTable.hpp"
+#include "Replay.hpp"
+#include "TransitionLog.hpp"
 #include "debug.hpp"
 
 #undef DBGLVL
 #define DBGLVL DBG_INFO1
 
 static pthread_mutex_t battery_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::atomic<uint32_t> in_base_bit(0);
+static std::atomic<uint32_t> charging_bit(0);
 
-power_line power_lines[] =
+static void BatteryTransitionSink(void * arg, uint32_t bit, int value, int64_t t_ns)
 {
-		{
-				.line = NULL,
-				.pin  = IN_DOCK_PIN
-		},
-		{
-				.line = NULL,
-				.pin  = CHARGING_PIN
-		}
-};
-
-static struct gpiod_chip *in_dock_chip;
-static struct gpiod_line *in_dock_line;
-static struct gpiod_chip *charging_chip;
-static struct gpiod_line *charging_line;
+	UNUSED(arg);
 
-static int IsInDock   = -1;
-static int IsCharging = -1;
+	TransitionLog_Record(bit, value, t_ns, TRANSITION_FLAG_NONE);
+}
 
 void *RunBatteryMonitor(void *args)
 {
@@ -82,256 +77,171 @@ int Battery_Init(void)
 	if (InitializeBatteryGPIOs() < 0)
 	{
 		DBGPRT(DBG_ERR, "Battery_Init: InitializeGPIOs failed\n");
+		pthread_mutex_unlock(&battery_lock);
 		return -1;
 	}
 
-	pthread_mutex_unlock(&battery_lock);
-
-	return 0;
-}
-
-int InitializeBatteryGPIOs()
-{
-	DBGPRT(DBG_INFO1, "InitializeBatteryGPIOs: started\n");
-
-	// IN_DOCK_PORT = 1
-	const char *in_dock_port_name  = "gpiochip1";
-	const int in_dock_pin 		   = IN_DOCK_PIN;
-	// CHARGING_PORT = 5
-	const char *charging_port_name  = "gpiochip5";
-	const int charging_pin 		   = CHARGING_PIN;
-
-	if ((in_dock_chip = gpiod_chip_open_by_name(in_dock_port_name)) == NULL)
-	{
-		DBGPRT(DBG_ERR, "InitializeBatteryGPIOs: Failed to open in dock chip, %s\n", strerror(errno));
-		return -1;
-	}
-
-	if ((in_dock_line = gpiod_chip_get_line(in_dock_chip, in_dock_pin)) == NULL)
-	{
-		DBGPRT(DBG_ERR, "InitializeBatteryGPIOs: Unable to get in dock line, %s\n", strerror(errno));
-		return -1;
-	}
-
-	if ((gpiod_line_request_falling_edge_events(in_dock_line, "")) == -1)
+	for (unsigned int i = 0; i < GpioTable_Count(); i++)
 	{
-		DBGPRT(DBG_ERR, "InitializeBatteryGPIOs: Unable to set input in dock line active low, %s\n", strerror(errno));
-		return -1;
+		TransitionLog_AddLine((uint32_t)1 << i, GpioTable_Line(i)->name, GpioTable_Line(i)->active_low ? 0 : 1);
 	}
 
-	DBGPRT(DBG_INFO1, "InitializeBatteryGPIOs: in dock initialized\n");
-
-	if ((charging_chip = gpiod_chip_open_by_name(charging_port_name)) == NULL)
+	if (TransitionLog_Init(TRANSITION_LOG_PATH) != 0)
 	{
-		DBGPRT(DBG_ERR, "InitializeBatteryGPIOs: Failed to open charging chip, %s\n", strerror(errno));
-		return -1;
+		DBGPRT(DBG_ERR, "Battery_Init: TransitionLog_Init failed, transitions kept in memory only\n");
 	}
 
-	if ((charging_line = gpiod_chip_get_line(charging_chip, charging_pin)) == NULL)
-	{
-		DBGPRT(DBG_ERR, "InitializeBatteryGPIOs: Unable to get charging line, %s\n", strerror(errno));
-		return -1;
-	}
+	// The state the engine starts from opens the sessions for this boot.
+	uint32_t valid;
+	uint32_t state = GpioEngine_GetState(&valid);
+	int64_t now_ns = Battery_NowNs();
 
-	if ((gpiod_line_request_falling_edge_events(charging_line, "")) == -1)
+	for (unsigned int i = 0; i < GpioTable_Count(); i++)
 	{
-		DBGPRT(DBG_ERR, "InitializeBatteryGPIOs: Unable to set input charging line active low, %s\n", strerror(errno));
-		return -1;
-	}
-
-	DBGPRT(DBG_INFO1, "InitializeBatteryGPIOs: charging initialized\n");
-
-	return 0;
-}
+		uint32_t bit = (uint32_t)1 << i;
 
-int OpenGPIO(line_id line_id)
-{
-	if (power_lines[line_id].line == NULL)
-	{
-		if ((power_lines[line_id].line = gpiod_chip_get_line(in_dock_chip, power_lines[line_id].pin)) == NULL)
+		if (valid & bit)
 		{
-			DBGPRT(DBG_ERR, "InitializeGPIOs: Unable to get battery line, %s\n", strerror(errno));
-			return -1;
+			TransitionLog_Record(bit, (state & bit) ? 1 : 0, now_ns, TRANSITION_FLAG_BOOT);
 		}
 	}
 
-	if ((gpiod_line_request_falling_edge_events(power_lines[line_id].line, CONSUMER)) == -1)
+	GpioEngine_AddSink(BatteryTransitionSink, NULL);
+
+	// Without the engine the lines are still read directly, just not cached.
+	if (GpioEngine_Start() != 0)
 	{
-		DBGPRT(DBG_ERR, "InitializeGPIOs: Unable to set input battery line active low, %s\n", strerror(errno));
-		return -1;
+		DBGPRT(DBG_ERR, "Battery_Init: GpioEngine_Start failed\n");
 	}
 
+	pthread_mutex_unlock(&battery_lock);
+
 	return 0;
 }
 
-int ReadGPIO(uint32_t GPIO)
+// The Rev9 lines, for boards without a GPIO table file.
+static void DefaultGpioLines(GpioLineConfig * lines)
 {
-	int result = -1;
-
-	switch (GPIO)
-	{
-	case BATTERY_GPIO_IN_BASE:
-		result = GetGPIOLineValue(LINE_IN_BASE);
-		DBGPRT(DBG_INFO1, "ReadGPIO: GPIO value for In Base: %d\n", result);
-		break;
-	case BATTERY_GPIO_CHARGING:
-		result = GetGPIOLineValue(LINE_CHARGING);
-		DBGPRT(DBG_INFO1, "ReadGPIO: GPIO value for Charging: %d\n", result);
-		break;
-	default:
-		break;
-	}
-
-	return result;
+	memset(lines, 0, 2 * sizeof(GpioLineConfig));
+
+	// IN_DOCK is active low, the meter is in the base while it reads 0.
+	snprintf(lines[0].name, sizeof(lines[0].name), "%s", GPIO_LINE_IN_BASE);
+	snprintf(lines[0].chip, sizeof(lines[0].chip), "gpiochip%d", IN_DOCK_PORT);
+	lines[0].offset      = IN_DOCK_PIN;
+	lines[0].edges       = GPIO_EDGE_BOTH;
+	lines[0].active_low  = true;
+	lines[0].debounce_ms = IN_DOCK_DEBOUNCE_MS;
+
+	snprintf(lines[1].name, sizeof(lines[1].name), "%s", GPIO_LINE_CHARGING);
+	snprintf(lines[1].chip, sizeof(lines[1].chip), "gpiochip%d", CHARGING_PORT);
+	lines[1].offset      = CHARGING_PIN;
+	lines[1].edges       = GPIO_EDGE_BOTH;
+	lines[1].active_low  = false;
+	lines[1].debounce_ms = CHARGING_DEBOUNCE_MS;
 }
 
-void CloseGPIOs()
+int Battery_LoadGpioTable(void)
 {
-	if (in_dock_line != NULL)
-	{
-		gpiod_line_release(in_dock_line);
-	}
+	GpioLineConfig defaults[2];
 
-	if (in_dock_chip != NULL)
-	{
-		gpiod_chip_close(in_dock_chip);
-		in_dock_chip = NULL;
-	}
+	DefaultGpioLines(defaults);
 
-	if (charging_line != NULL)
+	if (GpioTable_Load(GPIO_TABLE_PATH, defaults, 2) < 0)
 	{
-		gpiod_line_release(charging_line);
+		DBGPRT(DBG_ERR, "Battery_LoadGpioTable: No GPIO lines\n");
+		return -1;
 	}
 
-	if (charging_chip != NULL)
-	{
-		gpiod_chip_close(charging_chip);
-		charging_chip = NULL;
-	}
-}
-
-void CloseGPIO(line_id line_id)
-{
-	if (power_lines[line_id].line != NULL)
-	{
-		gpiod_line_release(power_lines[line_id].line);
-		power_lines[line_id].line = NULL;
-	}
+	return 0;
 }
 
-int GetGPIOLineValue(line_id line_id)
+int InitializeBatteryGPIOs()
 {
-	struct gpiod_line * line = power_lines[line_id].line;
+	DBGPRT(DBG_INFO1, "InitializeBatteryGPIOs: started\n");
 
-	if (line == NULL)
+	if (Battery_LoadGpioTable() != 0)
 	{
-		DBGPRT(DBG_ERR, "GetGPIOLineValue: GPIO was null\n");
 		return -1;
 	}
 
-	return gpiod_line_get_value(power_lines[line_id].line);
-}
-
-void MonitorForGPIOEvent(uint32_t * GPIOs)
-{
-	struct gpiod_line_bulk bulk_lines;
-
-	gpiod_line_bulk_init(&bulk_lines);
-
-	for(int i = 0; i < LINE_MAX; i++)
+	for (unsigned int i = 0; i < GpioTable_Count(); i++)
 	{
-		if (bulk_lines.num_lines < GPIOD_LINE_BULK_MAX_LINES)
+		if (GpioEngine_AddLine(GpioTable_Line(i), (uint32_t)1 << i) != 0)
 		{
-			if (power_lines[i].line != NULL)
-			{
-				gpiod_line_bulk_add(&bulk_lines, power_lines[i].line);
-			}
+			DBGPRT(DBG_ERR, "InitializeBatteryGPIOs: Unable to add line %s\n", GpioTable_Line(i)->name);
+			GpioEngine_Close();
+			return -1;
 		}
 	}
 
-	struct gpiod_line_bulk event_bulk_lines;
-
-	gpiod_line_bulk_init(&event_bulk_lines);
-
-	if (gpiod_line_event_wait_bulk(&bulk_lines, NULL, &event_bulk_lines) <= 0)
+	if (GpioEngine_Open() != 0)
 	{
-		DBGPRT(DBG_ERR, "MonitorForGPIOEvent: No events were returned for any lines\n");
-		return;
+		DBGPRT(DBG_ERR, "InitializeBatteryGPIOs: Unable to request GPIO lines\n");
+		GpioEngine_Close();
+		return -1;
 	}
 
-	for (unsigned int i = 0; i < event_bulk_lines.num_lines; i++)
-	{
-		struct gpiod_line * event_line = gpiod_line_bulk_get_line(&event_bulk_lines, i);
+	in_base_bit.store(GpioTable_Bit(GPIO_LINE_IN_BASE));
+	charging_bit.store(GpioTable_Bit(GPIO_LINE_CHARGING));
 
-		if (event_line != NULL)
-		{
-			struct gpiod_line_event event;
+	DBGPRT(DBG_INFO1, "InitializeBatteryGPIOs: %u lines initialized\n", GpioTable_Count());
 
-			unsigned int line_offset = gpiod_line_offset(event_line);
-
-			gpiod_line_event_read(event_line, &event);
+	return 0;
+}
 
-			if (line_offset == IN_DOCK_PIN)
-			{
-				*GPIOs |= BATTERY_GPIO_IN_BASE;
-			}
-			else if (line_offset == CHARGING_PIN)
-			{
-				*GPIOs |= BATTERY_GPIO_CHARGING;
-			}
-		}
-	}
+void CloseGPIOs()
+{
+	GpioEngine_Close();
+	TransitionLog_Cleanup();
 }
 
-void *BatteryTaskLoop(void *arg)
+// Cached by the engine, or one bulk read of the chips if it is not running.
+static int GpioReadLine(uint32_t bit)
 {
-	UNUSED(arg);
+	int value = (bit != 0) ? GpioEngine_GetLine(bit) : -1;
 
-	while (1)
+	if ((value >= 0) || (bit == 0))
 	{
-		uint32_t GPIOs = 0;
+		return value;
+	}
 
-		MonitorForGPIOEvent(&GPIOs);
+	uint32_t valid;
+	uint32_t state = GpioEngine_Read(&valid);
 
-		if (GPIOs == BATTERY_GPIO_IN_BASE)
-		{
-			IsInDock = IsMeterInDock();
-		}
-
-		if (GPIOs == BATTERY_GPIO_CHARGING)
-		{
-			IsCharging = IsBatteryCharging();
-		}
+	if ((valid & bit) == 0)
+	{
+		DBGPRT(DBG_ERR, "GpioReadLine: Get line 0x%x value failed\n", bit);
+		return -1;
 	}
+
+	return (state & bit) ? 1 : 0;
 }
 
-int IsMeterInDock(void)
+// Every table line, set while active.
+static uint32_t GpioReadActive(void)
 {
-	int in_dock_value = -1;
+	uint32_t lines = GpioTable_Count();
+	uint32_t all = (lines >= 32) ? 0xFFFFFFFF : (((uint32_t)1 << lines) - 1);
+	uint32_t valid;
+	uint32_t active = GpioEngine_GetActive(&valid);
 
-	if ((in_dock_value = gpiod_line_get_value(in_dock_line)) == NULL)
+	if ((valid & all) == all)
 	{
-		DBGPRT(DBG_ERR, "IsMeterInDock: Get in dock value failed, %s\n", strerror(errno));
-		in_dock_value = -1;
+		return active;
 	}
 
-	return in_dock_value;
-}
+	uint32_t state = GpioEngine_Read(&valid);
+	uint32_t active_low = 0;
 
-int IsBatteryCharging(void)
-{
-	int charging_value = -1;
-
-	if ((charging_value = gpiod_line_get_value(charging_line)) == NULL)
+	for (unsigned int i = 0; i < lines; i++)
 	{
-		DBGPRT(DBG_ERR, "IsBatteryCharging: Get charging value failed, %s\n", strerror(errno));
-		charging_value = -1;
+		active_low |= GpioTable_Line(i)->active_low ? ((uint32_t)1 << i) : 0;
 	}
 
-	return charging_value;
+	return (state ^ active_low) & valid;
 }
 
-int GetBatteryPercentage(void)
+static int SysfsReadLevel(void)
 {
 	FILE * file;
 	int percentage = -1;
@@ -341,7 +251,7 @@ int GetBatteryPercentage(void)
 
 	if ((file = fopen(BATTERY_CAPACITY_FILE, "r")) == NULL)
 	{
-		DBGPRT(DBG_ERR, "GetBatteryPercentage: Failed to open Battery Capacity File\n");
+		DBGPRT(DBG_ERR, "SysfsReadLevel: Failed to open Battery Capacity File\n");
 		return -1;
 	}
 
@@ -352,13 +262,13 @@ int GetBatteryPercentage(void)
 
 	if (fclose(file) != 0)
 	{
-		DBGPRT(DBG_ERR, "GetBatteryPercentage: Failed to close Battery Capacity File\n");
+		DBGPRT(DBG_ERR, "SysfsReadLevel: Failed to close Battery Capacity File\n");
 		return -1;
 	}
 
 	/*if ((file = fopen(BATTERY_CHARGE_NOW_FILE, "r")) == NULL)
 	{
-		DBGPRT(DBG_ERR, "GetBatteryPercentage: Failed to open Battery Charge Now File\n");
+		DBGPRT(DBG_ERR, "SysfsReadLevel: Failed to open Battery Charge Now File\n");
 		return -1;
 	}
 
@@ -371,7 +281,7 @@ int GetBatteryPercentage(void)
 
 	if ((file = fopen(BATTERY_CHARGE_FULL_FILE, "r")) == NULL)
 	{
-		DBGPRT(DBG_ERR, "GetBatteryPercentage: Failed to open Battery Charge Full File\n");
+		DBGPRT(DBG_ERR, "SysfsReadLevel: Failed to open Battery Charge Full File\n");
 		return -1;
 	}
 
@@ -384,32 +294,39 @@ int GetBatteryPercentage(void)
 
 	int percentage = (charge_now * 100) / charge_full;*/
 
-	DBGPRT(DBG_INFO4, "GetBatteryPercentage: Level = %d\n", percentage);
+	DBGPRT(DBG_INFO4, "SysfsReadLevel: Level = %d\n", percentage);
 
 	return percentage;
 }
 
-std::string GetBatteryHealth(void)
+// First word of the health file, straight into health. No allocation, it
+// is read every battery period.
+static void SysfsReadHealth(char * health, size_t len)
 {
-	std::ifstream file (BATTERY_HEALTH_FILE);
-	std::string h = "N/A";
+	char text[BATTERY_HEALTH_LEN];
+	FILE * file;
 
-	if (!file.is_open())
+	if ((file = fopen(BATTERY_HEALTH_FILE, "r")) == NULL)
 	{
-		DBGPRT(DBG_ERR, "GetBatteryHealth: Failed to open Battery Health File\n");
-		return "Error";
+		DBGPRT(DBG_ERR, "SysfsReadHealth: Failed to open Battery Health File\n");
+		snprintf(health, len, "Error");
+		return;
 	}
-	else
+
+	// %15s, the field width has to be a literal.
+	static_assert(BATTERY_HEALTH_LEN == 16, "update the fscanf width");
+
+	if (fscanf(file, "%15s", text) != 1)
 	{
-		file >> h;
+		snprintf(text, sizeof(text), "N/A");
 	}
 
-	file.close();
+	fclose(file);
 
-	return h;
+	snprintf(health, len, "%s", text);
 }
 
-int GetBatteryTemp(void)
+static int SysfsReadTemp(void)
 {
 	FILE * file;
 	int temp = -1;
@@ -417,13 +334,13 @@ int GetBatteryTemp(void)
 
 	if ((file = fopen(BATTERY_TEMP_FILE, "r")) == NULL)
 	{
-		DBGPRT(DBG_ERR, "GetBatteryTemp: Failed to open Battery Temp File\n");
+		DBGPRT(DBG_ERR, "SysfsReadTemp: Failed to open Battery Temp File\n");
 		return -1;
 	}
 
 	if ((error = fscanf(file, "%d", &temp)) == EOF)
 	{
-		DBGPRT(DBG_ERR, "GetBatteryTemp: Failed to get Battery Temp\n");
+		DBGPRT(DBG_ERR, "SysfsReadTemp: Failed to get Battery Temp\n");
 		temp = -1;
 	}
 
@@ -432,7 +349,7 @@ int GetBatteryTemp(void)
 	return temp;
 }
 
-int GetBatteryCurrent(void)
+static int SysfsReadCurrent(void)
 {
 	FILE * file;
 	int current = -1;
@@ -440,23 +357,23 @@ int GetBatteryCurrent(void)
 
 	if ((file = fopen(BATTERY_CURRENT_FILE, "r")) == NULL)
 	{
-		DBGPRT(DBG_ERR, "GetBatteryCurrent: Failed to open Battery Current File\n");
+		DBGPRT(DBG_ERR, "SysfsReadCurrent: Failed to open Battery Current File\n");
 		return -1;
 	}
 	if ((error = fscanf(file, "%d", &current)) == EOF)
 	{
-		DBGPRT(DBG_ERR, "GetBatteryCurrent: Failed to get Battery Current\n");
+		DBGPRT(DBG_ERR, "SysfsReadCurrent: Failed to get Battery Current\n");
 		current = -1;
 	}
 
 	current = current * 0.001;
-	DBGPRT(DBG_INFO4, "GetBatteryCurrent: %d\n", current);
+	DBGPRT(DBG_INFO4, "SysfsReadCurrent: %d\n", current);
 	fclose(file);
 
 	return current;
 }
 
-int GetBatteryVoltage(void)
+static int SysfsReadVoltage(void)
 {
 	FILE * file;
 	int voltage = -1;
@@ -464,23 +381,215 @@ int GetBatteryVoltage(void)
 
 	if ((file = fopen(BATTERY_VOLTAGE_FILE, "r")) == NULL)
 	{
-		DBGPRT(DBG_ERR, "GetBatteryVoltage: Failed to open Battery Voltage File\n");
+		DBGPRT(DBG_ERR, "SysfsReadVoltage: Failed to open Battery Voltage File\n");
 		return -1;
 	}
 	if ((error = fscanf(file, "%d", &voltage)) == EOF)
 	{
-		DBGPRT(DBG_ERR, "GetBatteryVoltage: Failed to get Battery Voltage\n");
+		DBGPRT(DBG_ERR, "SysfsReadVoltage: Failed to get Battery Voltage\n");
 		voltage = -1;
 	}
 
 	voltage = voltage * 0.0001;
-	DBGPRT(DBG_INFO4, "GetBatteryVoltage: %d\n", voltage);
+	DBGPRT(DBG_INFO4, "SysfsReadVoltage: %d\n", voltage);
 	fclose(file);
 
 	return voltage;
 }
 
+int Battery_ReadLines(BatterySample * sample, uint32_t fields)
+{
+	if (fields & BATTERY_FIELD_IN_DOCK)
+	{
+		sample->in_dock = GpioReadLine(in_base_bit.load());
+	}
+
+	if (fields & BATTERY_FIELD_CHARGING)
+	{
+		sample->charging = GpioReadLine(charging_bit.load());
+	}
+
+	if (fields & BATTERY_FIELD_GPIO)
+	{
+		sample->gpio       = GpioReadActive();
+		sample->gpio_table = GpioTable_Hash();
+	}
+
+	sample->fields |= fields & BATTERY_FIELD_LINES;
+
+	return 0;
+}
+
+static int SysfsRead(void * ctx, BatterySample * sample, uint32_t fields)
+{
+	UNUSED(ctx);
+
+	if (fields & BATTERY_FIELD_CURRENT)
+	{
+		sample->current = SysfsReadCurrent();
+	}
+
+	if (fields & BATTERY_FIELD_VOLTAGE)
+	{
+		sample->voltage = SysfsReadVoltage();
+	}
+
+	if (fields & BATTERY_FIELD_TEMP)
+	{
+		sample->temp = SysfsReadTemp();
+	}
+
+	if (fields & BATTERY_FIELD_LEVEL)
+	{
+		sample->level = SysfsReadLevel();
+	}
+
+	if (fields & BATTERY_FIELD_HEALTH)
+	{
+		SysfsReadHealth(sample->health, sizeof(sample->health));
+	}
+
+	sample->fields = fields & BATTERY_FIELD_ALL & ~BATTERY_FIELD_LINES;
+
+	return Battery_ReadLines(sample, fields);
+}
+
+static const BatterySource sysfs_source =
+{
+		.name = "sysfs",
+		.read = SysfsRead,
+		.ctx  = NULL,
+		.recorded = false
+};
+
+static std::atomic<const BatterySource *> active_source(&sysfs_source);
+
+int64_t Battery_NowNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((int64_t)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+void Battery_SetSource(const BatterySource * source)
+{
+	if (source == NULL)
+	{
+		source = &sysfs_source;
+	}
 
+	DBGPRT(DBG_INFO1, "Battery_SetSource: reading battery from %s\n", source->name);
 
+	active_source.store(source);
+}
 
+const BatterySource * Battery_GetSource(void)
+{
+	return active_source.load();
+}
+
+int Battery_ReadSample(BatterySample * sample, uint32_t fields)
+{
+	const BatterySource * source = active_source.load();
 
+	memset(sample, 0, sizeof(*sample));
+	sample->t_ns = Battery_NowNs();
+
+	int result = source->read(source->ctx, sample, fields);
+
+	if (!source->recorded)
+	{
+		Recorder_Write(sample);
+	}
+
+	return result;
+}
+
+int IsMeterInDock(void)
+{
+	BatterySample sample;
+
+	if ((Battery_ReadSample(&sample, BATTERY_FIELD_IN_DOCK) != 0) || !(sample.fields & BATTERY_FIELD_IN_DOCK))
+	{
+		return -1;
+	}
+
+	return sample.in_dock;
+}
+
+int IsBatteryCharging(void)
+{
+	BatterySample sample;
+
+	if ((Battery_ReadSample(&sample, BATTERY_FIELD_CHARGING) != 0) || !(sample.fields & BATTERY_FIELD_CHARGING))
+	{
+		return -1;
+	}
+
+	return sample.charging;
+}
+
+int GetBatteryPercentage(void)
+{
+	BatterySample sample;
+
+	if ((Battery_ReadSample(&sample, BATTERY_FIELD_LEVEL) != 0) || !(sample.fields & BATTERY_FIELD_LEVEL))
+	{
+		return -1;
+	}
+
+	return sample.level;
+}
+
+int GetBatteryHealth(char * health, size_t len)
+{
+	BatterySample sample;
+
+	if ((Battery_ReadSample(&sample, BATTERY_FIELD_HEALTH) != 0) || !(sample.fields & BATTERY_FIELD_HEALTH))
+	{
+		snprintf(health, len, "Error");
+		return -1;
+	}
+
+	snprintf(health, len, "%.*s", BATTERY_HEALTH_LEN, sample.health);
+
+	return 0;
+}
+
+int GetBatteryTemp(void)
+{
+	BatterySample sample;
+
+	if ((Battery_ReadSample(&sample, BATTERY_FIELD_TEMP) != 0) || !(sample.fields & BATTERY_FIELD_TEMP))
+	{
+		return -1;
+	}
+
+	return sample.temp;
+}
+
+int GetBatteryCurrent(void)
+{
+	BatterySample sample;
+
+	if ((Battery_ReadSample(&sample, BATTERY_FIELD_CURRENT) != 0) || !(sample.fields & BATTERY_FIELD_CURRENT))
+	{
+		return -1;
+	}
+
+	return sample.current;
+}
+
+int GetBatteryVoltage(void)
+{
+	BatterySample sample;
+
+	if ((Battery_ReadSample(&sample, BATTERY_FIELD_VOLTAGE) != 0) || !(sample.fields & BATTERY_FIELD_VOLTAGE))
+	{
+		return -1;
+	}
+
+	return sample.voltage;
+}
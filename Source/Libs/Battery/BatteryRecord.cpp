@@ -0,0 +1,220 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Battery Record
+ *  Source Filename  - BatteryRecord.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Encoder and checks for the battery wire record. Every
+ *  				   call works on the caller's buffer, nothing is allocated.
+ *
+ *******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+#include "Battery.hpp"
+#include "BatteryRecord.hpp"
+
+static inline void Store16(uint8_t * p, uint16_t v)
+{
+	v = htole16(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline void Store32(uint8_t * p, uint32_t v)
+{
+	v = htole32(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline void Store64(uint8_t * p, uint64_t v)
+{
+	v = htole64(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline size_t ExtPadded(size_t length)
+{
+	return (length + (BATTERY_RECORD_EXT_ALIGN - 1)) & ~(size_t)(BATTERY_RECORD_EXT_ALIGN - 1);
+}
+
+int BatteryRecord_Encode(const BatterySample * sample, uint8_t * buf, size_t len)
+{
+	if ((sample == NULL) || (buf == NULL) || (len < BATTERY_RECORD_FIXED_SIZE))
+	{
+		return -1;
+	}
+
+	buf[BATTERY_RECORD_OFF_SCHEMA]     = BATTERY_RECORD_SCHEMA;
+	buf[BATTERY_RECORD_OFF_FIXED_SIZE] = BATTERY_RECORD_FIXED_SIZE;
+	Store16(buf + BATTERY_RECORD_OFF_TOTAL_SIZE, BATTERY_RECORD_FIXED_SIZE);
+	Store32(buf + BATTERY_RECORD_OFF_PRESENCE, sample->fields & BATTERY_FIELD_ALL);
+	Store64(buf + BATTERY_RECORD_OFF_T_NS, (uint64_t)sample->t_ns);
+	Store32(buf + BATTERY_RECORD_OFF_CURRENT, (uint32_t)sample->current);
+	Store32(buf + BATTERY_RECORD_OFF_VOLTAGE, (uint32_t)sample->voltage);
+	Store32(buf + BATTERY_RECORD_OFF_TEMP, (uint32_t)sample->temp);
+	Store16(buf + BATTERY_RECORD_OFF_LEVEL, (uint16_t)(int16_t)sample->level);
+	buf[BATTERY_RECORD_OFF_IN_DOCK]  = (uint8_t)(int8_t)sample->in_dock;
+	buf[BATTERY_RECORD_OFF_CHARGING] = (uint8_t)(int8_t)sample->charging;
+
+	// strncpy pads with NULs so no stack bytes end up on the wire.
+	strncpy((char *)(buf + BATTERY_RECORD_OFF_HEALTH), sample->health, BATTERY_HEALTH_LEN);
+
+	if (sample->fields & BATTERY_FIELD_GPIO)
+	{
+		uint8_t gpio[2 * sizeof(uint32_t)];
+
+		Store32(gpio, sample->gpio);
+		Store32(gpio + sizeof(uint32_t), sample->gpio_table);
+
+		return BatteryRecord_AddExt(buf, len, BATTERY_EXT_GPIO, gpio, sizeof(gpio));
+	}
+
+	return BATTERY_RECORD_FIXED_SIZE;
+}
+
+int BatteryRecord_AddExt(uint8_t * buf, size_t len, uint16_t type, const void * data, uint16_t length)
+{
+	if ((buf == NULL) || (len < BATTERY_RECORD_FIXED_SIZE) || ((data == NULL) && (length > 0)))
+	{
+		return -1;
+	}
+
+	size_t total = BatteryRecord_Load16(buf + BATTERY_RECORD_OFF_TOTAL_SIZE);
+	size_t next  = total + BATTERY_RECORD_EXT_HDR + ExtPadded(length);
+
+	if ((next > len) || (next > BATTERY_RECORD_MAX_SIZE))
+	{
+		return -1;
+	}
+
+	uint8_t * ext = buf + total;
+
+	Store16(ext, type);
+	Store16(ext + 2, length);
+
+	if (length > 0)
+	{
+		memcpy(ext + BATTERY_RECORD_EXT_HDR, data, length);
+	}
+
+	memset(ext + BATTERY_RECORD_EXT_HDR + length, 0, ExtPadded(length) - length);
+	Store16(buf + BATTERY_RECORD_OFF_TOTAL_SIZE, (uint16_t)next);
+
+	return (int)next;
+}
+
+int BatteryRecord_View(const uint8_t * buf, size_t len, BatteryRecordView * view)
+{
+	if ((buf == NULL) || (view == NULL) || (len < BATTERY_RECORD_FIXED_SIZE))
+	{
+		return -1;
+	}
+
+	// Later schemas only append to the fixed part, so they stay readable.
+	if ((buf[BATTERY_RECORD_OFF_SCHEMA] < BATTERY_RECORD_SCHEMA) ||
+		(buf[BATTERY_RECORD_OFF_FIXED_SIZE] < BATTERY_RECORD_FIXED_SIZE))
+	{
+		return -1;
+	}
+
+	size_t total = BatteryRecord_Load16(buf + BATTERY_RECORD_OFF_TOTAL_SIZE);
+
+	if ((total < buf[BATTERY_RECORD_OFF_FIXED_SIZE]) || (total > len))
+	{
+		return -1;
+	}
+
+	view->data = buf;
+	view->size = total;
+
+	return 0;
+}
+
+int BatteryRecord_NextExt(const BatteryRecordView * view, size_t * offset, BatteryRecordExtView * ext)
+{
+	if (*offset == 0)
+	{
+		*offset = view->data[BATTERY_RECORD_OFF_FIXED_SIZE];
+	}
+
+	if (*offset >= view->size)
+	{
+		return 0;
+	}
+
+	if ((view->size - *offset) < BATTERY_RECORD_EXT_HDR)
+	{
+		return -1;
+	}
+
+	const uint8_t * p = view->data + *offset;
+	uint16_t length = BatteryRecord_Load16(p + 2);
+	size_t next = *offset + BATTERY_RECORD_EXT_HDR + ExtPadded(length);
+
+	if (next > view->size)
+	{
+		return -1;
+	}
+
+	ext->type   = BatteryRecord_Load16(p);
+	ext->length = length;
+	ext->data   = p + BATTERY_RECORD_EXT_HDR;
+	*offset     = next;
+
+	return 1;
+}
+
+void BatteryRecord_ToSample(const BatteryRecordView * view, BatterySample * sample)
+{
+	size_t health_len;
+	const char * health = BatteryRecord_Health(view, &health_len);
+
+	memset(sample, 0, sizeof(*sample));
+
+	sample->t_ns     = BatteryRecord_TimeNs(view);
+	sample->fields   = BatteryRecord_Presence(view) & BATTERY_FIELD_ALL;
+	sample->current  = BatteryRecord_Current(view);
+	sample->voltage  = BatteryRecord_Voltage(view);
+	sample->temp     = BatteryRecord_Temp(view);
+	sample->level    = BatteryRecord_Level(view);
+	sample->in_dock  = BatteryRecord_InDock(view);
+	sample->charging = BatteryRecord_Charging(view);
+
+	// Keep room for the terminator, health strings are far shorter than this.
+	if (health_len >= BATTERY_HEALTH_LEN)
+	{
+		health_len = BATTERY_HEALTH_LEN - 1;
+	}
+
+	memcpy(sample->health, health, health_len);
+
+	// The line bits travel as an extension, only trust the flag if it is there.
+	BatteryRecordExtView ext;
+	size_t offset = 0;
+
+	sample->fields &= ~BATTERY_FIELD_GPIO;
+
+	while (BatteryRecord_NextExt(view, &offset, &ext) > 0)
+	{
+		if ((ext.type == BATTERY_EXT_GPIO) && (ext.length >= sizeof(uint32_t)))
+		{
+			sample->gpio    = BatteryRecord_Load32(ext.data);
+			sample->fields |= BATTERY_FIELD_GPIO;
+
+			// Records from before the table hash leave it 0, unknown.
+			if (ext.length >= 2 * sizeof(uint32_t))
+			{
+				sample->gpio_table = BatteryRecord_Load32(ext.data + sizeof(uint32_t));
+			}
+
+			break;
+		}
+	}
+}
@@ -0,0 +1,344 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Edge Replay
+ *  Source Filename  - EdgeReplay.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The recorder is the GPIO engine's edge sink. A replay
+ *  				   turns the log into a mock script, edges keep their
+ *  				   spacing and go through the engine as read from a chip.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "Battery.hpp"
+#include "EdgeReplay.hpp"
+#include "GpioBackend.hpp"
+#include "GpioEngine.hpp"
+#include "GpioTable.hpp"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+#define EDGE_RECORDER_FLUSH_NS	(1000000000LL)
+#define EDGE_REPLAY_GROW		(1024)			// steps added each time the script fills
+
+static pthread_mutex_t edge_recorder_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE * edge_recorder_file = NULL;
+static int64_t edge_recorder_last_flush_ns = 0;
+
+static pthread_mutex_t edge_replay_lock = PTHREAD_MUTEX_INITIALIZER;
+static GpioMockStep * edge_steps = NULL;
+static size_t edge_count = 0;
+static bool edge_playing = false;
+static EdgeReplayStats edge_stats;				// kept once the playback stopped
+
+// GPIO engine edge sink, on the reactor thread.
+static void EdgeRecorderSink(void * arg, uint32_t bit, int value, int64_t t_ns)
+{
+	UNUSED(arg);
+
+	EdgeLogRecord record;
+
+	record.t_ns  = t_ns;
+	record.bit   = bit;
+	record.value = value;
+
+	pthread_mutex_lock(&edge_recorder_lock);
+
+	if (edge_recorder_file != NULL)
+	{
+		if (fwrite(&record, sizeof(record), 1, edge_recorder_file) != 1)
+		{
+			DBGPRT(DBG_ERR, "EdgeRecorderSink: Failed to write edge, %s\n", strerror(errno));
+		}
+
+		if ((t_ns - edge_recorder_last_flush_ns) >= EDGE_RECORDER_FLUSH_NS)
+		{
+			fflush(edge_recorder_file);
+			edge_recorder_last_flush_ns = t_ns;
+		}
+	}
+
+	pthread_mutex_unlock(&edge_recorder_lock);
+}
+
+int EdgeRecorder_Start(const char * path)
+{
+	EdgeLogHeader header;
+
+	pthread_mutex_lock(&edge_recorder_lock);
+
+	if (edge_recorder_file != NULL)
+	{
+		pthread_mutex_unlock(&edge_recorder_lock);
+		DBGPRT(DBG_ERR, "EdgeRecorder_Start: already recording\n");
+		return -1;
+	}
+
+	if ((edge_recorder_file = fopen(path, "wb")) == NULL)
+	{
+		pthread_mutex_unlock(&edge_recorder_lock);
+		DBGPRT(DBG_ERR, "EdgeRecorder_Start: Failed to open %s, %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic       = EDGE_LOG_MAGIC;
+	header.version     = EDGE_LOG_VERSION;
+	header.record_size = sizeof(EdgeLogRecord);
+	header.start_ns    = Battery_NowNs();
+	header.gpio_table  = GpioTable_Hash();
+	header.state       = GpioEngine_GetState(&header.valid);
+
+	if (fwrite(&header, sizeof(header), 1, edge_recorder_file) != 1)
+	{
+		DBGPRT(DBG_ERR, "EdgeRecorder_Start: Failed to write header, %s\n", strerror(errno));
+		fclose(edge_recorder_file);
+		edge_recorder_file = NULL;
+		pthread_mutex_unlock(&edge_recorder_lock);
+		return -1;
+	}
+
+	edge_recorder_last_flush_ns = header.start_ns;
+
+	pthread_mutex_unlock(&edge_recorder_lock);
+
+	GpioEngine_SetEdgeSink(EdgeRecorderSink, NULL);
+
+	DBGPRT(DBG_INFO1, "EdgeRecorder_Start: recording GPIO edges to %s\n", path);
+
+	return 0;
+}
+
+void EdgeRecorder_Stop(void)
+{
+	GpioEngine_SetEdgeSink(NULL, NULL);
+
+	pthread_mutex_lock(&edge_recorder_lock);
+
+	if (edge_recorder_file != NULL)
+	{
+		fclose(edge_recorder_file);
+		edge_recorder_file = NULL;
+	}
+
+	pthread_mutex_unlock(&edge_recorder_lock);
+}
+
+// Mock id of the table line under bit, -1 if the table has no such line.
+static int EdgeReplayLine(uint32_t bit)
+{
+	const GpioLineConfig * line = (bit != 0) ? GpioTable_Line(__builtin_ctz(bit)) : NULL;
+
+	return (line != NULL) ? GpioMock_Line(line->chip, line->offset) : -1;
+}
+
+static int EdgeReplayAppend(size_t * capacity, int64_t at_ns, int line, int value)
+{
+	if (edge_count == *capacity)
+	{
+		GpioMockStep * steps = (GpioMockStep *)realloc(edge_steps, (*capacity + EDGE_REPLAY_GROW) * sizeof(GpioMockStep));
+
+		if (steps == NULL)
+		{
+			return -1;
+		}
+
+		edge_steps = steps;
+		*capacity += EDGE_REPLAY_GROW;
+	}
+
+	edge_steps[edge_count].at_ns = at_ns;
+	edge_steps[edge_count].line  = line;
+	edge_steps[edge_count].value = value;
+	edge_count++;
+
+	return 0;
+}
+
+int EdgeReplay_Load(const char * path)
+{
+	EdgeLogHeader header;
+	EdgeLogRecord record;
+	size_t capacity = 0;
+	uint64_t skipped = 0;
+	int64_t last_ns = 0;
+	int result = 0;
+	FILE * file;
+
+	pthread_mutex_lock(&edge_replay_lock);
+
+	if (edge_steps != NULL)
+	{
+		pthread_mutex_unlock(&edge_replay_lock);
+		DBGPRT(DBG_ERR, "EdgeReplay_Load: edges already loaded\n");
+		return -1;
+	}
+
+	if ((file = fopen(path, "rb")) == NULL)
+	{
+		pthread_mutex_unlock(&edge_replay_lock);
+		DBGPRT(DBG_ERR, "EdgeReplay_Load: Failed to open %s, %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if ((fread(&header, sizeof(header), 1, file) != 1) ||
+		(header.magic != EDGE_LOG_MAGIC) ||
+		(header.version != EDGE_LOG_VERSION) ||
+		(header.record_size != sizeof(EdgeLogRecord)))
+	{
+		DBGPRT(DBG_ERR, "EdgeReplay_Load: %s is not an edge log\n", path);
+		fclose(file);
+		pthread_mutex_unlock(&edge_replay_lock);
+		return -1;
+	}
+
+	// The edges are still replayed, but onto whichever lines the bits name now.
+	if (header.gpio_table != GpioTable_Hash())
+	{
+		DBGPRT(DBG_WARN, "EdgeReplay_Load: recorded with GPIO table %08x, running with %08x\n",
+				header.gpio_table, GpioTable_Hash());
+	}
+
+	for (unsigned int i = 0; i < GpioTable_Count(); i++)
+	{
+		uint32_t bit = (uint32_t)1 << i;
+
+		if (header.valid & bit)
+		{
+			GpioMock_SetValue(EdgeReplayLine(bit), (header.state & bit) ? 1 : 0);
+		}
+	}
+
+	while ((result == 0) && (fread(&record, sizeof(record), 1, file) == 1))
+	{
+		int line = EdgeReplayLine(record.bit);
+
+		if (line < 0)
+		{
+			skipped++;
+			continue;
+		}
+
+		// The script has to be in order, an edge stamped before the start or
+		// before the previous one plays right after it.
+		int64_t at_ns = record.t_ns - header.start_ns;
+
+		last_ns = (at_ns > last_ns) ? at_ns : last_ns;
+		result  = EdgeReplayAppend(&capacity, last_ns, line, (record.value != 0) ? 1 : 0);
+	}
+
+	fclose(file);
+
+	if (result != 0)
+	{
+		DBGPRT(DBG_ERR, "EdgeReplay_Load: no memory for %zu edges\n", edge_count + 1);
+		free(edge_steps);
+		edge_steps = NULL;
+		edge_count = 0;
+		pthread_mutex_unlock(&edge_replay_lock);
+		return -1;
+	}
+
+	// An empty log still counts as loaded.
+	if ((edge_steps == NULL) && ((edge_steps = (GpioMockStep *)malloc(sizeof(GpioMockStep))) == NULL))
+	{
+		pthread_mutex_unlock(&edge_replay_lock);
+		return -1;
+	}
+
+	memset(&edge_stats, 0, sizeof(edge_stats));
+	edge_stats.edges = edge_count;
+
+	pthread_mutex_unlock(&edge_replay_lock);
+
+	DBGPRT(DBG_INFO1, "EdgeReplay_Load: %zu edges from %s, %llu on lines not in the table\n",
+			edge_count, path, (unsigned long long)skipped);
+
+	return 0;
+}
+
+int EdgeReplay_Start(void)
+{
+	pthread_mutex_lock(&edge_replay_lock);
+
+	if ((edge_steps == NULL) || edge_playing)
+	{
+		pthread_mutex_unlock(&edge_replay_lock);
+		DBGPRT(DBG_ERR, "EdgeReplay_Start: %s\n", edge_playing ? "already playing" : "no edges loaded");
+		return -1;
+	}
+
+	// Counted as done, so nothing waits on a playback that never started.
+	if (GpioMock_Play(edge_steps, edge_count) != 0)
+	{
+		edge_stats.done = true;
+		pthread_mutex_unlock(&edge_replay_lock);
+		return -1;
+	}
+
+	edge_playing = true;
+
+	pthread_mutex_unlock(&edge_replay_lock);
+
+	return 0;
+}
+
+// Called with edge_replay_lock held.
+static void EdgeReplayUpdate(void)
+{
+	GpioMockStats mock;
+
+	if (!edge_playing)
+	{
+		return;
+	}
+
+	GpioMock_GetStats(&mock);
+
+	edge_stats.done    = !mock.running;
+	edge_stats.played  = mock.steps;
+	edge_stats.late    = mock.late_steps;
+	edge_stats.dropped = mock.dropped;
+}
+
+void EdgeReplay_Stop(void)
+{
+	pthread_mutex_lock(&edge_replay_lock);
+
+	if (edge_playing)
+	{
+		GpioMock_Stop();
+		EdgeReplayUpdate();
+		edge_playing = false;
+	}
+
+	free(edge_steps);
+	edge_steps = NULL;
+	edge_count = 0;
+
+	pthread_mutex_unlock(&edge_replay_lock);
+}
+
+void EdgeReplay_GetStats(EdgeReplayStats * stats)
+{
+	pthread_mutex_lock(&edge_replay_lock);
+
+	EdgeReplayUpdate();
+	*stats = edge_stats;
+
+	pthread_mutex_unlock(&edge_replay_lock);
+}
@@ -0,0 +1,261 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Edge Trace
+ *  Source Filename  - EdgeTrace.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - One trace is open at a time, so the benchmark has to
+ *  				   inject an edge and wait for it before the next one.
+ *  				   Stages are stamped with CLOCK_MONOTONIC, the clock the
+ *  				   mock backend and kernels from 5.7 stamp events with.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include "EdgeTrace.hpp"
+#include "Battery.hpp"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+typedef struct
+{
+	int64_t t_ns[EDGE_STAGE_COUNT];
+} EdgeTraceSample;
+
+static const char * const stage_names[EDGE_STAGE_COUNT] =
+{
+		"kernel", "dispatch", "publish", "enqueue", "label", "flush"
+};
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_cond_t trace_cond;
+static std::atomic<bool> trace_enabled(false);
+static uint32_t trace_bit = 0;
+static EdgeTraceSample * trace_samples = NULL;
+static size_t trace_max = 0;
+static size_t trace_count = 0;
+static uint64_t trace_completed = 0;
+static uint64_t trace_dropped = 0;
+static uint64_t trace_waited = 0;			// completed + dropped when Wait last returned
+static bool trace_open = false;
+static EdgeTraceSample trace_current;
+
+static void TraceInitCond(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&trace_cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+int EdgeTrace_Start(uint32_t bit, size_t max_edges)
+{
+	EdgeTraceSample * samples;
+
+	if ((bit == 0) || (max_edges == 0) ||
+		((samples = (EdgeTraceSample *)calloc(max_edges, sizeof(EdgeTraceSample))) == NULL))
+	{
+		DBGPRT(DBG_ERR, "EdgeTrace_Start: Unable to trace %zu edges of 0x%x\n", max_edges, bit);
+		return -1;
+	}
+
+	pthread_once(&trace_once, TraceInitCond);
+	pthread_mutex_lock(&trace_lock);
+
+	free(trace_samples);
+	trace_samples   = samples;
+	trace_max       = max_edges;
+	trace_count     = 0;
+	trace_completed = 0;
+	trace_dropped   = 0;
+	trace_waited    = 0;
+	trace_open      = false;
+	trace_bit       = bit;
+	trace_enabled.store(true);
+
+	pthread_mutex_unlock(&trace_lock);
+
+	return 0;
+}
+
+void EdgeTrace_Stop(void)
+{
+	pthread_mutex_lock(&trace_lock);
+	trace_enabled.store(false);
+	trace_open = false;
+	pthread_mutex_unlock(&trace_lock);
+}
+
+void EdgeTrace_Dispatch(uint32_t bit, int64_t kernel_ns)
+{
+	if (!trace_enabled.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	int64_t now = Battery_NowNs();
+
+	pthread_mutex_lock(&trace_lock);
+
+	if ((bit == trace_bit) && !trace_open)
+	{
+		memset(&trace_current, 0, sizeof(trace_current));
+		trace_current.t_ns[EDGE_STAGE_KERNEL]   = kernel_ns;
+		trace_current.t_ns[EDGE_STAGE_DISPATCH] = now;
+		trace_open = true;
+	}
+
+	pthread_mutex_unlock(&trace_lock);
+}
+
+void EdgeTrace_Mark(EdgeStage stage)
+{
+	if (!trace_enabled.load(std::memory_order_relaxed) || (stage <= EDGE_STAGE_DISPATCH) || (stage >= EDGE_STAGE_COUNT))
+	{
+		return;
+	}
+
+	int64_t now = Battery_NowNs();
+
+	pthread_mutex_lock(&trace_lock);
+
+	// Stages only count in order, a mark for something else in between is ignored.
+	if (trace_open && (trace_current.t_ns[stage] == 0) && (trace_current.t_ns[stage - 1] != 0))
+	{
+		trace_current.t_ns[stage] = now;
+
+		if (stage == EDGE_STAGE_FLUSH)
+		{
+			if (trace_count < trace_max)
+			{
+				trace_samples[trace_count++] = trace_current;
+			}
+
+			trace_open = false;
+			trace_completed++;
+			pthread_cond_broadcast(&trace_cond);
+		}
+	}
+
+	pthread_mutex_unlock(&trace_lock);
+}
+
+int EdgeTrace_Wait(int timeout_ms)
+{
+	struct timespec deadline;
+	int result = 0;
+
+	pthread_once(&trace_once, TraceInitCond);
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec  += timeout_ms / 1000;
+	deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&trace_lock);
+
+	while ((trace_completed + trace_dropped) == trace_waited)
+	{
+		if (pthread_cond_timedwait(&trace_cond, &trace_lock, &deadline) == ETIMEDOUT)
+		{
+			DBGPRT(DBG_ERR, "EdgeTrace_Wait: edge stalled after %s\n",
+					trace_open ? stage_names[EDGE_STAGE_DISPATCH] : "injection");
+			trace_open = false;
+			trace_dropped++;
+			result = -1;
+		}
+	}
+
+	trace_waited = trace_completed + trace_dropped;
+
+	pthread_mutex_unlock(&trace_lock);
+
+	return result;
+}
+
+static void WriteStage(FILE * file, const char * name, std::vector<int64_t> & ns, bool last)
+{
+	double p50 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+
+	if (!ns.empty())
+	{
+		std::sort(ns.begin(), ns.end());
+
+		// Nearest rank.
+		p50 = ns[((ns.size() * 50) + 99) / 100 - 1] / 1000.0;
+		p99 = ns[((ns.size() * 99) + 99) / 100 - 1] / 1000.0;
+		max = ns.back() / 1000.0;
+	}
+
+	fprintf(file, "    \"%s\": { \"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f }%s\n",
+			name, p50, p99, max, last ? "" : ",");
+}
+
+void EdgeTrace_WriteJson(FILE * file)
+{
+	std::vector<int64_t> ns;
+	char name[32];
+
+	pthread_mutex_lock(&trace_lock);
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"edges\": %llu,\n", (unsigned long long)(trace_completed + trace_dropped));
+	fprintf(file, "  \"completed\": %llu,\n", (unsigned long long)trace_completed);
+	fprintf(file, "  \"dropped\": %llu,\n", (unsigned long long)trace_dropped);
+	fprintf(file, "  \"stages\": {\n");
+
+	ns.reserve(trace_count);
+
+	for (int stage = EDGE_STAGE_DISPATCH; stage < EDGE_STAGE_COUNT; stage++)
+	{
+		ns.clear();
+
+		for (size_t i = 0; i < trace_count; i++)
+		{
+			ns.push_back(trace_samples[i].t_ns[stage] - trace_samples[i].t_ns[stage - 1]);
+		}
+
+		snprintf(name, sizeof(name), "%s_to_%s", stage_names[stage - 1], stage_names[stage]);
+		WriteStage(file, name, ns, false);
+	}
+
+	ns.clear();
+
+	for (size_t i = 0; i < trace_count; i++)
+	{
+		ns.push_back(trace_samples[i].t_ns[EDGE_STAGE_FLUSH] - trace_samples[i].t_ns[EDGE_STAGE_KERNEL]);
+	}
+
+	WriteStage(file, "edge_to_flush", ns, true);
+
+	fprintf(file, "  }\n}\n");
+	fflush(file);
+
+	pthread_mutex_unlock(&trace_lock);
+}
@@ -0,0 +1,452 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Generator
+ *  Source Filename  - Generator.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Pack model (OCV curve, internal resistance, thermal
+ *  				   drift, noise, dock and charge events) that serves
+ *  				   samples through the battery source interface.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "Battery.hpp"
+#include "Generator.hpp"
+#include "Replay.hpp"
+#include "GpioTable.hpp"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+#define GENERATOR_BATCH_NS		(1000000LL)
+#define SECONDS_PER_DAY			(86400.0)
+
+typedef struct
+{
+	unsigned int index;
+	uint64_t rng;
+	double t_s;
+	double soc;
+	double temp_c;
+	bool docked;
+	bool charging;
+	double next_event_s;
+	BatterySample latest;
+	BatterySource source;
+} PackModel;
+
+// Open circuit voltage at 0%, 10% ... 100% state of charge.
+static const double ocv_table[] =
+{
+	3.00, 3.45, 3.60, 3.68, 3.74, 3.79, 3.85, 3.93, 4.01, 4.10, 4.20
+};
+
+static pthread_mutex_t generator_lock = PTHREAD_MUTEX_INITIALIZER;
+static GeneratorConfig generator_config;
+static PackModel * packs = NULL;
+static pthread_t generator_tid;
+static bool generator_running = false;
+static GeneratorSink generator_sink = NULL;
+static void * generator_sink_arg = NULL;
+static GeneratorStats generator_stats;
+static int64_t generator_start_ns = 0;
+static uint32_t generator_in_base_bit = 0;		// GPIO table bits, resolved by Generator_Start
+static uint32_t generator_charging_bit = 0;
+static uint32_t generator_gpio_table = 0;
+
+static double Uniform(PackModel * pack)
+{
+	// xorshift64*
+	pack->rng ^= pack->rng >> 12;
+	pack->rng ^= pack->rng << 25;
+	pack->rng ^= pack->rng >> 27;
+
+	return (double)((pack->rng * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+static double Gaussian(PackModel * pack)
+{
+	// Sum of four uniforms, close enough to normal for sensor noise.
+	return (Uniform(pack) + Uniform(pack) + Uniform(pack) + Uniform(pack) - 2.0) * 1.7320508;
+}
+
+static double Exponential(PackModel * pack, double mean)
+{
+	return -mean * log(1.0 - Uniform(pack));
+}
+
+static double OpenCircuitVoltage(double soc)
+{
+	const int last = (sizeof(ocv_table) / sizeof(ocv_table[0])) - 1;
+	double pos = soc * last;
+	int i = (int)pos;
+
+	if (i >= last)
+	{
+		return ocv_table[last];
+	}
+
+	if (i < 0)
+	{
+		return ocv_table[0];
+	}
+
+	return ocv_table[i] + ((ocv_table[i + 1] - ocv_table[i]) * (pos - i));
+}
+
+static uint32_t PackGpio(const PackModel * pack)
+{
+	return (pack->docked ? generator_in_base_bit : 0) | (pack->charging ? generator_charging_bit : 0);
+}
+
+static void StepPack(PackModel * pack, double dt, int64_t t_ns, BatterySample * sample)
+{
+	const GeneratorConfig * cfg = &generator_config;
+
+	pack->t_s += dt;
+
+	if (pack->t_s >= pack->next_event_s)
+	{
+		pack->docked = !pack->docked;
+		pack->next_event_s = pack->t_s + Exponential(pack, pack->docked ? cfg->undock_mean_s : cfg->dock_mean_s);
+	}
+
+	if (!pack->docked)
+	{
+		pack->charging = false;
+	}
+	else if (pack->soc >= 0.995)
+	{
+		pack->charging = false;
+	}
+	else if (pack->soc < 0.95)
+	{
+		pack->charging = true;
+	}
+
+	// Positive current charges the pack, negative discharges it.
+	double current_ma = 0;
+
+	if (pack->charging)
+	{
+		double taper = (1.0 - pack->soc) / 0.1;
+		current_ma = cfg->charge_ma * ((taper < 1.0) ? taper : 1.0);
+	}
+	else if (!pack->docked)
+	{
+		current_ma = -cfg->load_ma;
+	}
+
+	pack->soc += (current_ma * dt) / (3600.0 * cfg->capacity_mah);
+	pack->soc = (pack->soc < 0) ? 0 : ((pack->soc > 1) ? 1 : pack->soc);
+
+	double current_a = current_ma / 1000.0;
+	double voltage_v = OpenCircuitVoltage(pack->soc) + (current_a * cfg->r_internal_ohm);
+	double ambient_c = cfg->ambient_c + (cfg->ambient_drift_c * sin((2.0 * M_PI * pack->t_s) / SECONDS_PER_DAY));
+	double target_c  = ambient_c + (current_a * current_a * cfg->r_internal_ohm * cfg->thermal_r_c_per_w);
+
+	pack->temp_c += (target_c - pack->temp_c) * ((dt < cfg->thermal_tau_s) ? (dt / cfg->thermal_tau_s) : 1.0);
+
+	double temp_c = pack->temp_c + (cfg->noise_c * Gaussian(pack));
+
+	sample->t_ns     = t_ns;
+	sample->fields   = BATTERY_FIELD_ALL;
+	sample->current  = (int32_t)lround(current_ma + (cfg->noise_ma * Gaussian(pack)));
+	sample->voltage  = (int32_t)lround((voltage_v * 100.0) + ((cfg->noise_mv * Gaussian(pack)) / 10.0));
+	sample->temp     = (int32_t)lround(temp_c * 10.0);
+	sample->level    = (int32_t)lround(pack->soc * 100.0);
+	sample->in_dock  = pack->docked ? 0 : 1;		// hall sensor is active low
+	sample->charging = pack->charging ? 1 : 0;
+	sample->gpio       = PackGpio(pack);
+	sample->gpio_table = generator_gpio_table;
+
+	snprintf(sample->health, sizeof(sample->health), "%s",
+			(temp_c > 60.0) ? "Overheat" : ((temp_c < 0.0) ? "Cold" : "Good"));
+}
+
+static int GeneratorRead(void * ctx, BatterySample * sample, uint32_t fields)
+{
+	PackModel * pack = (PackModel *)ctx;
+
+	pthread_mutex_lock(&generator_lock);
+
+	int64_t t_ns = sample->t_ns;
+	*sample = pack->latest;
+	sample->t_ns = t_ns;
+	sample->fields &= fields;
+
+	pthread_mutex_unlock(&generator_lock);
+
+	return 0;
+}
+
+static void * GeneratorTaskLoop(void * arg)
+{
+	UNUSED(arg);
+
+	const GeneratorConfig * cfg = &generator_config;
+	const double period_ns = 1e9 / cfg->rate_hz;
+	const double dt = cfg->time_scale / cfg->rate_hz;
+	int64_t next_batch = generator_start_ns;
+	uint64_t produced = 0;
+	BatterySample * batch = (BatterySample *)calloc(cfg->supplies, sizeof(BatterySample));
+
+	if (batch == NULL)
+	{
+		DBGPRT(DBG_ERR, "GeneratorTaskLoop: Failed to allocate batch, %s\n", strerror(errno));
+		return NULL;
+	}
+
+	DBGPRT(DBG_INFO1, "GeneratorTaskLoop: %u packs at %.0f Hz\n", cfg->supplies, cfg->rate_hz);
+
+	while (__atomic_load_n(&generator_running, __ATOMIC_RELAXED))
+	{
+		struct timespec wake;
+
+		next_batch += GENERATOR_BATCH_NS;
+		wake.tv_sec  = next_batch / 1000000000LL;
+		wake.tv_nsec = next_batch % 1000000000LL;
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR)
+		{
+		}
+
+		int64_t lag = Battery_NowNs() - next_batch;
+
+		// Samples are due for everything up to the scheduled batch time.
+		double due = (double)(next_batch - generator_start_ns) / period_ns;
+
+		while ((double)produced < due)
+		{
+			int64_t t_ns = generator_start_ns + (int64_t)((double)produced * period_ns);
+
+			for (unsigned int i = 0; i < cfg->supplies; i++)
+			{
+				StepPack(&packs[i], dt, t_ns, &batch[i]);
+
+				// Every sample of the shown pack, in order, not just those read.
+				if (i == 0)
+				{
+					Recorder_Write(&batch[i]);
+				}
+
+				if (generator_sink != NULL)
+				{
+					generator_sink(generator_sink_arg, i, &batch[i]);
+				}
+			}
+
+			produced++;
+		}
+
+		pthread_mutex_lock(&generator_lock);
+
+		// Only the newest sample of each pack is served to readers.
+		for (unsigned int i = 0; i < cfg->supplies; i++)
+		{
+			packs[i].latest = batch[i];
+		}
+
+		generator_stats.samples = produced * cfg->supplies;
+		generator_stats.batches++;
+
+		if (lag >= GENERATOR_BATCH_NS)
+		{
+			generator_stats.late_batches++;
+		}
+
+		if ((lag > 0) && ((uint64_t)lag > generator_stats.max_lag_ns))
+		{
+			generator_stats.max_lag_ns = (uint64_t)lag;
+		}
+
+		pthread_mutex_unlock(&generator_lock);
+	}
+
+	free(batch);
+
+	return NULL;
+}
+
+void Generator_DefaultConfig(GeneratorConfig * config)
+{
+	memset(config, 0, sizeof(*config));
+
+	config->supplies          = 1;
+	config->rate_hz           = 1000.0;
+	config->time_scale        = 1.0;
+	config->seed              = 1;
+	config->capacity_mah      = 3400.0;
+	config->start_soc         = 0.8;
+	config->r_internal_ohm    = 0.15;
+	config->load_ma           = 450.0;
+	config->charge_ma         = 600.0;
+	config->ambient_c         = 25.0;
+	config->ambient_drift_c   = 3.0;
+	config->thermal_r_c_per_w = 20.0;
+	config->thermal_tau_s     = 600.0;
+	config->noise_ma          = 4.0;
+	config->noise_mv          = 3.0;
+	config->noise_c           = 0.2;
+	config->dock_mean_s       = 1800.0;
+	config->undock_mean_s     = 3600.0;
+}
+
+int Generator_Init(const GeneratorConfig * config)
+{
+	if ((config->supplies == 0) || (config->supplies > GENERATOR_MAX_SUPPLIES) || (config->rate_hz <= 0))
+	{
+		DBGPRT(DBG_ERR, "Generator_Init: invalid config, %u packs at %.0f Hz\n", config->supplies, config->rate_hz);
+		return -1;
+	}
+
+	Generator_Cleanup();
+
+	pthread_mutex_lock(&generator_lock);
+
+	generator_config = *config;
+
+	if (generator_config.rate_hz > GENERATOR_MAX_RATE_HZ)
+	{
+		generator_config.rate_hz = GENERATOR_MAX_RATE_HZ;
+	}
+
+	if ((packs = (PackModel *)calloc(config->supplies, sizeof(PackModel))) == NULL)
+	{
+		pthread_mutex_unlock(&generator_lock);
+		DBGPRT(DBG_ERR, "Generator_Init: Failed to allocate packs, %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < config->supplies; i++)
+	{
+		PackModel * pack = &packs[i];
+
+		pack->index        = i;
+		pack->rng          = ((uint64_t)config->seed << 32) ^ (0x9E3779B97F4A7C15ULL * (i + 1));
+		pack->soc          = config->start_soc;
+		pack->temp_c       = config->ambient_c;
+		pack->docked       = false;
+		pack->next_event_s = Exponential(pack, config->dock_mean_s);
+		pack->source.name  = "generator";
+		pack->source.read  = GeneratorRead;
+		pack->source.ctx   = pack;
+		pack->source.recorded = true;
+
+		StepPack(pack, 0, Battery_NowNs(), &pack->latest);
+	}
+
+	memset(&generator_stats, 0, sizeof(generator_stats));
+
+	pthread_mutex_unlock(&generator_lock);
+
+	return 0;
+}
+
+void Generator_Cleanup(void)
+{
+	Generator_Stop();
+
+	pthread_mutex_lock(&generator_lock);
+
+	free(packs);
+	packs = NULL;
+
+	pthread_mutex_unlock(&generator_lock);
+}
+
+const BatterySource * Generator_GetSource(unsigned int supply)
+{
+	if ((packs == NULL) || (supply >= generator_config.supplies))
+	{
+		return NULL;
+	}
+
+	return &packs[supply].source;
+}
+
+int Generator_Start(GeneratorSink sink, void * arg)
+{
+	if ((packs == NULL) || generator_running)
+	{
+		DBGPRT(DBG_ERR, "Generator_Start: not initialized or already running\n");
+		return -1;
+	}
+
+	// The table is loaded before the generator starts and never changes after.
+	pthread_mutex_lock(&generator_lock);
+
+	generator_in_base_bit  = GpioTable_Bit(GPIO_LINE_IN_BASE);
+	generator_charging_bit = GpioTable_Bit(GPIO_LINE_CHARGING);
+	generator_gpio_table   = GpioTable_Hash();
+
+	for (unsigned int i = 0; i < generator_config.supplies; i++)
+	{
+		packs[i].latest.gpio       = PackGpio(&packs[i]);
+		packs[i].latest.gpio_table = generator_gpio_table;
+	}
+
+	pthread_mutex_unlock(&generator_lock);
+
+	if ((generator_in_base_bit == 0) || (generator_charging_bit == 0))
+	{
+		DBGPRT(DBG_WARN, "Generator_Start: the GPIO table has no %s or %s line\n", GPIO_LINE_IN_BASE, GPIO_LINE_CHARGING);
+	}
+
+	generator_sink     = sink;
+	generator_sink_arg = arg;
+	generator_start_ns = Battery_NowNs();
+	generator_running  = true;
+
+	if (pthread_create(&generator_tid, NULL, GeneratorTaskLoop, NULL) != 0)
+	{
+		DBGPRT(DBG_ERR, "Generator_Start: Failed to create generator thread\n");
+		generator_running = false;
+		return -1;
+	}
+
+	return 0;
+}
+
+void Generator_Stop(void)
+{
+	if (!generator_running)
+	{
+		return;
+	}
+
+	__atomic_store_n(&generator_running, false, __ATOMIC_RELAXED);
+	pthread_join(generator_tid, NULL);
+}
+
+void Generator_GetStats(GeneratorStats * stats)
+{
+	pthread_mutex_lock(&generator_lock);
+
+	*stats = generator_stats;
+	stats->running = generator_running;
+
+	int64_t elapsed = Battery_NowNs() - generator_start_ns;
+
+	if ((elapsed > 0) && (generator_config.supplies > 0))
+	{
+		stats->achieved_hz = ((double)stats->samples / generator_config.supplies) * 1e9 / (double)elapsed;
+	}
+
+	pthread_mutex_unlock(&generator_lock);
+}
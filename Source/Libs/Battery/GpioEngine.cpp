@@ -0,0 +1,888 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - GPIO Engine
+ *  Source Filename  - GpioEngine.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Owns the board GPIO lines. Lines are grouped by chip
+ *  				   and requested and read in bulk through a GpioBackend,
+ *  				   libgpiod unless one is set. The event fds and debounce
+ *  				   timers of every line are sources of the app's reactor,
+ *  				   which reads the edges in batches and publishes the
+ *  				   confirmed line states as one atomic word.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "Battery.hpp"
+#include "EdgeTrace.hpp"
+#include "GpioBackend.hpp"
+#include "GpioEngine.hpp"
+#include "Reactor.h"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+typedef struct
+{
+	char chip[GPIO_ENGINE_CHIP_LEN];
+	unsigned int offset;
+	uint32_t bit;
+	unsigned int debounce_ms;
+	uint32_t reported;					// GpioEdge mask passed to the sink
+	bool active_low;
+	unsigned int chip_index;
+	unsigned int index;						// within the chip's request
+	int timer_fd;
+	int event_source;						// reactor source ids while started
+	int timer_source;
+	int raw;								// last edge seen, reactor thread only
+	int64_t raw_ns;							// kernel timestamp of that edge
+	int confirmed;							// published value, reactor thread only
+	uint64_t burst;							// edges since the last confirmation
+	std::atomic<uint64_t> edges;
+	std::atomic<uint64_t> bounces;
+	std::atomic<uint64_t> transitions;
+	std::atomic<uint64_t> max_burst;
+} EngineLine;
+
+typedef struct
+{
+	char name[GPIO_ENGINE_CHIP_LEN];
+	void * request;
+	unsigned int count;
+	unsigned int offsets[GPIO_BACKEND_MAX_REQUEST];
+	uint32_t bits[GPIO_BACKEND_MAX_REQUEST];
+} EngineChip;
+
+static pthread_mutex_t engine_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t engine_once = PTHREAD_ONCE_INIT;
+static pthread_cond_t engine_cond;
+static bool engine_open = false;
+static bool engine_running = false;			// the lines are reactor sources
+static EngineLine engine_lines[GPIO_ENGINE_MAX_LINES];
+static unsigned int engine_line_count = 0;
+static EngineChip engine_chips[GPIO_ENGINE_MAX_CHIPS];
+static unsigned int engine_chip_count = 0;
+static uint64_t engine_seq = 0;
+static int engine_notify_fd = -1;			// created by GpioEngine_EventFd, kept until exit
+static GpioTransitionSink engine_sinks[GPIO_ENGINE_MAX_SINKS];
+static void * engine_sink_args[GPIO_ENGINE_MAX_SINKS];
+static unsigned int engine_sink_count = 0;
+static std::atomic<GpioEdgeSink> engine_edge_sink(NULL);
+static void * engine_edge_arg = NULL;
+
+// Held around every sink call so RemoveSink can wait one out. Separate from
+// engine_lock so sinks may still read the engine.
+static pthread_mutex_t engine_sink_lock = PTHREAD_MUTEX_INITIALIZER;
+static const GpioBackend * engine_backend = NULL;
+
+// valid bits in the high word, line values in the low word.
+static std::atomic<uint64_t> engine_state(0);
+static std::atomic<uint32_t> engine_active_low(0);
+static std::atomic<uint64_t> engine_wakeups(0);
+static std::atomic<uint64_t> engine_events(0);
+static std::atomic<uint64_t> engine_changes(0);
+static std::atomic<uint64_t> engine_reads(0);
+
+static void EngineInitCond(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&engine_cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+// Called with engine_lock held, next to every engine_seq change.
+static void EngineNotify(void)
+{
+	uint64_t one = 1;
+
+	if ((engine_notify_fd >= 0) && (write(engine_notify_fd, &one, sizeof(one)) != sizeof(one)) && (errno != EAGAIN))
+	{
+		DBGPRT(DBG_ERR, "EngineNotify: write failed, %s\n", strerror(errno));
+	}
+}
+
+static void EnginePublish(uint32_t state, uint32_t valid)
+{
+	uint64_t word = ((uint64_t)valid << 32) | state;
+
+	if (engine_state.exchange(word) == word)
+	{
+		return;
+	}
+
+	engine_changes++;
+	EdgeTrace_Mark(EDGE_STAGE_PUBLISH);
+
+	pthread_mutex_lock(&engine_lock);
+	engine_seq++;
+	pthread_cond_broadcast(&engine_cond);
+	EngineNotify();
+	pthread_mutex_unlock(&engine_lock);
+}
+
+// One get_value_bulk per chip, however many of its lines are in use.
+static uint32_t EngineReadChips(uint32_t * valid)
+{
+	uint32_t state = 0;
+
+	*valid = 0;
+
+	for (unsigned int c = 0; c < engine_chip_count; c++)
+	{
+		EngineChip * chip = &engine_chips[c];
+		int values[GPIO_BACKEND_MAX_REQUEST];
+
+		if (engine_backend->get_values(chip->request, values) != 0)
+		{
+			DBGPRT(DBG_ERR, "EngineReadChips: Failed to read %s, %s\n", chip->name, strerror(errno));
+			continue;
+		}
+
+		engine_reads++;
+
+		for (unsigned int i = 0; i < chip->count; i++)
+		{
+			*valid |= chip->bits[i];
+			state  |= (values[i] != 0) ? chip->bits[i] : 0;
+		}
+	}
+
+	return state;
+}
+
+static void EngineCloseChips(void)
+{
+	for (unsigned int c = 0; c < engine_chip_count; c++)
+	{
+		if (engine_chips[c].request != NULL)
+		{
+			engine_backend->release(engine_chips[c].request);
+		}
+	}
+
+	memset(engine_chips, 0, sizeof(engine_chips));
+	engine_chip_count = 0;
+}
+
+static EngineChip * EngineFindChip(const char * name)
+{
+	for (unsigned int c = 0; c < engine_chip_count; c++)
+	{
+		if (strcmp(engine_chips[c].name, name) == 0)
+		{
+			return &engine_chips[c];
+		}
+	}
+
+	if (engine_chip_count >= GPIO_ENGINE_MAX_CHIPS)
+	{
+		return NULL;
+	}
+
+	EngineChip * chip = &engine_chips[engine_chip_count];
+	int length = snprintf(chip->name, sizeof(chip->name), "%s", name);
+
+	// A cut short name could match another chip.
+	if ((length < 0) || ((size_t)length >= sizeof(chip->name)))
+	{
+		DBGPRT(DBG_ERR, "EngineFindChip: chip name %s is too long\n", name);
+		return NULL;
+	}
+
+	chip->request = NULL;
+	chip->count   = 0;
+	engine_chip_count++;
+
+	return chip;
+}
+
+// Ends a debounce window. Edges that did not change the outcome were bounces.
+static void EngineConfirm(EngineLine * line)
+{
+	uint64_t burst = line->burst;
+
+	if (line->raw != line->confirmed)
+	{
+		line->confirmed = line->raw;
+		line->transitions++;
+		burst--;
+
+		uint32_t edge = ((line->confirmed != 0) != line->active_low) ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING;
+
+		if (line->reported & edge)
+		{
+			pthread_mutex_lock(&engine_sink_lock);
+
+			for (unsigned int i = 0; i < engine_sink_count; i++)
+			{
+				engine_sinks[i](engine_sink_args[i], line->bit, line->confirmed, line->raw_ns);
+			}
+
+			pthread_mutex_unlock(&engine_sink_lock);
+		}
+	}
+
+	line->bounces += burst;
+
+	if (line->burst > line->max_burst.load())
+	{
+		line->max_burst.store(line->burst);
+	}
+
+	line->burst = 0;
+}
+
+// Hands every edge read to the edge sink, before the debounce sees it.
+static void EngineTapEdges(const EngineLine * line, const GpioEvent * events, int count)
+{
+	pthread_mutex_lock(&engine_sink_lock);
+
+	GpioEdgeSink sink = engine_edge_sink.load();
+
+	for (int i = 0; (sink != NULL) && (i < count); i++)
+	{
+		sink(engine_edge_arg, line->bit, events[i].rising ? 1 : 0, events[i].t_ns);
+	}
+
+	pthread_mutex_unlock(&engine_sink_lock);
+}
+
+// Reads one batch of a line's queued edges. Without debouncing each edge is a
+// transition, with it only the last one decides the new value. The event fd
+// blocks when empty, so anything left over is picked up on the next (level
+// triggered) wakeup rather than by reading again here.
+static void EngineReadLine(EngineLine * line)
+{
+	GpioEvent events[GPIO_ENGINE_EVENT_BATCH];
+	int count = engine_backend->read_events(engine_chips[line->chip_index].request, line->index,
+											events, GPIO_ENGINE_EVENT_BATCH);
+
+	if (count <= 0)
+	{
+		if (count < 0)
+		{
+			DBGPRT(DBG_ERR, "EngineReadLine: event read failed, %s\n", strerror(errno));
+		}
+
+		return;
+	}
+
+	engine_events += count;
+	line->edges   += count;
+
+	// Checked without the lock so the common no-recorder case costs nothing.
+	if (engine_edge_sink.load(std::memory_order_relaxed) != NULL)
+	{
+		EngineTapEdges(line, events, count);
+	}
+
+	// Confirmed in order, so a pulse inside one batch still reaches the sinks.
+	if (line->timer_fd < 0)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			line->burst++;
+			line->raw    = events[i].rising ? 1 : 0;
+			line->raw_ns = events[i].t_ns;
+
+			EdgeTrace_Dispatch(line->bit, line->raw_ns);
+			EngineConfirm(line);
+		}
+
+		return;
+	}
+
+	line->burst += count;
+	line->raw    = events[count - 1].rising ? 1 : 0;
+	line->raw_ns = events[count - 1].t_ns;
+
+	EdgeTrace_Dispatch(line->bit, line->raw_ns);
+
+	// Every edge restarts the window, the line has to hold still for debounce_ms
+	// from when the edge happened, not from when it was read. A timestamp off
+	// another clock is held to one window from now.
+	int64_t now = Battery_NowNs();
+	int64_t length = (int64_t)line->debounce_ms * 1000000LL;
+	int64_t due = line->raw_ns + length;
+	struct itimerspec window;
+
+	if (due < now)
+	{
+		due = now;
+	}
+	else if (due > now + length)
+	{
+		due = now + length;
+	}
+
+	memset(&window, 0, sizeof(window));
+	window.it_value.tv_sec  = due / 1000000000LL;
+	window.it_value.tv_nsec = due % 1000000000LL;
+
+	if (timerfd_settime(line->timer_fd, TFD_TIMER_ABSTIME, &window, NULL) != 0)
+	{
+		DBGPRT(DBG_ERR, "EngineReadLine: Failed to arm debounce timer, %s\n", strerror(errno));
+		EngineConfirm(line);
+	}
+}
+
+// The level of one line now, -1 if its chip cannot be read.
+static int EngineReadLevel(const EngineLine * line)
+{
+	int values[GPIO_BACKEND_MAX_REQUEST];
+
+	if (engine_backend->get_values(engine_chips[line->chip_index].request, values) != 0)
+	{
+		DBGPRT(DBG_ERR, "EngineReadLevel: Failed to read %s, %s\n", line->chip, strerror(errno));
+		return -1;
+	}
+
+	engine_reads++;
+
+	return (values[line->index] != 0) ? 1 : 0;
+}
+
+// The window closed. An edge lost to a full event queue would leave raw
+// wrong, so the line itself decides what is confirmed.
+static void EngineTimerExpired(EngineLine * line)
+{
+	uint64_t expirations;
+
+	if (read(line->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+	{
+		return;
+	}
+
+	int level = EngineReadLevel(line);
+
+	if (level >= 0)
+	{
+		line->raw = level;
+	}
+
+	EngineConfirm(line);
+}
+
+// Consumers only ever see confirmed values.
+static void EnginePublishConfirmed(void)
+{
+	uint32_t valid = 0;
+	uint32_t state = 0;
+
+	for (unsigned int i = 0; i < engine_line_count; i++)
+	{
+		valid |= (engine_lines[i].confirmed >= 0) ? engine_lines[i].bit : 0;
+		state |= (engine_lines[i].confirmed > 0) ? engine_lines[i].bit : 0;
+	}
+
+	EnginePublish(state, valid);
+}
+
+// Reactor callback, a line's event fd is readable.
+static void EngineLineEvent(void * arg)
+{
+	engine_wakeups++;
+	EngineReadLine((EngineLine *)arg);
+	EnginePublishConfirmed();
+}
+
+// Reactor callback, a line's debounce window closed.
+static void EngineTimerEvent(void * arg)
+{
+	engine_wakeups++;
+	EngineTimerExpired((EngineLine *)arg);
+	EnginePublishConfirmed();
+}
+
+// Takes the lines off the reactor, called with engine_lock held.
+static void EngineUnwatch(void)
+{
+	for (unsigned int i = 0; i < engine_line_count; i++)
+	{
+		EngineLine * line = &engine_lines[i];
+
+		if (line->event_source >= 0)
+		{
+			Reactor_RemoveFd(line->event_source);
+			line->event_source = -1;
+		}
+
+		if (line->timer_source >= 0)
+		{
+			Reactor_RemoveFd(line->timer_source);
+			line->timer_source = -1;
+		}
+
+		if (line->timer_fd >= 0)
+		{
+			close(line->timer_fd);
+			line->timer_fd = -1;
+		}
+	}
+}
+
+int GpioEngine_AddLine(const GpioLineConfig * config, uint32_t bit)
+{
+	int result = -1;
+	uint32_t used = 0;
+
+	pthread_mutex_lock(&engine_lock);
+
+	for (unsigned int i = 0; i < engine_line_count; i++)
+	{
+		used |= engine_lines[i].bit;
+	}
+
+	if (engine_open)
+	{
+		DBGPRT(DBG_ERR, "GpioEngine_AddLine: lines already requested\n");
+	}
+	else if ((config == NULL) || (bit == 0) || (bit & (bit - 1)) || (bit & used) ||
+			 (memchr(config->chip, '\0', sizeof(config->chip)) == NULL) || (engine_line_count >= GPIO_ENGINE_MAX_LINES))
+	{
+		DBGPRT(DBG_ERR, "GpioEngine_AddLine: invalid line\n");
+	}
+	else
+	{
+		EngineLine * line = &engine_lines[engine_line_count];
+
+		snprintf(line->chip, sizeof(line->chip), "%s", config->chip);
+		line->offset       = config->offset;
+		line->bit          = bit;
+		line->debounce_ms  = config->debounce_ms;
+		line->reported     = config->edges;
+		line->active_low   = config->active_low;
+		line->chip_index   = 0;
+		line->index        = 0;
+		line->timer_fd     = -1;
+		line->event_source = -1;
+		line->timer_source = -1;
+		line->raw          = -1;
+		line->raw_ns       = 0;
+		line->confirmed    = -1;
+		line->burst        = 0;
+		line->edges        = 0;
+		line->bounces      = 0;
+		line->transitions  = 0;
+		line->max_burst    = 0;
+		engine_line_count++;
+		result = 0;
+
+		if (config->active_low)
+		{
+			engine_active_low |= bit;
+		}
+	}
+
+	pthread_mutex_unlock(&engine_lock);
+
+	return result;
+}
+
+int GpioEngine_Open(void)
+{
+	pthread_mutex_lock(&engine_lock);
+
+	if (engine_open)
+	{
+		pthread_mutex_unlock(&engine_lock);
+		return 0;
+	}
+
+	if (engine_backend == NULL)
+	{
+		engine_backend = GpioBackend_Gpiod();
+	}
+
+	for (unsigned int i = 0; i < engine_line_count; i++)
+	{
+		EngineLine * line = &engine_lines[i];
+		EngineChip * chip = EngineFindChip(line->chip);
+
+		if ((chip == NULL) || (chip->count >= GPIO_BACKEND_MAX_REQUEST))
+		{
+			DBGPRT(DBG_ERR, "GpioEngine_Open: No room for %s line %u\n", line->chip, line->offset);
+			EngineCloseChips();
+			pthread_mutex_unlock(&engine_lock);
+			return -1;
+		}
+
+		line->chip_index = (unsigned int)(chip - engine_chips);
+		line->index      = chip->count;
+		chip->offsets[chip->count] = line->offset;
+		chip->bits[chip->count]    = line->bit;
+		chip->count++;
+	}
+
+	// Both edges so the cached value follows the line either way.
+	for (unsigned int c = 0; c < engine_chip_count; c++)
+	{
+		EngineChip * chip = &engine_chips[c];
+
+		if ((chip->request = engine_backend->request(chip->name, chip->offsets, chip->count, CONSUMER)) == NULL)
+		{
+			DBGPRT(DBG_ERR, "GpioEngine_Open: Unable to request %s lines from %s, %s\n", chip->name, engine_backend->name, strerror(errno));
+			EngineCloseChips();
+			pthread_mutex_unlock(&engine_lock);
+			return -1;
+		}
+	}
+
+	// Edges only say what changed, so seed the cache with one read per chip.
+	uint32_t valid;
+	uint32_t state = EngineReadChips(&valid);
+
+	engine_state.store(((uint64_t)valid << 32) | state);
+	engine_seq++;
+	engine_open = true;
+	EngineNotify();
+
+	DBGPRT(DBG_INFO1, "GpioEngine_Open: %u lines on %u chips (%s)\n", engine_line_count, engine_chip_count, engine_backend->name);
+
+	pthread_mutex_unlock(&engine_lock);
+
+	return 0;
+}
+
+void GpioEngine_Close(void)
+{
+	GpioEngine_Stop();
+
+	pthread_once(&engine_once, EngineInitCond);
+	pthread_mutex_lock(&engine_lock);
+
+	if (engine_open)
+	{
+		EngineCloseChips();
+		engine_open = false;
+	}
+
+	engine_line_count = 0;
+	engine_active_low.store(0);
+	engine_state.store(0);
+	engine_seq++;
+	pthread_cond_broadcast(&engine_cond);
+	EngineNotify();
+
+	pthread_mutex_unlock(&engine_lock);
+}
+
+int GpioEngine_SetBackend(const GpioBackend * backend)
+{
+	int result = 0;
+
+	pthread_mutex_lock(&engine_lock);
+
+	if (engine_open)
+	{
+		DBGPRT(DBG_ERR, "GpioEngine_SetBackend: lines already requested\n");
+		result = -1;
+	}
+	else
+	{
+		engine_backend = (backend != NULL) ? backend : GpioBackend_Gpiod();
+	}
+
+	pthread_mutex_unlock(&engine_lock);
+
+	return result;
+}
+
+int GpioEngine_AddSink(GpioTransitionSink sink, void * arg)
+{
+	int result = -1;
+
+	pthread_mutex_lock(&engine_sink_lock);
+
+	if ((sink == NULL) || (engine_sink_count >= GPIO_ENGINE_MAX_SINKS))
+	{
+		DBGPRT(DBG_ERR, "GpioEngine_AddSink: no room for another sink\n");
+	}
+	else
+	{
+		engine_sinks[engine_sink_count]     = sink;
+		engine_sink_args[engine_sink_count] = arg;
+		engine_sink_count++;
+		result = 0;
+	}
+
+	pthread_mutex_unlock(&engine_sink_lock);
+
+	return result;
+}
+
+void GpioEngine_RemoveSink(GpioTransitionSink sink, void * arg)
+{
+	pthread_mutex_lock(&engine_sink_lock);
+
+	for (unsigned int i = 0; i < engine_sink_count; i++)
+	{
+		if ((engine_sinks[i] == sink) && (engine_sink_args[i] == arg))
+		{
+			engine_sink_count--;
+			engine_sinks[i]     = engine_sinks[engine_sink_count];
+			engine_sink_args[i] = engine_sink_args[engine_sink_count];
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&engine_sink_lock);
+}
+
+void GpioEngine_SetEdgeSink(GpioEdgeSink sink, void * arg)
+{
+	pthread_mutex_lock(&engine_sink_lock);
+
+	engine_edge_arg = arg;
+	engine_edge_sink.store(sink);
+
+	pthread_mutex_unlock(&engine_sink_lock);
+}
+
+int GpioEngine_Start(void)
+{
+	pthread_once(&engine_once, EngineInitCond);
+	pthread_mutex_lock(&engine_lock);
+
+	if (engine_running)
+	{
+		pthread_mutex_unlock(&engine_lock);
+		return 0;
+	}
+
+	if (!engine_open)
+	{
+		DBGPRT(DBG_ERR, "GpioEngine_Start: lines not requested\n");
+		pthread_mutex_unlock(&engine_lock);
+		return -1;
+	}
+
+	uint32_t valid;
+	uint32_t state = GpioEngine_GetState(&valid);
+
+	for (unsigned int i = 0; i < engine_line_count; i++)
+	{
+		EngineLine * line = &engine_lines[i];
+
+		line->confirmed = (valid & line->bit) ? ((state & line->bit) ? 1 : 0) : -1;
+		line->raw       = line->confirmed;
+		line->burst     = 0;
+
+		if (line->debounce_ms > 0)
+		{
+			if (((line->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) < 0) ||
+				((line->timer_source = Reactor_AddFd(line->timer_fd, EngineTimerEvent, line)) < 0))
+			{
+				DBGPRT(DBG_ERR, "GpioEngine_Start: Failed to set up debounce for line %u, %s\n", i, strerror(errno));
+				EngineUnwatch();
+				pthread_mutex_unlock(&engine_lock);
+				return -1;
+			}
+		}
+
+		int fd = engine_backend->event_fd(engine_chips[line->chip_index].request, line->index);
+
+		if ((line->event_source = Reactor_AddFd(fd, EngineLineEvent, line)) < 0)
+		{
+			DBGPRT(DBG_ERR, "GpioEngine_Start: Failed to watch line %u\n", i);
+			EngineUnwatch();
+			pthread_mutex_unlock(&engine_lock);
+			return -1;
+		}
+	}
+
+	DBGPRT(DBG_INFO1, "GpioEngine_Start: watching %u lines on %u chips\n", engine_line_count, engine_chip_count);
+
+	engine_running = true;
+	pthread_mutex_unlock(&engine_lock);
+
+	return 0;
+}
+
+void GpioEngine_Stop(void)
+{
+	pthread_mutex_lock(&engine_lock);
+
+	if (engine_running)
+	{
+		EngineUnwatch();
+		engine_running = false;
+	}
+
+	pthread_mutex_unlock(&engine_lock);
+}
+
+uint32_t GpioEngine_Read(uint32_t * valid)
+{
+	uint32_t known = 0;
+	uint32_t state = 0;
+
+	pthread_mutex_lock(&engine_lock);
+
+	if (engine_open)
+	{
+		state = EngineReadChips(&known);
+
+		// While the reactor watches the lines it owns the cache, a read here could race an edge.
+		if (!engine_running)
+		{
+			engine_state.store(((uint64_t)known << 32) | state);
+		}
+	}
+
+	pthread_mutex_unlock(&engine_lock);
+
+	if (valid != NULL)
+	{
+		*valid = known;
+	}
+
+	return state;
+}
+
+uint32_t GpioEngine_GetState(uint32_t * valid)
+{
+	uint64_t word = engine_state.load();
+
+	if (valid != NULL)
+	{
+		*valid = (uint32_t)(word >> 32);
+	}
+
+	return (uint32_t)word;
+}
+
+uint32_t GpioEngine_GetActive(uint32_t * valid)
+{
+	uint32_t known;
+	uint32_t state = GpioEngine_GetState(&known);
+
+	if (valid != NULL)
+	{
+		*valid = known;
+	}
+
+	return (state ^ engine_active_low.load()) & known;
+}
+
+int GpioEngine_GetLine(uint32_t bit)
+{
+	uint32_t valid;
+	uint32_t state = GpioEngine_GetState(&valid);
+
+	if ((valid & bit) == 0)
+	{
+		return -1;
+	}
+
+	return (state & bit) ? 1 : 0;
+}
+
+uint64_t GpioEngine_Wait(uint64_t seq, int timeout_ms)
+{
+	struct timespec deadline;
+
+	pthread_once(&engine_once, EngineInitCond);
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec  += timeout_ms / 1000;
+	deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&engine_lock);
+
+	while (engine_seq == seq)
+	{
+		if (pthread_cond_timedwait(&engine_cond, &engine_lock, &deadline) == ETIMEDOUT)
+		{
+			break;
+		}
+	}
+
+	seq = engine_seq;
+	pthread_mutex_unlock(&engine_lock);
+
+	return seq;
+}
+
+int GpioEngine_EventFd(void)
+{
+	pthread_mutex_lock(&engine_lock);
+
+	if ((engine_notify_fd < 0) && ((engine_notify_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0))
+	{
+		DBGPRT(DBG_ERR, "GpioEngine_EventFd: eventfd failed, %s\n", strerror(errno));
+	}
+
+	int fd = engine_notify_fd;
+
+	pthread_mutex_unlock(&engine_lock);
+
+	return fd;
+}
+
+int GpioEngine_GetLineStats(uint32_t bit, GpioLineStats * stats)
+{
+	int result = -1;
+
+	pthread_mutex_lock(&engine_lock);
+
+	for (unsigned int i = 0; i < engine_line_count; i++)
+	{
+		EngineLine * line = &engine_lines[i];
+
+		if (line->bit == bit)
+		{
+			stats->debounce_ms = line->debounce_ms;
+			stats->edges       = line->edges.load();
+			stats->bounces     = line->bounces.load();
+			stats->transitions = line->transitions.load();
+			stats->max_burst   = line->max_burst.load();
+			result = 0;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&engine_lock);
+
+	return result;
+}
+
+void GpioEngine_GetStats(GpioEngineStats * stats)
+{
+	pthread_mutex_lock(&engine_lock);
+	stats->running = engine_running;
+	stats->lines   = engine_line_count;
+	stats->chips   = engine_chip_count;
+	pthread_mutex_unlock(&engine_lock);
+
+	stats->wakeups = engine_wakeups.load();
+	stats->events  = engine_events.load();
+	stats->changes = engine_changes.load();
+	stats->reads   = engine_reads.load();
+}
@@ -0,0 +1,136 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - GPIO libgpiod Backend
+ *  Source Filename  - GpioGpiod.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - GPIO backend on libgpiod v1. One bulk request per chip.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <gpiod.h>
+
+#include "GpioBackend.hpp"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+typedef struct
+{
+	struct gpiod_chip * chip;
+	struct gpiod_line_bulk bulk;
+} GpiodRequest;
+
+static void * GpiodRequestLines(const char * chip, const unsigned int * offsets, unsigned int count, const char * consumer)
+{
+	GpiodRequest * request;
+
+	if ((count == 0) || (count > GPIOD_LINE_BULK_MAX_LINES))
+	{
+		return NULL;
+	}
+
+	if ((request = (GpiodRequest *)calloc(1, sizeof(GpiodRequest))) == NULL)
+	{
+		return NULL;
+	}
+
+	if ((request->chip = gpiod_chip_open_by_name(chip)) == NULL)
+	{
+		DBGPRT(DBG_ERR, "GpiodRequestLines: Failed to open %s, %s\n", chip, strerror(errno));
+		free(request);
+		return NULL;
+	}
+
+	if (gpiod_chip_get_lines(request->chip, (unsigned int *)offsets, count, &request->bulk) != 0)
+	{
+		DBGPRT(DBG_ERR, "GpiodRequestLines: Unable to get %s lines, %s\n", chip, strerror(errno));
+		gpiod_chip_close(request->chip);
+		free(request);
+		return NULL;
+	}
+
+	if (gpiod_line_request_bulk_both_edges_events(&request->bulk, consumer) != 0)
+	{
+		DBGPRT(DBG_ERR, "GpiodRequestLines: Unable to request %s lines, %s\n", chip, strerror(errno));
+		gpiod_chip_close(request->chip);
+		free(request);
+		return NULL;
+	}
+
+	return request;
+}
+
+static void GpiodRelease(void * handle)
+{
+	GpiodRequest * request = (GpiodRequest *)handle;
+
+	gpiod_line_release_bulk(&request->bulk);
+	gpiod_chip_close(request->chip);
+	free(request);
+}
+
+static int GpiodGetValues(void * handle, int * values)
+{
+	GpiodRequest * request = (GpiodRequest *)handle;
+
+	return gpiod_line_get_value_bulk(&request->bulk, values);
+}
+
+static int GpiodEventFd(void * handle, unsigned int index)
+{
+	GpiodRequest * request = (GpiodRequest *)handle;
+
+	return gpiod_line_event_get_fd(gpiod_line_bulk_get_line(&request->bulk, index));
+}
+
+static int GpiodReadEvents(void * handle, unsigned int index, GpioEvent * events, unsigned int max)
+{
+	GpiodRequest * request = (GpiodRequest *)handle;
+	struct gpiod_line_event raw[GPIOD_LINE_BULK_MAX_LINES];
+	int count;
+
+	if (max > GPIOD_LINE_BULK_MAX_LINES)
+	{
+		max = GPIOD_LINE_BULK_MAX_LINES;
+	}
+
+	if ((count = gpiod_line_event_read_multiple(gpiod_line_bulk_get_line(&request->bulk, index), raw, max)) < 0)
+	{
+		return -1;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		events[i].t_ns   = ((int64_t)raw[i].ts.tv_sec * 1000000000LL) + raw[i].ts.tv_nsec;
+		events[i].rising = (raw[i].event_type == GPIOD_LINE_EVENT_RISING_EDGE) ? 1 : 0;
+	}
+
+	return count;
+}
+
+static const GpioBackend gpiod_backend =
+{
+		.name        = "libgpiod",
+		.request     = GpiodRequestLines,
+		.release     = GpiodRelease,
+		.get_values  = GpiodGetValues,
+		.event_fd    = GpiodEventFd,
+		.read_events = GpiodReadEvents
+};
+
+const GpioBackend * GpioBackend_Gpiod(void)
+{
+	return &gpiod_backend;
+}
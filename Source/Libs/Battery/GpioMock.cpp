@@ -0,0 +1,480 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - GPIO Mock Backend
+ *  Source Filename  - GpioMock.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - In-process GPIO lines for running the GPIO engine on a
+ *  				   host without gpio-sim. Each requested line has an
+ *  				   eventfd that is readable while it has queued edges, so
+ *  				   the engine's epoll loop runs unchanged.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "GpioBackend.hpp"
+#include "GpioEngine.hpp"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+#define MOCK_LATE_NS		(1000000LL)
+
+typedef struct
+{
+	char chip[GPIO_ENGINE_CHIP_LEN];
+	unsigned int offset;
+	int value;
+	int event_fd;						// -1 while not requested
+	GpioEvent queue[GPIO_MOCK_QUEUE];
+	unsigned int head;
+	unsigned int count;
+} MockLine;
+
+typedef struct
+{
+	unsigned int count;
+	int lines[GPIO_BACKEND_MAX_REQUEST];
+} MockRequest;
+
+static pthread_mutex_t mock_lock = PTHREAD_MUTEX_INITIALIZER;
+static MockLine mock_lines[GPIO_MOCK_MAX_LINES];
+static unsigned int mock_line_count = 0;
+static uint64_t mock_edges = 0;
+static uint64_t mock_dropped = 0;
+
+static pthread_mutex_t play_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t play_once = PTHREAD_ONCE_INIT;
+static pthread_cond_t play_cond;
+static pthread_t play_tid;
+static bool play_running = false;
+static bool play_stop = false;
+static const GpioMockStep * play_steps = NULL;
+static size_t play_count = 0;
+static uint64_t play_played = 0;
+static uint64_t play_late = 0;
+
+static int64_t MockNowNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((int64_t)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+static void PlayInitCond(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&play_cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+static int FindLine(const char * chip, unsigned int offset)
+{
+	for (unsigned int i = 0; i < mock_line_count; i++)
+	{
+		if ((mock_lines[i].offset == offset) && (strcmp(mock_lines[i].chip, chip) == 0))
+		{
+			return (int)i;
+		}
+	}
+
+	if (mock_line_count >= GPIO_MOCK_MAX_LINES)
+	{
+		return -1;
+	}
+
+	MockLine * line = &mock_lines[mock_line_count];
+
+	memset(line, 0, sizeof(*line));
+	snprintf(line->chip, sizeof(line->chip), "%s", chip);
+	line->offset   = offset;
+	line->event_fd = -1;
+
+	return (int)mock_line_count++;
+}
+
+static void * MockRequestLines(const char * chip, const unsigned int * offsets, unsigned int count, const char * consumer)
+{
+	UNUSED(consumer);
+
+	MockRequest * request;
+
+	if ((count == 0) || (count > GPIO_BACKEND_MAX_REQUEST) ||
+		((request = (MockRequest *)calloc(1, sizeof(MockRequest))) == NULL))
+	{
+		return NULL;
+	}
+
+	pthread_mutex_lock(&mock_lock);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		int id = FindLine(chip, offsets[i]);
+
+		if ((id < 0) || (mock_lines[id].event_fd >= 0) ||
+			((mock_lines[id].event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0))
+		{
+			DBGPRT(DBG_ERR, "MockRequestLines: %s line %u unavailable\n", chip, offsets[i]);
+
+			// Hand back what this request already took.
+			for (unsigned int r = 0; r < request->count; r++)
+			{
+				close(mock_lines[request->lines[r]].event_fd);
+				mock_lines[request->lines[r]].event_fd = -1;
+			}
+
+			pthread_mutex_unlock(&mock_lock);
+			free(request);
+			errno = EBUSY;
+			return NULL;
+		}
+
+		mock_lines[id].head  = 0;
+		mock_lines[id].count = 0;
+		request->lines[request->count++] = id;
+	}
+
+	pthread_mutex_unlock(&mock_lock);
+
+	return request;
+}
+
+static void MockRelease(void * handle)
+{
+	MockRequest * request = (MockRequest *)handle;
+
+	pthread_mutex_lock(&mock_lock);
+
+	for (unsigned int i = 0; i < request->count; i++)
+	{
+		MockLine * line = &mock_lines[request->lines[i]];
+
+		close(line->event_fd);
+		line->event_fd = -1;
+		line->count    = 0;
+	}
+
+	pthread_mutex_unlock(&mock_lock);
+
+	free(request);
+}
+
+static int MockGetValues(void * handle, int * values)
+{
+	MockRequest * request = (MockRequest *)handle;
+
+	pthread_mutex_lock(&mock_lock);
+
+	for (unsigned int i = 0; i < request->count; i++)
+	{
+		values[i] = mock_lines[request->lines[i]].value;
+	}
+
+	pthread_mutex_unlock(&mock_lock);
+
+	return 0;
+}
+
+static int MockEventFd(void * handle, unsigned int index)
+{
+	MockRequest * request = (MockRequest *)handle;
+
+	return (index < request->count) ? mock_lines[request->lines[index]].event_fd : -1;
+}
+
+static int MockReadEvents(void * handle, unsigned int index, GpioEvent * events, unsigned int max)
+{
+	MockRequest * request = (MockRequest *)handle;
+	unsigned int count = 0;
+	uint64_t ticks;
+
+	if (index >= request->count)
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&mock_lock);
+
+	MockLine * line = &mock_lines[request->lines[index]];
+
+	while ((count < max) && (line->count > 0))
+	{
+		events[count++] = line->queue[line->head];
+		line->head = (line->head + 1) % GPIO_MOCK_QUEUE;
+		line->count--;
+	}
+
+	// Clear the eventfd, and leave it readable if edges are still queued.
+	if ((read(line->event_fd, &ticks, sizeof(ticks)) == sizeof(ticks)) && (line->count > 0))
+	{
+		ticks = 1;
+
+		if (write(line->event_fd, &ticks, sizeof(ticks)) != sizeof(ticks))
+		{
+			DBGPRT(DBG_ERR, "MockReadEvents: Failed to re-arm eventfd, %s\n", strerror(errno));
+		}
+	}
+
+	pthread_mutex_unlock(&mock_lock);
+
+	return (int)count;
+}
+
+static const GpioBackend mock_backend =
+{
+		.name        = "mock",
+		.request     = MockRequestLines,
+		.release     = MockRelease,
+		.get_values  = MockGetValues,
+		.event_fd    = MockEventFd,
+		.read_events = MockReadEvents
+};
+
+const GpioBackend * GpioBackend_Mock(void)
+{
+	return &mock_backend;
+}
+
+int GpioMock_Line(const char * chip, unsigned int offset)
+{
+	pthread_mutex_lock(&mock_lock);
+
+	int id = FindLine(chip, offset);
+
+	pthread_mutex_unlock(&mock_lock);
+
+	return id;
+}
+
+int GpioMock_SetValue(int id, int value)
+{
+	pthread_mutex_lock(&mock_lock);
+
+	if ((id < 0) || ((unsigned int)id >= mock_line_count))
+	{
+		pthread_mutex_unlock(&mock_lock);
+		return -1;
+	}
+
+	mock_lines[id].value = (value != 0) ? 1 : 0;
+
+	pthread_mutex_unlock(&mock_lock);
+
+	return 0;
+}
+
+int GpioMock_Edge(int id, int value, int64_t t_ns)
+{
+	uint64_t one = 1;
+
+	value = (value != 0) ? 1 : 0;
+
+	pthread_mutex_lock(&mock_lock);
+
+	if ((id < 0) || ((unsigned int)id >= mock_line_count))
+	{
+		pthread_mutex_unlock(&mock_lock);
+		return -1;
+	}
+
+	MockLine * line = &mock_lines[id];
+
+	if (line->value == value)
+	{
+		pthread_mutex_unlock(&mock_lock);
+		return 0;
+	}
+
+	line->value = value;
+	mock_edges++;
+
+	if (line->event_fd < 0)
+	{
+		pthread_mutex_unlock(&mock_lock);
+		return 0;
+	}
+
+	// Like the kernel, a full queue drops the new edge, the level still moves.
+	if (line->count >= GPIO_MOCK_QUEUE)
+	{
+		mock_dropped++;
+		pthread_mutex_unlock(&mock_lock);
+		return 0;
+	}
+
+	GpioEvent * event = &line->queue[(line->head + line->count) % GPIO_MOCK_QUEUE];
+
+	event->t_ns   = (t_ns != 0) ? t_ns : MockNowNs();
+	event->rising = (uint32_t)value;
+	line->count++;
+
+	if (write(line->event_fd, &one, sizeof(one)) != sizeof(one))
+	{
+		DBGPRT(DBG_ERR, "GpioMock_Edge: Failed to signal eventfd, %s\n", strerror(errno));
+	}
+
+	pthread_mutex_unlock(&mock_lock);
+
+	return 0;
+}
+
+// Plays every step that is due at each wakeup, so rates well above what the
+// scheduler can wake for still come out right on average.
+static void *PlayLoop(void *arg)
+{
+	UNUSED(arg);
+
+	int64_t start = MockNowNs();
+	size_t next = 0;
+
+	pthread_mutex_lock(&play_lock);
+
+	while (!play_stop && (next < play_count))
+	{
+		int64_t now = MockNowNs() - start;
+
+		if (play_steps[next].at_ns > now)
+		{
+			int64_t due = start + play_steps[next].at_ns;
+			struct timespec deadline;
+
+			deadline.tv_sec  = due / 1000000000LL;
+			deadline.tv_nsec = due % 1000000000LL;
+			pthread_cond_timedwait(&play_cond, &play_lock, &deadline);
+			continue;
+		}
+
+		uint64_t played = 0;
+		uint64_t late = 0;
+
+		pthread_mutex_unlock(&play_lock);
+
+		while ((next < play_count) && (play_steps[next].at_ns <= now))
+		{
+			const GpioMockStep * step = &play_steps[next++];
+
+			GpioMock_Edge(step->line, step->value, start + step->at_ns);
+
+			if ((now - step->at_ns) >= MOCK_LATE_NS)
+			{
+				late++;
+			}
+
+			played++;
+		}
+
+		// GpioMock_GetStats reads the counters under play_lock.
+		pthread_mutex_lock(&play_lock);
+
+		play_played += played;
+		play_late   += late;
+	}
+
+	pthread_mutex_unlock(&play_lock);
+
+	return NULL;
+}
+
+int GpioMock_Play(const GpioMockStep * steps, size_t count)
+{
+	GpioMock_Stop();
+
+	pthread_once(&play_once, PlayInitCond);
+	pthread_mutex_lock(&play_lock);
+
+	play_steps  = steps;
+	play_count  = count;
+	play_stop   = false;
+	play_played = 0;
+	play_late   = 0;
+
+	if (pthread_create(&play_tid, NULL, PlayLoop, NULL) != 0)
+	{
+		DBGPRT(DBG_ERR, "GpioMock_Play: Failed to start script thread\n");
+		pthread_mutex_unlock(&play_lock);
+		return -1;
+	}
+
+	play_running = true;
+	pthread_mutex_unlock(&play_lock);
+
+	return 0;
+}
+
+void GpioMock_Stop(void)
+{
+	pthread_once(&play_once, PlayInitCond);
+	pthread_mutex_lock(&play_lock);
+
+	if (!play_running)
+	{
+		pthread_mutex_unlock(&play_lock);
+		return;
+	}
+
+	play_stop = true;
+	pthread_cond_broadcast(&play_cond);
+	pthread_mutex_unlock(&play_lock);
+
+	pthread_join(play_tid, NULL);
+
+	pthread_mutex_lock(&play_lock);
+	play_running = false;
+	pthread_mutex_unlock(&play_lock);
+}
+
+void GpioMock_Reset(void)
+{
+	GpioMock_Stop();
+
+	pthread_mutex_lock(&mock_lock);
+
+	for (unsigned int i = 0; i < mock_line_count; i++)
+	{
+		if (mock_lines[i].event_fd >= 0)
+		{
+			close(mock_lines[i].event_fd);
+		}
+	}
+
+	memset(mock_lines, 0, sizeof(mock_lines));
+	mock_line_count = 0;
+	mock_edges      = 0;
+	mock_dropped    = 0;
+
+	pthread_mutex_unlock(&mock_lock);
+}
+
+void GpioMock_GetStats(GpioMockStats * stats)
+{
+	pthread_mutex_lock(&play_lock);
+	stats->running    = play_running && (play_played < play_count) && !play_stop;
+	stats->steps      = play_played;
+	stats->late_steps = play_late;
+	pthread_mutex_unlock(&play_lock);
+
+	pthread_mutex_lock(&mock_lock);
+	stats->edges   = mock_edges;
+	stats->dropped = mock_dropped;
+	pthread_mutex_unlock(&mock_lock);
+}
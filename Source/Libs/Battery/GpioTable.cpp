@@ -0,0 +1,259 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - GPIO Table
+ *  Source Filename  - GpioTable.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Loads the board GPIO line table. The table is only
+ *  				   written by GpioTable_Load at startup, before the GPIO
+ *  				   engine is opened, and read without locking after that.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "GpioTable.hpp"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+#define TABLE_LINE_LEN		(256)
+#define FNV_OFFSET_BASIS	(2166136261u)
+#define FNV_PRIME			(16777619u)
+
+static GpioLineConfig table_lines[GPIO_TABLE_MAX_LINES];
+static unsigned int table_count = 0;
+static uint32_t table_hash = 0;
+
+static uint32_t HashBytes(uint32_t hash, const void * data, size_t length)
+{
+	const uint8_t * bytes = (const uint8_t *)data;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	}
+
+	return hash;
+}
+
+// Field by field, so padding and the bytes after each name do not count.
+static uint32_t HashTable(const GpioLineConfig * lines, unsigned int count)
+{
+	uint32_t hash = FNV_OFFSET_BASIS;
+
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		uint8_t active_low = lines[i].active_low ? 1 : 0;
+
+		hash = HashBytes(hash, lines[i].name, strlen(lines[i].name) + 1);
+		hash = HashBytes(hash, lines[i].chip, strlen(lines[i].chip) + 1);
+		hash = HashBytes(hash, &lines[i].offset, sizeof(lines[i].offset));
+		hash = HashBytes(hash, &lines[i].edges, sizeof(lines[i].edges));
+		hash = HashBytes(hash, &active_low, sizeof(active_low));
+		hash = HashBytes(hash, &lines[i].debounce_ms, sizeof(lines[i].debounce_ms));
+	}
+
+	return hash;
+}
+
+static int ParseEdge(const char * text, uint32_t * edges)
+{
+	if (strcmp(text, "both") == 0)
+	{
+		*edges = GPIO_EDGE_BOTH;
+	}
+	else if (strcmp(text, "rising") == 0)
+	{
+		*edges = GPIO_EDGE_RISING;
+	}
+	else if (strcmp(text, "falling") == 0)
+	{
+		*edges = GPIO_EDGE_FALLING;
+	}
+	else
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+static int ParseActive(const char * text, bool * active_low)
+{
+	if (strcmp(text, "high") == 0)
+	{
+		*active_low = false;
+	}
+	else if (strcmp(text, "low") == 0)
+	{
+		*active_low = true;
+	}
+	else
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+// Names and chip offsets both have to be unique across the table.
+static int CheckUnique(const GpioLineConfig * lines, unsigned int count, const GpioLineConfig * line)
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (strcmp(lines[i].name, line->name) == 0)
+		{
+			return -1;
+		}
+
+		if ((lines[i].offset == line->offset) && (strcmp(lines[i].chip, line->chip) == 0))
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int ParseFile(FILE * file, const char * path, GpioLineConfig * lines, unsigned int * count)
+{
+	char text[TABLE_LINE_LEN];
+	unsigned int number = 0;
+
+	*count = 0;
+
+	while (fgets(text, sizeof(text), file) != NULL)
+	{
+		char edge[16];
+		char active[16];
+		char extra[2];
+		char * comment;
+		GpioLineConfig line;
+
+		number++;
+
+		if ((comment = strchr(text, '#')) != NULL)
+		{
+			*comment = '\0';
+		}
+
+		memset(&line, 0, sizeof(line));
+
+		int fields = sscanf(text, "%31s %31s %u %15s %15s %u %1s", line.name, line.chip, &line.offset,
+							edge, active, &line.debounce_ms, extra);
+
+		if (fields <= 0)
+		{
+			continue;
+		}
+
+		if ((fields != 6) || (ParseEdge(edge, &line.edges) != 0) || (ParseActive(active, &line.active_low) != 0))
+		{
+			DBGPRT(DBG_ERR, "ParseFile: %s:%u malformed line\n", path, number);
+			return -1;
+		}
+
+		if (*count >= GPIO_TABLE_MAX_LINES)
+		{
+			DBGPRT(DBG_ERR, "ParseFile: %s:%u more than %d lines\n", path, number, GPIO_TABLE_MAX_LINES);
+			return -1;
+		}
+
+		if (CheckUnique(lines, *count, &line) != 0)
+		{
+			DBGPRT(DBG_ERR, "ParseFile: %s:%u %s repeats a name or line\n", path, number, line.name);
+			return -1;
+		}
+
+		lines[(*count)++] = line;
+	}
+
+	return 0;
+}
+
+int GpioTable_Load(const char * path, const GpioLineConfig * defaults, unsigned int count)
+{
+	GpioLineConfig lines[GPIO_TABLE_MAX_LINES];
+	unsigned int loaded = 0;
+	FILE * file = NULL;
+
+	if ((path != NULL) && ((file = fopen(path, "r")) == NULL) && (errno != ENOENT))
+	{
+		DBGPRT(DBG_ERR, "GpioTable_Load: Failed to open %s, %s\n", path, strerror(errno));
+	}
+
+	if (file != NULL)
+	{
+		int result = ParseFile(file, path, lines, &loaded);
+
+		fclose(file);
+
+		if ((result == 0) && (loaded > 0))
+		{
+			memcpy(table_lines, lines, loaded * sizeof(GpioLineConfig));
+			table_count = loaded;
+			table_hash  = HashTable(table_lines, table_count);
+
+			DBGPRT(DBG_INFO1, "GpioTable_Load: %u lines from %s, table %08x\n", table_count, path, table_hash);
+			return 0;
+		}
+
+		DBGPRT(DBG_ERR, "GpioTable_Load: Ignoring %s, using the built in lines\n", path);
+	}
+
+	if ((defaults == NULL) || (count == 0) || (count > GPIO_TABLE_MAX_LINES))
+	{
+		table_count = 0;
+		table_hash  = 0;
+		return -1;
+	}
+
+	memcpy(table_lines, defaults, count * sizeof(GpioLineConfig));
+	table_count = count;
+	table_hash  = HashTable(table_lines, table_count);
+
+	return 1;
+}
+
+unsigned int GpioTable_Count(void)
+{
+	return table_count;
+}
+
+const GpioLineConfig * GpioTable_Line(unsigned int index)
+{
+	return (index < table_count) ? &table_lines[index] : NULL;
+}
+
+uint32_t GpioTable_Bit(const char * name)
+{
+	for (unsigned int i = 0; i < table_count; i++)
+	{
+		if (strcmp(table_lines[i].name, name) == 0)
+		{
+			return (uint32_t)1 << i;
+		}
+	}
+
+	return 0;
+}
+
+uint32_t GpioTable_Hash(void)
+{
+	return table_hash;
+}
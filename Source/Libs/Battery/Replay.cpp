@@ -0,0 +1,511 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Replay
+ *  Source Filename  - Replay.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Binary log recorder for the raw battery inputs and the
+ *  				   replay source that feeds a log back through the app.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "Battery.hpp"
+#include "Replay.hpp"
+#include "GpioTable.hpp"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+#define RECORDER_FLUSH_NS		(1000000000LL)
+#define REPLAY_CONSUME_WAIT_NS	(10000000LL)
+#define LATENCY_BUCKETS			(128)
+
+// Log2 histogram with four sub-buckets per octave, in microseconds.
+typedef struct
+{
+	uint64_t count;
+	uint32_t max;
+	uint64_t buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+static pthread_mutex_t recorder_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE * recorder_file = NULL;
+static int64_t recorder_last_flush_ns = 0;
+
+static pthread_mutex_t replay_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t replay_once = PTHREAD_ONCE_INIT;
+static pthread_cond_t replay_cond;
+static pthread_t replay_tid;
+static bool replay_running = false;
+static FILE * replay_file = NULL;
+static double replay_speed = 1.0;
+static uint32_t replay_fields = BATTERY_FIELD_ALL;	// the fields taken from the log
+static BatterySample replay_current;
+static uint32_t replay_pending = 0;
+static int64_t replay_publish_ns[BATTERY_FIELD_COUNT];
+static LatencyHistogram replay_late;
+static LatencyHistogram replay_consume;
+static ReplayStats replay_stats;
+static int64_t replay_start_ns = 0;
+static bool replay_table_warned = false;
+
+static unsigned int LatencyBucket(uint32_t us)
+{
+	if (us < 4)
+	{
+		return us;
+	}
+
+	unsigned int octave = 31 - __builtin_clz(us);
+	unsigned int sub = (us >> (octave - 2)) & 0x3;
+	unsigned int bucket = ((octave - 1) * 4) + sub;
+
+	return (bucket < LATENCY_BUCKETS) ? bucket : (LATENCY_BUCKETS - 1);
+}
+
+static uint32_t LatencyBucketLimit(unsigned int bucket)
+{
+	if (bucket < 4)
+	{
+		return bucket;
+	}
+
+	unsigned int octave = (bucket / 4) + 1;
+	unsigned int sub = bucket % 4;
+
+	return ((4 + sub + 1) << (octave - 2)) - 1;
+}
+
+static void LatencyAdd(LatencyHistogram * hist, int64_t ns)
+{
+	uint32_t us = (ns <= 0) ? 0 : ((ns / 1000) > UINT32_MAX ? UINT32_MAX : (uint32_t)(ns / 1000));
+
+	hist->buckets[LatencyBucket(us)]++;
+	hist->count++;
+
+	if (us > hist->max)
+	{
+		hist->max = us;
+	}
+}
+
+static uint32_t LatencyPercentile(const LatencyHistogram * hist, double pct)
+{
+	if (hist->count == 0)
+	{
+		return 0;
+	}
+
+	uint64_t target = (uint64_t)((double)hist->count * pct);
+	uint64_t seen = 0;
+
+	for (unsigned int i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		seen += hist->buckets[i];
+
+		if (seen > target)
+		{
+			uint32_t limit = LatencyBucketLimit(i);
+			return (limit < hist->max) ? limit : hist->max;
+		}
+	}
+
+	return hist->max;
+}
+
+static_assert(BATTERY_FIELD_ALL == ((1u << BATTERY_FIELD_COUNT) - 1), "BATTERY_FIELD_COUNT is out of date");
+
+static unsigned int FieldIndex(uint32_t field)
+{
+	return __builtin_ctz(field);
+}
+
+int Recorder_Start(const char * path)
+{
+	BatteryLogHeader header;
+
+	pthread_mutex_lock(&recorder_lock);
+
+	if (recorder_file != NULL)
+	{
+		pthread_mutex_unlock(&recorder_lock);
+		DBGPRT(DBG_ERR, "Recorder_Start: already recording\n");
+		return -1;
+	}
+
+	if ((recorder_file = fopen(path, "wb")) == NULL)
+	{
+		pthread_mutex_unlock(&recorder_lock);
+		DBGPRT(DBG_ERR, "Recorder_Start: Failed to open %s, %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	struct timespec wall;
+	clock_gettime(CLOCK_REALTIME, &wall);
+
+	memset(&header, 0, sizeof(header));
+	header.magic         = BATTERY_LOG_MAGIC;
+	header.version       = BATTERY_LOG_VERSION;
+	header.record_size   = sizeof(BatterySample);
+	header.start_ns      = Battery_NowNs();
+	header.start_wall_ns = ((int64_t)wall.tv_sec * 1000000000LL) + wall.tv_nsec;
+
+	if (gethostname(header.device_id, sizeof(header.device_id) - 1) != 0)
+	{
+		snprintf(header.device_id, sizeof(header.device_id), "unknown");
+	}
+
+	if (fwrite(&header, sizeof(header), 1, recorder_file) != 1)
+	{
+		DBGPRT(DBG_ERR, "Recorder_Start: Failed to write header, %s\n", strerror(errno));
+		fclose(recorder_file);
+		recorder_file = NULL;
+		pthread_mutex_unlock(&recorder_lock);
+		return -1;
+	}
+
+	recorder_last_flush_ns = header.start_ns;
+
+	pthread_mutex_unlock(&recorder_lock);
+
+	DBGPRT(DBG_INFO1, "Recorder_Start: recording battery inputs to %s\n", path);
+
+	return 0;
+}
+
+void Recorder_Stop(void)
+{
+	pthread_mutex_lock(&recorder_lock);
+
+	if (recorder_file != NULL)
+	{
+		fclose(recorder_file);
+		recorder_file = NULL;
+	}
+
+	pthread_mutex_unlock(&recorder_lock);
+}
+
+void Recorder_Write(const BatterySample * sample)
+{
+	// Checked without the lock so the common not-recording case costs nothing.
+	if (__atomic_load_n(&recorder_file, __ATOMIC_RELAXED) == NULL)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&recorder_lock);
+
+	if (recorder_file != NULL)
+	{
+		if (fwrite(sample, sizeof(*sample), 1, recorder_file) != 1)
+		{
+			DBGPRT(DBG_ERR, "Recorder_Write: Failed to write sample, %s\n", strerror(errno));
+		}
+
+		if ((sample->t_ns - recorder_last_flush_ns) >= RECORDER_FLUSH_NS)
+		{
+			fflush(recorder_file);
+			recorder_last_flush_ns = sample->t_ns;
+		}
+	}
+
+	pthread_mutex_unlock(&recorder_lock);
+}
+
+static int ReplayRead(void * ctx, BatterySample * sample, uint32_t fields)
+{
+	UNUSED(ctx);
+
+	int64_t now = Battery_NowNs();
+
+	pthread_mutex_lock(&replay_lock);
+
+	uint32_t valid = fields & replay_current.fields;
+	uint32_t lines = fields & BATTERY_FIELD_LINES & ~replay_fields;
+
+	sample->current  = replay_current.current;
+	sample->voltage  = replay_current.voltage;
+	sample->temp     = replay_current.temp;
+	sample->level    = replay_current.level;
+	sample->in_dock  = replay_current.in_dock;
+	sample->charging = replay_current.charging;
+	sample->gpio     = replay_current.gpio;
+	sample->gpio_table = replay_current.gpio_table;
+	memcpy(sample->health, replay_current.health, sizeof(sample->health));
+	sample->fields   = valid;
+
+	uint32_t consumed = valid & replay_pending;
+
+	while (consumed != 0)
+	{
+		uint32_t field = consumed & -consumed;
+
+		LatencyAdd(&replay_consume, now - replay_publish_ns[FieldIndex(field)]);
+		consumed &= ~field;
+	}
+
+	if ((replay_pending != 0) && ((replay_pending &= ~valid) == 0))
+	{
+		pthread_cond_signal(&replay_cond);
+	}
+
+	pthread_mutex_unlock(&replay_lock);
+
+	// Lines driven by an edge replay are read where the hardware ones are.
+	if (lines != 0)
+	{
+		Battery_ReadLines(sample, lines);
+	}
+
+	return 0;
+}
+
+static const BatterySource replay_source =
+{
+		.name = "replay",
+		.read = ReplayRead,
+		.ctx  = NULL,
+		.recorded = false
+};
+
+static void ReplayInitCond(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&replay_cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+// Waits on replay_cond until t_ns, a stop, or (if consumed) the pending fields are read.
+// Called with replay_lock held.
+static void WaitUntil(int64_t t_ns, bool consumed)
+{
+	struct timespec due;
+
+	due.tv_sec  = t_ns / 1000000000LL;
+	due.tv_nsec = t_ns % 1000000000LL;
+
+	while (replay_running && (!consumed || (replay_pending != 0)))
+	{
+		if (pthread_cond_timedwait(&replay_cond, &replay_lock, &due) == ETIMEDOUT)
+		{
+			break;
+		}
+	}
+}
+
+static void * ReplayTaskLoop(void * arg)
+{
+	UNUSED(arg);
+
+	BatterySample record;
+	int64_t first_ns = -1;
+
+	DBGPRT(DBG_INFO1, "ReplayTaskLoop: started, speed = %.2f\n", replay_speed);
+
+	while (fread(&record, sizeof(record), 1, replay_file) == 1)
+	{
+		if (first_ns < 0)
+		{
+			first_ns = record.t_ns;
+		}
+
+		pthread_mutex_lock(&replay_lock);
+
+		if (replay_speed > 0)
+		{
+			int64_t due = replay_start_ns + (int64_t)((double)(record.t_ns - first_ns) / replay_speed);
+
+			WaitUntil(due, false);
+			LatencyAdd(&replay_late, Battery_NowNs() - due);
+		}
+		else
+		{
+			WaitUntil(Battery_NowNs() + REPLAY_CONSUME_WAIT_NS, true);
+		}
+
+		if (!replay_running)
+		{
+			pthread_mutex_unlock(&replay_lock);
+			break;
+		}
+
+		if (replay_pending != 0)
+		{
+			replay_stats.unconsumed++;
+		}
+
+		int64_t now = Battery_NowNs();
+		uint32_t fields = record.fields & replay_fields;
+
+		if (fields & BATTERY_FIELD_CURRENT)  replay_current.current  = record.current;
+		if (fields & BATTERY_FIELD_VOLTAGE)  replay_current.voltage  = record.voltage;
+		if (fields & BATTERY_FIELD_TEMP)     replay_current.temp     = record.temp;
+		if (fields & BATTERY_FIELD_LEVEL)    replay_current.level    = record.level;
+		if (fields & BATTERY_FIELD_IN_DOCK)  replay_current.in_dock  = record.in_dock;
+		if (fields & BATTERY_FIELD_CHARGING) replay_current.charging = record.charging;
+		if (fields & BATTERY_FIELD_GPIO)     replay_current.gpio     = record.gpio;
+		if (fields & BATTERY_FIELD_GPIO)     replay_current.gpio_table = record.gpio_table;
+		if (fields & BATTERY_FIELD_HEALTH)   memcpy(replay_current.health, record.health, sizeof(record.health));
+
+		// The bits are still replayed, but they name other lines than the shown ones.
+		if ((fields & BATTERY_FIELD_GPIO) && (record.gpio_table != GpioTable_Hash()) && !replay_table_warned)
+		{
+			DBGPRT(DBG_WARN, "ReplayTaskLoop: recorded with GPIO table %08x, running with %08x\n",
+					record.gpio_table, GpioTable_Hash());
+			replay_table_warned = true;
+		}
+
+		replay_current.fields |= fields;
+		replay_current.t_ns = record.t_ns;
+		replay_pending |= fields;
+
+		for (uint32_t f = fields; f != 0; f &= (f - 1))
+		{
+			replay_publish_ns[FieldIndex(f & -f)] = now;
+		}
+
+		replay_stats.records++;
+
+		pthread_mutex_unlock(&replay_lock);
+	}
+
+	pthread_mutex_lock(&replay_lock);
+
+	replay_stats.done = true;
+	replay_stats.wall_ns = Battery_NowNs() - replay_start_ns;
+
+	pthread_mutex_unlock(&replay_lock);
+
+	DBGPRT(DBG_INFO1, "ReplayTaskLoop: end of the log\n");
+
+	return NULL;
+}
+
+int Replay_Start(const char * path, double speed, uint32_t fields)
+{
+	BatteryLogHeader header;
+
+	pthread_once(&replay_once, ReplayInitCond);
+
+	pthread_mutex_lock(&replay_lock);
+
+	if (replay_running)
+	{
+		pthread_mutex_unlock(&replay_lock);
+		DBGPRT(DBG_ERR, "Replay_Start: already replaying\n");
+		return -1;
+	}
+
+	if ((replay_file = fopen(path, "rb")) == NULL)
+	{
+		pthread_mutex_unlock(&replay_lock);
+		DBGPRT(DBG_ERR, "Replay_Start: Failed to open %s, %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if ((fread(&header, sizeof(header), 1, replay_file) != 1) ||
+		(header.magic != BATTERY_LOG_MAGIC) ||
+		(header.version != BATTERY_LOG_VERSION) ||
+		(header.record_size != sizeof(BatterySample)))
+	{
+		DBGPRT(DBG_ERR, "Replay_Start: %s is not a battery log\n", path);
+		fclose(replay_file);
+		replay_file = NULL;
+		pthread_mutex_unlock(&replay_lock);
+		return -1;
+	}
+
+	memset(&replay_current, 0, sizeof(replay_current));
+	memset(&replay_late, 0, sizeof(replay_late));
+	memset(&replay_consume, 0, sizeof(replay_consume));
+	memset(&replay_stats, 0, sizeof(replay_stats));
+	replay_pending  = 0;
+	replay_table_warned = false;
+	replay_speed    = speed;
+	replay_fields   = fields & BATTERY_FIELD_ALL;
+	replay_start_ns = Battery_NowNs();
+	replay_running  = true;
+
+	pthread_mutex_unlock(&replay_lock);
+
+	Battery_SetSource(&replay_source);
+
+	if (pthread_create(&replay_tid, NULL, ReplayTaskLoop, NULL) != 0)
+	{
+		DBGPRT(DBG_ERR, "Replay_Start: Failed to create replay thread\n");
+		Battery_SetSource(NULL);
+		pthread_mutex_lock(&replay_lock);
+		replay_running = false;
+		fclose(replay_file);
+		replay_file = NULL;
+		pthread_mutex_unlock(&replay_lock);
+		return -1;
+	}
+
+	DBGPRT(DBG_INFO1, "Replay_Start: replaying %s\n", path);
+
+	return 0;
+}
+
+void Replay_Stop(void)
+{
+	pthread_mutex_lock(&replay_lock);
+
+	if (!replay_running)
+	{
+		pthread_mutex_unlock(&replay_lock);
+		return;
+	}
+
+	replay_running = false;
+	pthread_cond_broadcast(&replay_cond);
+
+	pthread_mutex_unlock(&replay_lock);
+
+	pthread_join(replay_tid, NULL);
+
+	pthread_mutex_lock(&replay_lock);
+	fclose(replay_file);
+	replay_file = NULL;
+	pthread_mutex_unlock(&replay_lock);
+}
+
+void Replay_GetStats(ReplayStats * stats)
+{
+	pthread_mutex_lock(&replay_lock);
+
+	*stats = replay_stats;
+
+	if (!stats->done)
+	{
+		stats->wall_ns = Battery_NowNs() - replay_start_ns;
+	}
+
+	stats->records_per_sec = (stats->wall_ns > 0) ? ((double)stats->records * 1e9 / (double)stats->wall_ns) : 0;
+	stats->late_p50_us     = LatencyPercentile(&replay_late, 0.50);
+	stats->late_p99_us     = LatencyPercentile(&replay_late, 0.99);
+	stats->late_max_us     = replay_late.max;
+	stats->consume_p50_us  = LatencyPercentile(&replay_consume, 0.50);
+	stats->consume_p99_us  = LatencyPercentile(&replay_consume, 0.99);
+	stats->consume_max_us  = replay_consume.max;
+
+	pthread_mutex_unlock(&replay_lock);
+}
@@ -0,0 +1,628 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Transition Log
+ *  Source Filename  - TransitionLog.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Confirmed line transitions go to a ring, an append only
+ *  				   file and an index of active time per day and active
+ *  				   sessions per line. The index is updated as records
+ *  				   arrive, so queries never rescan the log.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "TransitionLog.hpp"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+#define NS_PER_SEC		(1000000000LL)
+
+typedef struct
+{
+	uint32_t bit;
+	char name[GPIO_LINE_NAME_LEN];
+	int active_value;
+	int value;							// -1 until the first record
+	int64_t active_since;				// wall ns, -1 while inactive
+	TransitionDay days[TRANSITION_MAX_DAYS];
+	size_t day_head;					// next slot
+	size_t day_count;
+	TransitionSession sessions[TRANSITION_MAX_SESSIONS];
+	size_t session_head;
+	size_t session_count;
+} LineIndex;
+
+static pthread_mutex_t transition_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE * transition_file = NULL;
+static TransitionRecord transition_ring[TRANSITION_RING_SIZE];
+static size_t transition_ring_head = 0;
+static size_t transition_ring_count = 0;
+static LineIndex * transition_lines[TRANSITION_MAX_LINES];
+static unsigned int transition_line_count = 0;
+static int64_t transition_last_wall_ns = -1;
+static int64_t transition_boot_wall_ns = -1;	// last heard before the current run of BOOT records
+static bool transition_in_boot = false;
+
+// Records queued for the writer thread, so the engine's sinks never wait on the file.
+static pthread_cond_t transition_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t transition_writer;
+static bool transition_writing = false;
+static TransitionRecord transition_queue[TRANSITION_WRITE_QUEUE];
+static size_t transition_queue_count = 0;
+
+static int64_t ClockNs(clockid_t clock)
+{
+	struct timespec now;
+
+	clock_gettime(clock, &now);
+
+	return ((int64_t)now.tv_sec * NS_PER_SEC) + now.tv_nsec;
+}
+
+// Kernels before 5.7 stamp line events with CLOCK_REALTIME, later ones with
+// CLOCK_MONOTONIC. Whichever clock t_ns is closer to is the one it came from.
+static void EventClocks(int64_t t_ns, int64_t * mono_ns, int64_t * wall_ns)
+{
+	int64_t mono   = ClockNs(CLOCK_MONOTONIC);
+	int64_t wall   = ClockNs(CLOCK_REALTIME);
+	int64_t offset = wall - mono;
+
+	if (llabs(t_ns - wall) < llabs(t_ns - mono))
+	{
+		*wall_ns = t_ns;
+		*mono_ns = t_ns - offset;
+	}
+	else
+	{
+		*mono_ns = t_ns;
+		*wall_ns = t_ns + offset;
+	}
+}
+
+static int64_t LocalMidnight(int64_t wall_ns, int days_ahead)
+{
+	time_t t = (time_t)(wall_ns / NS_PER_SEC);
+	struct tm local;
+
+	localtime_r(&t, &local);
+	local.tm_hour  = 0;
+	local.tm_min   = 0;
+	local.tm_sec   = 0;
+	local.tm_mday += days_ahead;
+	local.tm_isdst = -1;
+
+	return (int64_t)mktime(&local) * NS_PER_SEC;
+}
+
+static LineIndex * FindLine(uint32_t bit)
+{
+	for (unsigned int i = 0; i < transition_line_count; i++)
+	{
+		if (transition_lines[i]->bit == bit)
+		{
+			return transition_lines[i];
+		}
+	}
+
+	return NULL;
+}
+
+static LineIndex * FindLineByName(const char * name)
+{
+	for (unsigned int i = 0; i < transition_line_count; i++)
+	{
+		if (strncmp(transition_lines[i]->name, name, GPIO_LINE_NAME_LEN) == 0)
+		{
+			return transition_lines[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void DayAdd(TransitionDay * days, size_t * head, size_t * count, size_t capacity, int64_t day, int64_t ns)
+{
+	if (*count > 0)
+	{
+		TransitionDay * last = &days[(*head + capacity - 1) % capacity];
+
+		// A clock step backwards lands in the newest day rather than reordering.
+		if (day <= last->day_wall_ns)
+		{
+			last->active_ns += ns;
+			return;
+		}
+	}
+
+	days[*head].day_wall_ns = day;
+	days[*head].active_ns   = ns;
+	*head = (*head + 1) % capacity;
+
+	if (*count < capacity)
+	{
+		(*count)++;
+	}
+}
+
+// Splits [from, to) at local midnights.
+static void DaySpan(TransitionDay * days, size_t * head, size_t * count, size_t capacity, int64_t from, int64_t to)
+{
+	while (from < to)
+	{
+		int64_t day  = LocalMidnight(from, 0);
+		int64_t next = LocalMidnight(from, 1);
+		int64_t end  = (to < next) ? to : next;
+
+		DayAdd(days, head, count, capacity, day, end - from);
+		from = end;
+	}
+}
+
+static void IndexClose(LineIndex * line, int64_t wall_ns)
+{
+	if (line->active_since < 0)
+	{
+		return;
+	}
+
+	if (wall_ns > line->active_since)
+	{
+		DaySpan(line->days, &line->day_head, &line->day_count, TRANSITION_MAX_DAYS, line->active_since, wall_ns);
+	}
+
+	TransitionSession * session = &line->sessions[(line->session_head + TRANSITION_MAX_SESSIONS - 1) % TRANSITION_MAX_SESSIONS];
+
+	session->duration_ns = (wall_ns > line->active_since) ? (wall_ns - line->active_since) : 0;
+	session->open        = false;
+	line->active_since   = -1;
+}
+
+static void IndexOpen(LineIndex * line, int64_t wall_ns)
+{
+	TransitionSession * session = &line->sessions[line->session_head];
+
+	session->start_wall_ns = wall_ns;
+	session->duration_ns   = 0;
+	session->open          = true;
+	line->session_head     = (line->session_head + 1) % TRANSITION_MAX_SESSIONS;
+	line->active_since     = wall_ns;
+
+	if (line->session_count < TRANSITION_MAX_SESSIONS)
+	{
+		line->session_count++;
+	}
+}
+
+static void IndexApply(const TransitionRecord * record)
+{
+	LineIndex * line = FindLineByName(record->line);
+	bool boot = (record->flags & TRANSITION_FLAG_BOOT) != 0;
+
+	// Every line's BOOT record of one start closes at the same time, not at
+	// the BOOT record of the line before it.
+	if (boot && !transition_in_boot)
+	{
+		transition_boot_wall_ns = transition_last_wall_ns;
+	}
+
+	transition_in_boot = boot;
+
+	if (line != NULL)
+	{
+		bool active = (record->value == line->active_value);
+
+		// Nothing says when the meter went down, so a session left open across
+		// a reboot ends at the last thing the log heard before the boot.
+		if (boot)
+		{
+			IndexClose(line, transition_boot_wall_ns);
+		}
+		else if (!active)
+		{
+			IndexClose(line, record->wall_ns);
+		}
+
+		if (active && (line->active_since < 0))
+		{
+			IndexOpen(line, record->wall_ns);
+		}
+
+		line->value = record->value;
+	}
+
+	if (record->wall_ns > transition_last_wall_ns)
+	{
+		transition_last_wall_ns = record->wall_ns;
+	}
+}
+
+static void RingPush(const TransitionRecord * record)
+{
+	transition_ring[transition_ring_head] = *record;
+	transition_ring_head = (transition_ring_head + 1) % TRANSITION_RING_SIZE;
+
+	if (transition_ring_count < TRANSITION_RING_SIZE)
+	{
+		transition_ring_count++;
+	}
+}
+
+static int LoadLog(FILE * file, long * end)
+{
+	TransitionLogHeader header;
+	TransitionRecord record;
+	size_t records = 0;
+
+	if (fread(&header, sizeof(header), 1, file) != 1)
+	{
+		return -1;
+	}
+
+	if ((header.magic != TRANSITION_LOG_MAGIC) || (header.version != TRANSITION_LOG_VERSION) ||
+		(header.record_size != sizeof(TransitionRecord)))
+	{
+		DBGPRT(DBG_ERR, "LoadLog: unknown transition log format\n");
+		return -1;
+	}
+
+	while (fread(&record, sizeof(record), 1, file) == 1)
+	{
+		RingPush(&record);
+		IndexApply(&record);
+		records++;
+	}
+
+	*end = (long)(sizeof(header) + (records * sizeof(record)));
+
+	DBGPRT(DBG_INFO1, "LoadLog: indexed %zu transitions\n", records);
+
+	return 0;
+}
+
+// Appends the queued records until TransitionLog_Cleanup, then what is left.
+static void * TransitionWriteLoop(void * arg)
+{
+	UNUSED(arg);
+
+	TransitionRecord batch[TRANSITION_WRITE_QUEUE];
+
+	pthread_mutex_lock(&transition_lock);
+
+	for (;;)
+	{
+		while (transition_writing && (transition_queue_count == 0))
+		{
+			pthread_cond_wait(&transition_cond, &transition_lock);
+		}
+
+		size_t count = transition_queue_count;
+
+		if (count == 0)
+		{
+			break;
+		}
+
+		memcpy(batch, transition_queue, count * sizeof(TransitionRecord));
+		transition_queue_count = 0;
+
+		// The file is only closed once this thread has been joined.
+		pthread_mutex_unlock(&transition_lock);
+
+		if ((fwrite(batch, sizeof(TransitionRecord), count, transition_file) != count) || (fflush(transition_file) != 0))
+		{
+			DBGPRT(DBG_ERR, "TransitionWriteLoop: write failed, %s\n", strerror(errno));
+		}
+
+		pthread_mutex_lock(&transition_lock);
+	}
+
+	pthread_mutex_unlock(&transition_lock);
+
+	return NULL;
+}
+
+int TransitionLog_Load(const char * path)
+{
+	long end = 0;
+	int result = -1;
+
+	pthread_mutex_lock(&transition_lock);
+
+	FILE * file = fopen(path, "rb");
+
+	if (file != NULL)
+	{
+		result = LoadLog(file, &end);
+		fclose(file);
+	}
+	else
+	{
+		DBGPRT(DBG_ERR, "TransitionLog_Load: Failed to open %s, %s\n", path, strerror(errno));
+	}
+
+	pthread_mutex_unlock(&transition_lock);
+
+	return result;
+}
+
+int TransitionLog_Init(const char * path)
+{
+	pthread_mutex_lock(&transition_lock);
+
+	if (transition_file != NULL)
+	{
+		pthread_mutex_unlock(&transition_lock);
+		return 0;
+	}
+
+	if (path == NULL)
+	{
+		pthread_mutex_unlock(&transition_lock);
+		return 0;
+	}
+
+	FILE * file = fopen(path, "rb");
+	bool valid = false;
+	long end = 0;
+
+	if (file != NULL)
+	{
+		valid = (LoadLog(file, &end) == 0);
+		fclose(file);
+	}
+
+	// Drop a record torn by a power cut so appends stay aligned.
+	if (valid && (truncate(path, end) != 0))
+	{
+		DBGPRT(DBG_ERR, "TransitionLog_Init: Failed to trim %s, %s\n", path, strerror(errno));
+	}
+
+	// A missing or foreign log is started over rather than appended to.
+	if ((transition_file = fopen(path, valid ? "ab" : "wb")) == NULL)
+	{
+		DBGPRT(DBG_ERR, "TransitionLog_Init: Failed to open %s, %s\n", path, strerror(errno));
+		pthread_mutex_unlock(&transition_lock);
+		return -1;
+	}
+
+	if (!valid)
+	{
+		TransitionLogHeader header;
+
+		memset(&header, 0, sizeof(header));
+		header.magic       = TRANSITION_LOG_MAGIC;
+		header.version     = TRANSITION_LOG_VERSION;
+		header.record_size = sizeof(TransitionRecord);
+
+		if ((fwrite(&header, sizeof(header), 1, transition_file) != 1) || (fflush(transition_file) != 0))
+		{
+			DBGPRT(DBG_ERR, "TransitionLog_Init: Failed to write %s, %s\n", path, strerror(errno));
+			fclose(transition_file);
+			transition_file = NULL;
+			pthread_mutex_unlock(&transition_lock);
+			return -1;
+		}
+	}
+
+	transition_writing = true;
+
+	if (pthread_create(&transition_writer, NULL, TransitionWriteLoop, NULL) != 0)
+	{
+		DBGPRT(DBG_ERR, "TransitionLog_Init: Failed to create writer thread\n");
+		transition_writing = false;
+		fclose(transition_file);
+		transition_file = NULL;
+		pthread_mutex_unlock(&transition_lock);
+		return -1;
+	}
+
+	pthread_mutex_unlock(&transition_lock);
+
+	return 0;
+}
+
+void TransitionLog_Cleanup(void)
+{
+	pthread_mutex_lock(&transition_lock);
+
+	if (transition_writing)
+	{
+		transition_writing = false;
+		pthread_cond_signal(&transition_cond);
+		pthread_mutex_unlock(&transition_lock);
+
+		pthread_join(transition_writer, NULL);
+
+		pthread_mutex_lock(&transition_lock);
+	}
+
+	if (transition_file != NULL)
+	{
+		fclose(transition_file);
+		transition_file = NULL;
+	}
+
+	for (unsigned int i = 0; i < transition_line_count; i++)
+	{
+		free(transition_lines[i]);
+		transition_lines[i] = NULL;
+	}
+
+	transition_line_count   = 0;
+	transition_queue_count  = 0;
+	transition_ring_head    = 0;
+	transition_ring_count   = 0;
+	transition_last_wall_ns = -1;
+	transition_boot_wall_ns = -1;
+	transition_in_boot      = false;
+
+	pthread_mutex_unlock(&transition_lock);
+}
+
+int TransitionLog_AddLine(uint32_t bit, const char * name, int active_value)
+{
+	int result = -1;
+
+	pthread_mutex_lock(&transition_lock);
+
+	if ((FindLine(bit) == NULL) && (FindLineByName(name) == NULL) && (transition_line_count < TRANSITION_MAX_LINES))
+	{
+		LineIndex * line = (LineIndex *)calloc(1, sizeof(LineIndex));
+
+		if (line != NULL)
+		{
+			snprintf(line->name, sizeof(line->name), "%s", name);
+			line->bit          = bit;
+			line->active_value = active_value;
+			line->value        = -1;
+			line->active_since = -1;
+			transition_lines[transition_line_count++] = line;
+			result = 0;
+		}
+	}
+
+	pthread_mutex_unlock(&transition_lock);
+
+	return result;
+}
+
+void TransitionLog_Record(uint32_t bit, int value, int64_t t_ns, uint32_t flags)
+{
+	TransitionRecord record;
+
+	memset(&record, 0, sizeof(record));
+	EventClocks(t_ns, &record.t_ns, &record.wall_ns);
+	record.value = (uint8_t)value;
+	record.flags = (uint8_t)flags;
+
+	pthread_mutex_lock(&transition_lock);
+
+	LineIndex * line = FindLine(bit);
+
+	// strncpy pads with NULs so no stack bytes end up in the file.
+	strncpy(record.line, (line != NULL) ? line->name : "", sizeof(record.line));
+
+	RingPush(&record);
+	IndexApply(&record);
+
+	// Transitions are debounced and rare, the writer flushes each batch it takes.
+	if (transition_writing)
+	{
+		if (transition_queue_count < TRANSITION_WRITE_QUEUE)
+		{
+			transition_queue[transition_queue_count++] = record;
+			pthread_cond_signal(&transition_cond);
+		}
+		else
+		{
+			DBGPRT(DBG_ERR, "TransitionLog_Record: write queue full, %s transition not logged\n", record.line);
+		}
+	}
+
+	pthread_mutex_unlock(&transition_lock);
+}
+
+size_t TransitionLog_Recent(TransitionRecord * out, size_t max)
+{
+	pthread_mutex_lock(&transition_lock);
+
+	size_t count = (max < transition_ring_count) ? max : transition_ring_count;
+	size_t first = (transition_ring_head + TRANSITION_RING_SIZE - count) % TRANSITION_RING_SIZE;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i] = transition_ring[(first + i) % TRANSITION_RING_SIZE];
+	}
+
+	pthread_mutex_unlock(&transition_lock);
+
+	return count;
+}
+
+size_t TransitionLog_DailyActive(uint32_t bit, TransitionDay * out, size_t max)
+{
+	TransitionDay days[TRANSITION_MAX_DAYS];
+	size_t head;
+	size_t count = 0;
+
+	pthread_mutex_lock(&transition_lock);
+
+	LineIndex * line = FindLine(bit);
+
+	if (line != NULL)
+	{
+		memcpy(days, line->days, sizeof(days));
+		head  = line->day_head;
+		count = line->day_count;
+
+		// A session still running counts up to now, on a copy of the days.
+		if (line->active_since >= 0)
+		{
+			DaySpan(days, &head, &count, TRANSITION_MAX_DAYS, line->active_since, ClockNs(CLOCK_REALTIME));
+		}
+	}
+
+	pthread_mutex_unlock(&transition_lock);
+
+	if (count > max)
+	{
+		count = max;
+	}
+
+	size_t first = (head + TRANSITION_MAX_DAYS - count) % TRANSITION_MAX_DAYS;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i] = days[(first + i) % TRANSITION_MAX_DAYS];
+	}
+
+	return count;
+}
+
+size_t TransitionLog_Sessions(uint32_t bit, TransitionSession * out, size_t max)
+{
+	size_t count = 0;
+
+	pthread_mutex_lock(&transition_lock);
+
+	LineIndex * line = FindLine(bit);
+
+	if (line != NULL)
+	{
+		int64_t now  = ClockNs(CLOCK_REALTIME);
+		size_t first;
+
+		count = (max < line->session_count) ? max : line->session_count;
+		first = (line->session_head + TRANSITION_MAX_SESSIONS - count) % TRANSITION_MAX_SESSIONS;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			out[i] = line->sessions[(first + i) % TRANSITION_MAX_SESSIONS];
+
+			if (out[i].open)
+			{
+				out[i].duration_ns = now - out[i].start_wall_ns;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&transition_lock);
+
+	return count;
+}
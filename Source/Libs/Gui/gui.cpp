@@ -18,6 +18,8 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <vector>
+#include <algorithm>
+#include <atomic>
 
 #include "gui.h"
 #include "Gui.hpp"
@@ -55,6 +57,74 @@ static lv_point_t line_points[2] { {0, 120}, {480, 120} };
 pthread_t lvgl_task;
 pthread_t lvgl_tick;
 pthread_mutex_t lvgl_lock = PTHREAD_MUTEX_INITIALIZER;
+static lv_indev_t * gui_indev = NULL;
+
+// GuiPause parks both LVGL threads on gui_pause_cond.
+static pthread_mutex_t gui_pause_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gui_pause_cond = PTHREAD_COND_INITIALIZER;
+static std::atomic<bool> gui_paused(false);
+static std::atomic<uint64_t> gui_wakeups(0);
+
+static std::atomic<GuiHook> gui_hook(NULL);
+
+// Text storage of labels updated through GetLabelBuffer. LVGL points at
+// text[front] and only reads it under lvgl_lock, so the writer fills the other
+// buffer without the lock and SwapLabel flips them under it.
+typedef struct
+{
+	std::atomic<lv_obj_t *> obj;
+	unsigned int front;
+	char text[2][GUI_LABEL_TEXT_LEN];
+} GuiLabelText;
+
+static GuiLabelText label_texts[GUI_MAX_LABEL_TEXTS];
+
+// Points of the trend line, double buffered like the label texts.
+typedef struct
+{
+	lv_obj_t * obj;
+	unsigned int front;
+	lv_point_t points[2][GUI_TREND_MAX_POINTS];
+} GuiTrend;
+
+static GuiTrend gui_trend;
+static lv_style_t trend_style;
+
+static GuiLabelText * FindLabelText(lv_obj_t * obj, bool claim)
+{
+	for (int i = 0; i < GUI_MAX_LABEL_TEXTS; i++)
+	{
+		if (label_texts[i].obj.load() == obj)
+		{
+			return &label_texts[i];
+		}
+	}
+
+	for (int i = 0; claim && (i < GUI_MAX_LABEL_TEXTS); i++)
+	{
+		lv_obj_t * expected = NULL;
+
+		if (label_texts[i].obj.compare_exchange_strong(expected, obj))
+		{
+			label_texts[i].front = 0;
+			return &label_texts[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void GuiFlush(lv_disp_drv_t * drv, const lv_area_t * area, lv_color_t * color_p)
+{
+	fbdev_flush(drv, area, color_p);
+
+	GuiHook hook = gui_hook.load();
+
+	if ((hook != NULL) && lv_disp_flush_is_last(drv))
+	{
+		hook(GUI_EVENT_FLUSHED, NULL);
+	}
+}
 
 int GuiInit(void)
 {
@@ -75,14 +145,14 @@ int GuiInit(void)
 	/* Initialize and register a display driver */
 	lv_disp_drv_init(&disp_drv);
 	disp_drv.buffer = &disp_buf;
-	disp_drv.flush_cb = fbdev_flush;
+	disp_drv.flush_cb = GuiFlush;
 	lv_disp_drv_register(&disp_drv);
 
 	/* Initialize and register a touch driver. */
 	lv_indev_drv_init(&indev_drv);
 	indev_drv.type = LV_INDEV_TYPE_POINTER;
 	indev_drv.read_cb = evdev_read;
-	lv_indev_drv_register(&indev_drv);
+	gui_indev = lv_indev_drv_register(&indev_drv);
 
 	pthread_create(&lvgl_task, NULL, RunTaskThread, NULL);
 	pthread_create(&lvgl_tick, NULL, RunTickThread, NULL);
@@ -104,6 +174,45 @@ void GuiCleanUp(void)
 	pthread_mutex_unlock(&lvgl_lock);
 }
 
+static void GuiWaitResume(void)
+{
+	if (!gui_paused.load())
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&gui_pause_lock);
+
+	while (gui_paused.load())
+	{
+		pthread_cond_wait(&gui_pause_cond, &gui_pause_lock);
+	}
+
+	pthread_mutex_unlock(&gui_pause_lock);
+}
+
+void GuiPause(bool paused)
+{
+	pthread_mutex_lock(&gui_pause_lock);
+	bool was_paused = gui_paused.exchange(paused);
+	pthread_cond_broadcast(&gui_pause_cond);
+	pthread_mutex_unlock(&gui_pause_lock);
+
+	if (was_paused && !paused && (gui_indev != NULL))
+	{
+		pthread_mutex_lock(&lvgl_lock);
+		lv_indev_wait_release(gui_indev);
+		pthread_mutex_unlock(&lvgl_lock);
+	}
+
+	DBGPRT(DBG_INFO4, "GuiPause: %s\n", paused ? "paused" : "running");
+}
+
+uint64_t GuiGetWakeups(void)
+{
+	return gui_wakeups.load();
+}
+
 void * RunTaskThread(void *arg)
 {
 	UNUSED(arg);
@@ -113,10 +222,14 @@ void * RunTaskThread(void *arg)
 	while (1)
 	{
 		uint32_t time_till_next;
+		GuiWaitResume();
 		pthread_mutex_lock(&lvgl_lock);
 		time_till_next = lv_task_handler();
 		pthread_mutex_unlock(&lvgl_lock);
-		usleep(time_till_next);
+		gui_wakeups++;
+
+		// lv_task_handler returns milliseconds.
+		usleep(std::min(time_till_next, (uint32_t)GUI_TASK_MAX_SLEEP_MS) * 1000);
 	}
 
 	return NULL;
@@ -131,9 +244,11 @@ void * RunTickThread(void *arg)
 	while (1)
 	{
 		usleep(5* 1000);
+		GuiWaitResume();
 		pthread_mutex_lock(&lvgl_lock);
 		lv_tick_inc(5);
 		pthread_mutex_unlock(&lvgl_lock);
+		gui_wakeups++;
 	}
 
 	return NULL;
@@ -148,6 +263,11 @@ void DeclareStyles(void)
 	lv_style_set_line_color(&line_style, LV_STATE_DEFAULT, LV_COLOR_BLACK);
 	lv_style_set_line_rounded(&line_style, LV_STATE_DEFAULT, false);
 
+	lv_style_init(&trend_style);
+	lv_style_set_line_width(&trend_style, LV_STATE_DEFAULT, 2);
+	lv_style_set_line_color(&trend_style, LV_STATE_DEFAULT, LV_COLOR_BLUE);
+	lv_style_set_line_rounded(&trend_style, LV_STATE_DEFAULT, false);
+
 	lv_style_init(&button_style);
 	lv_style_set_text_color(&button_style, LV_STATE_DEFAULT, LV_COLOR_WHITE);
 	lv_style_set_text_color(&button_style, LV_STATE_PRESSED, LV_COLOR_WHITE);
@@ -272,6 +392,14 @@ void ClearScreen()
 
 	pthread_mutex_lock(&lvgl_lock);
 	lv_obj_clean(lv_scr_act());
+	gui_trend.obj = NULL;
+
+	// Every label went with the screen, free their text slots for the next one.
+	for (int i = 0; i < GUI_MAX_LABEL_TEXTS; i++)
+	{
+		label_texts[i].obj.store(NULL);
+	}
+
 	pthread_mutex_unlock(&lvgl_lock);
 
 	DBGPRT(DBG_INFO4, "ClearScreen: complete\n");
@@ -506,44 +634,61 @@ lv_obj_t * AddTitle(GuiObj title, char* text)
 	return title.label;
 }
 
-lv_obj_t * AddLabel(GuiObj obj, char* text)
+// Called with lvgl_lock held.
+static lv_obj_t * CreateLabel(const GuiLabelDesc * desc, bool hidden)
 {
-	DBGPRT(DBG_INFO4, "AddLabel: Started adding - [%s]\n", text);
-
-	pthread_mutex_lock(&lvgl_lock);
+	lv_obj_t * label = lv_label_create(lv_scr_act(), NULL);
 
-	obj.label = lv_label_create(lv_scr_act(), NULL);
+	DBGPRT(DBG_INFO4, "CreateLabel: label created\n");
 
-	DBGPRT(DBG_INFO4, "AddLabel: label created\n");
+	lv_label_set_long_mode(label, LV_LABEL_LONG_BREAK);
+	lv_label_set_recolor(label, true);
+	lv_label_set_align(label, desc->text_align);
 
-	lv_label_set_long_mode(obj.label, LV_LABEL_LONG_BREAK);
-	lv_label_set_recolor(obj.label, true);
-	lv_label_set_align(obj.label, obj.text_align);
+	DBGPRT(DBG_INFO4, "CreateLabel: label attributes set\n");
 
-	DBGPRT(DBG_INFO4, "AddLabel: label attributes set\n");
+	lv_label_set_text_static(label, desc->text);
 
-	lv_label_set_text_static(obj.label, text);
+	DBGPRT(DBG_INFO4, "CreateLabel: text added\n");
 
-	DBGPRT(DBG_INFO4, "AddLabel: text added\n");
+	lv_obj_set_width(label, desc->w);
+	lv_obj_set_pos(label, desc->x, desc->y);
 
-	lv_obj_set_width(obj.label, obj.w);
-	lv_obj_set_pos(obj.label, obj.x, obj.y);
+	DBGPRT(DBG_INFO4, "CreateLabel: attributes set, adding style\n");
 
-	DBGPRT(DBG_INFO4, "AddLabel: attributes set, adding style\n");
+	lv_obj_set_style_local_text_opa(label, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, LV_OPA_100);
+	lv_obj_set_style_local_text_font(label, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, desc->font);
 
-	lv_obj_set_style_local_text_opa(obj.label, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, LV_OPA_100);
-	lv_obj_set_style_local_text_font(obj.label, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, obj.font);
-
-	if (obj.set_color)
+	if (desc->set_color)
 	{
-		lv_obj_set_style_local_text_color(obj.label, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, obj.color);
+		lv_obj_set_style_local_text_color(label, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, desc->color);
 	}
 
-	if (obj.hidden)
+	if (hidden)
 	{
-		lv_obj_set_hidden(obj.label, true);
+		lv_obj_set_hidden(label, true);
 	}
 
+	return label;
+}
+
+lv_obj_t * AddLabel(GuiObj obj, char* text)
+{
+	GuiLabelDesc desc;
+
+	DBGPRT(DBG_INFO4, "AddLabel: Started adding - [%s]\n", text);
+
+	desc.text       = text;
+	desc.font       = obj.font;
+	desc.text_align = obj.text_align;
+	desc.x          = obj.x;
+	desc.y          = obj.y;
+	desc.w          = obj.w;
+	desc.set_color  = obj.set_color;
+	desc.color      = obj.color;
+
+	pthread_mutex_lock(&lvgl_lock);
+	obj.label = CreateLabel(&desc, obj.hidden);
 	pthread_mutex_unlock(&lvgl_lock);
 
 	DBGPRT(DBG_INFO4, "AddLabel: Completed\n");
@@ -551,6 +696,24 @@ lv_obj_t * AddLabel(GuiObj obj, char* text)
 	return obj.label;
 }
 
+int AddLabels(const GuiLabelDesc *labels, size_t count, lv_obj_t **objs)
+{
+	DBGPRT(DBG_INFO4, "AddLabels: Started adding %zu labels\n", count);
+
+	pthread_mutex_lock(&lvgl_lock);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		objs[i] = CreateLabel(&labels[i], false);
+	}
+
+	pthread_mutex_unlock(&lvgl_lock);
+
+	DBGPRT(DBG_INFO4, "AddLabels: Completed\n");
+
+	return 0;
+}
+
 void AddDirectionLabel()
 {
 	DBGPRT(DBG_INFO4, "AddDirectionsLabel: [%s]\n", "Directions:");
@@ -568,6 +731,54 @@ void AddDirectionLabel()
 	pthread_mutex_unlock(&lvgl_lock);
 }
 
+lv_obj_t * AddTrend(lv_coord_t x, lv_coord_t y, lv_coord_t w, lv_coord_t h)
+{
+	DBGPRT(DBG_INFO4, "AddTrend: %dx%d at %d,%d\n", w, h, x, y);
+
+	pthread_mutex_lock(&lvgl_lock);
+
+	lv_obj_t * line = lv_line_create(lv_scr_act(), NULL);
+	lv_line_set_auto_size(line, false);
+	lv_obj_set_size(line, w, h);
+	lv_obj_set_pos(line, x, y);
+	lv_line_set_points(line, gui_trend.points[0], 0);
+	lv_obj_add_style(line, LV_LINE_PART_MAIN, &trend_style);
+
+	gui_trend.obj   = line;
+	gui_trend.front = 0;
+
+	pthread_mutex_unlock(&lvgl_lock);
+
+	return line;
+}
+
+lv_point_t * GetTrendBuffer(lv_obj_t *obj, size_t *count)
+{
+	if ((obj == NULL) || (obj != gui_trend.obj))
+	{
+		return NULL;
+	}
+
+	*count = GUI_TREND_MAX_POINTS;
+
+	return gui_trend.points[gui_trend.front ^ 1];
+}
+
+void SwapTrend(lv_obj_t *obj, size_t count)
+{
+	if ((obj == NULL) || (obj != gui_trend.obj) || (count > GUI_TREND_MAX_POINTS))
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&lvgl_lock);
+
+	gui_trend.front ^= 1;
+	lv_line_set_points(obj, gui_trend.points[gui_trend.front], (uint16_t)count);
+
+	pthread_mutex_unlock(&lvgl_lock);
+}
+
 lv_obj_t * AddCountdownLabel(GuiObj ta, char *text)
 {
 	DBGPRT(DBG_INFO4, "AddCountdownLabel: [%s]\n", text);
@@ -588,6 +799,11 @@ lv_obj_t * AddCountdownLabel(GuiObj ta, char *text)
 	return countdown;
 }
 
+void GuiSetHook(GuiHook hook)
+{
+	gui_hook.store(hook);
+}
+
 void ChangeLabel(GuiObj label, char *text)
 {
 	DBGPRT(DBG_INFO4, "ChangeLabel: Changing [%s] to [%s]\n", (char*)label.text.c_str(), text);
@@ -601,6 +817,57 @@ void ChangeLabel(GuiObj label, char *text)
 		lv_obj_set_style_local_text_color(label.obj, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, label.color);
 	}
 
+	GuiHook hook = gui_hook.load();
+
+	if (hook != NULL)
+	{
+		hook(GUI_EVENT_LABEL_SET, label.obj);
+	}
+
+	pthread_mutex_unlock(&lvgl_lock);
+}
+
+char * GetLabelBuffer(lv_obj_t *obj, size_t *size)
+{
+	GuiLabelText * label = (obj != NULL) ? FindLabelText(obj, true) : NULL;
+
+	if (label == NULL)
+	{
+		DBGPRT(DBG_ERR, "GetLabelBuffer: no text buffer left for the label\n");
+		return NULL;
+	}
+
+	*size = GUI_LABEL_TEXT_LEN;
+
+	return label->text[label->front ^ 1];
+}
+
+void SwapLabel(lv_obj_t *obj, bool set_color, lv_color_t color)
+{
+	GuiLabelText * label = (obj != NULL) ? FindLabelText(obj, false) : NULL;
+
+	if (label == NULL)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&lvgl_lock);
+
+	label->front ^= 1;
+	lv_label_set_text_static(obj, label->text[label->front]);
+
+	if (set_color)
+	{
+		lv_obj_set_style_local_text_color(obj, LV_OBJ_PART_MAIN, LV_STATE_DEFAULT, color);
+	}
+
+	GuiHook hook = gui_hook.load();
+
+	if (hook != NULL)
+	{
+		hook(GUI_EVENT_LABEL_SET, obj);
+	}
+
 	pthread_mutex_unlock(&lvgl_lock);
 }
 
@@ -723,6 +990,13 @@ lv_obj_t * RemoveGuiObj(GuiObj guiObj)
 	lv_obj_del(guiObj.obj);
 	pthread_mutex_unlock(&lvgl_lock);
 
+	GuiLabelText * label = FindLabelText(guiObj.obj, false);
+
+	if (label != NULL)
+	{
+		label->obj.store(NULL);
+	}
+
 	return NULL;
 }
 
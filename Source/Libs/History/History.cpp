@@ -0,0 +1,474 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - History
+ *  Source Filename  - History.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Per metric sample rings and the LTTB / min-max
+ *  				   downsamplers that reduce them to the display width.
+ *
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "History.hpp"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+typedef struct
+{
+	HistoryPoint * samples;
+	size_t head;
+	size_t count;
+	pthread_mutex_t lock;
+} HistoryRing;
+
+static HistoryRing rings[HISTORY_MAX] =
+{
+		{ NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER },
+		{ NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER },
+		{ NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER },
+		{ NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER }
+};
+
+// Shared by every ring, only changed with all the ring locks held.
+static size_t ring_capacity = 0;
+static int64_t ring_period_ms = 0;
+
+static void LockAll(void)
+{
+	for (int i = 0; i < HISTORY_MAX; i++)
+	{
+		pthread_mutex_lock(&rings[i].lock);
+	}
+}
+
+static void UnlockAll(void)
+{
+	for (int i = HISTORY_MAX - 1; i >= 0; i--)
+	{
+		pthread_mutex_unlock(&rings[i].lock);
+	}
+}
+
+// Called with all the ring locks held.
+static void FreeAll(void)
+{
+	for (int i = 0; i < HISTORY_MAX; i++)
+	{
+		free(rings[i].samples);
+		rings[i].samples = NULL;
+		rings[i].head    = 0;
+		rings[i].count   = 0;
+	}
+
+	ring_capacity = 0;
+}
+
+static const HistoryPoint * At(const HistoryRing * ring, size_t start, size_t i)
+{
+	size_t idx = start + i;
+
+	if (idx >= ring_capacity)
+	{
+		idx -= ring_capacity;
+	}
+
+	return &ring->samples[idx];
+}
+
+// First logical index whose timestamp is >= t_ms.
+static size_t LowerBound(const HistoryRing * ring, size_t start, int64_t t_ms)
+{
+	size_t lo = 0;
+	size_t hi = ring->count;
+
+	while (lo < hi)
+	{
+		size_t mid = lo + ((hi - lo) / 2);
+
+		if (At(ring, start, mid)->t_ms < t_ms)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+// First logical index whose timestamp is > t_ms, t_ms may be INT64_MAX.
+static size_t UpperBound(const HistoryRing * ring, size_t start, int64_t t_ms)
+{
+	size_t lo = 0;
+	size_t hi = ring->count;
+
+	while (lo < hi)
+	{
+		size_t mid = lo + ((hi - lo) / 2);
+
+		if (At(ring, start, mid)->t_ms <= t_ms)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+// offset * buckets / (span + 1), in integers while that cannot overflow.
+// Only a window of more than 2^54 ms falls back to doubles.
+static size_t MinMaxBucket(uint64_t offset, uint64_t span, size_t buckets)
+{
+	if (span < (UINT64_MAX / buckets))
+	{
+		return (size_t)((offset * buckets) / (span + 1));
+	}
+
+	size_t b = (size_t)(((double)offset / ((double)span + 1.0)) * (double)buckets);
+
+	return (b < buckets) ? b : (buckets - 1);
+}
+
+static size_t DownsampleLTTB(const HistoryRing * ring, size_t start, size_t first, size_t n,
+		HistoryPoint * out, size_t max_points)
+{
+	if ((n <= max_points) || (max_points < 3))
+	{
+		size_t count = (n < max_points) ? n : max_points;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			out[i] = *At(ring, start, first + i);
+		}
+
+		return count;
+	}
+
+	// First and last samples are always kept, the rest are split into buckets.
+	double every = (double)(n - 2) / (double)(max_points - 2);
+	size_t a = 0;
+	size_t written = 0;
+
+	out[written++] = *At(ring, start, first);
+
+	for (size_t i = 0; i < max_points - 2; i++)
+	{
+		// Average of the next bucket is the third vertex of the triangle.
+		size_t avg_start = (size_t)((double)(i + 1) * every) + 1;
+		size_t avg_end   = (size_t)((double)(i + 2) * every) + 1;
+
+		if (avg_end > n)
+		{
+			avg_end = n;
+		}
+
+		double avg_t = 0;
+		double avg_v = 0;
+		size_t avg_len = avg_end - avg_start;
+
+		for (size_t j = avg_start; j < avg_end; j++)
+		{
+			const HistoryPoint * p = At(ring, start, first + j);
+			avg_t += (double)p->t_ms;
+			avg_v += (double)p->value;
+		}
+
+		if (avg_len > 0)
+		{
+			avg_t /= (double)avg_len;
+			avg_v /= (double)avg_len;
+		}
+
+		size_t range_start = (size_t)((double)i * every) + 1;
+		size_t range_end   = avg_start;
+
+		const HistoryPoint * pa = At(ring, start, first + a);
+		double a_t = (double)pa->t_ms;
+		double a_v = (double)pa->value;
+		double max_area = -1;
+		size_t next_a = range_start;
+
+		for (size_t j = range_start; j < range_end; j++)
+		{
+			const HistoryPoint * p = At(ring, start, first + j);
+			double area = ((a_t - avg_t) * ((double)p->value - a_v)) -
+						  ((a_t - (double)p->t_ms) * (avg_v - a_v));
+
+			if (area < 0)
+			{
+				area = -area;
+			}
+
+			if (area > max_area)
+			{
+				max_area = area;
+				next_a = j;
+			}
+		}
+
+		out[written++] = *At(ring, start, first + next_a);
+		a = next_a;
+	}
+
+	out[written++] = *At(ring, start, first + n - 1);
+
+	return written;
+}
+
+static size_t DownsampleMinMax(const HistoryRing * ring, size_t start, size_t first, size_t n,
+		int64_t from_ms, int64_t to_ms, HistoryPoint * out, size_t max_points)
+{
+	size_t buckets = max_points / 2;
+
+	if ((n <= max_points) || (buckets == 0))
+	{
+		size_t count = (n < max_points) ? n : max_points;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			out[i] = *At(ring, start, first + i);
+		}
+
+		return count;
+	}
+
+	// Buckets are fixed in time, one per pixel column. Unsigned offsets hold
+	// any window, from_ms <= t_ms <= to_ms for every sample.
+	uint64_t span = (uint64_t)to_ms - (uint64_t)from_ms;
+	size_t written = 0;
+	size_t bucket = SIZE_MAX;
+	size_t min_idx = 0;
+	size_t max_idx = 0;
+
+	for (size_t i = 0; i <= n; i++)
+	{
+		size_t b = SIZE_MAX;
+
+		if (i < n)
+		{
+			b = MinMaxBucket((uint64_t)At(ring, start, first + i)->t_ms - (uint64_t)from_ms, span, buckets);
+		}
+
+		if ((b != bucket) && (bucket != SIZE_MAX))
+		{
+			size_t lo = (min_idx < max_idx) ? min_idx : max_idx;
+			size_t hi = (min_idx < max_idx) ? max_idx : min_idx;
+
+			out[written++] = *At(ring, start, first + lo);
+
+			if ((hi != lo) && (written < max_points))
+			{
+				out[written++] = *At(ring, start, first + hi);
+			}
+		}
+
+		if (i == n)
+		{
+			break;
+		}
+
+		if (b != bucket)
+		{
+			bucket  = b;
+			min_idx = i;
+			max_idx = i;
+		}
+		else
+		{
+			int32_t v = At(ring, start, first + i)->value;
+
+			if (v < At(ring, start, first + min_idx)->value)
+			{
+				min_idx = i;
+			}
+
+			if (v > At(ring, start, first + max_idx)->value)
+			{
+				max_idx = i;
+			}
+		}
+
+		if (written >= max_points)
+		{
+			break;
+		}
+	}
+
+	return written;
+}
+
+int History_Init(size_t capacity, int64_t period_ms)
+{
+	int result = 0;
+
+	DBGPRT(DBG_INFO1, "History_Init: capacity = %zu, period = %lld ms\n", capacity, (long long)period_ms);
+
+	if (capacity == 0)
+	{
+		return -1;
+	}
+
+	LockAll();
+
+	FreeAll();
+
+	for (int i = 0; (i < HISTORY_MAX) && (result == 0); i++)
+	{
+		if ((rings[i].samples = (HistoryPoint *)calloc(capacity, sizeof(HistoryPoint))) == NULL)
+		{
+			DBGPRT(DBG_ERR, "History_Init: Failed to allocate history, %s\n", strerror(errno));
+			result = -1;
+		}
+	}
+
+	if (result == 0)
+	{
+		ring_capacity  = capacity;
+		ring_period_ms = period_ms;
+	}
+	else
+	{
+		FreeAll();
+	}
+
+	UnlockAll();
+
+	return result;
+}
+
+void History_Cleanup(void)
+{
+	LockAll();
+	FreeAll();
+	UnlockAll();
+}
+
+int History_Push(HistoryMetric metric, int64_t t_ms, int32_t value)
+{
+	int kept = 0;
+
+	if ((metric < 0) || (metric >= HISTORY_MAX))
+	{
+		return 0;
+	}
+
+	HistoryRing * ring = &rings[metric];
+
+	pthread_mutex_lock(&ring->lock);
+
+	if ((ring->samples != NULL) && (ring->count > 0))
+	{
+		size_t last = (ring->head == 0) ? (ring_capacity - 1) : (ring->head - 1);
+
+		if ((t_ms - ring->samples[last].t_ms) < ring_period_ms)
+		{
+			pthread_mutex_unlock(&ring->lock);
+			return 0;
+		}
+	}
+
+	if (ring->samples != NULL)
+	{
+		ring->samples[ring->head].t_ms  = t_ms;
+		ring->samples[ring->head].value = value;
+
+		if (++ring->head >= ring_capacity)
+		{
+			ring->head = 0;
+		}
+
+		if (ring->count < ring_capacity)
+		{
+			ring->count++;
+		}
+
+		kept = 1;
+	}
+
+	pthread_mutex_unlock(&ring->lock);
+
+	return kept;
+}
+
+size_t History_Count(HistoryMetric metric)
+{
+	if ((metric < 0) || (metric >= HISTORY_MAX))
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock(&rings[metric].lock);
+	size_t count = rings[metric].count;
+	pthread_mutex_unlock(&rings[metric].lock);
+
+	return count;
+}
+
+size_t History_Downsample(HistoryMetric metric, int64_t from_ms, int64_t to_ms,
+		HistoryPoint * out, size_t max_points, HistoryDownsampleMode mode)
+{
+	size_t written = 0;
+
+	if ((metric < 0) || (metric >= HISTORY_MAX) || (out == NULL) || (max_points == 0) || (to_ms < from_ms))
+	{
+		return 0;
+	}
+
+	HistoryRing * ring = &rings[metric];
+
+	pthread_mutex_lock(&ring->lock);
+
+	if ((ring->samples != NULL) && (ring->count > 0))
+	{
+		size_t start = (ring->head + ring_capacity - ring->count) % ring_capacity;
+		size_t first = LowerBound(ring, start, from_ms);
+		size_t last  = UpperBound(ring, start, to_ms);
+
+		if (last > first)
+		{
+			if (mode == HISTORY_DOWNSAMPLE_MINMAX)
+			{
+				written = DownsampleMinMax(ring, start, first, last - first, from_ms, to_ms, out, max_points);
+			}
+			else
+			{
+				written = DownsampleLTTB(ring, start, first, last - first, out, max_points);
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&ring->lock);
+
+	DBGPRT(DBG_INFO4, "History_Downsample: metric %d, %zu points\n", metric, written);
+
+	return written;
+}
+
+int64_t History_NowMs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((int64_t)now.tv_sec * 1000) + (now.tv_nsec / 1000000);
+}
@@ -0,0 +1,317 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Push Button
+ *  Source Filename  - PushButton.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The buttons are lines of the GPIO engine, so their
+ *  				   edges are debounced on its epoll thread and reach this
+ *  				   plugin through a transition sink. The caller of start
+ *  				   sleeps on a condition until a sink call, no thread
+ *  				   polls while the buttons are idle.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "PushButton.h"
+#include "Gui.hpp"
+#include "Battery.hpp"
+#include "GpioEngine.hpp"
+#include "GpioTable.hpp"
+#include "debug.hpp"
+
+#undef DBGLVL
+#define DBGLVL DBG_INFO1
+
+typedef struct
+{
+	const char * name;
+	uint32_t bit;
+	bool active_low;
+	bool pressed;
+	int64_t press_ns;					// kernel time of the last press
+	uint32_t presses;
+	uint32_t releases;
+	int64_t hold_min_ns;
+	int64_t hold_max_ns;
+} Button;
+
+static pthread_mutex_t button_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t button_once = PTHREAD_ONCE_INIT;
+static pthread_cond_t button_cond;
+static Button buttons[PUSH_BUTTON_MAX];
+static unsigned int button_count = 0;
+static bool button_changed = false;
+static bool button_stop = false;			// start timed out
+static int64_t button_confirm_ns = 0;	// when the engine confirmed the last transition
+static int64_t button_debounce_ns = 0;	// kernel edge to confirmation of the last transition
+static int64_t button_ui_max_ns = 0;	// slowest confirmation to table update
+static GuiObj button_table;
+
+static void ButtonInitCond(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&button_cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+// Reactor thread, from the GPIO engine. Only bookkeeping here, drawing is left to the start caller.
+static void ButtonSink(void * arg, uint32_t bit, int value, int64_t t_ns)
+{
+	UNUSED(arg);
+
+	int64_t now = Battery_NowNs();
+
+	pthread_mutex_lock(&button_lock);
+
+	for (unsigned int i = 0; i < button_count; i++)
+	{
+		Button * button = &buttons[i];
+
+		if (button->bit != bit)
+		{
+			continue;
+		}
+
+		if ((value != 0) != button->active_low)
+		{
+			button->pressed  = true;
+			button->press_ns = t_ns;
+			button->presses++;
+		}
+		else if (button->pressed)
+		{
+			int64_t hold = t_ns - button->press_ns;
+
+			if ((button->releases == 0) || (hold < button->hold_min_ns))
+			{
+				button->hold_min_ns = hold;
+			}
+
+			if (hold > button->hold_max_ns)
+			{
+				button->hold_max_ns = hold;
+			}
+
+			button->pressed = false;
+			button->releases++;
+		}
+
+		button_confirm_ns  = now;
+		button_debounce_ns = now - t_ns;
+		button_changed     = true;
+		pthread_cond_signal(&button_cond);
+		break;
+	}
+
+	pthread_mutex_unlock(&button_lock);
+}
+
+static bool ButtonsPassed(void)
+{
+	for (unsigned int i = 0; i < button_count; i++)
+	{
+		if (buttons[i].releases == 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static std::string FormatMs(int64_t ns)
+{
+	char text[32];
+
+	snprintf(text, sizeof(text), "%.1f", ns / 1000000.0);
+
+	return std::string(text);
+}
+
+// Called without button_lock, AddTable takes the LVGL lock.
+static void DrawTable(const Button * snapshot, unsigned int count, const char * status, int64_t debounce_ns, int64_t ui_max_ns)
+{
+	std::vector<std::vector<std::string>> values;
+	GuiTable table;
+	GpioLineStats stats;
+
+	values.push_back({ "Push Buttons", status });
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const Button * button = &snapshot[i];
+		std::string hold = "-";
+
+		if (GpioEngine_GetLineStats(button->bit, &stats) != 0)
+		{
+			memset(&stats, 0, sizeof(stats));
+		}
+
+		if (button->releases > 0)
+		{
+			hold = FormatMs(button->hold_min_ns) + " - " + FormatMs(button->hold_max_ns);
+		}
+
+		values.push_back({ button->name, (button->releases > 0) ? "PASSED" : (button->pressed ? "PRESSED" : "WAITING") });
+		values.push_back({ "  Presses / Bounces", std::to_string(button->presses) + " / " + std::to_string(stats.bounces) });
+		values.push_back({ "  Hold ms", hold });
+	}
+
+	values.push_back({ "Debounce ms", FormatMs(debounce_ns) });
+	values.push_back({ "Update ms", FormatMs(ui_max_ns) });
+
+	memset(&table, 0, sizeof(table));
+	table.r = (uint16_t)values.size();
+	table.c = 2;
+
+	if (button_table.obj != NULL)
+	{
+		RemoveGuiObj(button_table);
+	}
+
+	button_table.obj = AddTable(table, values, false, strcmp(status, "FAILED") != 0);
+}
+
+void * push_button_init(void * arg)
+{
+	UNUSED(arg);
+
+	pthread_once(&button_once, ButtonInitCond);
+	pthread_mutex_lock(&button_lock);
+
+	memset(buttons, 0, sizeof(buttons));
+	button_count       = 0;
+	button_changed     = false;
+	button_stop        = false;
+	button_confirm_ns  = 0;
+	button_debounce_ns = 0;
+	button_ui_max_ns   = 0;
+	button_table.obj   = NULL;
+
+	for (unsigned int i = 0; (i < GpioTable_Count()) && (button_count < PUSH_BUTTON_MAX); i++)
+	{
+		const GpioLineConfig * line = GpioTable_Line(i);
+
+		if (strncmp(line->name, PUSH_BUTTON_PREFIX, strlen(PUSH_BUTTON_PREFIX)) == 0)
+		{
+			buttons[button_count].name       = line->name;
+			buttons[button_count].bit        = (uint32_t)1 << i;
+			buttons[button_count].active_low = line->active_low;
+			button_count++;
+		}
+	}
+
+	pthread_mutex_unlock(&button_lock);
+
+	if (button_count == 0)
+	{
+		DBGPRT(DBG_ERR, "push_button_init: no %s lines in the GPIO table\n", PUSH_BUTTON_PREFIX);
+		return PUSH_BUTTON_FAILED;
+	}
+
+	if (GpioEngine_AddSink(ButtonSink, NULL) != 0)
+	{
+		return PUSH_BUTTON_FAILED;
+	}
+
+	DBGPRT(DBG_INFO1, "push_button_init: %u buttons\n", button_count);
+
+	return PUSH_BUTTON_PASSED;
+}
+
+void * push_button_start(void * arg)
+{
+	UNUSED(arg);
+
+	Button snapshot[PUSH_BUTTON_MAX];
+	struct timespec deadline;
+	const char * status = "WAITING";
+	bool draw = true;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += PUSH_BUTTON_TIMEOUT_S;
+
+	pthread_mutex_lock(&button_lock);
+
+	while (draw)
+	{
+		unsigned int count = button_count;
+		int64_t confirm_ns = button_confirm_ns;
+		int64_t debounce_ns = button_debounce_ns;
+		int64_t ui_max_ns = button_ui_max_ns;
+
+		memcpy(snapshot, buttons, sizeof(snapshot));
+		button_changed = false;
+
+		if (ButtonsPassed())
+		{
+			status = "PASSED";
+			draw   = false;
+		}
+		else if (button_stop)
+		{
+			status = "FAILED";
+			draw   = false;
+		}
+
+		pthread_mutex_unlock(&button_lock);
+
+		DrawTable(snapshot, count, status, debounce_ns, ui_max_ns);
+
+		int64_t ui_ns = Battery_NowNs() - confirm_ns;
+
+		pthread_mutex_lock(&button_lock);
+
+		if ((confirm_ns != 0) && (ui_ns > button_ui_max_ns))
+		{
+			button_ui_max_ns = ui_ns;
+		}
+
+		while (draw && !button_changed && !button_stop)
+		{
+			if (pthread_cond_timedwait(&button_cond, &button_lock, &deadline) == ETIMEDOUT)
+			{
+				DBGPRT(DBG_ERR, "push_button_start: timed out after %d s\n", PUSH_BUTTON_TIMEOUT_S);
+				button_stop = true;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&button_lock);
+
+	DBGPRT(DBG_INFO1, "push_button_start: %s\n", status);
+
+	return (strcmp(status, "PASSED") == 0) ? PUSH_BUTTON_PASSED : PUSH_BUTTON_FAILED;
+}
+
+void * push_button_end(void * arg)
+{
+	UNUSED(arg);
+
+	GpioEngine_RemoveSink(ButtonSink, NULL);
+
+	if (button_table.obj != NULL)
+	{
+		RemoveGuiObj(button_table);
+		button_table.obj = NULL;
+	}
+
+	return PUSH_BUTTON_PASSED;
+}
@@ -0,0 +1,56 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Push Button
+ *  Source Filename  - PushButton.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Push button diagnostic plugin. Every GPIO table line
+ *  				   named button* is a button under test, the test passes
+ *  				   once each of them has been pressed and released.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#define PLUGIN_API					__attribute__((visibility("default")))
+
+#define PUSH_BUTTON_PREFIX			"button"
+#define PUSH_BUTTON_MAX				(4)
+#define PUSH_BUTTON_TIMEOUT_S		(60)
+
+#define PUSH_BUTTON_PASSED			((void*)0)
+#define PUSH_BUTTON_FAILED			((void*)1)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * push_button_init
+ * finds the buttons in the GPIO table and starts collecting their edges.
+ * returns PUSH_BUTTON_PASSED, or PUSH_BUTTON_FAILED if there are none.
+ */
+PLUGIN_API void * push_button_init(void * arg);
+
+/**
+ * push_button_start
+ * shows the results table and keeps it current until every button has been
+ * pressed and released or the test times out.
+ * returns PUSH_BUTTON_PASSED or PUSH_BUTTON_FAILED.
+ */
+PLUGIN_API void * push_button_start(void * arg);
+
+/**
+ * push_button_end
+ * stops collecting edges and removes the table, once start has returned.
+ */
+PLUGIN_API void * push_button_end(void * arg);
+
+#ifdef __cplusplus
+}
+#endif
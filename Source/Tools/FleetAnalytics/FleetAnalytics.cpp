@@ -0,0 +1,653 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Fleet analytics
+ *  Source Filename  - FleetAnalytics.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Host side tool that reads battery logs pulled off the
+ *  				   meters and reports capacity fade, cycle counts,
+ *  				   temperature excursions and time-to-empty accuracy.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Replay.hpp"
+#include "WorkStealingPool.h"
+
+#define MAX_GAP_NS				(60LL * 1000000000LL)	// longer than this is a power cycle
+#define DROP_PAGES_BYTES		(64UL * 1024 * 1024)
+#define MIN_CAPACITY_DROP		(10)					// % level drop before capacity is estimated
+#define MIN_TTE_ACTUAL_S		(60.0)
+#define MAX_LEVEL				(100)
+
+struct Options
+{
+	unsigned int threads;
+	double design_mah;
+	double temp_low_c;
+	double temp_high_c;
+	const char * csv_path;
+};
+
+struct LogFile
+{
+	std::string path;
+	std::string device;
+	const uint8_t * base;
+	size_t size;
+	const BatteryLogHeader * header;
+	const BatterySample * records;
+	size_t count;
+	bool ok;
+};
+
+struct DeviceReport
+{
+	std::string device;
+	size_t files;
+	uint64_t records;
+	int64_t first_wall_ns;
+	int64_t last_wall_ns;
+	double capacity_mah;
+	double fade_pct;
+	double cycles;
+	uint64_t temp_excursions;
+	double temp_out_s;
+	double temp_max_c;
+	double temp_min_c;
+	uint64_t tte_checks;
+	double tte_mape_pct;
+};
+
+struct Checkpoint
+{
+	int64_t t_ns;
+	int level;
+	double predicted_s;
+};
+
+// Streaming per device analysis. Memory use is fixed regardless of log size.
+class DeviceAnalyzer
+{
+public:
+	DeviceAnalyzer(const Options & opts, DeviceReport & report)
+		: opts(opts), report(report), last_ns(-1), current_ma(0), have_current(false),
+		  level(-1), anchored(false), pending_mah(0), discharged_mah(0), level_drop(0), level_change(0),
+		  in_excursion(false), tte_error_sum(0), checkpoints(0)
+	{
+		report.records         = 0;
+		report.first_wall_ns   = -1;
+		report.last_wall_ns    = -1;
+		report.temp_excursions = 0;
+		report.temp_out_s      = 0;
+		report.temp_max_c      = -1000;
+		report.temp_min_c      = 1000;
+		report.tte_checks      = 0;
+	}
+
+	void Feed(int64_t t_ns, const BatterySample & s)
+	{
+		int64_t dt = (last_ns < 0) ? 0 : (t_ns - last_ns);
+
+		if (report.first_wall_ns < 0)
+		{
+			report.first_wall_ns = t_ns;
+		}
+
+		report.last_wall_ns = t_ns;
+		report.records++;
+
+		if (dt > MAX_GAP_NS)
+		{
+			EndSegment();
+			have_current = false;
+			anchored = false;
+			dt = 0;
+		}
+
+		if (have_current && (current_ma < 0) && (dt > 0))
+		{
+			pending_mah += (-current_ma * (double)dt) / 3.6e12;
+		}
+
+		if (in_excursion && (dt > 0))
+		{
+			report.temp_out_s += (double)dt / 1e9;
+		}
+
+		if (s.fields & BATTERY_FIELD_CURRENT)
+		{
+			current_ma = s.current;
+			have_current = true;
+		}
+
+		if ((s.fields & BATTERY_FIELD_LEVEL) && (s.level >= 0) && (s.level <= MAX_LEVEL))
+		{
+			FeedLevel(t_ns, s.level);
+		}
+
+		if ((s.fields & BATTERY_FIELD_TEMP) && (s.temp != -1))
+		{
+			double temp_c = s.temp / 10.0;
+			bool out = (temp_c < opts.temp_low_c) || (temp_c > opts.temp_high_c);
+
+			if (out && !in_excursion)
+			{
+				report.temp_excursions++;
+			}
+
+			in_excursion = out;
+			report.temp_max_c = std::max(report.temp_max_c, temp_c);
+			report.temp_min_c = std::min(report.temp_min_c, temp_c);
+		}
+
+		last_ns = t_ns;
+	}
+
+	void Finish()
+	{
+		EndSegment();
+
+		report.cycles = level_change / 200.0;
+		report.capacity_mah = (level_drop >= MIN_CAPACITY_DROP) ? (discharged_mah * 100.0 / level_drop) : 0;
+		report.fade_pct = (report.capacity_mah > 0) ? (100.0 * (1.0 - (report.capacity_mah / opts.design_mah))) : 0;
+		report.tte_mape_pct = (report.tte_checks > 0) ? (100.0 * tte_error_sum / report.tte_checks) : 0;
+
+		if (report.temp_max_c < report.temp_min_c)
+		{
+			report.temp_max_c = 0;
+			report.temp_min_c = 0;
+		}
+	}
+
+private:
+	void FeedLevel(int64_t t_ns, int new_level)
+	{
+		if (level >= 0)
+		{
+			int delta = new_level - level;
+
+			// A full cycle is 100% down and 100% up.
+			level_change += abs(delta);
+
+			if (delta > 0)
+			{
+				EndSegment();
+				anchored = false;
+			}
+			else if (delta < 0)
+			{
+				// Only charge drawn between two level ticks of the same discharge
+				// counts, the partial step before the first tick is unknown.
+				if (anchored)
+				{
+					discharged_mah += pending_mah;
+					level_drop += -delta;
+				}
+
+				anchored = true;
+
+				if (have_current && (current_ma < 0) && (checkpoints < MAX_LEVEL + 1))
+				{
+					double remaining_mah = (new_level / 100.0) * opts.design_mah;
+
+					checkpoint[checkpoints].t_ns        = t_ns;
+					checkpoint[checkpoints].level       = new_level;
+					checkpoint[checkpoints].predicted_s = remaining_mah / -current_ma * 3600.0;
+					checkpoints++;
+				}
+			}
+		}
+
+		if (new_level != level)
+		{
+			pending_mah = 0;
+		}
+
+		level = new_level;
+	}
+
+	// Scores the time-to-empty predictions made during a discharge against
+	// the time actually taken to reach the level the discharge ended at.
+	void EndSegment()
+	{
+		for (unsigned int i = 0; i < checkpoints; i++)
+		{
+			const Checkpoint & cp = checkpoint[i];
+
+			if ((cp.level <= level) || (cp.level == 0) || (last_ns <= cp.t_ns))
+			{
+				continue;
+			}
+
+			double actual_s    = (double)(last_ns - cp.t_ns) / 1e9;
+			double predicted_s = cp.predicted_s * (double)(cp.level - level) / cp.level;
+
+			if (actual_s >= MIN_TTE_ACTUAL_S)
+			{
+				tte_error_sum += fabs(predicted_s - actual_s) / actual_s;
+				report.tte_checks++;
+			}
+		}
+
+		checkpoints = 0;
+	}
+
+	const Options & opts;
+	DeviceReport & report;
+	int64_t last_ns;
+	double current_ma;
+	bool have_current;
+	int level;
+	bool anchored;
+	double pending_mah;
+	double discharged_mah;
+	double level_drop;
+	double level_change;
+	bool in_excursion;
+	double tte_error_sum;
+	Checkpoint checkpoint[MAX_LEVEL + 1];
+	unsigned int checkpoints;
+};
+
+// One position in one file for the k-way merge.
+struct Cursor
+{
+	const LogFile * file;
+	size_t index;
+	int64_t wall_offset_ns;
+
+	int64_t Wall() const { return file->records[index].t_ns + wall_offset_ns; }
+};
+
+struct CursorLater
+{
+	bool operator()(const Cursor & a, const Cursor & b) const { return a.Wall() > b.Wall(); }
+};
+
+static void OpenLog(LogFile & log)
+{
+	struct stat st;
+	int fd;
+
+	log.ok = false;
+
+	if ((fd = open(log.path.c_str(), O_RDONLY)) < 0)
+	{
+		fprintf(stderr, "%s: %s\n", log.path.c_str(), strerror(errno));
+		return;
+	}
+
+	if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(BatteryLogHeader)))
+	{
+		fprintf(stderr, "%s: too short for a battery log\n", log.path.c_str());
+		close(fd);
+		return;
+	}
+
+	log.size = (size_t)st.st_size;
+	void * map = mmap(NULL, log.size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	// The mapping holds the file, a fleet of logs must not hold a descriptor each.
+	close(fd);
+
+	if (map == MAP_FAILED)
+	{
+		fprintf(stderr, "%s: mmap failed, %s\n", log.path.c_str(), strerror(errno));
+		return;
+	}
+
+	madvise(map, log.size, MADV_SEQUENTIAL);
+
+	log.base   = (const uint8_t *)map;
+	log.header = (const BatteryLogHeader *)log.base;
+
+	if ((log.header->magic != BATTERY_LOG_MAGIC) ||
+		(log.header->version != BATTERY_LOG_VERSION) ||
+		(log.header->record_size != sizeof(BatterySample)))
+	{
+		fprintf(stderr, "%s: not a version %d battery log\n", log.path.c_str(), BATTERY_LOG_VERSION);
+		return;
+	}
+
+	log.records = (const BatterySample *)(log.base + sizeof(BatteryLogHeader));
+	log.count   = (log.size - sizeof(BatteryLogHeader)) / sizeof(BatterySample);
+
+	char device[BATTERY_LOG_DEVICE_LEN + 1] = { 0 };
+	memcpy(device, log.header->device_id, BATTERY_LOG_DEVICE_LEN);
+	log.device = (device[0] != '\0') ? device : log.path;
+	log.ok = true;
+}
+
+static void CloseLog(LogFile & log)
+{
+	if (log.base != NULL)
+	{
+		munmap((void *)log.base, log.size);
+		log.base = NULL;
+	}
+}
+
+static void AnalyzeDevice(const Options & opts, const std::vector<LogFile *> & logs, DeviceReport & report)
+{
+	std::priority_queue<Cursor, std::vector<Cursor>, CursorLater> heap;
+	std::vector<size_t> dropped(logs.size(), 0);
+	DeviceAnalyzer analyzer(opts, report);
+
+	report.device = logs[0]->device;
+	report.files  = logs.size();
+
+	for (const LogFile * log : logs)
+	{
+		if (log->count > 0)
+		{
+			heap.push({ log, 0, log->header->start_wall_ns - log->header->start_ns });
+		}
+	}
+
+	while (!heap.empty())
+	{
+		Cursor cursor = heap.top();
+		heap.pop();
+
+		analyzer.Feed(cursor.Wall(), cursor.file->records[cursor.index]);
+
+		if (++cursor.index < cursor.file->count)
+		{
+			// Hand pages we are done with back so RSS stays flat on huge logs.
+			size_t offset = sizeof(BatteryLogHeader) + (cursor.index * sizeof(BatterySample));
+
+			if ((offset & ~(DROP_PAGES_BYTES - 1)) != ((offset - sizeof(BatterySample)) & ~(DROP_PAGES_BYTES - 1)))
+			{
+				madvise((void *)cursor.file->base, offset & ~(DROP_PAGES_BYTES - 1), MADV_DONTNEED);
+			}
+
+			heap.push(cursor);
+		}
+	}
+
+	analyzer.Finish();
+}
+
+static void AddPath(const char * path, std::vector<std::string> & paths)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return;
+	}
+
+	if (!S_ISDIR(st.st_mode))
+	{
+		paths.push_back(path);
+		return;
+	}
+
+	DIR * dir = opendir(path);
+	struct dirent * entry;
+
+	if (dir == NULL)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return;
+	}
+
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (entry->d_name[0] != '.')
+		{
+			AddPath((std::string(path) + "/" + entry->d_name).c_str(), paths);
+		}
+	}
+
+	closedir(dir);
+}
+
+static double Percentile(std::vector<double> values, double pct)
+{
+	if (values.empty())
+	{
+		return 0;
+	}
+
+	std::sort(values.begin(), values.end());
+
+	return values[(size_t)(pct * (double)(values.size() - 1) + 0.5)];
+}
+
+static void PrintDistribution(const char * name, const std::vector<double> & values)
+{
+	printf("%-24s n=%-6zu p10=%-9.2f p50=%-9.2f p90=%-9.2f max=%.2f\n", name, values.size(),
+			Percentile(values, 0.10), Percentile(values, 0.50), Percentile(values, 0.90), Percentile(values, 1.0));
+}
+
+static void PrintUsage(const char * app)
+{
+	printf("usage: %s [options] <log or directory>...\n", app);
+	printf("  -j, --threads <N>       worker threads, defaults to the number of cores\n");
+	printf("  -d, --design-mah <mAh>  design capacity used for fade and time-to-empty\n");
+	printf("  -l, --temp-low <C>      low temperature excursion threshold\n");
+	printf("  -t, --temp-high <C>     high temperature excursion threshold\n");
+	printf("  -c, --csv <file>        also write one line per device to file\n");
+}
+
+int main(int argc, char ** argv)
+{
+	static const struct option long_options[] =
+	{
+		{ "threads",    required_argument, NULL, 'j' },
+		{ "design-mah", required_argument, NULL, 'd' },
+		{ "temp-low",   required_argument, NULL, 'l' },
+		{ "temp-high",  required_argument, NULL, 't' },
+		{ "csv",        required_argument, NULL, 'c' },
+		{ "help",       no_argument,       NULL, 'h' },
+		{ NULL,         0,                 NULL,  0  }
+	};
+
+	Options opts;
+	int opt;
+
+	opts.threads     = std::thread::hardware_concurrency();
+	opts.design_mah  = 3400.0;
+	opts.temp_low_c  = 0.0;
+	opts.temp_high_c = 45.0;
+	opts.csv_path    = NULL;
+
+	while ((opt = getopt_long(argc, argv, "j:d:l:t:c:h", long_options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'j':
+			opts.threads = (unsigned int)atoi(optarg);
+			break;
+		case 'd':
+			opts.design_mah = atof(optarg);
+			break;
+		case 'l':
+			opts.temp_low_c = atof(optarg);
+			break;
+		case 't':
+			opts.temp_high_c = atof(optarg);
+			break;
+		case 'c':
+			opts.csv_path = optarg;
+			break;
+		case 'h':
+		default:
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<std::string> paths;
+
+	for (int i = optind; i < argc; i++)
+	{
+		AddPath(argv[i], paths);
+	}
+
+	if (paths.empty())
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	std::vector<LogFile> logs(paths.size());
+	WorkStealingPool pool(opts.threads);
+
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		logs[i].path = paths[i];
+		logs[i].base = NULL;
+		pool.Submit([&logs, i] { OpenLog(logs[i]); });
+	}
+
+	pool.Wait();
+
+	std::map<std::string, std::vector<LogFile *>> devices;
+	size_t total_bytes = 0;
+
+	for (LogFile & log : logs)
+	{
+		if (log.ok)
+		{
+			devices[log.device].push_back(&log);
+			total_bytes += log.size;
+		}
+	}
+
+	// Biggest devices first so the long tasks start early and stealing evens out the tail.
+	std::vector<std::pair<size_t, const std::vector<LogFile *> *>> order;
+
+	for (auto & device : devices)
+	{
+		size_t bytes = 0;
+
+		for (const LogFile * log : device.second)
+		{
+			bytes += log->size;
+		}
+
+		order.push_back(std::make_pair(bytes, &device.second));
+	}
+
+	std::sort(order.begin(), order.end(), [](const auto & a, const auto & b) { return a.first > b.first; });
+
+	std::vector<DeviceReport> reports(order.size());
+	struct timespec start;
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const std::vector<LogFile *> * device_logs = order[i].second;
+		DeviceReport * report = &reports[i];
+
+		pool.Submit([&opts, device_logs, report] { AnalyzeDevice(opts, *device_logs, *report); });
+	}
+
+	pool.Wait();
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (LogFile & log : logs)
+	{
+		CloseLog(log);
+	}
+
+	std::sort(reports.begin(), reports.end(), [](const DeviceReport & a, const DeviceReport & b) { return a.device < b.device; });
+
+	std::vector<double> fade;
+	std::vector<double> cycles;
+	std::vector<double> excursions;
+	std::vector<double> tte;
+	uint64_t records = 0;
+	FILE * csv = (opts.csv_path != NULL) ? fopen(opts.csv_path, "w") : NULL;
+
+	if ((opts.csv_path != NULL) && (csv == NULL))
+	{
+		fprintf(stderr, "%s: %s\n", opts.csv_path, strerror(errno));
+	}
+
+	if (csv != NULL)
+	{
+		fprintf(csv, "device,files,records,hours,capacity_mah,fade_pct,cycles,temp_excursions,temp_out_s,temp_min_c,temp_max_c,tte_checks,tte_mape_pct\n");
+	}
+
+	printf("%-20s %5s %12s %8s %9s %7s %7s %5s %7s %7s\n",
+			"device", "files", "records", "hours", "cap mAh", "fade%", "cycles", "exc", "maxC", "tte%");
+
+	for (const DeviceReport & r : reports)
+	{
+		double hours = (r.last_wall_ns > r.first_wall_ns) ? ((double)(r.last_wall_ns - r.first_wall_ns) / 3.6e12) : 0;
+
+		printf("%-20s %5zu %12llu %8.1f %9.0f %7.1f %7.2f %5llu %7.1f %7.1f\n",
+				r.device.c_str(), r.files, (unsigned long long)r.records, hours, r.capacity_mah, r.fade_pct,
+				r.cycles, (unsigned long long)r.temp_excursions, r.temp_max_c, r.tte_mape_pct);
+
+		if (csv != NULL)
+		{
+			fprintf(csv, "%s,%zu,%llu,%.3f,%.1f,%.2f,%.3f,%llu,%.1f,%.1f,%.1f,%llu,%.2f\n",
+					r.device.c_str(), r.files, (unsigned long long)r.records, hours, r.capacity_mah, r.fade_pct,
+					r.cycles, (unsigned long long)r.temp_excursions, r.temp_out_s, r.temp_min_c, r.temp_max_c,
+					(unsigned long long)r.tte_checks, r.tte_mape_pct);
+		}
+
+		if (r.capacity_mah > 0)
+		{
+			fade.push_back(r.fade_pct);
+		}
+
+		if (r.tte_checks > 0)
+		{
+			tte.push_back(r.tte_mape_pct);
+		}
+
+		cycles.push_back(r.cycles);
+		excursions.push_back((double)r.temp_excursions);
+		records += r.records;
+	}
+
+	if (csv != NULL)
+	{
+		fclose(csv);
+	}
+
+	double seconds = (double)(end.tv_sec - start.tv_sec) + ((double)(end.tv_nsec - start.tv_nsec) / 1e9);
+
+	printf("\nfleet: %zu devices, %zu logs, %llu records, %.1f MB in %.2f s (%.0f MB/s) on %u threads, %llu steals\n",
+			reports.size(), logs.size(), (unsigned long long)records, (double)total_bytes / 1e6, seconds,
+			(seconds > 0) ? ((double)total_bytes / 1e6 / seconds) : 0, pool.Workers(), (unsigned long long)pool.Steals());
+	PrintDistribution("capacity fade %", fade);
+	PrintDistribution("cycles", cycles);
+	PrintDistribution("temp excursions", excursions);
+	PrintDistribution("time-to-empty error %", tte);
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Work stealing pool
+ *  Source Filename  - WorkStealingPool.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Owners pop from the back of their deque, thieves take
+ *  				   from the front, so big tasks queued first get spread out.
+ *
+ *******************************************************************************/
+
+#include "WorkStealingPool.h"
+
+WorkStealingPool::WorkStealingPool(unsigned int workers)
+	: next_queue(0), pending(0), queued(0), steals(0), stopping(false)
+{
+	if (workers == 0)
+	{
+		workers = 1;
+	}
+
+	for (unsigned int i = 0; i < workers; i++)
+	{
+		queues.push_back(new Queue());
+	}
+
+	for (unsigned int i = 0; i < workers; i++)
+	{
+		threads.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(idle_lock);
+		stopping = true;
+	}
+
+	idle_cond.notify_all();
+
+	for (std::thread & thread : threads)
+	{
+		thread.join();
+	}
+
+	for (Queue * queue : queues)
+	{
+		delete queue;
+	}
+}
+
+void WorkStealingPool::Submit(Task task)
+{
+	unsigned int target = next_queue++ % queues.size();
+
+	pending++;
+
+	{
+		std::lock_guard<std::mutex> guard(queues[target]->lock);
+		queues[target]->tasks.push_back(std::move(task));
+		queued++;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(idle_lock);
+	}
+
+	idle_cond.notify_one();
+}
+
+void WorkStealingPool::Wait()
+{
+	std::unique_lock<std::mutex> guard(idle_lock);
+
+	done_cond.wait(guard, [this] { return pending.load() == 0; });
+}
+
+bool WorkStealingPool::PopLocal(unsigned int self, Task & task)
+{
+	std::lock_guard<std::mutex> guard(queues[self]->lock);
+
+	if (queues[self]->tasks.empty())
+	{
+		return false;
+	}
+
+	task = std::move(queues[self]->tasks.back());
+	queues[self]->tasks.pop_back();
+	queued--;
+
+	return true;
+}
+
+bool WorkStealingPool::Steal(unsigned int self, Task & task)
+{
+	for (unsigned int i = 1; i < queues.size(); i++)
+	{
+		Queue * victim = queues[(self + i) % queues.size()];
+		std::lock_guard<std::mutex> guard(victim->lock);
+
+		if (!victim->tasks.empty())
+		{
+			task = std::move(victim->tasks.front());
+			victim->tasks.pop_front();
+			queued--;
+			steals++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void WorkStealingPool::WorkerLoop(unsigned int self)
+{
+	Task task;
+
+	while (true)
+	{
+		if (PopLocal(self, task) || Steal(self, task))
+		{
+			task();
+			task = nullptr;
+
+			if (--pending == 0)
+			{
+				std::lock_guard<std::mutex> guard(idle_lock);
+				done_cond.notify_all();
+			}
+
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(idle_lock);
+
+		if (stopping)
+		{
+			return;
+		}
+
+		// Re-check under the lock so a Submit between the scan and the wait is not lost.
+		idle_cond.wait(guard, [this] { return stopping.load() || (queued.load() > 0); });
+
+		if (stopping)
+		{
+			return;
+		}
+	}
+}
@@ -0,0 +1,76 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Work stealing pool
+ *  Source Filename  - WorkStealingPool.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Fixed set of worker threads, each with its own task
+ *  				   deque. Idle workers steal from the front of the others.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+class WorkStealingPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	explicit WorkStealingPool(unsigned int workers);
+	~WorkStealingPool();
+
+	/**
+	 * Submit
+	 * queues a task on the next worker in turn.
+	 */
+	void Submit(Task task);
+
+	/**
+	 * Wait
+	 * blocks until every submitted task has finished.
+	 */
+	void Wait();
+
+	unsigned int Workers() const { return (unsigned int)queues.size(); }
+
+	/**
+	 * Steals
+	 * number of tasks run by a worker other than the one they were queued on.
+	 */
+	uint64_t Steals() const { return steals.load(); }
+
+private:
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	void WorkerLoop(unsigned int self);
+	bool PopLocal(unsigned int self, Task & task);
+	bool Steal(unsigned int self, Task & task);
+
+	std::vector<Queue *> queues;
+	std::vector<std::thread> threads;
+	std::atomic<unsigned int> next_queue;
+	std::atomic<uint64_t> pending;		// submitted and not finished
+	std::atomic<uint64_t> queued;		// submitted and not yet picked up
+	std::atomic<uint64_t> steals;
+	std::atomic<bool> stopping;
+	std::mutex idle_lock;
+	std::condition_variable idle_cond;
+	std::condition_variable done_cond;
+};
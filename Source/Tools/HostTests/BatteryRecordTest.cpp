@@ -0,0 +1,262 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Battery Record Test
+ *  Source Filename  - BatteryRecordTest.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Wire records: a sample encoded and read back in place,
+ *  				   the extensions walked, records from other schemas, and
+ *  				   a file of records cut short in its last one.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Battery.hpp"
+#include "BatteryRecord.hpp"
+#include "HostTest.h"
+
+#define TEST_PATH			"/tmp/battery_record_test.bin"
+#define TEST_DEVICE			"meter-7"
+#define TEST_RECORDS		(3)
+#define TEST_BUF_LEN		(128)
+
+static BatterySample TestSample(int index)
+{
+	BatterySample sample;
+
+	memset(&sample, 0, sizeof(sample));
+	sample.t_ns       = 1234567890123LL + index;
+	sample.fields     = BATTERY_FIELD_ALL;
+	sample.current    = -1500 - index;
+	sample.voltage    = 412;
+	sample.temp       = -55;
+	sample.level      = 87;
+	sample.in_dock    = -1;
+	sample.charging   = 1;
+	sample.gpio       = 0x5;
+	sample.gpio_table = 0xDEADBEEF;
+	snprintf(sample.health, sizeof(sample.health), "Good");
+
+	return sample;
+}
+
+// Every field back as it went in, from the accessors and from ToSample.
+static void TestRoundTrip(void)
+{
+	uint8_t buf[TEST_BUF_LEN];
+	BatteryRecordView view;
+	BatterySample sample = TestSample(0);
+	BatterySample out;
+	size_t health_len;
+
+	int size = BatteryRecord_Encode(&sample, buf, sizeof(buf));
+
+	CHECK_EQ(size, BATTERY_RECORD_FIXED_SIZE + BATTERY_RECORD_EXT_HDR + 8);
+	CHECK_EQ(BatteryRecord_View(buf, size, &view), 0);
+
+	CHECK_EQ(BatteryRecord_Schema(&view), BATTERY_RECORD_SCHEMA);
+	CHECK_EQ(BatteryRecord_Presence(&view), BATTERY_FIELD_ALL);
+	CHECK(BatteryRecord_Has(&view, BATTERY_FIELD_CURRENT | BATTERY_FIELD_GPIO));
+	CHECK_EQ(BatteryRecord_TimeNs(&view), sample.t_ns);
+	CHECK_EQ(BatteryRecord_Current(&view), -1500);
+	CHECK_EQ(BatteryRecord_Voltage(&view), 412);
+	CHECK_EQ(BatteryRecord_Temp(&view), -55);
+	CHECK_EQ(BatteryRecord_Level(&view), 87);
+	CHECK_EQ(BatteryRecord_InDock(&view), -1);
+	CHECK_EQ(BatteryRecord_Charging(&view), 1);
+	CHECK(strncmp(BatteryRecord_Health(&view, &health_len), "Good", 4) == 0);
+	CHECK_EQ(health_len, 4);
+
+	BatteryRecord_ToSample(&view, &out);
+	CHECK_EQ(memcmp(&out, &sample, sizeof(sample)), 0);
+
+	// Without the GPIO field there is no extension, and no bits come back.
+	sample.fields &= ~BATTERY_FIELD_GPIO;
+	size = BatteryRecord_Encode(&sample, buf, sizeof(buf));
+
+	CHECK_EQ(size, BATTERY_RECORD_FIXED_SIZE);
+	CHECK_EQ(BatteryRecord_View(buf, size, &view), 0);
+
+	BatteryRecord_ToSample(&view, &out);
+	CHECK_EQ(out.fields, BATTERY_FIELD_ALL & ~BATTERY_FIELD_GPIO);
+	CHECK_EQ(out.gpio, 0);
+
+	// A full health string has no terminator on the wire, one in the sample.
+	memset(sample.health, 'x', sizeof(sample.health));
+	size = BatteryRecord_Encode(&sample, buf, sizeof(buf));
+
+	CHECK_EQ(BatteryRecord_View(buf, size, &view), 0);
+	BatteryRecord_Health(&view, &health_len);
+	CHECK_EQ(health_len, BATTERY_HEALTH_LEN);
+
+	BatteryRecord_ToSample(&view, &out);
+	CHECK_EQ(strlen(out.health), BATTERY_HEALTH_LEN - 1);
+
+	CHECK_EQ(BatteryRecord_Encode(&sample, buf, BATTERY_RECORD_FIXED_SIZE - 1), -1);
+}
+
+// Padded to 4 bytes, walked in order, and a length past the record stops it.
+static void TestExtensions(void)
+{
+	uint8_t buf[TEST_BUF_LEN];
+	BatteryRecordView view;
+	BatteryRecordExtView ext;
+	BatterySample sample = TestSample(0);
+	size_t offset = 0;
+
+	int size = BatteryRecord_Encode(&sample, buf, sizeof(buf));
+
+	size = BatteryRecord_AddExt(buf, sizeof(buf), BATTERY_EXT_DEVICE_ID, TEST_DEVICE, strlen(TEST_DEVICE));
+	CHECK_EQ(size, BATTERY_RECORD_FIXED_SIZE + 12 + 12);
+
+	size = BatteryRecord_AddExt(buf, sizeof(buf), BATTERY_EXT_VENDOR, NULL, 0);
+	CHECK_EQ(size, BATTERY_RECORD_FIXED_SIZE + 12 + 12 + 4);
+	CHECK_EQ(BatteryRecord_AddExt(buf, size + 4, BATTERY_EXT_VENDOR, "abcd", 4), -1);
+	CHECK_EQ(BatteryRecord_View(buf, size, &view), 0);
+
+	CHECK_EQ(BatteryRecord_NextExt(&view, &offset, &ext), 1);
+	CHECK_EQ(ext.type, BATTERY_EXT_GPIO);
+	CHECK_EQ(ext.length, 8);
+
+	CHECK_EQ(BatteryRecord_NextExt(&view, &offset, &ext), 1);
+	CHECK_EQ(ext.type, BATTERY_EXT_DEVICE_ID);
+	CHECK_EQ(ext.length, strlen(TEST_DEVICE));
+	CHECK(memcmp(ext.data, TEST_DEVICE, ext.length) == 0);
+
+	CHECK_EQ(BatteryRecord_NextExt(&view, &offset, &ext), 1);
+	CHECK_EQ(ext.type, BATTERY_EXT_VENDOR);
+	CHECK_EQ(ext.length, 0);
+
+	CHECK_EQ(BatteryRecord_NextExt(&view, &offset, &ext), 0);
+
+	// The device id claiming more bytes than the record holds.
+	buf[BATTERY_RECORD_FIXED_SIZE + 12 + 2] = 0xFF;
+	offset = 0;
+
+	CHECK_EQ(BatteryRecord_NextExt(&view, &offset, &ext), 1);
+	CHECK_EQ(BatteryRecord_NextExt(&view, &offset, &ext), -1);
+}
+
+// A later schema with a longer fixed part still reads, an older one does not.
+static void TestSchemas(void)
+{
+	uint8_t buf[TEST_BUF_LEN];
+	BatteryRecordView view;
+	BatteryRecordExtView ext;
+	BatterySample sample = TestSample(0);
+	BatterySample out;
+	size_t offset = 0;
+
+	int size = BatteryRecord_Encode(&sample, buf, sizeof(buf));
+
+	// Four new bytes before the extensions.
+	memmove(buf + BATTERY_RECORD_FIXED_SIZE + 4, buf + BATTERY_RECORD_FIXED_SIZE, size - BATTERY_RECORD_FIXED_SIZE);
+	memset(buf + BATTERY_RECORD_FIXED_SIZE, 0xAA, 4);
+	buf[BATTERY_RECORD_OFF_SCHEMA]     = BATTERY_RECORD_SCHEMA + 1;
+	buf[BATTERY_RECORD_OFF_FIXED_SIZE] = BATTERY_RECORD_FIXED_SIZE + 4;
+	buf[BATTERY_RECORD_OFF_TOTAL_SIZE] = (uint8_t)(size + 4);
+
+	CHECK_EQ(BatteryRecord_View(buf, size + 4, &view), 0);
+	CHECK_EQ(BatteryRecord_NextExt(&view, &offset, &ext), 1);
+	CHECK_EQ(ext.type, BATTERY_EXT_GPIO);
+
+	BatteryRecord_ToSample(&view, &out);
+	CHECK_EQ(out.current, sample.current);
+	CHECK_EQ(out.gpio_table, sample.gpio_table);
+
+	buf[BATTERY_RECORD_OFF_SCHEMA] = BATTERY_RECORD_SCHEMA - 1;
+	CHECK_EQ(BatteryRecord_View(buf, size + 4, &view), -1);
+
+	buf[BATTERY_RECORD_OFF_SCHEMA]     = BATTERY_RECORD_SCHEMA;
+	buf[BATTERY_RECORD_OFF_FIXED_SIZE] = BATTERY_RECORD_FIXED_SIZE - 1;
+	CHECK_EQ(BatteryRecord_View(buf, size + 4, &view), -1);
+}
+
+// Records back to back, the file cut inside the last one. Each record up to
+// the cut reads, the cut one is refused, wherever it was cut.
+static void TestTruncatedFile(void)
+{
+	uint8_t buf[TEST_RECORDS * TEST_BUF_LEN];
+	size_t total = 0;
+	FILE * file = fopen(TEST_PATH, "wb");
+
+	CHECK(file != NULL);
+
+	if (file == NULL)
+	{
+		return;
+	}
+
+	for (int i = 0; i < TEST_RECORDS; i++)
+	{
+		BatterySample sample = TestSample(i);
+		uint8_t record[TEST_BUF_LEN];
+		int size = BatteryRecord_Encode(&sample, record, sizeof(record));
+
+		size = BatteryRecord_AddExt(record, sizeof(record), BATTERY_EXT_DEVICE_ID, TEST_DEVICE, strlen(TEST_DEVICE));
+		fwrite(record, size, 1, file);
+		total += size;
+	}
+
+	fclose(file);
+
+	size_t record_size = total / TEST_RECORDS;
+	size_t cuts[] = { total - 1, total - record_size + BATTERY_RECORD_FIXED_SIZE, total - record_size + 3 };
+
+	for (size_t c = 0; c < sizeof(cuts) / sizeof(cuts[0]); c++)
+	{
+		size_t offset = 0;
+		int records = 0;
+
+		CHECK_EQ(truncate(TEST_PATH, cuts[c]), 0);
+
+		file = fopen(TEST_PATH, "rb");
+
+		size_t length = (file != NULL) ? fread(buf, 1, sizeof(buf), file) : 0;
+
+		if (file != NULL)
+		{
+			fclose(file);
+		}
+
+		CHECK_EQ(length, cuts[c]);
+
+		while (offset < length)
+		{
+			BatteryRecordView view;
+
+			if (BatteryRecord_View(buf + offset, length - offset, &view) != 0)
+			{
+				break;
+			}
+
+			CHECK_EQ(BatteryRecord_Current(&view), -1500 - records);
+			offset += view.size;
+			records++;
+		}
+
+		CHECK_EQ(records, TEST_RECORDS - 1);
+		CHECK_EQ(offset, (TEST_RECORDS - 1) * record_size);
+	}
+
+	unlink(TEST_PATH);
+}
+
+int main(void)
+{
+	HostTest_Run("round trip", TestRoundTrip);
+	HostTest_Run("extensions", TestExtensions);
+	HostTest_Run("schemas", TestSchemas);
+	HostTest_Run("truncated file", TestTruncatedFile);
+
+	return HostTest_Result("battery_record_test");
+}
@@ -0,0 +1,235 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Config Test
+ *  Source Filename  - ConfigTest.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The defaults without a file, a file with comments, blanks
+ *  				   and names for the levels, overrides on top of it, a file
+ *  				   rewritten while watched, and values that are refused.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Config.h"
+#include "Reactor.h"
+#include "Snapshot.h"
+#include "Idle.h"
+#include "Backlight.h"
+#include "HostTest.h"
+
+#define TEST_DIR			"/tmp/config_test"
+#define TEST_PATH			TEST_DIR "/battery_info.conf"
+#define TEST_TMP_PATH		TEST_DIR "/battery_info.conf.tmp"
+#define TEST_TICK_MS		(20)
+#define TEST_BAD_TICK		(1)
+#define TEST_GOOD_TICK		(5)
+#define TEST_TIMEOUT_TICK	(100)
+
+static int test_ticks = 0;
+static int test_reloads = 0;
+static int test_old_level = 0;
+static int test_new_level = 0;
+
+// Replaced by a rename, as an editor saves it.
+static int WriteConfig(const char * text)
+{
+	FILE * file = fopen(TEST_TMP_PATH, "w");
+
+	if (file == NULL)
+	{
+		return -1;
+	}
+
+	fputs(text, file);
+	fclose(file);
+
+	return rename(TEST_TMP_PATH, TEST_PATH);
+}
+
+// Every key at its default, without a file.
+static void TestDefaults(void)
+{
+	CHECK_EQ(Config_Init(TEST_DIR "/missing.conf"), 0);
+
+	const AppConfig * config = Config_Get();
+
+	CHECK_EQ(config->battery_period_ms, BATTERY_MONITOR_PERIOD_MS);
+	CHECK_EQ(config->gpio_poll_ms, GPIO_MONITOR_POLL_MS);
+	CHECK_EQ(config->snapshot_period_ms, SNAPSHOT_PERIOD_MS);
+	CHECK_EQ(config->idle_dim_s, IDLE_DIM_S);
+	CHECK_EQ(config->idle_blank_s, IDLE_BLANK_S);
+	CHECK_EQ(config->idle_dim_percent, IDLE_DIM_PERCENT);
+	CHECK_EQ(config->idle_sampler_ms, IDLE_SAMPLER_PERIOD_MS);
+	CHECK_EQ(config->level_good_min, 75);
+	CHECK_EQ(config->level_warn_min, 25);
+	CHECK_EQ(config->log_level, DBG_ALL);
+	CHECK_EQ(config->brightness, BACKLIGHT_DEFAULT);
+	CHECK(strcmp(config->snapshot_path, SNAPSHOT_PATH) == 0);
+}
+
+// Comments, blank lines, tabs, CRLF and hex, then overrides over the file.
+static void TestParse(void)
+{
+	CHECK_EQ(WriteConfig(
+			"# battery_info settings\n"
+			"\n"
+			"battery_period_ms = 1000\n"
+			"\tgpio_poll_ms=0x20\t# hex\n"
+			"   \r\n"
+			"temp_good_min = -50\r\n"
+			"level_good_min = 80\n"
+			"log_level = warn\n"
+			"snapshot_path = " TEST_DIR "/snapshot.bin\n"), 0);
+
+	CHECK_EQ(Config_Init(TEST_PATH), 0);
+
+	const AppConfig * config = Config_Get();
+
+	CHECK_EQ(config->battery_period_ms, 1000);
+	CHECK_EQ(config->gpio_poll_ms, 0x20);
+	CHECK_EQ(config->temp_good_min, -50);
+	CHECK_EQ(config->level_good_min, 80);
+	CHECK_EQ(config->log_level, DBG_WARN);
+	CHECK_EQ(dbg_level, DBG_WARN);
+	CHECK(strcmp(config->snapshot_path, TEST_DIR "/snapshot.bin") == 0);
+
+	// Left at their defaults.
+	CHECK_EQ(config->snapshot_period_ms, SNAPSHOT_PERIOD_MS);
+	CHECK_EQ(config->level_warn_min, 25);
+
+	CHECK_EQ(Config_Override("battery_period_ms=250"), 0);
+	CHECK_EQ(Config_Override(" log_level = err "), 0);
+	CHECK_EQ(Config_Init(TEST_PATH), 0);
+
+	CHECK_EQ(config->battery_period_ms, 250);
+	CHECK_EQ(config->gpio_poll_ms, 0x20);
+	CHECK_EQ(config->log_level, DBG_ERR);
+	CHECK_EQ(dbg_level, DBG_ERR);
+}
+
+static void ReloadCallback(const AppConfig * old_config, const AppConfig * new_config)
+{
+	test_reloads++;
+	test_old_level = old_config->level_good_min;
+	test_new_level = new_config->level_good_min;
+
+	Reactor_Stop();
+}
+
+// A bad file first, which is ignored, then a good one.
+static void ReloadTick(void * arg)
+{
+	UNUSED(arg);
+
+	test_ticks++;
+
+	if (test_ticks == TEST_BAD_TICK)
+	{
+		CHECK_EQ(WriteConfig("level_good_min = 90\nbattery_period_ms = fast\n"), 0);
+	}
+	else if (test_ticks == TEST_GOOD_TICK)
+	{
+		CHECK_EQ(test_reloads, 0);
+		CHECK_EQ(WriteConfig("level_good_min = 90\n"), 0);
+	}
+	else if (test_ticks >= TEST_TIMEOUT_TICK)
+	{
+		Reactor_Stop();
+	}
+}
+
+// Told once with the settings before and after, the overrides still applied.
+static void TestReload(void)
+{
+	CHECK_EQ(Reactor_Init(), 0);
+	CHECK_EQ(Config_Watch(ReloadCallback), 0);
+	CHECK(Reactor_AddTimer(TEST_TICK_MS, ReloadTick, NULL) >= 0);
+
+	Reactor_Run();
+
+	CHECK_EQ(test_reloads, 1);
+	CHECK_EQ(test_old_level, 80);
+	CHECK_EQ(test_new_level, 90);
+	CHECK(test_ticks < TEST_TIMEOUT_TICK);
+
+	const AppConfig * config = Config_Get();
+
+	CHECK_EQ(config->level_good_min, 90);
+	CHECK_EQ(config->battery_period_ms, 250);
+	CHECK_EQ(config->gpio_poll_ms, GPIO_MONITOR_POLL_MS);
+}
+
+// Refused overrides are not kept. A file with one bad line is dropped whole
+// for the defaults, with the overrides still on top.
+static void TestBadValues(void)
+{
+	char line[CONFIG_LINE_LEN];
+	char path[CONFIG_PATH_LEN + 1];
+
+	CHECK_EQ(Config_Override("battery_period_ms=10"), -1);
+	CHECK_EQ(Config_Override("idle_dim_percent=101"), -1);
+	CHECK_EQ(Config_Override("current_good_min=99999999999"), -1);
+	CHECK_EQ(Config_Override("gpio_poll_ms=12abc"), -1);
+	CHECK_EQ(Config_Override("gpio_poll_ms="), -1);
+	CHECK_EQ(Config_Override("gpio_poll_ms"), -1);
+	CHECK_EQ(Config_Override("brightness=-1"), -1);
+	CHECK_EQ(Config_Override("log_level=loud"), -1);
+	CHECK_EQ(Config_Override("log_level=8"), -1);
+	CHECK_EQ(Config_Override("snapshot_path="), -1);
+	CHECK_EQ(Config_Override("volume=3"), -1);
+
+	memset(path, 'x', CONFIG_PATH_LEN);
+	path[CONFIG_PATH_LEN] = '\0';
+	snprintf(line, sizeof(line), "snapshot_path=%s", path);
+	CHECK_EQ(Config_Override(line), -1);
+
+	CHECK_EQ(WriteConfig("gpio_poll_ms = 40\nlevel_good_min = 90\nlevel_warn_min 20\n"), 0);
+	CHECK_EQ(Config_Init(TEST_PATH), -1);
+
+	const AppConfig * config = Config_Get();
+
+	CHECK_EQ(config->gpio_poll_ms, GPIO_MONITOR_POLL_MS);
+	CHECK_EQ(config->level_good_min, 75);
+	CHECK_EQ(config->battery_period_ms, 250);
+	CHECK_EQ(config->log_level, DBG_ERR);
+
+	// Each line is valid, together they are not.
+	CHECK_EQ(WriteConfig("idle_dim_s = 60\nidle_blank_s = 30\n"), 0);
+	CHECK_EQ(Config_Init(TEST_PATH), -1);
+	CHECK_EQ(config->idle_dim_s, IDLE_DIM_S);
+	CHECK_EQ(config->idle_blank_s, IDLE_BLANK_S);
+
+	// Two were kept by TestParse.
+	for (int i = 2; i < CONFIG_MAX_OVERRIDES; i++)
+	{
+		CHECK_EQ(Config_Override("brightness=100"), 0);
+	}
+
+	CHECK_EQ(Config_Override("brightness=100"), -1);
+
+	unlink(TEST_PATH);
+	rmdir(TEST_DIR);
+}
+
+int main(void)
+{
+	mkdir(TEST_DIR, 0755);
+
+	HostTest_Run("defaults", TestDefaults);
+	HostTest_Run("parse", TestParse);
+	HostTest_Run("reload", TestReload);
+	HostTest_Run("bad values", TestBadValues);
+
+	return HostTest_Result("config_test");
+}
@@ -0,0 +1,345 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Coroutine Test
+ *  Source Filename  - CoroutineTest.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Coroutines on the reactor: sleepers resumed in order, a
+ *  				   pipe reader, edge waiters on mock lines through the GPIO
+ *  				   engine, and every frame freed when its task returns.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "GpioBackend.hpp"
+#include "GpioEngine.hpp"
+#include "Coroutine.h"
+#include "Reactor.h"
+#include "HostTest.h"
+
+#define TEST_CHIP			"gpiochip0"
+#define TEST_HIGH_BIT		(0x01)
+#define TEST_LOW_BIT		(0x02)			// active low
+#define TEST_TIMEOUT_MS		(2000)
+#define TEST_MAX_EVENTS		(16)
+#define TEST_FEED_MS		(50)
+
+// Who resumed, in the order they did.
+typedef struct
+{
+	int who;
+	int value;
+	int64_t t_ns;
+} TestEvent;
+
+static TestEvent test_events[TEST_MAX_EVENTS];
+static int test_count = 0;
+static int test_done = 0;					// tasks that returned
+static int test_expected = 0;				// tasks the Stopper waits for
+static int64_t test_start_ns = 0;
+
+static int test_pipe[2] = { -1, -1 };
+static int test_lines[2] = { -1, -1 };		// mock ids of TEST_HIGH_BIT and TEST_LOW_BIT
+
+// Only ever called from the reactor thread.
+static void Record(int who, int value, int64_t t_ns)
+{
+	if (test_count < TEST_MAX_EVENTS)
+	{
+		test_events[test_count].who   = who;
+		test_events[test_count].value = value;
+		test_events[test_count].t_ns  = t_ns;
+	}
+
+	test_count++;
+}
+
+static void Reset(int expected)
+{
+	memset(test_events, 0, sizeof(test_events));
+	test_count     = 0;
+	test_done      = 0;
+	test_expected  = expected;
+	test_start_ns  = HostTest_NowNs();
+}
+
+static int64_t ElapsedMs(void)
+{
+	return (HostTest_NowNs() - test_start_ns) / 1000000LL;
+}
+
+// Stops the reactor once the others returned, or at the timeout.
+static CoTask Stopper(void)
+{
+	for (int waited = 0; (test_done < test_expected) && (waited < TEST_TIMEOUT_MS); waited += 10)
+	{
+		co_await Co_SleepFor(10);
+	}
+
+	Reactor_Stop();
+}
+
+static CoTask Sleeper(int who, unsigned int ms, int times)
+{
+	for (int i = 0; i < times; i++)
+	{
+		co_await Co_SleepFor(ms);
+		Record(who, i, HostTest_NowNs());
+	}
+
+	test_done++;
+}
+
+static CoTask Reader(int who, int times)
+{
+	for (int i = 0; i < times; i++)
+	{
+		char byte = 0;
+		int result = co_await Co_Readable(test_pipe[0]);
+
+		CHECK_EQ(result, 0);
+		CHECK_EQ(read(test_pipe[0], &byte, 1), 1);
+		Record(who, byte, HostTest_NowNs());
+	}
+
+	test_done++;
+}
+
+static CoTask EdgeWaiter(int who, uint32_t bit, uint32_t edges)
+{
+	CoGpioEvent event = co_await Co_GpioEdge(bit, edges);
+
+	Record(who, event.value, event.t_ns);
+	test_done++;
+}
+
+// Waits on both lines, records which one changed.
+static CoTask AnyEdgeWaiter(int who, uint32_t edges)
+{
+	CoGpioEvent event = co_await Co_GpioEdge(TEST_HIGH_BIT | TEST_LOW_BIT, edges);
+
+	Record(who, (int)event.bit, event.t_ns);
+	test_done++;
+}
+
+static CoTask BadFd(int who)
+{
+	int result = co_await Co_Readable(-1);
+
+	Record(who, result, 0);
+	test_done++;
+}
+
+static void RunReactor(void)
+{
+	Co_Spawn(Stopper());
+	Reactor_Run();
+}
+
+// A 30 ms sleeper twice and a 100 ms one three times, interleaved by due time.
+static void TestSleepers(void)
+{
+	static const int expected[] = { 2, 2, 1, 1, 1 };
+	CoStats stats;
+
+	Reset(2);
+	Co_Spawn(Sleeper(1, 100, 3));
+	Co_Spawn(Sleeper(2, 30, 2));
+
+	Co_GetStats(&stats);
+	CHECK_EQ(stats.tasks, 2);
+	CHECK(stats.frame_bytes > 0);
+
+	RunReactor();
+
+	CHECK_EQ(test_count, 5);
+
+	for (int i = 0; (i < 5) && (i < test_count); i++)
+	{
+		CHECK_EQ(test_events[i].who, expected[i]);
+		CHECK_EQ(test_events[i].value, (expected[i] == 2) ? (i % 2) : (i - 2));
+	}
+
+	CHECK((test_events[1].t_ns - test_start_ns) >= 60 * 1000000LL);
+	CHECK((test_events[4].t_ns - test_start_ns) >= 300 * 1000000LL);
+	CHECK(ElapsedMs() < TEST_TIMEOUT_MS);
+}
+
+static void * FeedPipe(void * arg)
+{
+	UNUSED(arg);
+
+	usleep(TEST_FEED_MS * 1000);
+	CHECK_EQ(write(test_pipe[1], "a", 1), 1);
+	usleep(TEST_FEED_MS * 1000);
+	CHECK_EQ(write(test_pipe[1], "b", 1), 1);
+
+	return NULL;
+}
+
+// Resumed once per byte, after it was written. A bad fd resumes at once.
+static void TestReader(void)
+{
+	pthread_t feeder;
+
+	Reset(2);
+	Co_Spawn(BadFd(2));
+	Co_Spawn(Reader(1, 2));
+
+	// The bad fd never suspended.
+	CHECK_EQ(test_count, 1);
+	CHECK_EQ(test_events[0].who, 2);
+	CHECK_EQ(test_events[0].value, -1);
+
+	pthread_create(&feeder, NULL, FeedPipe, NULL);
+	RunReactor();
+	pthread_join(feeder, NULL);
+
+	CHECK_EQ(test_count, 3);
+	CHECK_EQ(test_events[1].who, 1);
+	CHECK_EQ(test_events[1].value, 'a');
+	CHECK_EQ(test_events[2].who, 1);
+	CHECK_EQ(test_events[2].value, 'b');
+	CHECK((test_events[2].t_ns - test_start_ns) >= 2 * TEST_FEED_MS * 1000000LL);
+}
+
+static int AddLine(unsigned int offset, uint32_t bit, bool active_low, int level)
+{
+	GpioLineConfig config;
+
+	memset(&config, 0, sizeof(config));
+	snprintf(config.name, sizeof(config.name), "line%u", offset);
+	snprintf(config.chip, sizeof(config.chip), "%s", TEST_CHIP);
+	config.offset     = offset;
+	config.edges      = GPIO_EDGE_BOTH;
+	config.active_low = active_low;
+
+	int line = GpioMock_Line(config.chip, config.offset);
+
+	GpioMock_SetValue(line, level);
+
+	return (GpioEngine_AddLine(&config, bit) == 0) ? line : -1;
+}
+
+static void * FeedEdges(void * arg)
+{
+	UNUSED(arg);
+
+	usleep(TEST_FEED_MS * 1000);
+	GpioMock_Edge(test_lines[0], 1, 111);
+	GpioMock_Edge(test_lines[1], 0, 222);
+	usleep(TEST_FEED_MS * 1000);
+	GpioMock_Edge(test_lines[0], 0, 333);
+
+	return NULL;
+}
+
+// Rising is the line turning active, so level 0 on the active low line. A
+// wait on both lines resumes on the first of them.
+static void TestGpioEdge(void)
+{
+	pthread_t feeder;
+	int high_rising = -1;
+	int low_rising = -1;
+	int high_falling = -1;
+	int any_rising = -1;
+
+	test_lines[0] = AddLine(1, TEST_HIGH_BIT, false, 0);
+	test_lines[1] = AddLine(2, TEST_LOW_BIT, true, 1);
+
+	CHECK(test_lines[0] >= 0);
+	CHECK(test_lines[1] >= 0);
+	CHECK_EQ(GpioEngine_Open(), 0);
+	CHECK_EQ(GpioEngine_Start(), 0);
+
+	Reset(4);
+	Co_Spawn(EdgeWaiter(1, TEST_HIGH_BIT, GPIO_EDGE_RISING));
+	Co_Spawn(EdgeWaiter(2, TEST_LOW_BIT, GPIO_EDGE_RISING));
+	Co_Spawn(EdgeWaiter(3, TEST_HIGH_BIT, GPIO_EDGE_FALLING));
+	Co_Spawn(AnyEdgeWaiter(4, GPIO_EDGE_RISING));
+
+	pthread_create(&feeder, NULL, FeedEdges, NULL);
+	RunReactor();
+	pthread_join(feeder, NULL);
+
+	GpioEngine_Close();
+	GpioMock_Reset();
+
+	CHECK_EQ(test_count, 4);
+
+	for (int i = 0; (i < 4) && (i < test_count); i++)
+	{
+		switch (test_events[i].who)
+		{
+			case 1: high_rising  = i; break;
+			case 2: low_rising   = i; break;
+			case 3: high_falling = i; break;
+			case 4: any_rising   = i; break;
+			default: break;
+		}
+	}
+
+	CHECK(high_rising >= 0);
+	CHECK(low_rising >= 0);
+	CHECK(any_rising >= 0);
+	CHECK_EQ(high_falling, 3);
+
+	if ((high_rising >= 0) && (low_rising >= 0) && (high_falling >= 0) && (any_rising >= 0))
+	{
+		CHECK_EQ(test_events[high_rising].value, 1);
+		CHECK_EQ(test_events[high_rising].t_ns, 111);
+		CHECK_EQ(test_events[low_rising].value, 0);
+		CHECK_EQ(test_events[low_rising].t_ns, 222);
+		CHECK_EQ(test_events[high_falling].value, 0);
+		CHECK_EQ(test_events[high_falling].t_ns, 333);
+		CHECK_EQ(test_events[any_rising].value, TEST_HIGH_BIT);
+		CHECK_EQ(test_events[any_rising].t_ns, 111);
+	}
+}
+
+// Every frame freed, the largest one reported.
+static void TestFrames(void)
+{
+	CoStats stats;
+
+	Co_GetStats(&stats);
+
+	CHECK_EQ(stats.tasks, 0);
+	CHECK_EQ(stats.frame_bytes, 0);
+	CHECK(stats.frame_max > 0);
+	CHECK(stats.resumes > 0);
+	CHECK_EQ(stats.gpio_dropped, 0);
+
+	printf("    largest frame %u bytes, %llu resumes\n", stats.frame_max, (unsigned long long)stats.resumes);
+}
+
+int main(void)
+{
+	GpioEngine_SetBackend(GpioBackend_Mock());
+
+	if ((Reactor_Init() != 0) || (Co_Init() != 0) || (pipe(test_pipe) != 0))
+	{
+		printf("coroutine_test: Failed to start the reactor\n");
+		return 1;
+	}
+
+	HostTest_Run("sleepers", TestSleepers);
+	HostTest_Run("reader", TestReader);
+	HostTest_Run("gpio edge", TestGpioEdge);
+	HostTest_Run("frames", TestFrames);
+
+	close(test_pipe[0]);
+	close(test_pipe[1]);
+
+	return HostTest_Result("coroutine_test");
+}
@@ -0,0 +1,264 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Fleet Analytics Test
+ *  Source Filename  - FleetAnalyticsTest.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Runs fleet_analytics, built next to this test, on a small
+ *  				   fleet written here: one meter's discharge split over two
+ *  				   logs, an idle meter and a file that is not a log. Checks
+ *  				   the per device lines of its csv.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Replay.hpp"
+#include "HostTest.h"
+
+#define TEST_DIR			"/tmp/fleet_test"
+#define TEST_CSV			"/tmp/fleet_test.csv"
+#define TEST_DESIGN_MAH		(2000)
+#define TEST_STEP_NS		(36LL * 1000000000LL)	// 1% at 1000 mA is 10 mAh, a 1000 mAh pack
+#define TEST_STEPS			(20)
+#define TEST_SPLIT			(11)					// first record of the second log
+#define TEST_WALL_NS		(1700000000LL * 1000000000LL)
+
+// One csv line of fleet_analytics.
+typedef struct
+{
+	char device[BATTERY_LOG_DEVICE_LEN + 1];
+	unsigned int files;
+	unsigned long long records;
+	double hours;
+	double capacity_mah;
+	double fade_pct;
+	double cycles;
+	unsigned long long temp_excursions;
+	double temp_out_s;
+	double temp_min_c;
+	double temp_max_c;
+	unsigned long long tte_checks;
+	double tte_mape_pct;
+} TestReport;
+
+static char test_tool[PATH_MAX];
+
+static FILE * OpenLog(const char * name, const char * device, int64_t start_ns, int64_t start_wall_ns)
+{
+	BatteryLogHeader header;
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", TEST_DIR, name);
+
+	FILE * file = fopen(path, "wb");
+
+	if (file == NULL)
+	{
+		return NULL;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic         = BATTERY_LOG_MAGIC;
+	header.version       = BATTERY_LOG_VERSION;
+	header.record_size   = sizeof(BatterySample);
+	header.start_ns      = start_ns;
+	header.start_wall_ns = start_wall_ns;
+	snprintf(header.device_id, sizeof(header.device_id), "%s", device);
+
+	fwrite(&header, sizeof(header), 1, file);
+
+	return file;
+}
+
+static void WriteSample(FILE * file, int64_t t_ns, int current, int level, int temp)
+{
+	BatterySample sample;
+
+	memset(&sample, 0, sizeof(sample));
+	sample.t_ns    = t_ns;
+	sample.fields  = BATTERY_FIELD_CURRENT | BATTERY_FIELD_LEVEL | BATTERY_FIELD_TEMP;
+	sample.current = current;
+	sample.level   = level;
+	sample.temp    = temp;
+
+	fwrite(&sample, sizeof(sample), 1, file);
+}
+
+// meter-a falls from 100% to 80% at 1000 mA, 36 s a percent, too hot at steps
+// 5 and 6 and too cold at 15. The second log starts from a later boot, on
+// another monotonic base. meter-b sits idle at 50%.
+static int WriteFleet(void)
+{
+	FILE * first;
+	FILE * second;
+	FILE * idle;
+	FILE * bad;
+
+	mkdir(TEST_DIR, 0755);
+
+	first  = OpenLog("a1.log", "meter-a", 1000000000LL, TEST_WALL_NS);
+	second = OpenLog("a2.log", "meter-a", 5000000000LL, TEST_WALL_NS + (TEST_SPLIT * TEST_STEP_NS));
+	idle   = OpenLog("b.log", "meter-b", 0, TEST_WALL_NS);
+	bad    = fopen(TEST_DIR "/notes.txt", "w");
+
+	if ((first == NULL) || (second == NULL) || (idle == NULL) || (bad == NULL))
+	{
+		return -1;
+	}
+
+	for (int i = 0; i <= TEST_STEPS; i++)
+	{
+		int temp = ((i == 5) || (i == 6)) ? 500 : ((i == 15) ? -50 : 250);
+
+		if (i < TEST_SPLIT)
+		{
+			WriteSample(first, 1000000000LL + (i * TEST_STEP_NS), -1000, 100 - i, temp);
+		}
+		else
+		{
+			WriteSample(second, 5000000000LL + ((i - TEST_SPLIT) * TEST_STEP_NS), -1000, 100 - i, temp);
+		}
+	}
+
+	for (int i = 0; i < 10; i++)
+	{
+		WriteSample(idle, i * 1000000000LL, 0, 50, 200);
+	}
+
+	fprintf(bad, "not a battery log, but long enough to have a header's worth of bytes in it\n");
+
+	fclose(first);
+	fclose(second);
+	fclose(idle);
+	fclose(bad);
+
+	return 0;
+}
+
+// The csv lines after the heading, sorted by device as written.
+static int ReadCsv(TestReport * reports, int max)
+{
+	char line[512];
+	int count = 0;
+	FILE * csv = fopen(TEST_CSV, "r");
+
+	if (csv == NULL)
+	{
+		return -1;
+	}
+
+	if (fgets(line, sizeof(line), csv) == NULL)
+	{
+		fclose(csv);
+		return -1;
+	}
+
+	while ((count < max) && (fgets(line, sizeof(line), csv) != NULL))
+	{
+		TestReport * r = &reports[count];
+
+		if (sscanf(line, "%32[^,],%u,%llu,%lf,%lf,%lf,%lf,%llu,%lf,%lf,%lf,%llu,%lf",
+				r->device, &r->files, &r->records, &r->hours, &r->capacity_mah, &r->fade_pct, &r->cycles,
+				&r->temp_excursions, &r->temp_out_s, &r->temp_min_c, &r->temp_max_c, &r->tte_checks,
+				&r->tte_mape_pct) == 13)
+		{
+			count++;
+		}
+	}
+
+	fclose(csv);
+
+	return count;
+}
+
+static bool Near(double a, double b)
+{
+	return (a - b < 0.01) && (b - a < 0.01);
+}
+
+static void TestFleet(void)
+{
+	TestReport reports[4];
+	char command[PATH_MAX * 2];
+
+	CHECK_EQ(WriteFleet(), 0);
+
+	snprintf(command, sizeof(command), "%s -j 2 -d %d -c %s %s > /dev/null 2>&1",
+			test_tool, TEST_DESIGN_MAH, TEST_CSV, TEST_DIR);
+
+	CHECK_EQ(system(command), 0);
+	CHECK_EQ(ReadCsv(reports, 4), 2);
+
+	// The two logs merged on the wall clock into one discharge.
+	TestReport * a = &reports[0];
+
+	CHECK(strcmp(a->device, "meter-a") == 0);
+	CHECK_EQ(a->files, 2);
+	CHECK_EQ(a->records, TEST_STEPS + 1);
+	CHECK(Near(a->hours, 0.2));
+	CHECK(Near(a->capacity_mah, 1000));
+	CHECK(Near(a->fade_pct, 50));
+	CHECK(Near(a->cycles, 0.1));
+	CHECK_EQ(a->temp_excursions, 2);
+	CHECK(Near(a->temp_out_s, 3 * 36));
+	CHECK(Near(a->temp_min_c, -5));
+	CHECK(Near(a->temp_max_c, 50));
+
+	// Predicted at the design capacity, twice the real pack, so every check
+	// from 99% down to 82% is off by 100%.
+	CHECK_EQ(a->tte_checks, 18);
+	CHECK(Near(a->tte_mape_pct, 100));
+
+	TestReport * b = &reports[1];
+
+	CHECK(strcmp(b->device, "meter-b") == 0);
+	CHECK_EQ(b->files, 1);
+	CHECK_EQ(b->records, 10);
+	CHECK(Near(b->capacity_mah, 0));
+	CHECK(Near(b->fade_pct, 0));
+	CHECK(Near(b->cycles, 0));
+	CHECK_EQ(b->temp_excursions, 0);
+	CHECK(Near(b->temp_min_c, 20));
+	CHECK(Near(b->temp_max_c, 20));
+	CHECK_EQ(b->tte_checks, 0);
+
+	unlink(TEST_DIR "/a1.log");
+	unlink(TEST_DIR "/a2.log");
+	unlink(TEST_DIR "/b.log");
+	unlink(TEST_DIR "/notes.txt");
+	rmdir(TEST_DIR);
+	unlink(TEST_CSV);
+}
+
+int main(int argc, char ** argv)
+{
+	UNUSED(argc);
+
+	char self[PATH_MAX];
+
+	snprintf(self, sizeof(self), "%s", argv[0]);
+	snprintf(test_tool, sizeof(test_tool), "%s/fleet_analytics", dirname(self));
+
+	if (access(test_tool, X_OK) != 0)
+	{
+		printf("fleet_test: %s is not built\n", test_tool);
+		return 1;
+	}
+
+	HostTest_Run("fleet", TestFleet);
+
+	return HostTest_Result("fleet_test");
+}
@@ -0,0 +1,243 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - GPIO Engine Benchmark
+ *  Source Filename  - GpioEngineBench.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Edge to sink latency of the engine on the reactor, and how fast
+ *  				   a scripted edge storm is turned into transitions, on mock
+ *  				   lines.
+ *
+ *  				   gpio_engine_bench [edges]
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <algorithm>
+#include <vector>
+
+#include "GpioBackend.hpp"
+#include "GpioEngine.hpp"
+#include "Reactor.h"
+#include "HostTest.h"
+
+#define BENCH_CHIP				"gpiochip0"
+#define BENCH_BIT				(0x01)
+#define BENCH_EDGES				(20000)
+#define BENCH_STORM_SPACING_NS	(10000LL)		// 100k edges per second
+#define BENCH_DEBOUNCE_MS		(5)
+#define BENCH_TIMEOUT_NS		(10000000000LL)
+
+static std::atomic<uint64_t> bench_calls(0);
+static std::atomic<int64_t> bench_seen_ns(0);
+
+static void BenchSink(void * arg, uint32_t bit, int value, int64_t t_ns)
+{
+	UNUSED(arg);
+	UNUSED(bit);
+	UNUSED(value);
+	UNUSED(t_ns);
+
+	bench_seen_ns.store(HostTest_NowNs());
+	bench_calls++;
+}
+
+static int StartLine(unsigned int debounce_ms)
+{
+	GpioLineConfig config;
+
+	memset(&config, 0, sizeof(config));
+	snprintf(config.name, sizeof(config.name), "bench");
+	snprintf(config.chip, sizeof(config.chip), "%s", BENCH_CHIP);
+	config.offset      = 0;
+	config.edges       = GPIO_EDGE_BOTH;
+	config.debounce_ms = debounce_ms;
+
+	int line = GpioMock_Line(config.chip, config.offset);
+
+	bench_calls.store(0);
+
+	if ((GpioEngine_AddLine(&config, BENCH_BIT) != 0) || (GpioEngine_AddSink(BenchSink, NULL) != 0) ||
+		(GpioEngine_Open() != 0) || (GpioEngine_Start() != 0) || (HostTest_StartReactor() != 0))
+	{
+		printf("StartLine: Failed to start the engine\n");
+		return -1;
+	}
+
+	return line;
+}
+
+static void StopLine(void)
+{
+	HostTest_StopReactor();
+	GpioEngine_Close();
+	GpioEngine_RemoveSink(BenchSink, NULL);
+	GpioMock_Reset();
+}
+
+static bool WaitCalls(uint64_t count)
+{
+	int64_t deadline = HostTest_NowNs() + BENCH_TIMEOUT_NS;
+
+	while (bench_calls.load() < count)
+	{
+		if (HostTest_NowNs() > deadline)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static int64_t Percentile(std::vector<int64_t> & samples, unsigned int percent)
+{
+	size_t index = (samples.size() - 1) * percent / 100;
+
+	return samples[index];
+}
+
+// One edge at a time, each waited for, so the queue never fills.
+static void BenchLatency(int edges)
+{
+	std::vector<int64_t> latency;
+	int line = StartLine(0);
+
+	if (line < 0)
+	{
+		return;
+	}
+
+	latency.reserve(edges);
+
+	int64_t start = HostTest_NowNs();
+
+	for (int i = 0; i < edges; i++)
+	{
+		int64_t sent = HostTest_NowNs();
+
+		GpioMock_Edge(line, (i % 2 == 0) ? 1 : 0, sent);
+
+		if (!WaitCalls((uint64_t)i + 1))
+		{
+			printf("BenchLatency: edge %d never reached the sink\n", i);
+			break;
+		}
+
+		latency.push_back(bench_seen_ns.load() - sent);
+	}
+
+	int64_t elapsed = HostTest_NowNs() - start;
+
+	StopLine();
+
+	if (latency.empty())
+	{
+		return;
+	}
+
+	std::sort(latency.begin(), latency.end());
+
+	printf("latency, %zu edges one at a time: %.0f edges/s\n", latency.size(), latency.size() * 1e9 / elapsed);
+	printf("    min %.1f us, median %.1f us, p99 %.1f us, max %.1f us\n",
+			latency.front() / 1000.0, Percentile(latency, 50) / 1000.0,
+			Percentile(latency, 99) / 1000.0, latency.back() / 1000.0);
+}
+
+// Edges faster than the engine wakes, so batches and the mock queue fill up.
+static void BenchStorm(int edges, unsigned int debounce_ms)
+{
+	std::vector<GpioMockStep> steps(edges);
+	GpioMockStats mock;
+	GpioLineStats line_stats;
+	GpioEngineStats before;
+	GpioEngineStats engine;
+	int line = StartLine(debounce_ms);
+
+	if (line < 0)
+	{
+		return;
+	}
+
+	for (int i = 0; i < edges; i++)
+	{
+		steps[i].at_ns = (int64_t)i * BENCH_STORM_SPACING_NS;
+		steps[i].line  = line;
+		steps[i].value = (i % 2 == 0) ? 1 : 0;
+	}
+
+	// The engine counters run on across Close.
+	GpioEngine_GetStats(&before);
+
+	int64_t start = HostTest_NowNs();
+
+	GpioMock_Play(steps.data(), steps.size());
+
+	do
+	{
+		GpioMock_GetStats(&mock);
+	}
+	while (mock.steps < (uint64_t)edges);
+
+	// Wait for the engine to drain what is queued, and the debounce window to close.
+	while ((GpioEngine_GetLineStats(BENCH_BIT, &line_stats) == 0) &&
+		   (line_stats.edges + mock.dropped < mock.edges) && (HostTest_NowNs() - start < BENCH_TIMEOUT_NS))
+	{
+	}
+
+	usleep((debounce_ms + 10) * 1000);
+
+	int64_t elapsed = HostTest_NowNs() - start;
+
+	GpioMock_GetStats(&mock);
+	GpioEngine_GetLineStats(BENCH_BIT, &line_stats);
+	GpioEngine_GetStats(&engine);
+	StopLine();
+
+	engine.wakeups -= before.wakeups;
+
+	printf("storm, %d edges every %lld ns, debounce %u ms: %.1f ms\n",
+			edges, BENCH_STORM_SPACING_NS, debounce_ms, elapsed / 1e6);
+	printf("    %llu late steps, %llu dropped by the queue, %llu read in %llu wakeups (%.1f per wakeup)\n",
+			(unsigned long long)mock.late_steps, (unsigned long long)mock.dropped,
+			(unsigned long long)line_stats.edges, (unsigned long long)engine.wakeups,
+			engine.wakeups ? (double)line_stats.edges / engine.wakeups : 0.0);
+	printf("    %llu transitions, %llu bounces, max burst %llu, %llu sink calls\n",
+			(unsigned long long)line_stats.transitions, (unsigned long long)line_stats.bounces,
+			(unsigned long long)line_stats.max_burst, (unsigned long long)bench_calls.load());
+}
+
+int main(int argc, char *argv[])
+{
+	int edges = (argc > 1) ? atoi(argv[1]) : BENCH_EDGES;
+
+	if (edges <= 0)
+	{
+		printf("usage: gpio_engine_bench [edges]\n");
+		return 1;
+	}
+
+	GpioEngine_SetBackend(GpioBackend_Mock());
+
+	if (Reactor_Init() != 0)
+	{
+		printf("gpio_engine_bench: Failed to create the reactor\n");
+		return 1;
+	}
+
+	BenchLatency(edges);
+	BenchStorm(edges, 0);
+	BenchStorm(edges, BENCH_DEBOUNCE_MS);
+
+	return 0;
+}
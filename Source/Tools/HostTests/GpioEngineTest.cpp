@@ -0,0 +1,535 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - GPIO Engine Test
+ *  Source Filename  - GpioEngineTest.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The engine and its debouncer on mock lines: which edges
+ *  				   become transitions, what the sinks and the cache see,
+ *  				   and the mock's own queue and script.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "GpioBackend.hpp"
+#include "GpioEngine.hpp"
+#include "Reactor.h"
+#include "HostTest.h"
+
+#define TEST_CHIP			"gpiochip0"
+#define TEST_BIT			(0x01)
+#define TEST_DEBOUNCE_MS	(20)
+#define TEST_TIMEOUT_MS		(1000)
+#define TEST_SETTLE_MS		(100)
+#define TEST_MAX_CALLS		(32)
+
+typedef struct
+{
+	uint32_t bit;
+	int value;
+	int64_t t_ns;
+} SinkCall;
+
+static pthread_mutex_t sink_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sink_cond;				// on CLOCK_MONOTONIC, like HostTest_NowNs
+static SinkCall sink_calls[TEST_MAX_CALLS];
+static int sink_count = 0;
+static bool sink_gate = false;			// holds the reactor thread in the first call
+
+static void RecordSink(void * arg, uint32_t bit, int value, int64_t t_ns)
+{
+	UNUSED(arg);
+
+	pthread_mutex_lock(&sink_lock);
+
+	if (sink_count < TEST_MAX_CALLS)
+	{
+		sink_calls[sink_count].bit   = bit;
+		sink_calls[sink_count].value = value;
+		sink_calls[sink_count].t_ns  = t_ns;
+	}
+
+	sink_count++;
+	pthread_cond_broadcast(&sink_cond);
+
+	while (sink_gate)
+	{
+		pthread_cond_wait(&sink_cond, &sink_lock);
+	}
+
+	pthread_mutex_unlock(&sink_lock);
+}
+
+static void OpenGate(void)
+{
+	pthread_mutex_lock(&sink_lock);
+	sink_gate = false;
+	pthread_cond_broadcast(&sink_cond);
+	pthread_mutex_unlock(&sink_lock);
+}
+
+// Waits for count sink calls, returns how many there were.
+static int WaitCalls(int count, int timeout_ms)
+{
+	int64_t deadline = HostTest_NowNs() + ((int64_t)timeout_ms * 1000000LL);
+	struct timespec until;
+
+	until.tv_sec  = deadline / 1000000000LL;
+	until.tv_nsec = deadline % 1000000000LL;
+
+	pthread_mutex_lock(&sink_lock);
+
+	while (sink_count < count)
+	{
+		if (pthread_cond_timedwait(&sink_cond, &sink_lock, &until) != 0)
+		{
+			break;
+		}
+	}
+
+	int result = sink_count;
+
+	pthread_mutex_unlock(&sink_lock);
+
+	return result;
+}
+
+// Waits for the cached levels under mask to become expected.
+static uint32_t WaitState(uint32_t mask, uint32_t expected, int timeout_ms)
+{
+	int64_t deadline = HostTest_NowNs() + ((int64_t)timeout_ms * 1000000LL);
+	uint64_t seq = GpioEngine_Wait(0, 0);
+	uint32_t state = GpioEngine_GetState(NULL);
+
+	while (((state & mask) != expected) && (HostTest_NowNs() < deadline))
+	{
+		seq   = GpioEngine_Wait(seq, 10);
+		state = GpioEngine_GetState(NULL);
+	}
+
+	return state & mask;
+}
+
+static int SinkCount(void)
+{
+	pthread_mutex_lock(&sink_lock);
+
+	int count = sink_count;
+
+	pthread_mutex_unlock(&sink_lock);
+
+	return count;
+}
+
+static GpioLineConfig LineConfig(unsigned int offset, uint32_t edges, bool active_low, unsigned int debounce_ms)
+{
+	GpioLineConfig config;
+
+	memset(&config, 0, sizeof(config));
+	snprintf(config.name, sizeof(config.name), "line%u", offset);
+	snprintf(config.chip, sizeof(config.chip), "%s", TEST_CHIP);
+	config.offset      = offset;
+	config.edges       = edges;
+	config.active_low  = active_low;
+	config.debounce_ms = debounce_ms;
+
+	return config;
+}
+
+// One line under TEST_BIT at level, started. Returns its mock id.
+static int StartLine(const GpioLineConfig * config, int level)
+{
+	int line = GpioMock_Line(config->chip, config->offset);
+
+	GpioMock_SetValue(line, level);
+	GpioEngine_AddLine(config, TEST_BIT);
+	GpioEngine_AddSink(RecordSink, NULL);
+
+	if ((GpioEngine_Open() != 0) || (GpioEngine_Start() != 0) || (HostTest_StartReactor() != 0))
+	{
+		return -1;
+	}
+
+	return line;
+}
+
+static void TearDown(void)
+{
+	OpenGate();
+	HostTest_StopReactor();
+	GpioEngine_Close();
+	GpioEngine_RemoveSink(RecordSink, NULL);
+	GpioMock_Reset();
+
+	pthread_mutex_lock(&sink_lock);
+	memset(sink_calls, 0, sizeof(sink_calls));
+	sink_count = 0;
+	pthread_mutex_unlock(&sink_lock);
+}
+
+// Without debouncing a pulse read in one batch still gives every edge, in order.
+static void TestUndebouncedBatch(void)
+{
+	GpioLineConfig config = LineConfig(1, GPIO_EDGE_BOTH, false, 0);
+	GpioLineStats stats;
+	int line = StartLine(&config, 0);
+
+	CHECK(line >= 0);
+
+	// The reactor thread waits in the first call while the rest queue up.
+	sink_gate = true;
+	GpioMock_Edge(line, 1, 1000);
+	CHECK_EQ(WaitCalls(1, TEST_TIMEOUT_MS), 1);
+
+	GpioMock_Edge(line, 0, 2000);
+	GpioMock_Edge(line, 1, 3000);
+	GpioMock_Edge(line, 0, 4000);
+	OpenGate();
+
+	CHECK_EQ(WaitCalls(4, TEST_TIMEOUT_MS), 4);
+
+	for (int i = 0; i < 4; i++)
+	{
+		CHECK_EQ(sink_calls[i].bit, TEST_BIT);
+		CHECK_EQ(sink_calls[i].value, (i % 2 == 0) ? 1 : 0);
+		CHECK_EQ(sink_calls[i].t_ns, (i + 1) * 1000);
+	}
+
+	CHECK_EQ(GpioEngine_GetLineStats(TEST_BIT, &stats), 0);
+	CHECK_EQ(stats.edges, 4);
+	CHECK_EQ(stats.transitions, 4);
+	CHECK_EQ(stats.bounces, 0);
+	CHECK_EQ(WaitState(TEST_BIT, 0, TEST_TIMEOUT_MS), 0);
+
+	TearDown();
+}
+
+// Edges inside the window are bounces, the last one decides. The window runs
+// from the kernel timestamps, so these are now.
+static void TestDebounceSettles(void)
+{
+	GpioLineConfig config = LineConfig(2, GPIO_EDGE_BOTH, false, TEST_DEBOUNCE_MS);
+	GpioLineStats stats;
+	int line = StartLine(&config, 0);
+	int64_t start = HostTest_NowNs();
+
+	CHECK(line >= 0);
+
+	GpioMock_Edge(line, 1, start);
+	GpioMock_Edge(line, 0, start + 1000);
+	GpioMock_Edge(line, 1, start + 2000);
+
+	CHECK_EQ(WaitCalls(1, TEST_TIMEOUT_MS), 1);
+	usleep(TEST_SETTLE_MS * 1000);
+
+	CHECK_EQ(SinkCount(), 1);
+	CHECK_EQ(sink_calls[0].value, 1);
+	CHECK_EQ(sink_calls[0].t_ns, start + 2000);
+	CHECK(HostTest_NowNs() - start >= TEST_DEBOUNCE_MS * 1000000LL);
+
+	CHECK_EQ(GpioEngine_GetLineStats(TEST_BIT, &stats), 0);
+	CHECK_EQ(stats.debounce_ms, TEST_DEBOUNCE_MS);
+	CHECK_EQ(stats.edges, 3);
+	CHECK_EQ(stats.bounces, 2);
+	CHECK_EQ(stats.transitions, 1);
+	CHECK_EQ(stats.max_burst, 3);
+	CHECK_EQ(WaitState(TEST_BIT, TEST_BIT, TEST_TIMEOUT_MS), TEST_BIT);
+	CHECK_EQ(GpioEngine_GetLine(TEST_BIT), 1);
+
+	TearDown();
+}
+
+// A glitch that ends where it started is not a transition at all.
+static void TestDebounceGlitch(void)
+{
+	GpioLineConfig config = LineConfig(3, GPIO_EDGE_BOTH, false, TEST_DEBOUNCE_MS);
+	GpioLineStats stats;
+	int line = StartLine(&config, 0);
+
+	CHECK(line >= 0);
+
+	GpioMock_Edge(line, 1, 0);
+	GpioMock_Edge(line, 0, 0);
+	usleep(TEST_SETTLE_MS * 1000);
+
+	CHECK_EQ(SinkCount(), 0);
+	CHECK_EQ(GpioEngine_GetLineStats(TEST_BIT, &stats), 0);
+	CHECK_EQ(stats.edges, 2);
+	CHECK_EQ(stats.bounces, 2);
+	CHECK_EQ(stats.transitions, 0);
+	CHECK_EQ(stats.max_burst, 2);
+	CHECK_EQ(GpioEngine_GetLine(TEST_BIT), 0);
+
+	TearDown();
+}
+
+// The last edge was lost, the level read when the window closes is confirmed.
+static void TestDebounceLostEdge(void)
+{
+	GpioLineConfig config = LineConfig(12, GPIO_EDGE_BOTH, false, TEST_DEBOUNCE_MS);
+	GpioLineStats stats;
+	int line = StartLine(&config, 0);
+
+	CHECK(line >= 0);
+
+	GpioMock_Edge(line, 1, 0);
+	GpioMock_Edge(line, 0, 0);
+	GpioMock_SetValue(line, 1);
+
+	CHECK_EQ(WaitCalls(1, TEST_TIMEOUT_MS), 1);
+	CHECK_EQ(sink_calls[0].value, 1);
+	CHECK_EQ(WaitState(TEST_BIT, TEST_BIT, TEST_TIMEOUT_MS), TEST_BIT);
+
+	CHECK_EQ(GpioEngine_GetLineStats(TEST_BIT, &stats), 0);
+	CHECK_EQ(stats.edges, 2);
+	CHECK_EQ(stats.transitions, 1);
+
+	TearDown();
+}
+
+// A stamp off another clock, far ahead, is not held past one window from now.
+static void TestDebounceFutureStamp(void)
+{
+	GpioLineConfig config = LineConfig(13, GPIO_EDGE_BOTH, false, TEST_DEBOUNCE_MS);
+	int line = StartLine(&config, 0);
+	int64_t start = HostTest_NowNs();
+
+	CHECK(line >= 0);
+
+	GpioMock_Edge(line, 1, start + 1000000000000LL);
+
+	CHECK_EQ(WaitCalls(1, TEST_TIMEOUT_MS), 1);
+	CHECK(HostTest_NowNs() - start < TEST_TIMEOUT_MS * 1000000LL / 2);
+
+	TearDown();
+}
+
+// Unreported edges still move the cache, the sinks only see the rising ones.
+static void TestEdgeMask(void)
+{
+	GpioLineConfig config = LineConfig(4, GPIO_EDGE_RISING, false, 0);
+	GpioLineStats stats;
+	int line = StartLine(&config, 0);
+
+	CHECK(line >= 0);
+
+	for (int i = 0; i < 4; i++)
+	{
+		GpioMock_Edge(line, (i % 2 == 0) ? 1 : 0, (i + 1) * 1000);
+	}
+
+	CHECK_EQ(WaitCalls(2, TEST_TIMEOUT_MS), 2);
+	CHECK_EQ(WaitState(TEST_BIT, 0, TEST_TIMEOUT_MS), 0);
+	CHECK_EQ(SinkCount(), 2);
+	CHECK_EQ(sink_calls[0].value, 1);
+	CHECK_EQ(sink_calls[1].value, 1);
+	CHECK_EQ(sink_calls[1].t_ns, 3000);
+
+	CHECK_EQ(GpioEngine_GetLineStats(TEST_BIT, &stats), 0);
+	CHECK_EQ(stats.transitions, 4);
+
+	TearDown();
+}
+
+// An active low line is active at level 0, and its rising edge is the fall.
+static void TestActiveLow(void)
+{
+	GpioLineConfig config = LineConfig(5, GPIO_EDGE_RISING, true, 0);
+	uint32_t valid;
+	int line = StartLine(&config, 1);
+
+	CHECK(line >= 0);
+	CHECK_EQ(GpioEngine_GetState(&valid), TEST_BIT);
+	CHECK_EQ(valid, TEST_BIT);
+	CHECK_EQ(GpioEngine_GetActive(&valid), 0);
+
+	GpioMock_Edge(line, 0, 1000);
+
+	CHECK_EQ(WaitCalls(1, TEST_TIMEOUT_MS), 1);
+	CHECK_EQ(sink_calls[0].value, 0);
+	CHECK_EQ(WaitState(TEST_BIT, 0, TEST_TIMEOUT_MS), 0);
+	CHECK_EQ(GpioEngine_GetActive(NULL), TEST_BIT);
+
+	GpioMock_Edge(line, 1, 2000);
+
+	CHECK_EQ(WaitState(TEST_BIT, TEST_BIT, TEST_TIMEOUT_MS), TEST_BIT);
+	CHECK_EQ(SinkCount(), 1);
+	CHECK_EQ(GpioEngine_GetActive(NULL), 0);
+
+	TearDown();
+}
+
+// Lines on two chips, one bit each.
+static void TestTwoChips(void)
+{
+	GpioLineConfig first = LineConfig(6, GPIO_EDGE_BOTH, false, 0);
+	GpioLineConfig second = LineConfig(7, GPIO_EDGE_BOTH, false, 0);
+	GpioLineConfig unterminated = LineConfig(11, GPIO_EDGE_BOTH, false, 0);
+	GpioEngineStats stats;
+	uint32_t valid;
+
+	snprintf(second.chip, sizeof(second.chip), "gpiochip1");
+	memset(unterminated.chip, 'x', sizeof(unterminated.chip));
+
+	int line = GpioMock_Line(second.chip, second.offset);
+
+	CHECK_EQ(GpioEngine_AddLine(&first, 0x01), 0);
+	CHECK_EQ(GpioEngine_AddLine(&second, 0x04), 0);
+	CHECK(GpioEngine_AddLine(&second, 0x03) != 0);
+	CHECK(GpioEngine_AddLine(&unterminated, 0x02) != 0);
+	CHECK_EQ(GpioEngine_Open(), 0);
+	CHECK(GpioEngine_AddLine(&second, 0x08) != 0);
+	CHECK_EQ(GpioEngine_Start(), 0);
+	CHECK_EQ(HostTest_StartReactor(), 0);
+
+	GpioEngine_GetStats(&stats);
+	CHECK(stats.running);
+	CHECK_EQ(stats.lines, 2);
+	CHECK_EQ(stats.chips, 2);
+
+	GpioMock_Edge(line, 1, 1000);
+
+	CHECK_EQ(WaitState(0x05, 0x04, TEST_TIMEOUT_MS), 0x04);
+	GpioEngine_GetState(&valid);
+	CHECK_EQ(valid, 0x05);
+	CHECK_EQ(GpioEngine_Read(&valid), 0x04);
+	CHECK_EQ(GpioEngine_GetLine(0x01), 0);
+	CHECK_EQ(GpioEngine_GetLine(0x02), -1);
+
+	TearDown();
+}
+
+// The notify fd and GpioEngine_Wait both follow the cache.
+static void TestEventFd(void)
+{
+	GpioLineConfig config = LineConfig(8, GPIO_EDGE_BOTH, false, 0);
+	int fd = GpioEngine_EventFd();
+	int line = StartLine(&config, 0);
+	uint64_t ticks;
+
+	CHECK(fd >= 0);
+	CHECK(line >= 0);
+
+	while (read(fd, &ticks, sizeof(ticks)) == sizeof(ticks))
+	{
+	}
+
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	uint64_t seq = GpioEngine_Wait(0, 0);
+
+	CHECK_EQ(poll(&pfd, 1, 0), 0);
+
+	GpioMock_Edge(line, 1, 1000);
+
+	CHECK_EQ(poll(&pfd, 1, TEST_TIMEOUT_MS), 1);
+	CHECK(GpioEngine_Wait(seq, TEST_TIMEOUT_MS) > seq);
+	CHECK_EQ(read(fd, &ticks, sizeof(ticks)), (ssize_t)sizeof(ticks));
+	CHECK_EQ(poll(&pfd, 1, 0), 0);
+
+	TearDown();
+}
+
+// Like the kernel, the mock keeps GPIO_MOCK_QUEUE edges per line and drops the rest.
+static void TestMockOverflow(void)
+{
+	GpioLineConfig config = LineConfig(9, GPIO_EDGE_BOTH, false, 0);
+	GpioMockStats stats;
+	int line = GpioMock_Line(config.chip, config.offset);
+
+	GpioEngine_AddLine(&config, TEST_BIT);
+	CHECK_EQ(GpioEngine_Open(), 0);
+
+	for (int i = 0; i < GPIO_MOCK_QUEUE + 4; i++)
+	{
+		GpioMock_Edge(line, (i % 2 == 0) ? 1 : 0, (i + 1) * 1000);
+	}
+
+	// Not an edge, the level is already there.
+	GpioMock_Edge(line, 0, 0);
+
+	GpioMock_GetStats(&stats);
+	CHECK_EQ(stats.edges, GPIO_MOCK_QUEUE + 4);
+	CHECK_EQ(stats.dropped, 4);
+	CHECK(!stats.running);
+
+	TearDown();
+}
+
+// A script plays each step once, in order, into the running engine.
+static void TestMockPlay(void)
+{
+	GpioLineConfig config = LineConfig(10, GPIO_EDGE_BOTH, false, 0);
+	GpioMockStep steps[10];
+	GpioMockStats stats;
+	int line = StartLine(&config, 0);
+
+	CHECK(line >= 0);
+
+	for (int i = 0; i < 10; i++)
+	{
+		steps[i].at_ns = (int64_t)(i + 1) * 1000000LL;
+		steps[i].line  = line;
+		steps[i].value = (i % 2 == 0) ? 1 : 0;
+	}
+
+	CHECK_EQ(GpioMock_Play(steps, 10), 0);
+	CHECK_EQ(WaitCalls(10, TEST_TIMEOUT_MS), 10);
+
+	// Done once every step is played, whether or not it was stopped.
+	GpioMock_GetStats(&stats);
+	CHECK(!stats.running);
+	CHECK_EQ(stats.steps, 10);
+	CHECK_EQ(stats.edges, 10);
+	CHECK(stats.late_steps <= stats.steps);
+	GpioMock_Stop();
+
+	for (int i = 1; i < 10; i++)
+	{
+		CHECK(sink_calls[i].t_ns > sink_calls[i - 1].t_ns);
+	}
+
+	TearDown();
+}
+
+int main(void)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sink_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	GpioEngine_SetBackend(GpioBackend_Mock());
+
+	if (Reactor_Init() != 0)
+	{
+		printf("gpio_engine_test: Failed to create the reactor\n");
+		return 1;
+	}
+
+	HostTest_Run("undebounced batch", TestUndebouncedBatch);
+	HostTest_Run("debounce settles", TestDebounceSettles);
+	HostTest_Run("debounce glitch", TestDebounceGlitch);
+	HostTest_Run("debounce lost edge", TestDebounceLostEdge);
+	HostTest_Run("debounce future stamp", TestDebounceFutureStamp);
+	HostTest_Run("edge mask", TestEdgeMask);
+	HostTest_Run("active low", TestActiveLow);
+	HostTest_Run("two chips", TestTwoChips);
+	HostTest_Run("event fd", TestEventFd);
+	HostTest_Run("mock overflow", TestMockOverflow);
+	HostTest_Run("mock play", TestMockPlay);
+
+	return HostTest_Result("gpio_engine_test");
+}
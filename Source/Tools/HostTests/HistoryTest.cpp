@@ -0,0 +1,164 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - History Test
+ *  Source Filename  - HistoryTest.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The sample rings: the period and wrap around, then both
+ *  				   downsamplers, LTTB keeping its endpoints, point count and
+ *  				   a spike, min/max keeping each bucket's extremes.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "History.hpp"
+#include "HostTest.h"
+
+#define TEST_SAMPLES		(1000)
+#define TEST_LTTB_POINTS	(50)
+#define TEST_BUCKETS		(10)			// 100 ms each over TEST_SAMPLES
+#define TEST_LOW_SPIKE_MS	(333)
+#define TEST_HIGH_SPIKE_MS	(777)
+
+static HistoryPoint test_points[TEST_SAMPLES];
+
+// A sample every ms, a sawtooth of 0 to 9 with a spike down and one up.
+static void PushSawtooth(HistoryMetric metric)
+{
+	for (int t = 0; t < TEST_SAMPLES; t++)
+	{
+		int32_t value = t % 10;
+
+		if (t == TEST_LOW_SPIKE_MS)
+		{
+			value = -500;
+		}
+		else if (t == TEST_HIGH_SPIKE_MS)
+		{
+			value = 700;
+		}
+
+		History_Push(metric, t, value);
+	}
+}
+
+// Pushes inside the period are dropped, a full ring keeps the newest samples.
+static void TestRing(void)
+{
+	CHECK_EQ(History_Init(8, 10), 0);
+
+	CHECK_EQ(History_Push(HISTORY_LEVEL, 0, 1), 1);
+	CHECK_EQ(History_Push(HISTORY_LEVEL, 5, 2), 0);
+	CHECK_EQ(History_Push(HISTORY_LEVEL, 10, 3), 1);
+	CHECK_EQ(History_Count(HISTORY_LEVEL), 2);
+	CHECK_EQ(History_Count(HISTORY_CURRENT), 0);
+
+	for (int i = 2; i < 20; i++)
+	{
+		History_Push(HISTORY_LEVEL, i * 10, i);
+	}
+
+	CHECK_EQ(History_Count(HISTORY_LEVEL), 8);
+	CHECK_EQ(History_Downsample(HISTORY_LEVEL, 0, INT64_MAX, test_points, 8, HISTORY_DOWNSAMPLE_LTTB), 8);
+
+	for (int i = 0; i < 8; i++)
+	{
+		CHECK_EQ(test_points[i].t_ms, (12 + i) * 10);
+		CHECK_EQ(test_points[i].value, 12 + i);
+	}
+
+	// Only the window, and nothing from a window before the oldest sample.
+	CHECK_EQ(History_Downsample(HISTORY_LEVEL, 150, 170, test_points, 8, HISTORY_DOWNSAMPLE_LTTB), 3);
+	CHECK_EQ(test_points[0].t_ms, 150);
+	CHECK_EQ(History_Downsample(HISTORY_LEVEL, 0, 100, test_points, 8, HISTORY_DOWNSAMPLE_LTTB), 0);
+	CHECK_EQ(History_Downsample(HISTORY_LEVEL, 170, 150, test_points, 8, HISTORY_DOWNSAMPLE_LTTB), 0);
+
+	History_Cleanup();
+
+	CHECK_EQ(History_Count(HISTORY_LEVEL), 0);
+	CHECK_EQ(History_Push(HISTORY_LEVEL, 1000, 1), 0);
+}
+
+// Exactly max_points, in order, from the first sample to the last, and the
+// spikes are the largest triangles so they are kept.
+static void TestLttb(void)
+{
+	bool low = false;
+	bool high = false;
+
+	CHECK_EQ(History_Init(TEST_SAMPLES, 1), 0);
+	PushSawtooth(HISTORY_VOLTAGE);
+
+	size_t count = History_Downsample(HISTORY_VOLTAGE, 0, INT64_MAX, test_points, TEST_LTTB_POINTS,
+			HISTORY_DOWNSAMPLE_LTTB);
+
+	CHECK_EQ(count, TEST_LTTB_POINTS);
+	CHECK_EQ(test_points[0].t_ms, 0);
+	CHECK_EQ(test_points[TEST_LTTB_POINTS - 1].t_ms, TEST_SAMPLES - 1);
+
+	for (size_t i = 0; (i < count) && (i < TEST_LTTB_POINTS); i++)
+	{
+		if (i > 0)
+		{
+			CHECK(test_points[i].t_ms > test_points[i - 1].t_ms);
+		}
+
+		low  = low || (test_points[i].t_ms == TEST_LOW_SPIKE_MS);
+		high = high || (test_points[i].t_ms == TEST_HIGH_SPIKE_MS);
+	}
+
+	CHECK(low);
+	CHECK(high);
+
+	// Fewer samples than points are returned as they are.
+	CHECK_EQ(History_Downsample(HISTORY_VOLTAGE, 100, 119, test_points, TEST_LTTB_POINTS,
+			HISTORY_DOWNSAMPLE_LTTB), 20);
+	CHECK_EQ(test_points[19].t_ms, 119);
+
+	History_Cleanup();
+}
+
+// One min and one max per 100 ms bucket, in time order, each from its bucket.
+static void TestMinMax(void)
+{
+	CHECK_EQ(History_Init(TEST_SAMPLES, 1), 0);
+	PushSawtooth(HISTORY_TEMP);
+
+	size_t count = History_Downsample(HISTORY_TEMP, 0, TEST_SAMPLES - 1, test_points, 2 * TEST_BUCKETS,
+			HISTORY_DOWNSAMPLE_MINMAX);
+
+	CHECK_EQ(count, 2 * TEST_BUCKETS);
+
+	for (int k = 0; (k < TEST_BUCKETS) && ((size_t)(2 * k + 1) < count); k++)
+	{
+		HistoryPoint * first = &test_points[2 * k];
+		HistoryPoint * second = &test_points[2 * k + 1];
+		int32_t min = (first->value < second->value) ? first->value : second->value;
+		int32_t max = (first->value < second->value) ? second->value : first->value;
+
+		CHECK_EQ(first->t_ms / 100, k);
+		CHECK_EQ(second->t_ms / 100, k);
+		CHECK(first->t_ms < second->t_ms);
+		CHECK_EQ(min, (k == TEST_LOW_SPIKE_MS / 100) ? -500 : 0);
+		CHECK_EQ(max, (k == TEST_HIGH_SPIKE_MS / 100) ? 700 : 9);
+	}
+
+	History_Cleanup();
+}
+
+int main(void)
+{
+	HostTest_Run("ring", TestRing);
+	HostTest_Run("lttb", TestLttb);
+	HostTest_Run("min max", TestMinMax);
+
+	return HostTest_Result("history_test");
+}
@@ -0,0 +1,69 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Host GPIO
+ *  Source Filename  - HostGpio.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Stands in for GpioGpiod.cpp in the programs that link
+ *  				   the GPIO engine. There is no libgpiod on the host, every
+ *  				   line comes from the mock. The engine's lines are reactor
+ *  				   sources, so those programs also run a reactor thread.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "GpioBackend.hpp"
+#include "Reactor.h"
+#include "HostTest.h"
+
+static pthread_t host_reactor_tid;
+static bool host_reactor_running = false;
+
+const GpioBackend * GpioBackend_Gpiod(void)
+{
+	return GpioBackend_Mock();
+}
+
+static void * HostReactor(void * arg)
+{
+	UNUSED(arg);
+
+	Reactor_Run();
+
+	return NULL;
+}
+
+int HostTest_StartReactor(void)
+{
+	if (host_reactor_running)
+	{
+		return 0;
+	}
+
+	if ((Reactor_Init() != 0) || (pthread_create(&host_reactor_tid, NULL, HostReactor, NULL) != 0))
+	{
+		printf("HostTest_StartReactor: Failed to start the reactor\n");
+		return -1;
+	}
+
+	host_reactor_running = true;
+
+	return 0;
+}
+
+void HostTest_StopReactor(void)
+{
+	if (host_reactor_running)
+	{
+		Reactor_Stop();
+		pthread_join(host_reactor_tid, NULL);
+		host_reactor_running = false;
+	}
+}
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Host Stubs
+ *  Source Filename  - HostStubs.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - What the library sources under test need from the parts
+ *  				   of the meter build that are not linked on the host,
+ *  				   and the test runner.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "Battery.hpp"
+#include "HostTest.h"
+
+// Quiet unless something fails.
+int dbg_level = DBG_ERR;
+
+int host_test_failures = 0;
+
+static const BatterySource * host_source = NULL;
+
+// The replay installs itself as the battery source, Battery.cpp is not linked.
+void Battery_SetSource(const BatterySource * source)
+{
+	host_source = source;
+}
+
+const BatterySource * Battery_GetSource(void)
+{
+	return host_source;
+}
+
+// No lines without Battery.cpp, a replay that leaves them out reads none.
+int Battery_ReadLines(BatterySample * sample, uint32_t fields)
+{
+	UNUSED(sample);
+	UNUSED(fields);
+
+	return 0;
+}
+
+int64_t Battery_NowNs(void)
+{
+	return HostTest_NowNs();
+}
+
+void HostTest_Run(const char * name, HostTestFunc test)
+{
+	int failures = host_test_failures;
+
+	printf("%s\n", name);
+
+	test();
+
+	printf("    %s\n", (host_test_failures == failures) ? "ok" : "FAILED");
+}
+
+int HostTest_Result(const char * program)
+{
+	printf("%s: %d failed checks\n", program, host_test_failures);
+
+	return (host_test_failures == 0) ? 0 : 1;
+}
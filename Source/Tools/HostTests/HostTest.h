@@ -0,0 +1,83 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Host Test
+ *  Source Filename  - HostTest.h
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Checks shared by the host test programs. Each program
+ *  				   runs its tests in order and exits non-zero if any
+ *  				   check failed.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "debug.hpp"
+
+extern int host_test_failures;
+
+#define CHECK(cond)																	\
+	do {																			\
+		if (!(cond))																\
+		{																			\
+			printf("    FAIL %s:%d: %s\n", __FILENAME__, __LINE__, #cond);			\
+			host_test_failures++;													\
+		}																			\
+	} while (0)
+
+#define CHECK_EQ(a, b)																\
+	do {																			\
+		long long check_a = (long long)(a);											\
+		long long check_b = (long long)(b);											\
+		if (check_a != check_b)														\
+		{																			\
+			printf("    FAIL %s:%d: %s == %s, %lld != %lld\n",						\
+					__FILENAME__, __LINE__, #a, #b, check_a, check_b);				\
+			host_test_failures++;													\
+		}																			\
+	} while (0)
+
+typedef void (*HostTestFunc)(void);
+
+static inline int64_t HostTest_NowNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((int64_t)now.tv_sec * 1000000000LL) + now.tv_nsec;
+}
+
+/**
+ * HostTest_Run
+ * runs one test and reports whether its checks passed.
+ */
+void HostTest_Run(const char * name, HostTestFunc test);
+
+/**
+ * HostTest_Result
+ * prints the summary, returns the exit code for main.
+ */
+int HostTest_Result(const char * program);
+
+/**
+ * HostTest_StartReactor
+ * runs the reactor on a thread of its own, as main does in the app. Start
+ * the GPIO engine before this, it adds its sources while the loop is idle.
+ */
+int HostTest_StartReactor(void);
+
+/**
+ * HostTest_StopReactor
+ * stops the reactor thread and waits for it.
+ */
+void HostTest_StopReactor(void);
@@ -0,0 +1,253 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - JSON Lines Test
+ *  Source Filename  - JsonLinesTest.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The JSON Lines stream: the exact text of a line, which
+ *  				   fields it carries, escaping, write errors, and every
+ *  				   sample of a generator run written whole.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Battery.hpp"
+#include "Generator.hpp"
+#include "GpioTable.hpp"
+#include "JsonLines.h"
+#include "HostTest.h"
+
+#define TEST_GENERATOR_HZ		(10000.0)
+#define TEST_GENERATOR_PACKS	(2)
+#define TEST_GENERATOR_MS		(300)
+#define TEST_FILE_LEN			(1024 * 1024)
+
+static char test_path[] = "/tmp/jsonl_test_XXXXXX";
+static char test_text[TEST_FILE_LEN];
+
+// Reads the stream back, returns its length.
+static size_t ReadBack(void)
+{
+	FILE * file = fopen(test_path, "r");
+	size_t length = 0;
+
+	if (file != NULL)
+	{
+		length = fread(test_text, 1, sizeof(test_text) - 1, file);
+		fclose(file);
+	}
+
+	test_text[length] = '\0';
+
+	return length;
+}
+
+static BatterySample FullSample(void)
+{
+	BatterySample sample;
+
+	memset(&sample, 0, sizeof(sample));
+	sample.t_ns       = 123456789;
+	sample.fields     = BATTERY_FIELD_ALL;
+	sample.current    = -512;
+	sample.voltage    = 385;
+	sample.temp       = 251;
+	sample.level      = 80;
+	sample.in_dock    = 1;
+	sample.charging   = 0;
+	sample.gpio       = 3;
+	sample.gpio_table = 0xDEADBEEF;
+	snprintf(sample.health, sizeof(sample.health), "Good");
+
+	return sample;
+}
+
+static void TestFullLine(void)
+{
+	BatterySample sample = FullSample();
+	JsonLinesStats stats;
+
+	CHECK_EQ(JsonLines_Open(test_path), 0);
+	CHECK_EQ(JsonLines_Write(2, &sample), 0);
+	JsonLines_GetStats(&stats);
+	JsonLines_Close();
+
+	const char * expected =
+		"{\"t_ns\":123456789,\"supply\":2,\"current\":-512,\"voltage\":385,\"temp\":251,"
+		"\"level\":80,\"health\":\"Good\",\"in_dock\":1,\"charging\":0,\"gpio\":3,"
+		"\"gpio_table\":3735928559}\n";
+
+	CHECK_EQ(ReadBack(), strlen(expected));
+	CHECK(strcmp(test_text, expected) == 0);
+	CHECK_EQ(stats.records, 1);
+	CHECK_EQ(stats.bytes, strlen(expected));
+	CHECK_EQ(stats.dropped, 0);
+}
+
+// Only the fields the sample has, and the extremes of the integers.
+static void TestPartialLine(void)
+{
+	BatterySample sample = FullSample();
+
+	sample.t_ns    = -5;
+	sample.fields  = BATTERY_FIELD_CURRENT | BATTERY_FIELD_LEVEL;
+	sample.current = INT32_MIN;
+	sample.level   = INT32_MAX;
+
+	CHECK_EQ(JsonLines_Open(test_path), 0);
+	CHECK_EQ(JsonLines_Write(0, &sample), 0);
+	JsonLines_Close();
+	ReadBack();
+
+	CHECK(strcmp(test_text, "{\"t_ns\":-5,\"supply\":0,\"current\":-2147483648,\"level\":2147483647}\n") == 0);
+}
+
+// Quotes, backslashes and control characters, and a health string with no terminator.
+static void TestEscaping(void)
+{
+	BatterySample sample = FullSample();
+
+	sample.fields = BATTERY_FIELD_HEALTH;
+	snprintf(sample.health, sizeof(sample.health), "G\"o\\d\x01\n");
+
+	CHECK_EQ(JsonLines_Open(test_path), 0);
+	CHECK_EQ(JsonLines_Write(0, &sample), 0);
+
+	memset(sample.health, 'x', sizeof(sample.health));
+	CHECK_EQ(JsonLines_Write(1, &sample), 0);
+	JsonLines_Close();
+	ReadBack();
+
+	CHECK(strcmp(test_text,
+			"{\"t_ns\":123456789,\"supply\":0,\"health\":\"G\\\"o\\\\d\\u0001\\u000a\"}\n"
+			"{\"t_ns\":123456789,\"supply\":1,\"health\":\"xxxxxxxxxxxxxxxx\"}\n") == 0);
+}
+
+// A failed write is counted and the line dropped, the stream carries on.
+static void TestWriteErrors(void)
+{
+	BatterySample sample = FullSample();
+	JsonLinesStats stats;
+
+	CHECK_EQ(JsonLines_Open("/dev/full"), 0);
+	CHECK_EQ(JsonLines_Write(0, &sample), -1);
+	CHECK_EQ(JsonLines_Write(0, &sample), -1);
+	JsonLines_Close();
+
+	JsonLines_GetStats(&stats);
+	CHECK_EQ(stats.records, 0);
+	CHECK_EQ(stats.dropped, 2);
+
+	// Closed, so dropped too.
+	CHECK_EQ(JsonLines_Write(0, &sample), -1);
+	JsonLines_GetStats(&stats);
+	CHECK_EQ(stats.dropped, 3);
+
+	CHECK(JsonLines_Open("/nonexistent/dir/file.jsonl") != 0);
+}
+
+static void StreamSink(void * arg, unsigned int supply, const BatterySample * sample)
+{
+	UNUSED(arg);
+
+	JsonLines_Write(supply, sample);
+}
+
+// Every sample of every pack, each a whole line, the GPIO bits naming the loaded table.
+static void TestGenerator(void)
+{
+	GeneratorConfig config;
+	GeneratorStats generator;
+	JsonLinesStats stats;
+	GpioLineConfig lines[2];
+
+	memset(lines, 0, sizeof(lines));
+	snprintf(lines[0].name, sizeof(lines[0].name), GPIO_LINE_IN_BASE);
+	snprintf(lines[0].chip, sizeof(lines[0].chip), "gpiochip1");
+	lines[0].offset = IN_DOCK_PIN;
+	snprintf(lines[1].name, sizeof(lines[1].name), GPIO_LINE_CHARGING);
+	snprintf(lines[1].chip, sizeof(lines[1].chip), "gpiochip5");
+	lines[1].offset = CHARGING_PIN;
+	CHECK_EQ(GpioTable_Load(NULL, lines, 2), 1);
+
+	Generator_DefaultConfig(&config);
+	config.rate_hz  = TEST_GENERATOR_HZ;
+	config.supplies = TEST_GENERATOR_PACKS;
+
+	CHECK_EQ(JsonLines_Open(test_path), 0);
+	CHECK_EQ(Generator_Init(&config), 0);
+	CHECK_EQ(Generator_Start(StreamSink, NULL), 0);
+	usleep(TEST_GENERATOR_MS * 1000);
+	Generator_Stop();
+	Generator_GetStats(&generator);
+	JsonLines_GetStats(&stats);
+	JsonLines_Close();
+	Generator_Cleanup();
+
+	CHECK(generator.samples > 0);
+	CHECK_EQ(stats.records, generator.samples);
+	CHECK_EQ(stats.dropped, 0);
+	CHECK(stats.bytes < sizeof(test_text));
+
+	CHECK_EQ(ReadBack(), stats.bytes);
+
+	char table[32];
+	uint64_t lines_read = 0;
+	uint64_t bad = 0;
+	uint64_t per_supply[TEST_GENERATOR_PACKS] = { 0 };
+
+	snprintf(table, sizeof(table), "\"gpio_table\":%u}", GpioTable_Hash());
+
+	for (char * line = strtok(test_text, "\n"); line != NULL; line = strtok(NULL, "\n"))
+	{
+		unsigned int supply = 0;
+
+		lines_read++;
+
+		if ((strncmp(line, "{\"t_ns\":", 8) != 0) || (strstr(line, table) == NULL) ||
+			(sscanf(strstr(line, "\"supply\":"), "\"supply\":%u", &supply) != 1) || (supply >= TEST_GENERATOR_PACKS))
+		{
+			bad++;
+			continue;
+		}
+
+		per_supply[supply]++;
+	}
+
+	CHECK_EQ(lines_read, stats.records);
+	CHECK_EQ(bad, 0);
+	CHECK_EQ(per_supply[0], per_supply[1]);
+}
+
+int main(void)
+{
+	int fd = mkstemp(test_path);
+
+	if (fd < 0)
+	{
+		printf("jsonl_test: Failed to create %s\n", test_path);
+		return 1;
+	}
+
+	close(fd);
+
+	HostTest_Run("full line", TestFullLine);
+	HostTest_Run("partial line", TestPartialLine);
+	HostTest_Run("escaping", TestEscaping);
+	HostTest_Run("write errors", TestWriteErrors);
+	HostTest_Run("generator", TestGenerator);
+
+	unlink(test_path);
+
+	return HostTest_Result("jsonl_test");
+}
@@ -0,0 +1,169 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Metric Test
+ *  Source Filename  - MetricTest.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - Observers told only of changes, counted in the stats, and
+ *  				   each metric formatted as the screen shows it, also into
+ *  				   buffers too small for it.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Metric.h"
+#include "HostTest.h"
+
+#define TEST_TEXT_LEN		(32)
+
+static int test_calls[METRIC_COUNT];
+static Metric test_last;
+
+static void CountObserver(void * arg, MetricId id, const Metric * metric)
+{
+	UNUSED(arg);
+
+	test_calls[id]++;
+	test_last = *metric;
+}
+
+// Formats value as id and checks the text and its length.
+static void CheckFormat(MetricId id, int32_t value, size_t size, const char * expected)
+{
+	Metric metric;
+	char text[TEST_TEXT_LEN];
+
+	memset(&metric, 0, sizeof(metric));
+	metric.known = true;
+	metric.value = value;
+
+	size_t length = Metric_Format(id, &metric, text, size);
+
+	if (strcmp(text, expected) != 0)
+	{
+		printf("    FAIL metric %d value %d in %zu bytes: \"%s\" != \"%s\"\n", id, value, size, text, expected);
+		host_test_failures++;
+	}
+
+	CHECK_EQ(length, strlen(expected));
+}
+
+// Same value and level again is not a change, a new level or text is.
+static void TestChanges(void)
+{
+	MetricStats before;
+	MetricStats after;
+	Metric metric;
+
+	Metric_GetStats(&before);
+
+	CHECK_EQ(Metric_Subscribe(METRIC_LEVEL, CountObserver, NULL), 0);
+	CHECK_EQ(test_calls[METRIC_LEVEL], 0);
+
+	Metric_Set(METRIC_LEVEL, 80, METRIC_LEVEL_GOOD);
+	Metric_Set(METRIC_LEVEL, 80, METRIC_LEVEL_GOOD);
+	CHECK_EQ(test_calls[METRIC_LEVEL], 1);
+
+	Metric_Set(METRIC_LEVEL, 80, METRIC_LEVEL_WARN);
+	Metric_Set(METRIC_LEVEL, 79, METRIC_LEVEL_WARN);
+	CHECK_EQ(test_calls[METRIC_LEVEL], 3);
+	CHECK_EQ(test_last.value, 79);
+	CHECK_EQ(test_last.level, METRIC_LEVEL_WARN);
+
+	Metric_SetText(METRIC_HEALTH, "Good", METRIC_LEVEL_GOOD);
+	CHECK_EQ(Metric_Subscribe(METRIC_HEALTH, CountObserver, NULL), 0);
+
+	// Told at once of a value it subscribed after.
+	CHECK_EQ(test_calls[METRIC_HEALTH], 1);
+	CHECK(strcmp(test_last.text, "Good") == 0);
+
+	Metric_SetText(METRIC_HEALTH, "Good", METRIC_LEVEL_GOOD);
+	CHECK_EQ(test_calls[METRIC_HEALTH], 1);
+	Metric_SetText(METRIC_HEALTH, "Overheat", METRIC_LEVEL_BAD);
+	CHECK_EQ(test_calls[METRIC_HEALTH], 2);
+
+	Metric_Get(METRIC_HEALTH, &metric);
+	CHECK(metric.known);
+	CHECK(strcmp(metric.text, "Overheat") == 0);
+	CHECK_EQ(metric.level, METRIC_LEVEL_BAD);
+
+	Metric_Get(METRIC_TEMP, &metric);
+	CHECK(!metric.known);
+
+	Metric_GetStats(&after);
+	CHECK_EQ(after.sets - before.sets, 7);
+	CHECK_EQ(after.changes - before.changes, 5);
+
+	// Other metrics, full observer tables and unknown ids are refused or ignored.
+	Metric_Set(METRIC_COUNT, 1, METRIC_LEVEL_NONE);
+	CHECK_EQ(Metric_Subscribe(METRIC_COUNT, CountObserver, NULL), -1);
+	CHECK_EQ(Metric_Subscribe(METRIC_LEVEL, NULL, NULL), -1);
+
+	for (int i = 1; i < METRIC_MAX_OBSERVERS; i++)
+	{
+		CHECK_EQ(Metric_Subscribe(METRIC_LEVEL, CountObserver, NULL), 0);
+	}
+
+	CHECK_EQ(Metric_Subscribe(METRIC_LEVEL, CountObserver, NULL), -1);
+
+	Metric_Set(METRIC_LEVEL, 78, METRIC_LEVEL_WARN);
+	CHECK_EQ(test_calls[METRIC_LEVEL], 3 + (2 * METRIC_MAX_OBSERVERS) - 1);
+}
+
+// Fixed point in the units of each metric, the fraction zero padded.
+static void TestFormat(void)
+{
+	CheckFormat(METRIC_VOLTAGE, 1234, TEST_TEXT_LEN, "12.34 V");
+	CheckFormat(METRIC_VOLTAGE, 5, TEST_TEXT_LEN, "0.05 V");
+	CheckFormat(METRIC_VOLTAGE, -5, TEST_TEXT_LEN, "-0.05 V");
+	CheckFormat(METRIC_TEMP, 250, TEST_TEXT_LEN, "25.0 ºC");
+	CheckFormat(METRIC_TEMP, -5, TEST_TEXT_LEN, "-0.5 ºC");
+	CheckFormat(METRIC_TEMP, -123, TEST_TEXT_LEN, "-12.3 ºC");
+	CheckFormat(METRIC_CURRENT, -1500, TEST_TEXT_LEN, "-1500 mA");
+	CheckFormat(METRIC_CURRENT, 0, TEST_TEXT_LEN, "0 mA");
+	CheckFormat(METRIC_CURRENT, INT32_MIN, TEST_TEXT_LEN, "-2147483648 mA");
+	CheckFormat(METRIC_LEVEL, 87, TEST_TEXT_LEN, "87%");
+	CheckFormat(METRIC_BRIGHTNESS, 7, TEST_TEXT_LEN, "7");
+	CheckFormat(METRIC_IN_DOCK, 1, TEST_TEXT_LEN, "TRUE");
+	CheckFormat(METRIC_CHARGING, 0, TEST_TEXT_LEN, "FALSE");
+}
+
+// Cut short, always terminated, and a number is never cut inside its digits.
+static void TestShortBuffer(void)
+{
+	Metric metric;
+	char text[TEST_TEXT_LEN];
+
+	CheckFormat(METRIC_VOLTAGE, 1234, 6, "12.34");
+	CheckFormat(METRIC_VOLTAGE, 1234, 5, "12.3");
+	CheckFormat(METRIC_VOLTAGE, 1234, 3, "12");
+	CheckFormat(METRIC_CURRENT, -1500, 4, "-");
+	CheckFormat(METRIC_IN_DOCK, 0, 3, "FA");
+	CheckFormat(METRIC_LEVEL, 87, 1, "");
+
+	memset(&metric, 0, sizeof(metric));
+	snprintf(metric.text, sizeof(metric.text), "Overheat");
+
+	CHECK_EQ(Metric_Format(METRIC_HEALTH, &metric, text, 5), 4);
+	CHECK(strcmp(text, "Over") == 0);
+	CHECK_EQ(Metric_Format(METRIC_HEALTH, &metric, text, 0), 0);
+	CHECK_EQ(Metric_Format(METRIC_COUNT, &metric, text, sizeof(text)), 0);
+	CHECK_EQ(text[0], '\0');
+}
+
+int main(void)
+{
+	HostTest_Run("changes", TestChanges);
+	HostTest_Run("format", TestFormat);
+	HostTest_Run("short buffer", TestShortBuffer);
+
+	return HostTest_Result("metric_test");
+}
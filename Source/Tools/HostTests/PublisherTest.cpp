@@ -0,0 +1,295 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Publisher Test
+ *  Source Filename  - PublisherTest.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The snapshot socket: a client following every change, one
+ *  				   held to an interval, one that never reads and one that
+ *  				   sends a bad request, against a sampler on the reactor,
+ *  				   then the stop.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <atomic>
+
+#include "Coroutine.h"
+#include "Reactor.h"
+#include "Publisher.h"
+#include "BatteryRecord.hpp"
+#include "BatterySubscribe.hpp"
+#include "HostTest.h"
+
+#define TEST_PATH				"/tmp/publisher_test.sock"
+#define TEST_PERIOD_MS			(10)
+#define TEST_TICKS				(300)
+#define TEST_LEVEL_TICKS		(20)		// the level changes every 200 ms
+#define TEST_INTERVAL_MS		(100)
+#define TEST_RECV_TIMEOUT_MS	(300)
+
+// What one client thread received.
+typedef struct
+{
+	uint32_t fields;
+	uint32_t interval_ms;
+	int records;
+	int bad_records;					// not a record, or not after the one before
+	int first_current;
+	int last_current;
+	int last_level;
+	int64_t min_gap_ns;
+} TestClient;
+
+static TestClient test_current = { BATTERY_FIELD_CURRENT, 0, 0, 0, -1, -1, -1, INT64_MAX };
+static TestClient test_level = { BATTERY_FIELD_LEVEL, TEST_INTERVAL_MS, 0, 0, -1, -1, -1, INT64_MAX };
+static ssize_t test_bad_recv = 1;
+
+static int test_ticks = 0;
+static int64_t test_slowest_ns = 0;
+static std::atomic<bool> test_finished(false);
+
+// Reactor timer, one sample per tick, the current changing every tick.
+static void Sampler(void * arg)
+{
+	UNUSED(arg);
+
+	BatterySample sample;
+
+	memset(&sample, 0, sizeof(sample));
+	sample.t_ns    = HostTest_NowNs();
+	sample.fields  = BATTERY_FIELD_ALL & ~BATTERY_FIELD_GPIO;
+	sample.current = test_ticks;
+	sample.level   = test_ticks / TEST_LEVEL_TICKS;
+	snprintf(sample.health, sizeof(sample.health), "Good");
+
+	int64_t start = HostTest_NowNs();
+
+	Publisher_Publish(&sample);
+
+	int64_t elapsed = HostTest_NowNs() - start;
+
+	if (elapsed > test_slowest_ns)
+	{
+		test_slowest_ns = elapsed;
+	}
+
+	if (++test_ticks == TEST_TICKS)
+	{
+		test_finished.store(true);
+		Reactor_Stop();
+	}
+}
+
+static int Connect(uint32_t fields, uint32_t interval_ms, bool bad)
+{
+	struct sockaddr_un addr;
+	uint8_t request[BATTERY_SUBSCRIBE_SIZE];
+	int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", TEST_PATH);
+
+	if ((fd < 0) || (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0))
+	{
+		printf("Connect: Failed to connect to %s\n", TEST_PATH);
+		return -1;
+	}
+
+	BatterySubscribe_Encode(request, fields, interval_ms);
+
+	if (bad)
+	{
+		request[BATTERY_SUBSCRIBE_OFF_MAGIC] ^= 1;
+	}
+
+	send(fd, request, sizeof(request), 0);
+
+	return fd;
+}
+
+// Reads records until none came for TEST_RECV_TIMEOUT_MS.
+static void * Client(void * arg)
+{
+	TestClient * client = (TestClient *)arg;
+	struct timeval timeout = { 0, TEST_RECV_TIMEOUT_MS * 1000 };
+	uint8_t buf[PUBLISHER_RECORD_LEN];
+	int64_t last_ns = 0;
+	ssize_t length;
+	int fd = Connect(client->fields, client->interval_ms, false);
+
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	while ((length = recv(fd, buf, sizeof(buf), 0)) > 0)
+	{
+		BatteryRecordView view;
+		int64_t now = HostTest_NowNs();
+
+		if (BatteryRecord_View(buf, length, &view) != 0)
+		{
+			client->bad_records++;
+			continue;
+		}
+
+		int current = BatteryRecord_Current(&view);
+		int level = BatteryRecord_Level(&view);
+
+		if ((current <= client->last_current) ||
+			((client->fields == BATTERY_FIELD_LEVEL) && (client->records > 0) && (level <= client->last_level)))
+		{
+			client->bad_records++;
+		}
+
+		if (client->records == 0)
+		{
+			client->first_current = current;
+		}
+		else if (now - last_ns < client->min_gap_ns)
+		{
+			client->min_gap_ns = now - last_ns;
+		}
+
+		client->last_current = current;
+		client->last_level   = level;
+		last_ns = now;
+		client->records++;
+	}
+
+	close(fd);
+
+	return NULL;
+}
+
+// Subscribes to everything and never reads, until the sampler is done.
+static void * SlowClient(void * arg)
+{
+	UNUSED(arg);
+
+	int fd = Connect(BATTERY_FIELD_ALL, 0, false);
+
+	while (!test_finished.load())
+	{
+		usleep(TEST_PERIOD_MS * 1000);
+	}
+
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+
+	return NULL;
+}
+
+// A bad magic, the server closes the connection.
+static void * BadClient(void * arg)
+{
+	UNUSED(arg);
+
+	uint8_t buf[PUBLISHER_RECORD_LEN];
+	int fd = Connect(BATTERY_FIELD_ALL, 0, true);
+
+	if (fd >= 0)
+	{
+		test_bad_recv = recv(fd, buf, sizeof(buf), 0);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static void TestSubscribers(void)
+{
+	pthread_t threads[4];
+	PublisherStats stats;
+
+	CHECK_EQ(Publisher_Start(TEST_PATH), 0);
+	CHECK(Reactor_AddTimer(TEST_PERIOD_MS, Sampler, NULL) >= 0);
+
+	pthread_create(&threads[0], NULL, Client, &test_current);
+	pthread_create(&threads[1], NULL, Client, &test_level);
+	pthread_create(&threads[2], NULL, SlowClient, NULL);
+	pthread_create(&threads[3], NULL, BadClient, NULL);
+
+	Reactor_Run();
+
+	for (int i = 0; i < 4; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	Publisher_GetStats(&stats);
+
+	// Every change from the first snapshot after subscribing, in order.
+	CHECK(test_current.records > TEST_TICKS * 9 / 10);
+	CHECK_EQ(test_current.records, TEST_TICKS - test_current.first_current);
+	CHECK_EQ(test_current.last_current, TEST_TICKS - 1);
+	CHECK_EQ(test_current.bad_records, 0);
+
+	// One per level change, never closer than the interval.
+	CHECK(test_level.records >= TEST_TICKS / TEST_LEVEL_TICKS - 1);
+	CHECK(test_level.records <= TEST_TICKS / TEST_LEVEL_TICKS);
+	CHECK_EQ(test_level.last_level, (TEST_TICKS - 1) / TEST_LEVEL_TICKS);
+	CHECK(test_level.min_gap_ns >= TEST_INTERVAL_MS * 1000000LL);
+	CHECK_EQ(test_level.bad_records, 0);
+
+	CHECK_EQ(test_bad_recv, 0);
+	CHECK(stats.dropped > 0);
+	CHECK(stats.snapshots >= (uint64_t)test_current.records);
+
+	printf("    %d and %d records, %llu dropped, slowest publish %lld us\n",
+			test_current.records, test_level.records, (unsigned long long)stats.dropped,
+			(long long)(test_slowest_ns / 1000));
+}
+
+// With the reactor stopped, the slow client and the listener are still
+// suspended on their sockets. Stopping frees them and removes the path.
+static void TestStop(void)
+{
+	CoStats co_stats;
+
+	Co_GetStats(&co_stats);
+	CHECK(co_stats.tasks > 0);
+
+	Publisher_Stop();
+	Co_GetStats(&co_stats);
+
+	CHECK_EQ(co_stats.tasks, 0);
+	CHECK_EQ(co_stats.frame_bytes, 0);
+	CHECK_EQ(Publisher_Clients(), 0);
+	CHECK(access(TEST_PATH, F_OK) != 0);
+
+	// A second stop finds nothing to do.
+	Publisher_Stop();
+}
+
+int main(void)
+{
+	if ((Reactor_Init() != 0) || (Co_Init() != 0))
+	{
+		printf("publisher_test: Failed to start the reactor\n");
+		return 1;
+	}
+
+	HostTest_Run("subscribers", TestSubscribers);
+	HostTest_Run("stop", TestStop);
+
+	return HostTest_Result("publisher_test");
+}
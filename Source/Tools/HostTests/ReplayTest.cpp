@@ -0,0 +1,364 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Replay Test
+ *  Source Filename  - ReplayTest.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - A recorded sample log played back in real time and as
+ *  				   fast as it is read, with the timing stats, then bouncing
+ *  				   mock edges recorded from the engine and replayed through
+ *  				   the mock backend into the same transitions.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "Battery.hpp"
+#include "Replay.hpp"
+#include "EdgeReplay.hpp"
+#include "GpioBackend.hpp"
+#include "GpioEngine.hpp"
+#include "GpioTable.hpp"
+#include "Reactor.h"
+#include "HostTest.h"
+
+#define TEST_LOG_PATH		"/tmp/replay_test.log"
+#define TEST_EDGE_PATH		"/tmp/replay_test.log" EDGE_LOG_SUFFIX
+#define TEST_NO_TABLE		"/tmp/replay_test.conf.missing"
+#define TEST_CHIP			"gpiochip0"
+#define TEST_SAMPLES		(20)
+#define TEST_PERIOD_MS		(10)
+#define TEST_TIMEOUT_MS		(2000)
+#define TEST_DEBOUNCE_MS	(20)
+#define TEST_GAP_MS			(60)			// between the bursts, past the debounce
+#define TEST_SPACING_MS		(10)			// allowed drift of a replayed transition
+#define TEST_MAX_CALLS		(16)
+
+typedef struct
+{
+	uint32_t bit;
+	int value;
+	int64_t t_ns;
+} SinkCall;
+
+static pthread_mutex_t sink_lock = PTHREAD_MUTEX_INITIALIZER;
+static SinkCall sink_calls[TEST_MAX_CALLS];
+static int sink_count = 0;
+
+static void RecordSink(void * arg, uint32_t bit, int value, int64_t t_ns)
+{
+	UNUSED(arg);
+
+	pthread_mutex_lock(&sink_lock);
+
+	if (sink_count < TEST_MAX_CALLS)
+	{
+		sink_calls[sink_count].bit   = bit;
+		sink_calls[sink_count].value = value;
+		sink_calls[sink_count].t_ns  = t_ns;
+	}
+
+	sink_count++;
+
+	pthread_mutex_unlock(&sink_lock);
+}
+
+// Takes the sink calls so far and starts over.
+static int TakeCalls(SinkCall * calls)
+{
+	pthread_mutex_lock(&sink_lock);
+
+	int count = sink_count;
+
+	memcpy(calls, sink_calls, sizeof(sink_calls));
+	memset(sink_calls, 0, sizeof(sink_calls));
+	sink_count = 0;
+
+	pthread_mutex_unlock(&sink_lock);
+
+	return count;
+}
+
+// TEST_SAMPLES samples TEST_PERIOD_MS apart, every field set from the index.
+static void WriteLog(void)
+{
+	BatterySample sample;
+	int64_t start = HostTest_NowNs();
+
+	CHECK_EQ(Recorder_Start(TEST_LOG_PATH), 0);
+
+	for (int i = 0; i < TEST_SAMPLES; i++)
+	{
+		memset(&sample, 0, sizeof(sample));
+		sample.t_ns     = start + ((int64_t)i * TEST_PERIOD_MS * 1000000LL);
+		sample.fields   = BATTERY_FIELD_ALL;
+		sample.current  = i;
+		sample.voltage  = 400 + i;
+		sample.temp     = 250;
+		sample.level    = i;
+		sample.in_dock  = i & 1;
+		sample.charging = (i >> 1) & 1;
+		sample.gpio     = i & 3;
+		snprintf(sample.health, sizeof(sample.health), "Good");
+
+		Recorder_Write(&sample);
+	}
+
+	Recorder_Stop();
+}
+
+// Reads the replay source every poll_us until the log ended. Returns how many
+// different samples were read, each after the one before.
+static int ReadReplay(uint32_t fields, unsigned int poll_us, BatterySample * last, ReplayStats * stats)
+{
+	const BatterySource * source = Battery_GetSource();
+	int64_t deadline = HostTest_NowNs() + ((int64_t)TEST_TIMEOUT_MS * 1000000LL);
+	int seen = 0;
+
+	last->current = -1;
+
+	CHECK(source != NULL);
+
+	if (source == NULL)
+	{
+		return 0;
+	}
+
+	do
+	{
+		BatterySample sample;
+
+		Replay_GetStats(stats);
+
+		memset(&sample, 0, sizeof(sample));
+		CHECK_EQ(source->read(source->ctx, &sample, fields), 0);
+
+		if ((sample.fields != 0) && (sample.current != last->current))
+		{
+			CHECK(sample.current > last->current);
+			*last = sample;
+			seen++;
+		}
+
+		usleep(poll_us);
+	}
+	while (!stats->done && (HostTest_NowNs() < deadline));
+
+	Replay_Stop();
+	Replay_GetStats(stats);
+
+	return seen;
+}
+
+// Spaced as recorded, the replay thread on time against the log.
+static void TestRealTime(void)
+{
+	BatterySample last;
+	ReplayStats stats;
+
+	WriteLog();
+
+	CHECK_EQ(Replay_Start(TEST_LOG_PATH, 1.0, BATTERY_FIELD_ALL), 0);
+	CHECK(ReadReplay(BATTERY_FIELD_ALL, 1000, &last, &stats) > TEST_SAMPLES / 2);
+
+	CHECK(stats.done);
+	CHECK_EQ(stats.records, TEST_SAMPLES);
+	CHECK(stats.wall_ns >= (TEST_SAMPLES - 1) * TEST_PERIOD_MS * 1000000LL);
+	CHECK(stats.records_per_sec > 0);
+	CHECK(stats.late_p50_us <= stats.late_p99_us);
+	CHECK(stats.late_p99_us <= stats.late_max_us);
+	CHECK(stats.late_max_us < TEST_PERIOD_MS * 1000);
+
+	CHECK_EQ(last.fields, BATTERY_FIELD_ALL);
+	CHECK_EQ(last.current, TEST_SAMPLES - 1);
+	CHECK_EQ(last.voltage, 400 + TEST_SAMPLES - 1);
+	CHECK_EQ(last.gpio, (TEST_SAMPLES - 1) & 3);
+	CHECK(strcmp(last.health, "Good") == 0);
+
+	printf("    lateness p99 %u us, max %u us\n", stats.late_p99_us, stats.late_max_us);
+}
+
+// As fast as it is read, every record consumed. The lines left to an edge
+// replay are not taken from the log.
+static void TestMaxSpeed(void)
+{
+	BatterySample last;
+	ReplayStats stats;
+	uint32_t fields = BATTERY_FIELD_ALL & ~BATTERY_FIELD_LINES;
+
+	CHECK_EQ(Replay_Start(TEST_LOG_PATH, REPLAY_SPEED_MAX, fields), 0);
+	CHECK_EQ(ReadReplay(BATTERY_FIELD_ALL, 200, &last, &stats), TEST_SAMPLES);
+
+	CHECK(stats.done);
+	CHECK_EQ(stats.records, TEST_SAMPLES);
+	CHECK_EQ(stats.unconsumed, 0);
+	CHECK(stats.wall_ns < (TEST_SAMPLES - 1) * TEST_PERIOD_MS * 1000000LL);
+	CHECK(stats.consume_p50_us <= stats.consume_max_us);
+	CHECK(stats.consume_max_us < TEST_PERIOD_MS * 1000);
+
+	CHECK_EQ(last.fields, fields);
+	CHECK_EQ(last.current, TEST_SAMPLES - 1);
+
+	printf("    %.0f records/s, consume p99 %u us\n", stats.records_per_sec, stats.consume_p99_us);
+}
+
+// Both table lines on the mock chip, the first one debounced.
+static void LoadTable(void)
+{
+	GpioLineConfig lines[2];
+
+	memset(lines, 0, sizeof(lines));
+
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		snprintf(lines[i].name, sizeof(lines[i].name), "line%u", i + 1);
+		snprintf(lines[i].chip, sizeof(lines[i].chip), "%s", TEST_CHIP);
+		lines[i].offset = i + 1;
+		lines[i].edges  = GPIO_EDGE_BOTH;
+	}
+
+	lines[0].debounce_ms = TEST_DEBOUNCE_MS;
+
+	CHECK_EQ(GpioTable_Load(TEST_NO_TABLE, lines, 2), 1);
+}
+
+static int StartEngine(void)
+{
+	for (unsigned int i = 0; i < GpioTable_Count(); i++)
+	{
+		GpioEngine_AddLine(GpioTable_Line(i), (uint32_t)1 << i);
+	}
+
+	GpioEngine_AddSink(RecordSink, NULL);
+
+	if ((GpioEngine_Open() != 0) || (GpioEngine_Start() != 0) || (HostTest_StartReactor() != 0))
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+static void StopEngine(void)
+{
+	HostTest_StopReactor();
+	GpioEngine_Close();
+	GpioEngine_RemoveSink(RecordSink, NULL);
+	GpioMock_Reset();
+}
+
+// Three edges 1 ms apart on line, ending on value.
+static void Burst(int line, int value)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		GpioMock_Edge(line, (i % 2 == 0) ? value : !value, HostTest_NowNs());
+		usleep(1000);
+	}
+}
+
+// Bounces on the debounced line around a clean edge on the other one, each
+// confirmed transition again when the log plays through the mock.
+static void TestEdges(void)
+{
+	SinkCall recorded[TEST_MAX_CALLS];
+	SinkCall replayed[TEST_MAX_CALLS];
+	EdgeReplayStats stats;
+	int64_t deadline;
+
+	LoadTable();
+
+	int bounce = GpioMock_Line(TEST_CHIP, 1);
+	int clean = GpioMock_Line(TEST_CHIP, 2);
+
+	CHECK_EQ(StartEngine(), 0);
+	CHECK_EQ(EdgeRecorder_Start(TEST_EDGE_PATH), 0);
+
+	Burst(bounce, 1);
+	usleep(TEST_GAP_MS * 1000);
+	GpioMock_Edge(clean, 1, HostTest_NowNs());
+	usleep(TEST_GAP_MS * 1000);
+	Burst(bounce, 0);
+	usleep(TEST_GAP_MS * 1000);
+
+	EdgeRecorder_Stop();
+	StopEngine();
+
+	int count = TakeCalls(recorded);
+
+	CHECK_EQ(count, 3);
+
+	// The mock lines come back at the recorded levels before the engine opens them.
+	CHECK_EQ(EdgeReplay_Load(TEST_EDGE_PATH), 0);
+	CHECK_EQ(StartEngine(), 0);
+	CHECK_EQ(EdgeReplay_Start(), 0);
+
+	deadline = HostTest_NowNs() + ((int64_t)TEST_TIMEOUT_MS * 1000000LL);
+
+	do
+	{
+		usleep(TEST_PERIOD_MS * 1000);
+		EdgeReplay_GetStats(&stats);
+	}
+	while (!stats.done && (HostTest_NowNs() < deadline));
+
+	// The last burst settles after the script ends.
+	usleep(TEST_GAP_MS * 1000);
+
+	EdgeReplay_Stop();
+	EdgeReplay_GetStats(&stats);
+	StopEngine();
+
+	CHECK(stats.done);
+	CHECK_EQ(stats.edges, 7);
+	CHECK_EQ(stats.played, 7);
+	CHECK_EQ(stats.dropped, 0);
+
+	CHECK_EQ(TakeCalls(replayed), count);
+
+	for (int i = 0; (i < count) && (i < TEST_MAX_CALLS); i++)
+	{
+		int64_t recorded_ns = recorded[i].t_ns - recorded[0].t_ns;
+		int64_t replayed_ns = replayed[i].t_ns - replayed[0].t_ns;
+		int64_t drift = replayed_ns - recorded_ns;
+
+		CHECK_EQ(replayed[i].bit, recorded[i].bit);
+		CHECK_EQ(replayed[i].value, recorded[i].value);
+		CHECK((drift > -TEST_SPACING_MS * 1000000LL) && (drift < TEST_SPACING_MS * 1000000LL));
+	}
+
+	printf("    %llu edges, %llu late\n", (unsigned long long)stats.played, (unsigned long long)stats.late);
+
+	// Loaded again once stopped, a truncated log is refused.
+	CHECK_EQ(truncate(TEST_EDGE_PATH, sizeof(EdgeLogHeader) - 1), 0);
+	CHECK(EdgeReplay_Load(TEST_EDGE_PATH) != 0);
+}
+
+int main(void)
+{
+	GpioEngine_SetBackend(GpioBackend_Mock());
+
+	if (Reactor_Init() != 0)
+	{
+		printf("replay_test: Failed to create the reactor\n");
+		return 1;
+	}
+
+	HostTest_Run("real time", TestRealTime);
+	HostTest_Run("max speed", TestMaxSpeed);
+	HostTest_Run("edges", TestEdges);
+
+	unlink(TEST_LOG_PATH);
+	unlink(TEST_EDGE_PATH);
+
+	return HostTest_Result("replay_test");
+}
@@ -0,0 +1,192 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Startup Test
+ *  Source Filename  - StartupTest.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The startup graph: stages after their dependencies and
+ *  				   independent ones side by side, a failed stage, cycles
+ *  				   and unknown names, and every stage run inline when no
+ *  				   thread can be started.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "Startup.h"
+#include "HostTest.h"
+
+#define TEST_STAGES			(4)
+#define TEST_STAGE_US		(20000)
+
+// When each stage ran, in Startup_Us.
+typedef struct
+{
+	int runs;
+	int order;
+	int64_t start_us;
+	int64_t end_us;
+} TestStage;
+
+static pthread_mutex_t test_lock = PTHREAD_MUTEX_INITIALIZER;
+static TestStage test_stages[TEST_STAGES];
+static int test_order = 0;
+static int test_fail_stage = -1;
+static bool test_no_threads = false;
+
+// Linked with --wrap=pthread_create, so Startup_Run can be refused threads.
+extern "C" int __real_pthread_create(pthread_t * tid, const pthread_attr_t * attr, void *(*func)(void *), void * arg);
+
+extern "C" int __wrap_pthread_create(pthread_t * tid, const pthread_attr_t * attr, void *(*func)(void *), void * arg)
+{
+	if (test_no_threads)
+	{
+		return EAGAIN;
+	}
+
+	return __real_pthread_create(tid, attr, func, arg);
+}
+
+static int RunStage(int index)
+{
+	int64_t start_us = Startup_Us();
+
+	usleep(TEST_STAGE_US);
+
+	pthread_mutex_lock(&test_lock);
+	test_stages[index].runs++;
+	test_stages[index].order    = test_order++;
+	test_stages[index].start_us = start_us;
+	test_stages[index].end_us   = Startup_Us();
+	pthread_mutex_unlock(&test_lock);
+
+	return (index == test_fail_stage) ? -1 : 0;
+}
+
+static int StageGpio(void)		{ return RunStage(0); }
+static int StageGui(void)		{ return RunStage(1); }
+static int StageBattery(void)	{ return RunStage(2); }
+static int StageTasks(void)		{ return RunStage(3); }
+
+// Listed with every stage before the ones it needs.
+static const StartupStage app_stages[] =
+{
+	// name         func              deps
+	{ "tasks",      StageTasks,       { "gpio", "battery", "gui", NULL } },
+	{ "battery",    StageBattery,     { "gpio", NULL } },
+	{ "gui",        StageGui,         { NULL } },
+	{ "gpio",       StageGpio,        { NULL } },
+};
+
+static const StartupStage cycle_stages[] =
+{
+	{ "gpio",       StageGpio,        { "tasks", NULL } },
+	{ "battery",    StageBattery,     { "gpio", NULL } },
+	{ "tasks",      StageTasks,       { "battery", NULL } },
+};
+
+static const StartupStage unknown_stages[] =
+{
+	{ "gpio",       StageGpio,        { NULL } },
+	{ "battery",    StageBattery,     { "gpoi", NULL } },
+};
+
+static void Reset(int fail_stage, bool no_threads)
+{
+	memset(test_stages, 0, sizeof(test_stages));
+	test_order      = 0;
+	test_fail_stage = fail_stage;
+	test_no_threads = no_threads;
+}
+
+static int Run(const StartupStage * stages, unsigned int count)
+{
+	int result = Startup_Run(stages, count);
+
+	test_no_threads = false;
+
+	return result;
+}
+
+// A stage starts once its dependencies ended, gpio and gui run together.
+static void CheckOrder(void)
+{
+	TestStage * gpio = &test_stages[0];
+	TestStage * gui = &test_stages[1];
+	TestStage * battery = &test_stages[2];
+	TestStage * tasks = &test_stages[3];
+
+	for (int i = 0; i < TEST_STAGES; i++)
+	{
+		CHECK_EQ(test_stages[i].runs, 1);
+	}
+
+	CHECK(battery->start_us >= gpio->end_us);
+	CHECK(tasks->start_us >= gpio->end_us);
+	CHECK(tasks->start_us >= gui->end_us);
+	CHECK(tasks->start_us >= battery->end_us);
+	CHECK_EQ(tasks->order, 3);
+}
+
+static void TestOrder(void)
+{
+	Reset(-1, false);
+
+	CHECK_EQ(Run(app_stages, TEST_STAGES), 0);
+	CheckOrder();
+
+	// Side by side, not one after the other.
+	CHECK(test_stages[1].start_us < test_stages[0].end_us);
+	CHECK(test_stages[0].start_us < test_stages[1].end_us);
+}
+
+// The stages after a failed one still run.
+static void TestFailed(void)
+{
+	Reset(2, false);
+
+	CHECK_EQ(Run(app_stages, TEST_STAGES), 1);
+	CheckOrder();
+}
+
+// Nothing runs from a graph that cannot finish.
+static void TestCycle(void)
+{
+	Reset(-1, false);
+
+	CHECK_EQ(Run(cycle_stages, 3), -1);
+	CHECK_EQ(Run(unknown_stages, 2), -1);
+	CHECK_EQ(test_order, 0);
+}
+
+// Without threads each stage runs inline, and the ones listed before their
+// dependencies still start once those are done.
+static void TestInline(void)
+{
+	Reset(-1, true);
+
+	CHECK_EQ(Run(app_stages, TEST_STAGES), 0);
+	CheckOrder();
+}
+
+int main(void)
+{
+	Startup_Init();
+
+	HostTest_Run("order", TestOrder);
+	HostTest_Run("failed", TestFailed);
+	HostTest_Run("cycle", TestCycle);
+	HostTest_Run("inline", TestInline);
+
+	return HostTest_Result("startup_test");
+}
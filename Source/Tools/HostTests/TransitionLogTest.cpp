@@ -0,0 +1,203 @@
+/*******************************************************************************
+ *                         COPYRIGHT NOTICE
+ *                   "Copyright 2023 Nova Biomedical Corporation"
+ *             This program is the property of Nova Biomedical Corporation
+ *                 200 Prospect Street, Waltham, MA 02454-9141
+ *             Any unauthorized use or duplication is prohibited
+ ********************************************************************************
+ *
+ *  Title            - Transition Log Test
+ *  Source Filename  - TransitionLogTest.cpp
+ *  Author           - Anthony Meng-Lim
+ *  Description      - The day and session index built from a log written here,
+ *  				   with a reboot between two days and a session over a
+ *  				   midnight, in UTC. Then a log with a torn last record
+ *  				   trimmed and appended to.
+ *
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "TransitionLog.hpp"
+#include "HostTest.h"
+
+#define TEST_PATH			"/tmp/transition_log_test.log"
+#define TEST_IN_BASE		(0x01)			// active low
+#define TEST_CHARGING		(0x02)
+#define TEST_HOUR_NS		(3600LL * 1000000000LL)
+#define TEST_DAY_NS			(24 * TEST_HOUR_NS)
+#define TEST_DAY0_NS		(1699920000LL * 1000000000LL)	// a UTC midnight
+#define TEST_MAX			(8)
+
+static int64_t At(int day, int hour)
+{
+	return TEST_DAY0_NS + (day * TEST_DAY_NS) + (hour * TEST_HOUR_NS);
+}
+
+static void WriteRecord(FILE * file, const char * line, int value, int64_t wall_ns, uint32_t flags)
+{
+	TransitionRecord record;
+
+	memset(&record, 0, sizeof(record));
+	record.t_ns    = wall_ns - TEST_DAY0_NS;
+	record.wall_ns = wall_ns;
+	record.value   = (uint8_t)value;
+	record.flags   = (uint8_t)flags;
+	snprintf(record.line, sizeof(record.line), "%s", line);
+
+	fwrite(&record, sizeof(record), 1, file);
+}
+
+// in_base is active 10:00 to 12:00 and 22:00 to 23:00 on day 0. charging goes
+// active at 20:00 and is still active when the meter goes down after 23:00.
+// It boots at 06:00 on day 1 with charging still active, which ends at 02:00
+// on day 2.
+static int WriteLog(void)
+{
+	TransitionLogHeader header;
+	FILE * file = fopen(TEST_PATH, "wb");
+
+	if (file == NULL)
+	{
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic       = TRANSITION_LOG_MAGIC;
+	header.version     = TRANSITION_LOG_VERSION;
+	header.record_size = sizeof(TransitionRecord);
+	fwrite(&header, sizeof(header), 1, file);
+
+	WriteRecord(file, "in_base", 1, At(0, 8), TRANSITION_FLAG_BOOT);
+	WriteRecord(file, "charging", 0, At(0, 8), TRANSITION_FLAG_BOOT);
+	WriteRecord(file, "in_base", 0, At(0, 10), TRANSITION_FLAG_NONE);
+	WriteRecord(file, "in_base", 1, At(0, 12), TRANSITION_FLAG_NONE);
+	WriteRecord(file, "charging", 1, At(0, 20), TRANSITION_FLAG_NONE);
+	WriteRecord(file, "in_base", 0, At(0, 22), TRANSITION_FLAG_NONE);
+	WriteRecord(file, "in_base", 1, At(0, 23), TRANSITION_FLAG_NONE);
+	WriteRecord(file, "in_base", 1, At(1, 6), TRANSITION_FLAG_BOOT);
+	WriteRecord(file, "charging", 1, At(1, 6), TRANSITION_FLAG_BOOT);
+	WriteRecord(file, "charging", 0, At(2, 2), TRANSITION_FLAG_NONE);
+
+	fclose(file);
+
+	return 0;
+}
+
+static void AddLines(void)
+{
+	CHECK_EQ(TransitionLog_AddLine(TEST_IN_BASE, "in_base", 0), 0);
+	CHECK_EQ(TransitionLog_AddLine(TEST_CHARGING, "charging", 1), 0);
+}
+
+static void CheckSession(const TransitionSession * session, int64_t start_ns, int64_t duration_ns)
+{
+	CHECK_EQ(session->start_wall_ns, start_ns);
+	CHECK_EQ(session->duration_ns, duration_ns);
+	CHECK(!session->open);
+}
+
+static void CheckDay(const TransitionDay * day, int index, int64_t active_ns)
+{
+	CHECK_EQ(day->day_wall_ns, At(index, 0));
+	CHECK_EQ(day->active_ns, active_ns);
+}
+
+// A session open at the reboot ends at the last record before it, for every
+// line, and the next boot's state opens a new one.
+static void TestIndex(void)
+{
+	TransitionSession sessions[TEST_MAX];
+	TransitionDay days[TEST_MAX];
+	TransitionRecord recent[TEST_MAX];
+
+	CHECK_EQ(WriteLog(), 0);
+	AddLines();
+	CHECK_EQ(TransitionLog_Load(TEST_PATH), 0);
+
+	CHECK_EQ(TransitionLog_Sessions(TEST_IN_BASE, sessions, TEST_MAX), 2);
+	CheckSession(&sessions[0], At(0, 10), 2 * TEST_HOUR_NS);
+	CheckSession(&sessions[1], At(0, 22), 1 * TEST_HOUR_NS);
+
+	CHECK_EQ(TransitionLog_DailyActive(TEST_IN_BASE, days, TEST_MAX), 1);
+	CheckDay(&days[0], 0, 3 * TEST_HOUR_NS);
+
+	CHECK_EQ(TransitionLog_Sessions(TEST_CHARGING, sessions, TEST_MAX), 2);
+	CheckSession(&sessions[0], At(0, 20), 3 * TEST_HOUR_NS);
+	CheckSession(&sessions[1], At(1, 6), 20 * TEST_HOUR_NS);
+
+	// Split at each midnight.
+	CHECK_EQ(TransitionLog_DailyActive(TEST_CHARGING, days, TEST_MAX), 3);
+	CheckDay(&days[0], 0, 3 * TEST_HOUR_NS);
+	CheckDay(&days[1], 1, 18 * TEST_HOUR_NS);
+	CheckDay(&days[2], 2, 2 * TEST_HOUR_NS);
+
+	// Only the newest, oldest first.
+	CHECK_EQ(TransitionLog_Sessions(TEST_CHARGING, sessions, 1), 1);
+	CheckSession(&sessions[0], At(1, 6), 20 * TEST_HOUR_NS);
+	CHECK_EQ(TransitionLog_Recent(recent, 2), 2);
+	CHECK_EQ(recent[0].wall_ns, At(1, 6));
+	CHECK_EQ(recent[1].wall_ns, At(2, 2));
+
+	CHECK_EQ(TransitionLog_Sessions(0x04, sessions, TEST_MAX), 0);
+
+	TransitionLog_Cleanup();
+}
+
+// The torn record is dropped, a new one lands after the last whole one and
+// is read back after a restart.
+static void TestTornRecord(void)
+{
+	TransitionSession sessions[TEST_MAX];
+	struct stat st;
+
+	CHECK_EQ(WriteLog(), 0);
+
+	FILE * file = fopen(TEST_PATH, "ab");
+
+	CHECK(file != NULL);
+
+	if (file != NULL)
+	{
+		fwrite("torn", 4, 1, file);
+		fclose(file);
+	}
+
+	AddLines();
+	CHECK_EQ(TransitionLog_Init(TEST_PATH), 0);
+
+	TransitionLog_Record(TEST_IN_BASE, 0, HostTest_NowNs(), TRANSITION_FLAG_NONE);
+	TransitionLog_Cleanup();
+
+	CHECK_EQ(stat(TEST_PATH, &st), 0);
+	CHECK_EQ(st.st_size, sizeof(TransitionLogHeader) + (11 * sizeof(TransitionRecord)));
+
+	AddLines();
+	CHECK_EQ(TransitionLog_Load(TEST_PATH), 0);
+
+	// The new session is still open.
+	CHECK_EQ(TransitionLog_Sessions(TEST_IN_BASE, sessions, TEST_MAX), 3);
+	CHECK(sessions[2].open);
+	CHECK(sessions[2].start_wall_ns > At(2, 2));
+
+	TransitionLog_Cleanup();
+	unlink(TEST_PATH);
+}
+
+int main(void)
+{
+	// Days are local, the midnights above are UTC ones.
+	setenv("TZ", "UTC", 1);
+	tzset();
+
+	HostTest_Run("index", TestIndex);
+	HostTest_Run("torn record", TestTornRecord);
+
+	return HostTest_Result("transition_log_test");
+}
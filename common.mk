@@ -29,6 +29,8 @@ LIB_DIR				:= $(BUILD_DIR)/lib
 PLUGIN_DIR			:= $(BUILD_DIR)/plugins
 APP_OBJ_DIR			:= $(BUILD_DIR)/objs/app
 LIB_OBJ_DIR			:= $(BUILD_DIR)/objs/lib
+TOOL_DIR			:= $(BUILD_DIR)/tools
+TOOL_OBJ_DIR		:= $(BUILD_DIR)/objs/tools
 LVGL_DIRS			:= $(shell find $(LVGL_BUILD) -type d)
 LVGL_INCLUDES		:= $(patsubst %, -I%, $(LVGL_DIRS))
 INCLUDES            += -I$(PROJECT_ROOT)/Include -I$(SYSROOT)/usr/include $(LVGL_INCLUDES)
@@ -42,6 +44,8 @@ CFLAGS				= -Wall -Wextra $(INCLUDES) -fpie -s
 LIB_CXXFLAGS		= -Wall -Wextra $(INCLUDES) -fpic -shared
 LIB_CFLAGS			= -Wall -Wextra $(INCLUDES) -fpic -shared
 LDFLAGS				= -s -L$(LVGL_BUILD)/lib -L$(SYSROOT)/lib -L$(SYSROOT)/usr/lib -L$(LIB_DIR)
+HOST_CXX			:= g++
+HOST_CXXFLAGS		= -Wall -Wextra -O2 -std=c++17 -pthread -I$(PROJECT_ROOT)/Include
 LIB_PREFIX			:= libdiag.
 LIB_SUFFIX			:= .so
 PLUGIN_SUFFIX		:= .pi.so